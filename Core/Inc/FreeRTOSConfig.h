@@ -0,0 +1,87 @@
+/*
+ * FreeRTOSConfig.h
+ *
+ *  Kernel configuration of the optional FreeRTOS build (USE_FREERTOS).
+ *  Everything is statically allocated: there is no heap_x.c in the build.
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+#ifndef FREERTOS_CONFIG_H
+#define FREERTOS_CONFIG_H
+
+#if defined(__GNUC__) && !defined(HOST_BUILD)
+#include <stdint.h>
+extern uint32_t SystemCoreClock;
+#endif
+
+/* Scheduler */
+#define configUSE_PREEMPTION                     1
+#define configUSE_PORT_OPTIMISED_TASK_SELECTION  0
+#define configUSE_TICKLESS_IDLE                  0
+#define configCPU_CLOCK_HZ                        (SystemCoreClock)
+#define configTICK_RATE_HZ                       ((TickType_t)1000)
+#define configMAX_PRIORITIES                     7
+#if defined(HOST_BUILD)
+#define configMINIMAL_STACK_SIZE                 ((uint16_t)4096)
+#else
+#define configMINIMAL_STACK_SIZE                 ((uint16_t)128)
+#endif
+#define configMAX_TASK_NAME_LEN                  12
+#define configUSE_16_BIT_TICKS                   0
+#define configIDLE_SHOULD_YIELD                  1
+#define configUSE_TASK_NOTIFICATIONS             1
+#define configUSE_MUTEXES                        1
+#define configQUEUE_REGISTRY_SIZE                0
+#define configUSE_TIME_SLICING                   1
+
+/* Memory: static allocation only */
+#define configSUPPORT_STATIC_ALLOCATION          1
+#define configSUPPORT_DYNAMIC_ALLOCATION         0
+#define configTOTAL_HEAP_SIZE                    0
+
+/* Hooks and checks */
+#define configUSE_IDLE_HOOK                      0
+#define configUSE_TICK_HOOK                      0
+#define configUSE_MALLOC_FAILED_HOOK             0
+#define configCHECK_FOR_STACK_OVERFLOW           2
+#define configGENERATE_RUN_TIME_STATS            0
+#define configUSE_TRACE_FACILITY                 1
+
+/* No software timers: the application tasks do their own timing */
+#define configUSE_TIMERS                         0
+#define configUSE_CO_ROUTINES                    0
+
+/* Optional functions */
+#define INCLUDE_vTaskDelay                       1
+#define INCLUDE_vTaskDelayUntil                  1
+#define INCLUDE_vTaskSuspend                     1
+#define INCLUDE_uxTaskGetStackHighWaterMark      1
+#define INCLUDE_xTaskGetSchedulerState           1
+#define INCLUDE_xTaskGetCurrentTaskHandle        1
+
+#if !defined(HOST_BUILD)
+/* Cortex-M4: 4 priority bits, NVIC_PRIORITYGROUP_4. Interrupts calling
+   ...FromISR() functions (UART4, its RX and TX DMA streams, USART2 and its
+   TX DMA stream) must have a priority value >= configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY. */
+#define configPRIO_BITS                              4
+#define configLIBRARY_LOWEST_INTERRUPT_PRIORITY      15
+#define configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY 5
+#define configKERNEL_INTERRUPT_PRIORITY      (configLIBRARY_LOWEST_INTERRUPT_PRIORITY << (8 - configPRIO_BITS))
+#define configMAX_SYSCALL_INTERRUPT_PRIORITY (configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY << (8 - configPRIO_BITS))
+
+/* The port provides the SVC and PendSV handlers (stm32f4xx_it.c leaves them
+   out under USE_FREERTOS); SysTick_Handler forwards to xPortSysTickHandler(). */
+#define vPortSVCHandler    SVC_Handler
+#define xPortPendSVHandler PendSV_Handler
+#endif
+
+#if defined(HOST_BUILD)
+#include <assert.h>
+#define configASSERT(x)    assert(x)
+#else
+#define configASSERT(x)    if ((x) == 0) { taskDISABLE_INTERRUPTS(); for (;;); }
+#endif
+
+#endif /* FREERTOS_CONFIG_H */
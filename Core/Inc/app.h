@@ -9,5 +9,23 @@
 #define INC_APP_H_
 
 #include <stdint.h>
+
+#define APP_PUBLISH_PERIOD_MS        1000
+#define APP_HOUSEKEEPING_PERIOD_MS   50      /* log drain, metrics check */
+#define APP_RECONNECT_MIN_MS         1000
+#define APP_RECONNECT_MAX_MS         32000
+#define APP_BUSY_RETRY_MS            250     /* publish or connect again after the module was busy */
+#define APP_METRICS_PORT             0       /* GET /metrics on the LAN (e.g. 9100), 0 for none */
+
+typedef struct {
+    uint32_t messages;           /* +MQTTSUBRECV frames received */
+    uint32_t message_bytes;      /* their payload bytes */
+    uint32_t truncated;          /* payloads longer than the frame buffer, ignored */
+} app_rx_stats_t;
+
 int32_t publish_and_process_incoming_message(void);
+void app_init(void);
+void app_set_publish_period(uint32_t period_ms);
+void app_set_metrics_port(uint16_t port);
+void app_get_rx_stats(app_rx_stats_t* stats);
 #endif /* INC_APP_H_ */
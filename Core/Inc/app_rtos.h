@@ -0,0 +1,84 @@
+/*
+ * app_rtos.h
+ *
+ *  Optional FreeRTOS application (USE_FREERTOS): an RX task owning the
+ *  reception ring, a TX task owning the command channel, and application
+ *  tasks talking to both through static queues.
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+#ifndef INC_APP_RTOS_H_
+#define INC_APP_RTOS_H_
+
+/* Includes ------------------------------------------------------------------*/
+#include "esp8266.h"
+#include <stdint.h>
+
+/* Exported constants --------------------------------------------------------*/
+#define APP_RTOS_RX_PRIORITY             5
+#define APP_RTOS_TX_PRIORITY             4
+#define APP_RTOS_URC_PRIORITY            3
+#define APP_RTOS_PUBLISH_PRIORITY        2
+#define APP_RTOS_MONITOR_PRIORITY        1
+
+/* Stack sizes in words. The host build (FreeRTOS POSIX port) overrides them:
+   each task is a pthread, which needs at least PTHREAD_STACK_MIN. */
+#ifndef APP_RTOS_RX_STACK
+#define APP_RTOS_RX_STACK                256
+#define APP_RTOS_TX_STACK                256
+#define APP_RTOS_URC_STACK               256
+#define APP_RTOS_PUBLISH_STACK           384
+#define APP_RTOS_MONITOR_STACK           384
+#endif
+
+#define APP_RTOS_TX_QUEUE_LENGTH         4
+#define APP_RTOS_URC_QUEUE_LENGTH        4
+#define APP_RTOS_URC_LINE_SIZE           96     /* longer lines are truncated, longer messages dropped */
+#define APP_RTOS_RX_FRAME_SIZE           (1024 + 128)   /* a 1 KB message and its +MQTTSUBRECV header */
+#define APP_RTOS_CMD_TIMEOUT_MS          0      /* 0: the deadline of the AT verb */
+#define APP_RTOS_LATE_ANSWER_MS          500    /* after a timeout, wait for its final line before the next command */
+#ifndef APP_RTOS_PUBLISH_PERIOD_MS
+#define APP_RTOS_PUBLISH_PERIOD_MS       1000
+#endif
+#ifndef APP_RTOS_MONITOR_PERIOD_MS
+#define APP_RTOS_MONITOR_PERIOD_MS       10000
+#endif
+#define APP_RTOS_LOG_DRAIN_PERIOD_MS     50
+#define APP_RTOS_TASK_COUNT              5
+
+/* Exported types ------------------------------------------------------------*/
+typedef struct {
+    uint32_t rx_wakeups;            /* RX task notifications consumed */
+    uint32_t rx_wake_max_us;        /* RX event interrupt -> RX task running */
+    uint32_t commands;              /* commands completed by the TX task */
+    uint32_t command_errors;        /* ERROR / FAIL final lines */
+    uint32_t command_timeouts;
+    uint32_t late_answers;          /* final lines of commands that had timed out */
+    uint32_t queue_full;            /* requests not queued, TX queue full */
+    uint32_t queue_wait_max_ms;     /* request queued -> picked by the TX task */
+    uint32_t command_max_ms;        /* command sent -> final line */
+    uint32_t urcs;                  /* URCs handed to the URC task */
+    uint32_t urc_drops;             /* URCs dropped, URC queue full */
+    uint32_t message_drops;         /* messages dropped, longer than a URC */
+    uint32_t busy;                  /* busy p... / busy s... answers */
+    uint32_t busy_wait_ms;          /* spent waiting before resending them */
+} app_rtos_stats_t;
+
+typedef struct {
+    const char* name;
+    uint32_t    stack_bytes;
+    uint32_t    unused_bytes;       /* stack high-water mark: never used */
+} app_rtos_task_info_t;
+
+/* Exported functions ------------------------------------------------------- */
+void app_rtos_start(void);
+esp8266_status_t app_rtos_at_command(const char* cmd, uint32_t length, const char* final, uint32_t timeout_ms);
+esp8266_status_t app_rtos_at_command_data(const char* cmd, uint32_t length, const uint8_t* data, uint32_t data_length,
+                                          const char* final, uint32_t timeout_ms);
+void app_rtos_cancel(void);
+void app_rtos_get_stats(app_rtos_stats_t* stats);
+uint32_t app_rtos_get_task_info(app_rtos_task_info_t* info, uint32_t max);
+
+#endif /* INC_APP_RTOS_H_ */
@@ -0,0 +1,45 @@
+/*
+ * at_builder.h
+ *
+ *  Append-only AT command builder writing straight into a TX buffer, without
+ *  the printf formatter: literals, quoted strings escaped as ESP-AT expects,
+ *  decimals and CRLF. The length is kept as the command is built.
+ *
+ *  A command that does not fit is not truncated: the builder is marked as
+ *  overflowed, further appends are ignored and at_builder_finish() fails.
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+#ifndef INC_AT_BUILDER_H_
+#define INC_AT_BUILDER_H_
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+/* Exported types ------------------------------------------------------------*/
+typedef struct {
+    char*       buf;
+    uint32_t    size;               /* including the terminating '\0' */
+    uint32_t    length;
+    uint8_t     overflow;
+} at_builder_t;
+
+/* Exported macro ------------------------------------------------------------*/
+/* String literal, length known at compile time */
+#define at_builder_lit(b, lit)   at_builder_mem((b), (lit), sizeof(lit) - 1U)
+
+/* Exported functions ------------------------------------------------------- */
+void at_builder_init(at_builder_t* b, char* buf, uint32_t size);
+void at_builder_mem(at_builder_t* b, const char* data, uint32_t length);
+void at_builder_str(at_builder_t* b, const char* s);
+void at_builder_char(at_builder_t* b, char c);
+void at_builder_quoted(at_builder_t* b, const char* s);
+void at_builder_escaped(at_builder_t* b, const char* s);
+void at_builder_uint(at_builder_t* b, uint32_t value);
+void at_builder_int(at_builder_t* b, int32_t value);
+void at_builder_crlf(at_builder_t* b);
+int32_t at_builder_finish(at_builder_t* b);
+
+#endif /* INC_AT_BUILDER_H_ */
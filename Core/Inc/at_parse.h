@@ -0,0 +1,48 @@
+/*
+ * at_parse.h
+ *
+ *  Parser of the AT response lines, without copies: a line such as
+ *  +VERB:a,"b",c is split into slices pointing into the receive buffer, the
+ *  verb and one per field. Quoted fields are given without their quotes and
+ *  still escaped; nothing is written into the buffer. The fields of a
+ *  +CWLAP:(...) line are given without the parentheses.
+ *
+ *  A line without '+' is "<name>:<value>" (AT+GMR) or plain text ("No AP"):
+ *  its value is a single field, commas included.
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+#ifndef INC_AT_PARSE_H_
+#define INC_AT_PARSE_H_
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+/* Exported constants --------------------------------------------------------*/
+#define AT_PARSE_MAX_FIELDS              12     /* +CWLAP has 11 */
+
+/* Exported types ------------------------------------------------------------*/
+typedef struct {
+    const char* ptr;
+    uint16_t    length;
+    uint8_t     quoted;             /* was between double quotes, may hold escapes */
+} at_field_t;
+
+typedef struct {
+    at_field_t  text;               /* the whole line, without CRLF */
+    at_field_t  verb;               /* "CIFSR" of +CIFSR:..., empty without ':' */
+    at_field_t  field[AT_PARSE_MAX_FIELDS];
+    uint8_t     count;
+    uint8_t     truncated;          /* more than AT_PARSE_MAX_FIELDS fields */
+} at_line_t;
+
+/* Exported functions ------------------------------------------------------- */
+void at_parse_line(const char* data, uint32_t length, at_line_t* line);
+uint8_t at_line_is(const at_line_t* line, const char* verb);
+uint8_t at_field_equals(const at_field_t* field, const char* s);
+int8_t at_field_int(const at_field_t* field, int32_t* value);
+uint32_t at_field_copy(const at_field_t* field, char* dst, uint32_t size);
+
+#endif /* INC_AT_PARSE_H_ */
@@ -0,0 +1,81 @@
+/*
+ * at_scan.h
+ *
+ *  Search of AT delimiters four bytes at a time: each 32-bit word is compared
+ *  with every character of a set in one operation per character. On the
+ *  Cortex-M4 the comparison uses the DSP byte-lane instructions (USUB8 sets
+ *  a GE flag per non-zero byte, SEL turns the flags into a byte mask); the
+ *  host build uses the portable SWAR zero-byte test.
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+#ifndef INC_AT_SCAN_H_
+#define INC_AT_SCAN_H_
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#if defined(__ARM_FEATURE_DSP) && (__ARM_FEATURE_DSP == 1)
+#include "stm32f4xx.h"
+#endif
+
+/* Exported constants --------------------------------------------------------*/
+#define AT_SCAN_MAX_CHARS                4
+
+/* Exported types ------------------------------------------------------------*/
+/* Characters searched for, each one repeated in the four bytes of a word */
+typedef struct {
+    uint32_t    pattern[AT_SCAN_MAX_CHARS];
+    uint8_t     count;
+} at_scan_set_t;
+
+/* Exported macro ------------------------------------------------------------*/
+#define AT_SCAN_REPEAT(c)   ((uint32_t)(uint8_t)(c) * 0x01010101U)
+
+/* Exported variables --------------------------------------------------------*/
+extern const at_scan_set_t at_scan_line;      /* '\n' '>': end of a response line or prompt */
+extern const at_scan_set_t at_scan_eol;       /* '\n': end of a line that may hold a '>' */
+extern const at_scan_set_t at_scan_escape;    /* '"' ',' '\\': escaped in a quoted parameter */
+
+/* Exported functions ------------------------------------------------------- */
+void at_scan_set_init(at_scan_set_t* set, const char* chars);
+uint32_t at_scan(const uint8_t* data, uint32_t length, const at_scan_set_t* set);
+uint32_t at_scan_str(const char* s, const at_scan_set_t* set);
+
+/* Exported inline functions -------------------------------------------------*/
+
+/**
+  * @brief  Mark the zero bytes of a word: the lowest zero byte is always
+  *         marked and no byte below it is. Only the lowest mark is used.
+  */
+static inline uint32_t at_scan_zero_bytes(uint32_t word)
+{
+#if defined(__ARM_FEATURE_DSP) && (__ARM_FEATURE_DSP == 1)
+  /* GE[n] is set when byte n >= 1, SEL takes 0x00 there and 0xFF elsewhere */
+  (void)__USUB8(word, 0x01010101U);
+  return __SEL(0U, 0xFFFFFFFFU);
+#else
+  /* A zero byte borrows through bit 7; the borrow may mark the bytes
+     above it as well, never the ones below */
+  return (word - 0x01010101U) & ~word & 0x80808080U;
+#endif
+}
+
+/**
+  * @brief  Mark the bytes of a word equal to a character of set, as
+  *         at_scan_zero_bytes() does. Little endian: the first byte in
+  *         memory is the least significant.
+  */
+static inline uint32_t at_scan_mask(uint32_t word, const at_scan_set_t* set)
+{
+  uint32_t mask = 0;
+
+  for (uint8_t i = 0; i < set->count; i++)
+  {
+    mask |= at_scan_zero_bytes(word ^ set->pattern[i]);
+  }
+  return mask;
+}
+
+#endif /* INC_AT_SCAN_H_ */
@@ -13,7 +13,8 @@
 #include "stm32f4xx_hal.h"
 
 /* Private define ------------------------------------------------------------*/
-#define MAX_AT_CMD_SIZE         256
+#define MAX_AT_CMD_SIZE         288
+#define MAX_MQTTPUB_CMD_SIZE    256             /* ESP-AT rejects longer AT+MQTTPUB lines, CRLF included */
 #define MAX_BUFFER_SIZE         (1024 * 8)
 #define AT_OK_STRING            "OK\r\n"
 #define AT_CONNECT_STRING       "CONNECT\r\n"
@@ -21,7 +22,24 @@
 #define AT_SEND_OK_STRING       "SEND OK\r\n"
 #define AT_SEND_PROMPT_STRING   "OK\r\n\r\n>"
 #define AT_ERROR_STRING         "ERROR\r\n"
+#define AT_FAIL_STRING          "FAIL\r\n"
+#define AT_BUSY_STRING          "busy "         /* busy p... or busy s... */
 #define AT_IPD_STRING           "+IPD,"
+#define AT_MQTTPUB_OK_STRING    "+MQTTPUB:OK"
+#define MAX_PUB_PREFIX_SIZE     96      /* AT+MQTTPUB=0,"<topic>"," */
+#define MAX_PUB_SUFFIX_SIZE     8       /* ",<qos>,<retain>\r\n */
+#define ESP8266_RTO_K           4       /* deadline: SRTT + K x RTTVAR */
+#define ESP8266_BUSY_RETRIES    3       /* resends of a command answered busy (async, RTOS TX task) */
+#define ESP8266_BUSY_BACKOFF_MS 20      /* before the first resend, doubled each time */
+#define ESP8266_IP_SIZE         16      /* "255.255.255.255" */
+#define ESP8266_MAC_SIZE        18      /* "aa:bb:cc:dd:ee:ff" */
+#define ESP8266_SSID_SIZE       33
+#define ESP8266_HOST_SIZE       64
+#define ESP8266_MAX_DATAGRAM_SIZE 2048   /* payload of one AT+CIPSEND over UDP */
+#define ESP8266_MAX_SEGMENT_SIZE  2048   /* data of one AT+CIPSEND=<link>,<length> */
+#define ESP8266_MAX_LINKS       5       /* links of AT+CIPMUX=1, 0 to 4 */
+#define ESP8266_CLIENT_LINK     4       /* of the outgoing connection while the server runs, never a client */
+#define ESP8266_DNS_TTL_MS      (5U * 60U * 1000U)  /* a cached broker address is looked up again after */
 
 /* Exported types ------------------------------------------------------------*/
 typedef enum {
@@ -37,6 +55,8 @@ typedef enum {
     ESP8266_CONNECTION_CLOSED             = 4,
     ESP8266_TIMEOUT                       = 5,
     ESP8266_IO_ERROR                      = 6,
+    ESP8266_CANCELLED                     = 7,
+    ESP8266_QUEUE_FULL                    = 8,  /* not sent: the command queue stayed full */
 } esp8266_status_t;
 
 typedef enum {
@@ -87,6 +107,12 @@ typedef struct {
     esp8266_boolean              is_server;
 } esp8266_connection_info_t;
 
+typedef enum {
+    ESP8266_SLEEP_DISABLE     = 0,
+    ESP8266_SLEEP_MODEM       = 1,  /* radio off between DTIM beacons, UART usable */
+    ESP8266_SLEEP_LIGHT       = 2,  /* CPU and radio off, woken by a GPIO */
+} esp8266_sleep_mode_t;
+
 typedef struct {
     uint8_t*                     ssid;
     uint8_t*                     password;
@@ -94,6 +120,99 @@ typedef struct {
     esp8266_encryption_t  encryption_mode;
 } esp8266_ap_config_t;
 
+/* An access point, from AT+CWJAP? (the current one) or AT+CWLAP */
+typedef struct {
+    char                         ssid[ESP8266_SSID_SIZE];
+    char                         bssid[ESP8266_MAC_SIZE];
+    int8_t                       rssi;
+    uint8_t                      channel;
+    esp8266_encryption_t         encryption;       /* AT+CWLAP only */
+} esp8266_ap_info_t;
+
+typedef void (*esp8266_ap_callback_t)(const esp8266_ap_info_t* ap, void* context);
+
+/* State of the MQTT connection, from AT+MQTTCONN? */
+typedef struct {
+    uint8_t                      state;            /* 4: connected, 6: subscribed */
+    uint8_t                      scheme;           /* 1: TCP, 2 to 5: TLS */
+    char                         host[ESP8266_HOST_SIZE];
+    uint16_t                     port;
+    uint8_t                      reconnect;
+} esp8266_mqtt_conn_info_t;
+
+/* Date and time from AT+CIPSNTPTIME?, year 1970 until SNTP synchronized */
+typedef struct {
+    uint16_t                     year;
+    uint8_t                      month;            /* 1 to 12 */
+    uint8_t                      day;
+    uint8_t                      hour;
+    uint8_t                      minute;
+    uint8_t                      second;
+} esp8266_time_t;
+
+/*
+ * Publish handle: the AT+MQTTPUB text around the payload, rendered once by
+ * esp8266_mqtt_publish_register() for a topic, QoS and retain flag.
+ */
+typedef struct {
+    char                         prefix[MAX_PUB_PREFIX_SIZE];
+    char                         suffix[MAX_PUB_SUFFIX_SIZE];
+    uint8_t                      prefix_length;
+    uint8_t                      suffix_length;
+} esp8266_pub_handle_t;
+
+typedef enum {
+    ESP8266_SNI_UNKNOWN       = 0,  /* not set since the module started */
+    ESP8266_SNI_SET           = 1,
+    ESP8266_SNI_UNSUPPORTED   = 2,  /* AT+MQTTSNI answered ERROR: connect by name only */
+} esp8266_sni_state_t;
+
+/*
+ * Broker address of esp8266_mqtt_connect_cached(), from AT+CIPDOMAIN. It is
+ * reused until ESP8266_DNS_TTL_MS old, or until a connection to it fails.
+ */
+typedef struct {
+    char                         host[ESP8266_HOST_SIZE];
+    char                         ip[ESP8266_IP_SIZE];  /* "" when not resolved */
+    uint32_t                     resolved_tick;    /* HAL_GetTick() of the lookup */
+    esp8266_sni_state_t          sni;              /* AT+MQTTSNI=0,"<host>" */
+    uint32_t                     lookups;
+    uint32_t                     refreshes;        /* lookups for an expired or failing address */
+    uint32_t                     by_address;       /* connections made to the address */
+    uint32_t                     by_name;          /* made to the host name, without lookup or SNI */
+} esp8266_dns_cache_t;
+
+/*
+ * A client of the TCP server, from its <link>,CONNECT and <link>,CLOSED lines.
+ */
+typedef struct {
+    uint8_t                      connected;
+    uint32_t                     connects;         /* since the server started */
+    uint32_t                     bytes_sent;       /* of the current client */
+} esp8266_link_t;
+
+/*
+ * Deadline of the commands of one AT verb, from the command sent to its
+ * final response, and how long their failures took to be detected. The
+ * deadline follows the measured round trips as TCP does (RFC 6298), between
+ * min_ms and max_ms, and doubles on each timeout.
+ */
+typedef struct {
+    const char*                  verb;             /* "CWJAP" for AT+CWJAP, "" for AT and ATE0 */
+    uint32_t                     min_ms;
+    uint32_t                     max_ms;           /* also the deadline until the first round trip */
+    uint32_t                     rto_ms;           /* deadline of the next command */
+    uint32_t                     srtt_x8;          /* smoothed round trip, ms x 8, 0 before a sample */
+    uint32_t                     rttvar_x4;        /* round trip variation, ms x 4 */
+    uint32_t                     samples;
+    uint32_t                     failures;         /* timeouts, errors and cancels */
+    uint32_t                     fail_latency_last_ms;
+    uint32_t                     fail_latency_max_ms;
+} esp8266_deadline_t;
+
+/* Exported variables --------------------------------------------------------*/
+extern esp8266_boolean esp8266_mqtt_connected_once;
+
 /* Exported functions ------------------------------------------------------- */
 esp8266_status_t esp8266_init (void);
 esp8266_status_t esp8266_deinit(void);
@@ -101,19 +220,52 @@ esp8266_status_t esp8266_reset(void);
 
 esp8266_status_t esp8266_quit_ap(void);
 esp8266_status_t esp8266_joint_ap(uint8_t* ssid, uint8_t* password);
+esp8266_status_t esp8266_join_ap_bssid(const char* ssid, const char* password, const char* bssid);
 esp8266_status_t esp8266_get_ip(esp8266_mode_t mode, uint8_t* ip_address);
+esp8266_status_t esp8266_get_ap_info(esp8266_ap_info_t* ap);
+esp8266_status_t esp8266_list_ap(esp8266_ap_callback_t callback, void* context);
+esp8266_status_t esp8266_get_version(char* version, uint32_t size);
 esp8266_status_t esp8266_establish_connection(const esp8266_connection_info_t* connection_info);
 esp8266_status_t esp8266_close_connection(const uint8_t channel_id);
+esp8266_status_t esp8266_server_start(uint16_t port);
+esp8266_status_t esp8266_server_stop(void);
+esp8266_status_t esp8266_server_send(uint8_t link, const uint8_t* data, uint32_t length);
+uint8_t esp8266_server_handle_line(const char* line, uint32_t length);
+const esp8266_link_t* esp8266_server_links(uint32_t* count);
+uint8_t esp8266_server_running(void);
+void esp8266_ipd_received(uint8_t link, const uint8_t* data, uint32_t length);
+void esp8266_message_received(const char* topic, uint32_t topic_length,
+                              const uint8_t* data, uint32_t length, uint8_t truncated);
+void esp8266_command_starting(void);
 
 esp8266_status_t esp8266_config_sntp(const char *ntp_server);
-esp8266_status_t esp8266_get_sntp_time(void);
+esp8266_status_t esp8266_get_sntp_time(esp8266_time_t* time);
 esp8266_status_t esp8266_mqtt_usercfg(const char *clientId, const char *username, const char *password);
 esp8266_status_t esp8266_mqtt_connect(const char *endpoint, uint16_t port, uint8_t secure);
+esp8266_status_t esp8266_mqtt_connect_cached(const char *endpoint, uint16_t port, uint8_t secure);
+esp8266_status_t esp8266_mqtt_set_sni(const char *host);
+esp8266_status_t esp8266_resolve(const char* host, char* ip);
+const esp8266_dns_cache_t* esp8266_dns_cache(void);
+esp8266_status_t esp8266_mqtt_get_conn(esp8266_mqtt_conn_info_t* info);
 esp8266_status_t esp8266_mqtt_subscribe(const char *topic, uint8_t qos);
 esp8266_status_t esp8266_mqtt_publish(const char *topic, const char *message, uint8_t qos, uint8_t retain);
+esp8266_status_t esp8266_mqtt_publish_register(esp8266_pub_handle_t* handle, const char *topic, uint8_t qos, uint8_t retain);
+esp8266_status_t esp8266_mqtt_publish_handle(const esp8266_pub_handle_t* handle, const char *message);
+esp8266_status_t esp8266_mqtt_publish_raw(const char *topic, const uint8_t* data, uint32_t length, uint8_t qos, uint8_t retain);
+esp8266_status_t esp8266_sleep(esp8266_sleep_mode_t mode);
+esp8266_status_t esp8266_sleep_wakeup_gpio(uint8_t gpio, uint8_t level);
 esp8266_status_t catch_incoming_message(uint8_t* messageBuffer, uint32_t maxBufferLength, const uint8_t* token);
 esp8266_status_t esp8266_send_data(uint8_t* pData, uint32_t length);
+esp8266_status_t esp8266_send_datagram(const uint8_t* data, uint32_t length, const char* remote_ip, uint32_t remote_port);
 esp8266_status_t esp8266_recv_data(uint8_t* pData, uint32_t length, uint32_t* ret_length);
+void esp8266_cancel(void);
+
+esp8266_deadline_t* esp8266_deadline_of(const uint8_t* cmd, uint32_t length, uint8_t data);
+void esp8266_deadline_sample(esp8266_deadline_t* deadline, uint32_t rtt_ms);
+void esp8266_deadline_failed(esp8266_deadline_t* deadline, esp8266_status_t status, uint32_t latency_ms);
+void esp8266_deadline_backoff_all(void);
+const esp8266_deadline_t* esp8266_deadline_table(uint32_t* count);
+const char* esp8266_deadline_label(const esp8266_deadline_t* deadline);
 
 
 #endif /* INC_ESP8266_H_ */
@@ -0,0 +1,85 @@
+/*
+ * esp8266_async.h
+ *
+ *  Non-blocking versions of the esp8266.c operations, as stackless
+ *  coroutines (pt.h). An operation is started with one of the
+ *  esp8266_*_async() functions, then advanced with esp8266_op_poll() until it
+ *  returns ESP8266_TRUE, e.g. from the RX event task and a timer. Each poll
+ *  consumes the bytes already received and returns instead of waiting, so
+ *  any number of operations can be in progress on one stack; they use the
+ *  command channel one at a time, in the order of their first poll.
+ *
+ *  Rules:
+ *   - the strings and buffers passed to a start function must stay valid
+ *     until the operation completes;
+ *   - once polled, an operation must be polled until it completes (it holds
+ *     its place in the channel queue); polled again after that, it returns
+ *     ESP8266_TRUE at once, op->status unchanged;
+ *   - the blocking esp8266_* functions must not be called while operations
+ *     are in progress, both read the same reception ring.
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+#ifndef INC_ESP8266_ASYNC_H_
+#define INC_ESP8266_ASYNC_H_
+
+/* Includes ------------------------------------------------------------------*/
+#include "esp8266.h"
+#include "pt.h"
+
+/* Exported types ------------------------------------------------------------*/
+typedef enum {
+    ESP8266_OP_INIT         = 0,
+    ESP8266_OP_JOIN_AP      = 1,
+    ESP8266_OP_MQTT_CONNECT = 2,
+    ESP8266_OP_MQTT_SUB     = 3,
+    ESP8266_OP_MQTT_PUB     = 4,
+    ESP8266_OP_SEND_DATA    = 5,
+} esp8266_op_kind_t;
+
+/*
+ * One operation in progress, owned by the caller. This is all the RAM an
+ * operation needs: the command is formatted in a buffer shared by all
+ * operations once the channel is theirs. Payloads are sent from the
+ * caller's memory, never copied there.
+ */
+typedef struct {
+    pt_t               pt;          /* operation steps */
+    pt_t               child;       /* command in flight */
+    uint8_t            kind;        /* esp8266_op_kind_t */
+    uint8_t            match;       /* bytes of token matched so far */
+    uint8_t            error_match; /* bytes of AT_ERROR_STRING matched so far */
+    uint8_t            busy_match;  /* bytes of AT_BUSY_STRING matched so far */
+    uint8_t            attempt;     /* resends of the command in flight, answered busy */
+    uint8_t            done;        /* completed: polled again, it returns at once */
+    volatile uint8_t   cancel;      /* set by esp8266_op_cancel() */
+    uint16_t           ticket;      /* place in the channel queue */
+    esp8266_status_t   status;      /* result, valid once completed */
+    const char*        token;       /* final response of the command in flight */
+    uint32_t           sent;        /* HAL_GetTick() when the command in flight was sent */
+    uint32_t           deadline;    /* HAL_GetTick() of the response timeout, or of the resend */
+    esp8266_deadline_t* verb;       /* deadline entry of the command in flight */
+    uint32_t           started;     /* HAL_GetTick() when the channel was taken */
+    union {
+        struct { const char* ssid; const char* password; } join;
+        struct { const char* endpoint; uint16_t port; uint8_t secure; } connect;
+        struct { const char* topic; uint8_t qos; } sub;
+        struct { const char* topic; const char* message; uint32_t length; uint8_t qos; uint8_t retain; uint8_t raw; } pub;
+        struct { const uint8_t* data; uint32_t length; } send;
+    } args;
+} esp8266_op_t;
+
+/* Exported functions ------------------------------------------------------- */
+void esp8266_init_async(esp8266_op_t* op);
+void esp8266_joint_ap_async(esp8266_op_t* op, const char* ssid, const char* password);
+void esp8266_mqtt_connect_async(esp8266_op_t* op, const char* endpoint, uint16_t port, uint8_t secure);
+void esp8266_mqtt_subscribe_async(esp8266_op_t* op, const char* topic, uint8_t qos);
+void esp8266_mqtt_publish_async(esp8266_op_t* op, const char* topic, const char* message, uint8_t qos, uint8_t retain);
+void esp8266_send_data_async(esp8266_op_t* op, const uint8_t* data, uint32_t length);
+
+esp8266_boolean esp8266_op_poll(esp8266_op_t* op);
+void esp8266_op_cancel(esp8266_op_t* op);
+
+#endif /* INC_ESP8266_ASYNC_H_ */
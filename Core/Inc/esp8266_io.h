@@ -10,11 +10,22 @@
 
 /* Includes ------------------------------------------------------------------*/
 #include "stm32f4xx_hal.h"
+#include "at_scan.h"
 
 extern UART_HandleTypeDef *wifi_uart_handle;
 /* Exported types ------------------------------------------------------------*/
+/*
+ * One segment of a frame sent by esp8266_io_sendv(): a command header, a
+ * payload left in the caller's memory, a trailer...
+ */
+typedef struct {
+    const uint8_t*  base;
+    uint32_t        length;
+} esp8266_iovec_t;
+
 /* Exported constants --------------------------------------------------------*/
-#define DEFAULT_TIME_OUT                 1000 /* in ms */
+#define DEFAULT_TIME_OUT                 1000 /* in ms, without a command deadline */
+#define IDLE_TIME_OUT                    50   /* in ms, between two bytes of a line */
 
 /* Exported constants --------------------------------------------------------*/
 /* Exported macro ------------------------------------------------------------*/
@@ -26,7 +37,16 @@ int8_t uart_dma_restart(void);
 
 
 int8_t esp8266_io_send(uint8_t* Buffer, uint32_t Length);
+int8_t esp8266_io_sendv(const esp8266_iovec_t* iov, uint32_t count);
 int32_t esp8266_io_recv(uint8_t* Buffer, uint32_t Length);
+int32_t esp8266_io_recv_until(uint8_t* Buffer, uint32_t Length, const at_scan_set_t* set);
+uint32_t esp8266_io_read(uint8_t* Buffer, uint32_t Length, const at_scan_set_t* set);
+uint32_t esp8266_io_rx_pending(void);
+void esp8266_io_deadline_set(uint32_t deadline);
+void esp8266_io_deadline_clear(void);
+void esp8266_io_cancel(void);
+uint8_t esp8266_io_cancelled(void);
+void esp8266_io_rx_event(void);
 
 
 #endif /* INC_ESP8266_IO_H_ */
@@ -0,0 +1,65 @@
+/*
+ * esp8266_power.h
+ *
+ *  Sleep of the ESP8266 between publishes: after a publish the module is put
+ *  in modem or light sleep (AT+SLEEP) and woken up again ahead of the next
+ *  publish, or of the MQTT keepalive deadline, by the measured wake-up
+ *  latency. The radio-on time per message and the wake-up latency are
+ *  reported in the metrics.
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+#ifndef INC_ESP8266_POWER_H_
+#define INC_ESP8266_POWER_H_
+
+/* Includes ------------------------------------------------------------------*/
+#include "esp8266.h"
+
+/* Exported constants --------------------------------------------------------*/
+#ifndef ESP8266_POWER_SLEEP_MODE
+#define ESP8266_POWER_SLEEP_MODE         ESP8266_SLEEP_MODEM
+#endif
+#define ESP8266_POWER_KEEPALIVE_MS       120000 /* AT+MQTTCONNCFG default */
+#define ESP8266_POWER_PING_MS            500    /* awake time for a keepalive ping */
+#define ESP8266_POWER_MIN_SLEEP_MS       200    /* shorter gaps keep the radio on */
+#define ESP8266_POWER_WAKE_MARGIN_MS     5      /* added to the wake-up latency */
+
+/* Limits: a wake-up slower than ESP8266_POWER_MAX_WAKE_MS (the time a command
+   can wait for the module) falls back to the next shallower sleep mode; a
+   publish later than ESP8266_POWER_MAX_JITTER_MS makes the next wake-ups
+   earlier. */
+#define ESP8266_POWER_MAX_WAKE_MS        100
+#define ESP8266_POWER_MAX_JITTER_MS      10
+
+/* Light sleep is woken up by a module GPIO driven low by the MCU: define
+   ESP8266_WAKE_GPIO_Port / ESP8266_WAKE_Pin (MCU side) and
+   ESP8266_WAKE_MODULE_GPIO (module side) to use it. Without them modem sleep
+   is used: the UART stays usable and AT+SLEEP=0 is enough. */
+#define ESP8266_POWER_WAKE_PULSE_MS      1
+
+/* Exported types ------------------------------------------------------------*/
+typedef struct {
+    uint8_t  mode;                  /* esp8266_sleep_mode_t in use */
+    uint8_t  asleep;
+    uint32_t sleeps;
+    uint32_t fallbacks;             /* mode changes after a slow wake-up */
+    uint32_t wake_latency_max_ms;
+    uint32_t wake_lead_ms;          /* wake-up this early before a deadline */
+    uint32_t jitter_max_ms;         /* latest publish start seen */
+    uint32_t late_publishes;        /* later than ESP8266_POWER_MAX_JITTER_MS */
+    uint64_t radio_on_ms;           /* since esp8266_power_init() */
+    uint32_t radio_on_per_msg_ms;   /* last report window */
+} esp8266_power_stats_t;
+
+/* Exported functions ------------------------------------------------------- */
+esp8266_status_t esp8266_power_init(void);
+uint32_t esp8266_power_sleep(uint32_t idle_ms);
+esp8266_status_t esp8266_power_wake(void);
+uint8_t esp8266_power_asleep(void);
+void esp8266_power_publish_started(uint32_t late_ms);
+void esp8266_power_update_metrics(void);
+void esp8266_power_get_stats(esp8266_power_stats_t* stats);
+
+#endif /* INC_ESP8266_POWER_H_ */
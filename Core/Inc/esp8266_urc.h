@@ -0,0 +1,76 @@
+/*
+ * esp8266_urc.h
+ *
+ *  Reader of what the module sends on its own (URCs), without waiting: the
+ *  received bytes are split into lines, except the payload of a
+ *  +MQTTSUBRECV:<link>,"<topic>",<length>,<payload> frame, which is read by
+ *  its declared length, and the data of a +IPD,[<link>,]<length>:<data>
+ *  frame, read the same way. A payload may hold any byte ('\0', CRLF, "OK", '>')
+ *  and arrive over any number of receive events: it is completed in place,
+ *  right after its header, in the buffer of the reader.
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+#ifndef INC_ESP8266_URC_H_
+#define INC_ESP8266_URC_H_
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+/* Exported constants --------------------------------------------------------*/
+/* Leading bytes of a +MQTTSUBRECV or +IPD header that may be lost or garbled
+   with the header still recognized: up to 3 are received while the clock
+   restarts after Stop mode (power.c). A header lost beyond that leaves its
+   payload read as lines, up to the next line ending. */
+#define ESP8266_URC_RESYNC_BYTES         3
+
+/* Exported types ------------------------------------------------------------*/
+typedef enum {
+    ESP8266_URC_LINE          = 0,
+    ESP8266_URC_PROMPT        = 1,  /* a '>' alone, not followed by a line ending */
+    ESP8266_URC_SUBRECV       = 2,
+    ESP8266_URC_IPD           = 3,  /* data of a client of the TCP server, or of the connection */
+} esp8266_urc_type_t;
+
+/* A complete URC, valid until the next esp8266_urc_read() */
+typedef struct {
+    esp8266_urc_type_t           type;
+    const char*                  line;             /* LINE: '\0' terminated, without CRLF */
+    uint32_t                     length;
+    const char*                  topic;            /* SUBRECV, not terminated */
+    uint32_t                     topic_length;
+    const uint8_t*               data;             /* SUBRECV payload or IPD data, not terminated */
+    uint32_t                     data_length;
+    uint8_t                      link;             /* IPD: the link, 0 without AT+CIPMUX=1 */
+    uint8_t                      truncated;        /* longer than the buffer: its start only */
+} esp8266_urc_t;
+
+/* Where the topic and the payload of a +MQTTSUBRECV or +IPD frame are */
+typedef struct {
+    esp8266_urc_type_t           type;             /* SUBRECV or IPD */
+    uint8_t                      link;             /* IPD */
+    uint32_t                     topic_start;
+    uint32_t                     topic_length;
+    uint32_t                     data_start;       /* 0 outside a frame */
+    uint32_t                     data_length;      /* as declared */
+} esp8266_urc_frame_t;
+
+typedef struct {
+    char*                        buf;
+    uint32_t                     size;
+    uint32_t                     length;           /* bytes of the current URC in buf */
+    esp8266_urc_frame_t          frame;            /* of the message being read */
+    uint32_t                     skip;             /* payload bytes past the buffer, dropped */
+    uint8_t                      overflow;         /* line past the buffer, dropped up to '\n' */
+    uint8_t                      done;             /* buf holds a URC already returned */
+} esp8266_urc_reader_t;
+
+/* Exported functions ------------------------------------------------------- */
+void esp8266_urc_init(esp8266_urc_reader_t* reader, char* buf, uint32_t size);
+uint8_t esp8266_urc_read(esp8266_urc_reader_t* reader, esp8266_urc_t* urc);
+uint8_t esp8266_urc_partial(const esp8266_urc_reader_t* reader);
+uint8_t esp8266_urc_parse_frame(const char* buf, uint32_t length, esp8266_urc_frame_t* frame);
+
+#endif /* INC_ESP8266_URC_H_ */
@@ -0,0 +1,95 @@
+/*
+ * link_ctrl.h
+ *
+ *  Link-quality controller of the publishing: from the RSSI of the AP
+ *  (AT+CWJAP?, sampled every rssi_period_ms) and the measured round trip of
+ *  every publish, it moves between three levels, each with a policy per
+ *  message class: samples batched per publish, sample period and QoS.
+ *
+ *  A level is left for a worse one as soon as the smoothed latency exceeds
+ *  the target, the RSSI falls under the threshold of the level, or a publish
+ *  is answered busy or fails. It is left for a better one only after
+ *  recover_hold good samples in a row, with the RSSI rssi_hysteresis dB
+ *  above the threshold; the hold doubles each time the better level does not
+ *  last, so that the controller does not oscillate around a bad link.
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+#ifndef INC_LINK_CTRL_H_
+#define INC_LINK_CTRL_H_
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include "esp8266.h"
+
+/* Exported constants --------------------------------------------------------*/
+#define LINK_TARGET_LATENCY_MS           250   /* publish round trip held */
+#define LINK_RSSI_PERIOD_MS              10000
+#define LINK_RSSI_FAIR                   (-75) /* dBm: LINK_GOOD to LINK_FAIR under it */
+#define LINK_RSSI_POOR                   (-85) /* dBm: LINK_FAIR to LINK_POOR under it */
+#define LINK_RSSI_HYSTERESIS             5     /* dB above a threshold to move back up */
+#define LINK_SETTLE_SAMPLES              2     /* publishes at a new level before it is judged */
+#define LINK_RECOVER_SAMPLES             5     /* good samples in a row to move up, at first */
+#define LINK_RECOVER_MAX_SAMPLES         80
+
+/* Exported types ------------------------------------------------------------*/
+typedef enum {
+    LINK_GOOD                 = 0,
+    LINK_FAIR                 = 1,
+    LINK_POOR                 = 2,
+    LINK_LEVEL_COUNT          = 3,
+} link_level_t;
+
+typedef enum {
+    LINK_CLASS_TELEMETRY      = 0,  /* the periodic samples */
+    LINK_CLASS_METRICS        = 1,  /* runtime metrics on "<client id>/$metrics" */
+    LINK_CLASS_COUNT          = 2,
+} link_class_t;
+
+/* What one message class does at one level */
+typedef struct {
+    uint8_t                      enabled;
+    uint8_t                      qos;
+    uint8_t                      batch;            /* samples per publish */
+    uint8_t                      period_factor;    /* sample period, times the configured one */
+} link_policy_t;
+
+typedef struct {
+    uint8_t                      adaptive;         /* 0: LINK_GOOD always, the link measured only */
+    uint32_t                     target_latency_ms;
+    uint32_t                     rssi_period_ms;
+    int8_t                       rssi_fair;
+    int8_t                       rssi_poor;
+    int8_t                       rssi_hysteresis;
+} link_ctrl_config_t;
+
+typedef struct {
+    link_level_t                 level;
+    uint32_t                     level_changes;
+    uint32_t                     level_ms[LINK_LEVEL_COUNT];   /* time spent at each level */
+    uint32_t                     publishes;
+    uint32_t                     samples;          /* carried by the publishes */
+    uint32_t                     samples_qos1;
+    uint32_t                     over_target;      /* publishes slower than the target */
+    uint32_t                     failed;           /* busy or failed */
+    uint32_t                     latency_sum_ms;
+    uint32_t                     latency_max_ms;
+    uint32_t                     latency_ms;       /* smoothed */
+    int8_t                       rssi;             /* last sample, 0 before */
+    uint32_t                     rssi_samples;
+    uint32_t                     recover_hold;     /* good samples needed to move up now */
+} link_ctrl_stats_t;
+
+/* Exported functions ------------------------------------------------------- */
+void link_ctrl_configure(const link_ctrl_config_t* config);
+void link_ctrl_get_config(link_ctrl_config_t* config);
+void link_ctrl_reset(void);
+void link_ctrl_publish_done(uint32_t latency_ms, esp8266_status_t status, uint32_t samples, uint8_t qos);
+uint8_t link_ctrl_rssi_due(void);
+void link_ctrl_rssi(int8_t rssi);
+const link_policy_t* link_ctrl_policy(link_class_t message_class);
+void link_ctrl_get_stats(link_ctrl_stats_t* stats);
+
+#endif /* INC_LINK_CTRL_H_ */
@@ -0,0 +1,51 @@
+/*
+ * log_ring.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+#ifndef INC_LOG_RING_H_
+#define INC_LOG_RING_H_
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+/* Exported constants --------------------------------------------------------*/
+#ifndef LOG_RING_SIZE
+#define LOG_RING_SIZE                    2048  /* power of two */
+#endif
+#define LOG_RING_MAX_RECORD              252   /* longer writes are split */
+#define LOG_RING_STAGING_SIZE            256   /* linear chunk handed to a sink */
+
+/* Exported types ------------------------------------------------------------*/
+/*
+ * A log sink consumes the ring content from the idle loop.
+ * ready() tells whether the sink can take new data (e.g. no DMA in flight),
+ * write() returns how many bytes it accepted; it must never block. A sink that
+ * keeps a pointer to the data (DMA) must report not ready until it is done.
+ */
+typedef struct {
+    uint8_t  (*ready)(void);
+    uint32_t (*write)(const uint8_t* data, uint32_t length);
+} log_sink_t;
+
+typedef struct {
+    uint32_t written;       /* records committed */
+    uint32_t dropped;       /* records dropped because the ring was full */
+    uint32_t last_cycles;   /* cost of the last log_ring_write() call */
+    uint32_t max_cycles;    /* worst log_ring_write() cost seen */
+} log_ring_stats_t;
+
+/* Exported variables --------------------------------------------------------*/
+extern const log_sink_t log_sink_itm;
+extern const log_sink_t log_sink_uart_dma;
+
+/* Exported functions ------------------------------------------------------- */
+void log_ring_init(const log_sink_t* sink);
+void log_ring_set_sink(const log_sink_t* sink);
+int32_t log_ring_write(const void* data, uint32_t length);
+void log_ring_drain(void);
+void log_ring_get_stats(log_ring_stats_t* stats);
+
+#endif /* INC_LOG_RING_H_ */
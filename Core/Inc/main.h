@@ -43,8 +43,11 @@ extern "C" {
 /* USER CODE BEGIN EC */
 #define WIFI_SSID         "BHARATISOFT 2011"
 #define WIFI_PASSWORD     "12345678"
+#define WIFI_SSID_ALT     "BHARATISOFT GUEST"     /* joined when stronger, or WIFI_SSID is gone */
+#define WIFI_PASSWORD_ALT "87654321"
 #define MQTT_BROKER       "a1xj5b9bzz0f3a-ats.iot.ap-south-1.amazonaws.com"
 #define MQTT_PORT         8883
+#define MQTT_CLIENT_ID    "esp32"
 
 #define UART_RX_BUFFER_SIZE 6024
 /* USER CODE END EC */
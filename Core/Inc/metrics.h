@@ -0,0 +1,135 @@
+/*
+ * metrics.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+#ifndef INC_METRICS_H_
+#define INC_METRICS_H_
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+/* Exported constants --------------------------------------------------------*/
+#ifndef METRICS_PUBLISH_PERIOD_MS
+#define METRICS_PUBLISH_PERIOD_MS        60000 /* in ms, 0 disables publishing */
+#endif
+
+#define METRICS_TOPIC_SUFFIX             "/$metrics"
+#define METRICS_HIST_BUCKETS             16    /* log2 buckets: [0], [1], [2..3], [4..7] ... */
+#define METRICS_KEY_MAX_SIZE             4     /* longest short key, checked in metrics.c */
+#define METRICS_VALUE_MAX_SIZE           10    /* digits of a uint32_t */
+
+/* Exported types ------------------------------------------------------------*/
+typedef enum {
+    METRIC_COUNTER   = 0,   /* monotonic, never reset */
+    METRIC_GAUGE     = 1,   /* last value or high-water mark */
+} metric_type_t;
+
+/*
+ * Registry of scalar metrics. Every entry is (id, short key, type); the short
+ * key is what goes on the wire, so keep it to a few characters. Adding a metric
+ * is a matter of adding a line here, storage is reserved at compile time.
+ */
+#define METRICS_SCALAR_TABLE(X)                              \
+    X(METRIC_RX_BYTES,        "rx",   METRIC_COUNTER)        \
+    X(METRIC_TX_BYTES,        "tx",   METRIC_COUNTER)        \
+    X(METRIC_RING_HWM,        "rhw",  METRIC_GAUGE)          \
+    X(METRIC_DMA_OVERRUNS,    "ovr",  METRIC_COUNTER)        \
+    X(METRIC_UART_ERRORS,     "uer",  METRIC_COUNTER)        \
+    X(METRIC_AT_ERRORS,       "aer",  METRIC_COUNTER)        \
+    X(METRIC_AT_TIMEOUTS,     "ato",  METRIC_COUNTER)        \
+    X(METRIC_AT_BUSY,         "abz",  METRIC_COUNTER)        \
+    X(METRIC_BUSY_WAIT_MS,    "bzw",  METRIC_COUNTER)        \
+    X(METRIC_PUBLISHES,       "pub",  METRIC_COUNTER)        \
+    X(METRIC_DATAGRAMS,       "dgm",  METRIC_COUNTER)        \
+    X(METRIC_SERVER_FAILURES, "svf",  METRIC_COUNTER)        \
+    X(METRIC_RECONNECTS,      "rcn",  METRIC_COUNTER)        \
+    X(METRIC_HEAP_HWM,        "hhw",  METRIC_GAUGE)          \
+    X(METRIC_STACK_HWM,       "shw",  METRIC_GAUGE)          \
+    X(METRIC_CPU_IDLE_PCT,    "idle", METRIC_GAUGE)          \
+    X(METRIC_LOG_DROPS,       "ldr",  METRIC_COUNTER)        \
+    X(METRIC_LOG_CYCLES_MAX,  "lcy",  METRIC_GAUGE)          \
+    X(METRIC_SCHED_DISPATCHES, "dsp", METRIC_COUNTER)       \
+    X(METRIC_DUTY_PCT,        "duty", METRIC_GAUGE)          \
+    X(METRIC_ENERGY_PER_PUB,  "epp",  METRIC_GAUGE)          \
+    X(METRIC_RADIO_ON_PER_MSG, "ron", METRIC_GAUGE)          \
+    X(METRIC_PUBLISH_JITTER,  "pjt",  METRIC_GAUGE)          \
+    X(METRIC_LINK_LEVEL,      "lnk",  METRIC_GAUGE)          \
+    X(METRIC_ENCODE_FAILURES, "enf",  METRIC_COUNTER)
+
+/* Registry of histograms, reported as p50/p99 over one publish period; the
+   count and sum of their samples since boot are kept for GET /metrics. */
+#define METRICS_HISTOGRAM_TABLE(X)                           \
+    X(METRIC_HIST_PUBLISH_LATENCY, "pl")                     \
+    X(METRIC_HIST_DISPATCH_LATENCY, "dl")                    \
+    X(METRIC_HIST_CMD_LATENCY, "cl")                         \
+    X(METRIC_HIST_WAKE_LATENCY, "wl")
+
+#define METRICS_ENUM_ENTRY(id, key, ...)  id,
+
+typedef enum {
+    METRICS_SCALAR_TABLE(METRICS_ENUM_ENTRY)
+    METRIC_SCALAR_COUNT
+} metric_id_t;
+
+typedef enum {
+    METRICS_HISTOGRAM_TABLE(METRICS_ENUM_ENTRY)
+    METRIC_HISTOGRAM_COUNT
+} metric_hist_id_t;
+
+typedef struct {
+    const char*     key;
+    metric_type_t   type;
+} metric_desc_t;
+
+/* Longest encoding, every value at 10 digits: "up=<v>", ";<key>=<v>" per
+   scalar, ";<key>50=<v>;<key>99=<v>" per histogram, and the NUL */
+#define METRICS_MAX_ENCODED_SIZE                                                    \
+    ((3U + METRICS_VALUE_MAX_SIZE) +                                                \
+     (METRIC_SCALAR_COUNT * (2U + METRICS_KEY_MAX_SIZE + METRICS_VALUE_MAX_SIZE)) +   \
+     (METRIC_HISTOGRAM_COUNT * 2U * (4U + METRICS_KEY_MAX_SIZE + METRICS_VALUE_MAX_SIZE)) + 1U)
+
+typedef struct {
+    volatile uint32_t bucket[METRICS_HIST_BUCKETS];
+    volatile uint32_t count;    /* samples since boot, never reset */
+    volatile uint32_t sum;      /* of those samples, never reset */
+} metric_histogram_t;
+
+typedef struct {
+    uint32_t value[METRIC_SCALAR_COUNT];
+    uint32_t p50[METRIC_HISTOGRAM_COUNT];
+    uint32_t p99[METRIC_HISTOGRAM_COUNT];
+    uint32_t count[METRIC_HISTOGRAM_COUNT];
+    uint32_t sum[METRIC_HISTOGRAM_COUNT];
+    uint32_t uptime_ms;
+} metrics_snapshot_t;
+
+/* Exported variables --------------------------------------------------------*/
+extern volatile uint32_t metric_values[METRIC_SCALAR_COUNT];
+extern metric_histogram_t metric_histograms[METRIC_HISTOGRAM_COUNT];
+extern const metric_desc_t metric_desc[METRIC_SCALAR_COUNT];
+
+/* Exported macro ------------------------------------------------------------*/
+/* Gauges are a single store. Counters are owned by one context (thread or one
+   ISR) each, so the read-modify-write needs no locking. */
+#define METRIC_SET(id, v)        (metric_values[(id)] = (uint32_t)(v))
+#define METRIC_ADD(id, n)        (metric_values[(id)] += (uint32_t)(n))
+#define METRIC_INC(id)           METRIC_ADD((id), 1)
+#define METRIC_MAX(id, v)        do { uint32_t v_ = (uint32_t)(v); \
+                                      if (v_ > metric_values[(id)]) metric_values[(id)] = v_; } while (0)
+
+/* Exported functions ------------------------------------------------------- */
+void metrics_init(void);
+void metrics_observe(metric_hist_id_t id, uint32_t value);
+void metrics_idle_enter(void);
+void metrics_idle_exit(void);
+void metrics_idle_add_ms(uint32_t ms);
+void metrics_snapshot(metrics_snapshot_t* snapshot);
+void metrics_peek(metrics_snapshot_t* snapshot);
+int32_t metrics_encode(const metrics_snapshot_t* snapshot, char* buffer, uint32_t size);
+void metrics_set_period(uint32_t period_ms);
+int8_t metrics_publish_if_due(void);
+
+#endif /* INC_METRICS_H_ */
@@ -0,0 +1,45 @@
+/*
+ * metrics_http.h
+ *
+ *  Minimal HTTP/1.1 responder on the TCP server of the module: GET /metrics
+ *  is answered with the metrics registry, the per-verb AT round trips and
+ *  the uptime in the Prometheus text exposition format (version 0.0.4).
+ *
+ *  The response is never built whole: metrics_http_step() renders the next
+ *  lines into one chunk of METRICS_HTTP_CHUNK_SIZE bytes and sends it, with
+ *  chunked transfer encoding, then returns. The caller runs one step at a
+ *  time between its other work, so a scrape holds the module for one chunk
+ *  at most; the longest step is measured. One scrape is served at a time,
+ *  the link is closed at its end.
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+#ifndef INC_METRICS_HTTP_H_
+#define INC_METRICS_HTTP_H_
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+/* Exported constants --------------------------------------------------------*/
+#define METRICS_HTTP_CHUNK_SIZE          512   /* body bytes sent per step */
+
+/* Exported types ------------------------------------------------------------*/
+typedef struct {
+    uint32_t scrapes;           /* GET /metrics answered */
+    uint32_t not_found;         /* other requests, answered 404 */
+    uint32_t aborted;           /* client gone, send failed, or an item larger than a chunk */
+    uint32_t bytes;             /* response bytes sent */
+    uint32_t steps;
+    uint32_t step_max_us;       /* longest metrics_http_step(): the stall it causes */
+    uint32_t scrape_max_ms;     /* longest scrape, request to close */
+} metrics_http_stats_t;
+
+/* Exported functions ------------------------------------------------------- */
+void metrics_http_init(void);
+uint8_t metrics_http_receive(uint8_t link, const uint8_t* data, uint32_t length);
+int8_t metrics_http_step(void);
+void metrics_http_get_stats(metrics_http_stats_t* stats);
+
+#endif /* INC_METRICS_HTTP_H_ */
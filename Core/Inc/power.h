@@ -0,0 +1,54 @@
+/*
+ * power.h
+ *
+ *  Idle-time low-power management: the scheduler hands every idle period to
+ *  power_idle(), which sleeps with WFI (woken by the UART IDLE / DMA
+ *  interrupts or SysTick) or, when enabled and allowed, enters Stop mode
+ *  until the next timer deadline. Time spent in each mode is accounted to
+ *  estimate the duty cycle and the energy per published message.
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+#ifndef INC_POWER_H_
+#define INC_POWER_H_
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+/* Exported constants --------------------------------------------------------*/
+#ifndef POWER_STOP_ENABLE
+#define POWER_STOP_ENABLE                0     /* 1: Stop mode between timer deadlines */
+#endif
+#define POWER_STOP_MIN_MS                20    /* shorter idle periods only use WFI */
+#define POWER_STOP_MARGIN_MS             2     /* wake up this early: clock restart */
+#define POWER_REPORT_PERIOD_MS           10000 /* duty cycle / energy metrics window */
+
+/* Energy model: supply voltage and typical STM32F446 currents at 180 MHz
+   with the peripherals of this project. Calibrate with a meter. */
+#define POWER_SUPPLY_MV                  3300
+#define POWER_RUN_UA                     60000
+#define POWER_SLEEP_UA                   25000
+#define POWER_STOP_UA                    300
+
+/* Exported types ------------------------------------------------------------*/
+typedef struct {
+    uint64_t run_us;
+    uint64_t sleep_us;              /* WFI */
+    uint64_t stop_us;               /* Stop mode */
+    uint64_t energy_uj;             /* estimated, since power_init() */
+    uint32_t stop_entries;
+    uint32_t stop_wake_max_us;      /* wake-up event -> PLL clock restored */
+    uint32_t duty_pct;              /* run time, last report window */
+    uint32_t energy_per_publish_uj; /* last report window */
+} power_stats_t;
+
+/* Exported functions ------------------------------------------------------- */
+void power_init(void);
+void power_idle(uint32_t budget_ms);
+void power_set_stop_allowed(uint8_t allowed);
+void power_update_metrics(void);
+void power_get_stats(power_stats_t* stats);
+
+#endif /* INC_POWER_H_ */
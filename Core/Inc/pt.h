@@ -0,0 +1,67 @@
+/*
+ * pt.h
+ *
+ *  Stackless coroutines (protothreads): a function written as a sequence of
+ *  steps that returns to its caller whenever it has to wait, and resumes at
+ *  the same place on the next call. The only state kept between calls is the
+ *  resume point (pt_t) plus whatever the caller stores in its own context:
+ *  local variables do NOT survive a wait, and a protothread body must not
+ *  use a switch statement across a wait.
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+#ifndef INC_PT_H_
+#define INC_PT_H_
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+/* Exported types ------------------------------------------------------------*/
+typedef struct {
+    uint16_t lc;                /* resume point: source line, 0 at the start */
+} pt_t;
+
+/* Exported constants --------------------------------------------------------*/
+#define PT_WAITING               0
+#define PT_YIELDED               1
+#define PT_EXITED                2
+#define PT_ENDED                 3
+
+/* Exported macro ------------------------------------------------------------*/
+#if defined(__GNUC__) && (__GNUC__ >= 7)
+#define PT_FALLTHROUGH_          __attribute__((fallthrough))
+#else
+#define PT_FALLTHROUGH_
+#endif
+
+#define PT_THREAD(decl)          int8_t decl
+#define PT_INIT(pt)              ((pt)->lc = 0)
+
+#define PT_BEGIN(pt)             { uint8_t pt_yield_ = 1; (void)pt_yield_; \
+                                   switch ((pt)->lc) { case 0:
+#define PT_END(pt)               } pt_yield_ = 0; PT_INIT(pt); return PT_ENDED; }
+
+/* Return PT_WAITING until cond is true */
+#define PT_WAIT_UNTIL(pt, cond)  do { (pt)->lc = __LINE__;                \
+                                      PT_FALLTHROUGH_; case __LINE__:  \
+                                      if (!(cond)) { return PT_WAITING; } } while (0)
+#define PT_WAIT_WHILE(pt, cond)  PT_WAIT_UNTIL((pt), !(cond))
+
+/* Run a child protothread to completion, waiting while it waits */
+#define PT_WAIT_THREAD(pt, thread) PT_WAIT_WHILE((pt), (thread) < PT_EXITED)
+#define PT_SPAWN(pt, child, thread) do { PT_INIT(child);                    \
+                                         PT_WAIT_THREAD((pt), (thread)); } while (0)
+
+/* Give the caller a turn once, even if nothing is awaited */
+#define PT_YIELD(pt)             do { pt_yield_ = 0; (pt)->lc = __LINE__; \
+                                      PT_FALLTHROUGH_; case __LINE__:     \
+                                      if (pt_yield_ == 0) { return PT_YIELDED; } } while (0)
+
+#define PT_EXIT(pt)              do { PT_INIT(pt); return PT_EXITED; } while (0)
+#define PT_RESTART(pt)           do { PT_INIT(pt); return PT_WAITING; } while (0)
+
+#define PT_SCHEDULE(f)           ((f) < PT_EXITED)
+
+#endif /* INC_PT_H_ */
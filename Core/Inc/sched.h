@@ -0,0 +1,70 @@
+/*
+ * sched.h
+ *
+ *  Run-to-completion cooperative scheduler: event-driven tasks, a software
+ *  timer queue and deferred work items, dispatched from the main loop. The
+ *  core sleeps with WFI while nothing is pending.
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+#ifndef INC_SCHED_H_
+#define INC_SCHED_H_
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+/* Exported constants --------------------------------------------------------*/
+#define SCHED_MAX_TASKS                  8     /* index is the priority, 0 first */
+
+/* Exported types ------------------------------------------------------------*/
+typedef uint8_t sched_task_id_t;
+typedef uint32_t sched_events_t;
+
+/* A task handler gets all the events posted since its previous run */
+typedef void (*sched_task_fn_t)(sched_events_t events);
+typedef void (*sched_work_fn_t)(void* arg);
+
+/*
+ * Software timer, owned by the caller. Timers are started, stopped and expire
+ * in the main loop context only; the callback runs there too.
+ */
+typedef struct sched_timer {
+    struct sched_timer* next;
+    sched_work_fn_t     fn;
+    void*               arg;
+    uint32_t            deadline;   /* HAL_GetTick() value */
+    uint32_t            period;     /* 0: one shot */
+    uint8_t             active;
+} sched_timer_t;
+
+/*
+ * Deferred work item, owned by the caller. It can be queued from an ISR and
+ * runs once in the main loop; queueing an item already queued is a no-op.
+ */
+typedef struct sched_work {
+    struct sched_work*  next;
+    sched_work_fn_t     fn;
+    void*               arg;
+    volatile uint8_t    queued;
+} sched_work_t;
+
+typedef struct {
+    uint32_t dispatches;            /* task runs */
+    uint32_t timers_fired;
+    uint32_t work_done;
+    uint32_t max_latency_us;        /* worst post-to-dispatch delay */
+} sched_stats_t;
+
+/* Exported functions ------------------------------------------------------- */
+void sched_init(void);
+int8_t sched_task_create(sched_task_fn_t fn, sched_task_id_t* id);
+void sched_post(sched_task_id_t task, sched_events_t events);
+void sched_timer_start(sched_timer_t* timer, sched_work_fn_t fn, void* arg, uint32_t delay_ms, uint32_t period_ms);
+void sched_timer_stop(sched_timer_t* timer);
+void sched_defer(sched_work_t* work, sched_work_fn_t fn, void* arg);
+void sched_run_once(void);
+void sched_get_stats(sched_stats_t* stats);
+
+#endif /* INC_SCHED_H_ */
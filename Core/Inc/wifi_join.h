@@ -0,0 +1,58 @@
+/*
+ * wifi_join.h
+ *
+ *  Join manager of the station over several configured networks. The BSSID
+ *  of the last successful join is kept, and the next join goes to it
+ *  directly with a fast scan: AT+CWJAP takes no channel, but the scan stops
+ *  on the first channel where the AP answers. The last AP is kept in RAM
+ *  only: no RTC backup domain is set up (stm32f4xx_hal_conf.h), so a reset
+ *  forgets it and the first join after it scans. When that fails, one AT+CWLAP scan ranks the APs of every configured
+ *  network by RSSI and the strongest ones are tried in turn; networks not
+ *  seen by the scan (hidden SSIDs) are joined by name last.
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+#ifndef INC_WIFI_JOIN_H_
+#define INC_WIFI_JOIN_H_
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include "esp8266.h"
+
+/* Exported constants --------------------------------------------------------*/
+#define WIFI_JOIN_MAX_CANDIDATES         4     /* strongest APs tried after a scan */
+
+/* Exported types ------------------------------------------------------------*/
+typedef struct {
+    const char*                  ssid;
+    const char*                  password;
+} wifi_network_t;
+
+/* An AP of a configured network */
+typedef struct {
+    uint8_t                      valid;
+    uint8_t                      network;          /* index in the configured networks */
+    char                         bssid[ESP8266_MAC_SIZE];
+    int8_t                       rssi;             /* at the scan that found it */
+} wifi_join_ap_t;
+
+typedef struct {
+    uint32_t                     joins;            /* successful */
+    uint32_t                     fast_joins;       /* to the last AP, without a scan */
+    uint32_t                     fast_failures;    /* last AP gone: a scan followed */
+    uint32_t                     scans;
+    uint32_t                     failures;         /* no configured network joined */
+    uint32_t                     last_ms;          /* of the last join, successful or not */
+    uint32_t                     fast_max_ms;
+    uint32_t                     scan_max_ms;      /* longest successful join through a scan */
+} wifi_join_stats_t;
+
+/* Exported functions ------------------------------------------------------- */
+void wifi_join_init(const wifi_network_t* list, uint32_t count);
+esp8266_status_t wifi_join(void);
+const wifi_join_ap_t* wifi_join_last_ap(void);
+void wifi_join_get_stats(wifi_join_stats_t* stats);
+
+#endif /* INC_WIFI_JOIN_H_ */
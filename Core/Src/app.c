@@ -6,33 +6,112 @@
  */
 
 #include "app.h"
+#include "at_builder.h"
 #include "esp8266.h"
+#include "esp8266_io.h"
+#include "esp8266_power.h"
+#include "esp8266_urc.h"
+#include "link_ctrl.h"
+#include "log_ring.h"
+#include "metrics.h"
+#include "metrics_http.h"
+#include "power.h"
+#include "sched.h"
 #include <string.h>
 #include "main.h"
 #include <stdio.h>
 
 #define MAX_PUB_MSG_SIZE     128
 #define MAX_INCOMING_BUFFER  MAX_BUFFER_SIZE
+#define APP_RX_FRAME_SIZE    (1024 + 128)   // a 1 KB message and its +MQTTSUBRECV header
+#define APP_MAX_BATCH        8              // samples in one publish, fits MAX_PUB_MSG_SIZE
+
+#if !defined(USE_FREERTOS)
+// Task events
+#define APP_EVT_PUBLISH      (1U << 0)
+#define APP_EVT_RADIO        (1U << 1)
+#define APP_EVT_RETRY        (1U << 2)
+#define RX_EVT_DATA          (1U << 0)
+#define RECONNECT_EVT_RETRY  (1U << 0)
+#define LED_EVT_UPDATE       (1U << 0)
+#define HTTP_EVT_SERVE       (1U << 0)
+
+extern UART_HandleTypeDef huart2;
+
+static sched_task_id_t app_task;
+static sched_task_id_t rx_task;
+static sched_task_id_t reconnect_task;
+static sched_task_id_t led_task;
+static sched_task_id_t http_task;
+
+static sched_timer_t publish_timer;
+static sched_timer_t housekeeping_timer;
+static sched_timer_t reconnect_timer;
+static sched_timer_t radio_timer;
+static sched_timer_t busy_timer;
+static sched_work_t log_drain_work;
+
+static uint32_t publish_period_ms = APP_PUBLISH_PERIOD_MS;
+static uint16_t metrics_port = APP_METRICS_PORT;
+static volatile uint8_t mqtt_connected;
+static uint8_t led_request;
+static volatile uint32_t rx_event_cycles;   // first RX event not processed yet
+static uint32_t rx_batch_cycles;            // RX event of the bytes being parsed
+static uint32_t led_request_cycles;         // RX event of the pending LED command
+static uint32_t reconnect_backoff_ms = APP_RECONNECT_MIN_MS;
+static uint32_t tick_period_ms;             // sample period of the link level
+static uint32_t samples_pending;            // sampled, waiting for a full batch
+
+static char rx_frame[APP_RX_FRAME_SIZE];
+static esp8266_urc_reader_t rx_reader;
+static app_rx_stats_t rx_stats;
+
+static void app_task_handler(sched_events_t events);
+static void rx_task_handler(sched_events_t events);
+static void reconnect_task_handler(sched_events_t events);
+static void led_task_handler(sched_events_t events);
+static void http_task_handler(sched_events_t events);
+static void rx_process_urc(const esp8266_urc_t* urc);
+static void rx_message(const uint8_t* data, uint32_t length, uint8_t truncated);
+static void radio_sleep(void);
+static uint32_t ms_to_publish(void);
+static void link_sample(void);
+static void link_apply_period(void);
+static void post_event(void* arg);
+static void post_radio_event(void* arg);
+static void post_retry_event(void* arg);
+static void housekeeping(void* arg);
+static void log_drain(void* arg);
+#endif
+
+static uint32_t sample_counter;
+
+static esp8266_status_t publish_samples(uint32_t count, uint8_t qos);
 
 
 //-----------------------------------------------------------------------------
 // This function publishes a message and then waits for an incoming response.
 // It then checks the received message for LED control commands ("LED ON" or "LED OFF")
 // and controls the LED accordingly.
+// Returns 0 when published, 1 when the module was busy (publish it again
+// later, the session is fine), -1 on failure.
 //-----------------------------------------------------------------------------
 int32_t publish_and_process_incoming_message(void)
 {
-    static uint32_t counter = 0;
-    char pubMessage[MAX_PUB_MSG_SIZE];
+    esp8266_status_t status;
+#if 0
     uint8_t messageBuffer[MAX_INCOMING_BUFFER];
     const uint8_t *token = (const uint8_t *)"OK";
+#endif
 
-    sprintf(pubMessage, "hello aws! Count: %lu", counter++);
-
-    // Publish the message to "topic/esp32at" with QoS 1 and no retain
-    if (esp8266_mqtt_publish("topic/esp32at", pubMessage, 1, 0) != ESP8266_OK)
+    status = publish_samples(1, 1);
+    if (status == ESP8266_BUSY)
     {
-        Error_Handler();
+        return 1;
+    }
+    if (status != ESP8266_OK)
+    {
+        return -1;
     }
 #if 0
     // Optional delay to give the module time to send its response
@@ -64,4 +143,580 @@ int32_t publish_and_process_incoming_message(void)
         return -1;
     }
 #endif
+    return 0;
+}
+
+//-----------------------------------------------------------------------------
+// Publish the next `count` samples in one message to "topic/esp32at", no
+// retain: "hello aws! Count: 7" or, batched, "hello aws! Count: 7 8 9 10"
+// (a comma would need AT+MQTTPUBRAW, one more round trip). The command
+// around the payload is rendered once per QoS.
+//-----------------------------------------------------------------------------
+static esp8266_status_t publish_samples(uint32_t count, uint8_t qos)
+{
+    static esp8266_pub_handle_t pubHandle[2];
+    static uint8_t pubHandleReady[2];
+    char pubMessage[MAX_PUB_MSG_SIZE];
+    at_builder_t message;
+    esp8266_status_t status;
+
+    qos = (qos != 0) ? 1 : 0;
+
+    at_builder_init(&message, pubMessage, sizeof(pubMessage));
+    at_builder_lit(&message, "hello aws! Count: ");
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if (i != 0)
+        {
+            at_builder_char(&message, ' ');
+        }
+        at_builder_uint(&message, sample_counter + i);
+    }
+    at_builder_finish(&message);
+
+    if (pubHandleReady[qos] == 0)
+    {
+        status = esp8266_mqtt_publish_register(&pubHandle[qos], "topic/esp32at", qos, 0);
+        if (status != ESP8266_OK)
+        {
+            return status;
+        }
+        pubHandleReady[qos] = 1;
+    }
+
+    status = esp8266_mqtt_publish_handle(&pubHandle[qos], pubMessage);
+    if (status == ESP8266_OK)
+    {
+        sample_counter += count;
+    }
+    return status;
+}
+
+#if !defined(USE_FREERTOS)
+//-----------------------------------------------------------------------------
+// Create the application tasks and timers. Called once the module is connected
+// to the broker; from then on main() only runs sched_run_once().
+//
+//   app        samples every APP_PUBLISH_PERIOD_MS (default) while connected
+//              and publishes with the policy of the link level (link_ctrl.c):
+//              batched, less often and at QoS 0 on a poor link; the module
+//              is asleep in between (esp8266_power.c)
+//   rx         parses the unsolicited lines (URCs) the module sends between
+//              commands, woken up by the UART RX event interrupt
+//   reconnect  reconnects to the broker with an exponential backoff
+//   led        drives LD2 from the "LED ON" / "LED OFF" messages
+//   http       answers GET /metrics on APP_METRICS_PORT (none by default,
+//              see app_set_metrics_port()), one chunk per dispatch and last
+//              in priority: a publish due meanwhile waits for one chunk at most
+//-----------------------------------------------------------------------------
+void app_init(void)
+{
+    sched_init();
+
+    // Creation order is the dispatch priority
+    sched_task_create(rx_task_handler, &rx_task);
+    sched_task_create(led_task_handler, &led_task);
+    sched_task_create(reconnect_task_handler, &reconnect_task);
+    sched_task_create(app_task_handler, &app_task);
+    sched_task_create(http_task_handler, &http_task);
+
+    mqtt_connected = 1;
+    samples_pending = 0;
+    tick_period_ms = publish_period_ms;
+    link_ctrl_reset();
+    esp8266_urc_init(&rx_reader, rx_frame, sizeof(rx_frame));
+    memset(&rx_stats, 0, sizeof(rx_stats));
+
+    // Stop mode between publishes when POWER_STOP_ENABLE is set: the URC
+    // parser below tolerates the damaged first byte of a waking line
+    power_set_stop_allowed(1);
+
+    // Module sleep mode and wakeup source; it stays awake until the first publish
+    esp8266_power_init();
+
+    // Scrapes of the metrics by the monitoring, on the LAN when a port is set;
+    // publishing goes on without it
+    metrics_http_init();
+    if ((metrics_port != 0) && (esp8266_server_start(metrics_port) != ESP8266_OK))
+    {
+        printf("metrics server on port %u not started\r\n", (unsigned int)metrics_port);
+        METRIC_INC(METRIC_SERVER_FAILURES);
+        metrics_port = 0;
+    }
+
+    sched_timer_start(&publish_timer, post_event, &app_task, publish_period_ms, publish_period_ms);
+    sched_timer_start(&housekeeping_timer, housekeeping, NULL, APP_HOUSEKEEPING_PERIOD_MS, APP_HOUSEKEEPING_PERIOD_MS);
+
+    // Bytes received before the tasks existed
+    sched_post(rx_task, RX_EVT_DATA);
+}
+
+//-----------------------------------------------------------------------------
+// Change the sample period of a good link, takes effect at the next app_init().
+//-----------------------------------------------------------------------------
+void app_set_publish_period(uint32_t period_ms)
+{
+    publish_period_ms = period_ms;
+}
+
+//-----------------------------------------------------------------------------
+// Change the port of the metrics endpoint, 0 for none; takes effect at the
+// next app_init().
+//-----------------------------------------------------------------------------
+void app_set_metrics_port(uint16_t port)
+{
+    metrics_port = port;
+}
+
+//-----------------------------------------------------------------------------
+// Copy the counters of the messages received.
+//-----------------------------------------------------------------------------
+void app_get_rx_stats(app_rx_stats_t* stats)
+{
+    *stats = rx_stats;
+}
+
+//-----------------------------------------------------------------------------
+// UART RX event interrupt: new bytes are in the reception ring.
+//-----------------------------------------------------------------------------
+void esp8266_io_rx_event(void)
+{
+    // Start of the command-to-action latency
+    if (rx_event_cycles == 0)
+    {
+        rx_event_cycles = DWT->CYCCNT | 1U;
+    }
+    sched_post(rx_task, RX_EVT_DATA);
+}
+
+//-----------------------------------------------------------------------------
+// USART2 TX DMA complete interrupt: push the next log chunk without waiting
+// for the housekeeping timer.
+//-----------------------------------------------------------------------------
+void HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart)
+{
+    if (huart == &huart2)
+    {
+        sched_defer(&log_drain_work, log_drain, NULL);
+    }
+}
+
+static void app_task_handler(sched_events_t events)
+{
+    const link_policy_t* policy = link_ctrl_policy(LINK_CLASS_TELEMETRY);
+    uint32_t start;
+    esp8266_status_t status;
+
+    if (mqtt_connected == 0)
+    {
+        return;
+    }
+
+    // Wake-up ahead of a publish or of the keepalive deadline, then back to
+    // sleep once the module had time to ping the broker if no publish is near
+    if ((events & APP_EVT_RADIO) != 0)
+    {
+        if (esp8266_power_asleep() == 0)
+        {
+            radio_sleep();
+        }
+        else if (esp8266_power_wake() == ESP8266_OK)
+        {
+            if (ms_to_publish() >
+                (ESP8266_POWER_PING_MS + ESP8266_POWER_MIN_SLEEP_MS + ESP8266_POWER_MAX_WAKE_MS))
+            {
+                sched_timer_start(&radio_timer, post_radio_event, NULL, ESP8266_POWER_PING_MS, 0);
+            }
+        }
+    }
+
+    if ((events & (APP_EVT_PUBLISH | APP_EVT_RETRY)) == 0)
+    {
+        return;
+    }
+
+    // A new sample; past APP_MAX_BATCH unpublished ones, the newest are dropped
+    if (((events & APP_EVT_PUBLISH) != 0) && (samples_pending < APP_MAX_BATCH))
+    {
+        samples_pending++;
+    }
+
+    // Batched on a worse link: nothing to send until the batch is full, the
+    // radio wake-up is already planned for that publish (ms_to_publish())
+    if (samples_pending < policy->batch)
+    {
+        if (esp8266_power_asleep() == 0)
+        {
+            radio_sleep();
+        }
+        return;
+    }
+
+    // The periodic timer is already reloaded: this publish was due one period ago
+    esp8266_power_publish_started(HAL_GetTick() - (publish_timer.deadline - tick_period_ms));
+
+    if (esp8266_power_wake() != ESP8266_OK)
+    {
+        mqtt_connected = 0;
+        sched_post(reconnect_task, RECONNECT_EVT_RETRY);
+        return;
+    }
+
+    // Round trip of the publish: the PUBACK at QoS 1, the module at QoS 0
+    start = HAL_GetTick();
+    status = publish_samples(samples_pending, policy->qos);
+    link_ctrl_publish_done(HAL_GetTick() - start, status, samples_pending, policy->qos);
+    link_apply_period();
+    if (status == ESP8266_BUSY)
+    {
+        // Busy module: the same publish again shortly, awake and connected
+        METRIC_ADD(METRIC_BUSY_WAIT_MS, APP_BUSY_RETRY_MS);
+        sched_timer_start(&busy_timer, post_retry_event, NULL, APP_BUSY_RETRY_MS, 0);
+        return;
+    }
+    if (status != ESP8266_OK)
+    {
+        mqtt_connected = 0;
+        sched_post(reconnect_task, RECONNECT_EVT_RETRY);
+        return;
+    }
+    samples_pending = 0;
+
+    // Signal strength of the AP, every LINK_RSSI_PERIOD_MS while the radio is on
+    if (link_ctrl_rssi_due() != 0)
+    {
+        link_sample();
+    }
+
+    // Periodic runtime telemetry on "<client id>/$metrics", while the radio
+    // is on; dropped on a poor link
+    if (link_ctrl_policy(LINK_CLASS_METRICS)->enabled != 0)
+    {
+        metrics_publish_if_due();
+    }
+
+    radio_sleep();
+}
+
+//-----------------------------------------------------------------------------
+// RSSI of the AP (AT+CWJAP?) for the link controller.
+//-----------------------------------------------------------------------------
+static void link_sample(void)
+{
+    esp8266_ap_info_t ap;
+
+    if (esp8266_get_ap_info(&ap) == ESP8266_OK)
+    {
+        link_ctrl_rssi(ap.rssi);
+        link_apply_period();
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Restart the periodic timer when the link level changed the sample period.
+//-----------------------------------------------------------------------------
+static void link_apply_period(void)
+{
+    uint32_t period_ms = publish_period_ms * link_ctrl_policy(LINK_CLASS_TELEMETRY)->period_factor;
+
+    if (period_ms != tick_period_ms)
+    {
+        tick_period_ms = period_ms;
+        sched_timer_start(&publish_timer, post_event, &app_task, period_ms, period_ms);
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Put the module to sleep until the next publish, the wake-up comes back as
+// APP_EVT_RADIO.
+//-----------------------------------------------------------------------------
+static void radio_sleep(void)
+{
+    uint32_t wake_in_ms = esp8266_power_sleep(ms_to_publish());
+
+    if (wake_in_ms != 0)
+    {
+        sched_timer_start(&radio_timer, post_radio_event, NULL, wake_in_ms, 0);
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Time to the next publish: the next sample, and the ones after it a batch
+// still needs.
+//-----------------------------------------------------------------------------
+static uint32_t ms_to_publish(void)
+{
+    int32_t left = (int32_t)(publish_timer.deadline - HAL_GetTick());
+    uint32_t batch = link_ctrl_policy(LINK_CLASS_TELEMETRY)->batch;
+    uint32_t ticks = ((samples_pending + 1U) < batch) ? (batch - samples_pending - 1U) : 0U;
+
+    return ((left > 0) ? (uint32_t)left : 0U) + (ticks * tick_period_ms);
+}
+
+//-----------------------------------------------------------------------------
+// Only runs between commands (tasks run to completion), so whatever is in the
+// ring is unsolicited. Never waits: reads only what is already received, a
+// message completed over several RX events stays in rx_frame meanwhile.
+//-----------------------------------------------------------------------------
+static void rx_task_handler(sched_events_t events)
+{
+    esp8266_urc_t urc;
+
+    (void)events;
+
+    rx_batch_cycles = rx_event_cycles;
+    rx_event_cycles = 0;
+
+    while (esp8266_urc_read(&rx_reader, &urc) != 0)
+    {
+        rx_process_urc(&urc);
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Messages are routed by their payload, compared by length: any byte may be
+// part of it. Other URCs are searched anywhere in the line: when a line wakes
+// the MCU up from Stop mode its first byte is lost or garbled.
+//-----------------------------------------------------------------------------
+static void rx_process_urc(const esp8266_urc_t* urc)
+{
+    if (urc->type == ESP8266_URC_IPD)
+    {
+        esp8266_ipd_received(urc->link, urc->data, urc->data_length);
+    }
+    else if (urc->type == ESP8266_URC_SUBRECV)
+    {
+        rx_message(urc->data, urc->data_length, urc->truncated);
+    }
+    else if (strstr(urc->line, "MQTTDISCONNECTED:") != NULL)
+    {
+        mqtt_connected = 0;
+        sched_post(reconnect_task, RECONNECT_EVT_RETRY);
+    }
+    else
+    {
+        // <link>,CONNECT / <link>,CLOSED of the clients of the TCP server
+        esp8266_server_handle_line(urc->line, urc->length);
+    }
+}
+
+//-----------------------------------------------------------------------------
+// A +MQTTSUBRECV message, from rx_process_urc() or received while a command
+// was waiting for its response.
+//-----------------------------------------------------------------------------
+static void rx_message(const uint8_t* data, uint32_t length, uint8_t truncated)
+{
+    rx_stats.messages++;
+    rx_stats.message_bytes += length;
+    if (truncated != 0)
+    {
+        rx_stats.truncated++;
+        return;
+    }
+
+    // Check if the message is an LED control command.
+    if ((length == 6) && (memcmp(data, "LED ON", 6) == 0))
+    {
+        led_request = 1;
+    }
+    else if ((length == 7) && (memcmp(data, "LED OFF", 7) == 0))
+    {
+        led_request = 0;
+    }
+    else
+    {
+        return;
+    }
+
+    if (led_request_cycles == 0)
+    {
+        led_request_cycles = rx_batch_cycles;
+    }
+    sched_post(led_task, LED_EVT_UPDATE);
+}
+
+//-----------------------------------------------------------------------------
+// Messages read by the driver while a command was waiting (esp8266.c): the
+// command may be run by any task, the message is handled as if rx_task had
+// read it. One subscription, the topic is not checked.
+//-----------------------------------------------------------------------------
+void esp8266_message_received(const char* topic, uint32_t topic_length,
+                              const uint8_t* data, uint32_t length, uint8_t truncated)
+{
+    (void)topic;
+    (void)topic_length;
+
+    rx_message(data, length, truncated);
+}
+
+//-----------------------------------------------------------------------------
+// Called by the driver before each command. A URC rx_task has started to read
+// over several RX events is completed first, or its rest would be read as the
+// response, and the response as its payload. The module sends a URC without
+// pausing: one stalled for DEFAULT_TIME_OUT is dropped.
+//-----------------------------------------------------------------------------
+void esp8266_command_starting(void)
+{
+    esp8266_urc_t urc;
+    uint32_t start;
+
+    while (esp8266_urc_partial(&rx_reader) != 0)
+    {
+        if (esp8266_urc_read(&rx_reader, &urc) != 0)
+        {
+            rx_process_urc(&urc);
+            continue;
+        }
+
+        start = HAL_GetTick();
+        while ((esp8266_io_rx_pending() == 0) && ((HAL_GetTick() - start) < DEFAULT_TIME_OUT))
+        {
+            power_idle(0);
+        }
+        if (esp8266_io_rx_pending() == 0)
+        {
+            esp8266_urc_init(&rx_reader, rx_frame, sizeof(rx_frame));
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Data of a client of the TCP server, from rx_process_urc() or received while
+// a command was waiting for its response (esp8266.c): an HTTP request.
+//-----------------------------------------------------------------------------
+void esp8266_ipd_received(uint8_t link, const uint8_t* data, uint32_t length)
+{
+    // Data of the outgoing connection, not a request
+    if (link == ESP8266_CLIENT_LINK)
+    {
+        return;
+    }
+    if (metrics_http_receive(link, data, length) != 0)
+    {
+        sched_post(http_task, HTTP_EVT_SERVE);
+    }
+}
+
+//-----------------------------------------------------------------------------
+// One step of the scrape in progress, then the other tasks run again.
+//-----------------------------------------------------------------------------
+static void http_task_handler(sched_events_t events)
+{
+    (void)events;
+
+    // The radio may be asleep until the next publish; if it does not wake
+    // up, the client asks again
+    sched_timer_stop(&radio_timer);
+    if (esp8266_power_wake() != ESP8266_OK)
+    {
+        return;
+    }
+
+    if (metrics_http_step() != 0)
+    {
+        sched_post(http_task, HTTP_EVT_SERVE);
+    }
+    else if (mqtt_connected != 0)
+    {
+        radio_sleep();
+    }
+}
+
+static void reconnect_task_handler(sched_events_t events)
+{
+    esp8266_status_t status;
+
+    (void)events;
+
+    if (mqtt_connected != 0)
+    {
+        return;
+    }
+
+    // The module may have been left asleep by the last publish
+    sched_timer_stop(&radio_timer);
+    esp8266_power_wake();
+
+    // By the cached address: no DNS lookup before each attempt
+    status = esp8266_mqtt_connect_cached(MQTT_BROKER, MQTT_PORT, 1);
+    if (status == ESP8266_OK)
+    {
+        status = esp8266_mqtt_subscribe("led/cmd", 1);
+    }
+    if (status == ESP8266_OK)
+    {
+        mqtt_connected = 1;
+        reconnect_backoff_ms = APP_RECONNECT_MIN_MS;
+        return;
+    }
+
+    // Busy module: the driver does not wait, try again shortly, same delay
+    if (status == ESP8266_BUSY)
+    {
+        METRIC_ADD(METRIC_BUSY_WAIT_MS, APP_BUSY_RETRY_MS);
+        sched_timer_start(&reconnect_timer, post_event, &reconnect_task, APP_BUSY_RETRY_MS, 0);
+        return;
+    }
+
+    // Retry later, doubling the delay each time
+    sched_timer_start(&reconnect_timer, post_event, &reconnect_task, reconnect_backoff_ms, 0);
+    if (reconnect_backoff_ms < APP_RECONNECT_MAX_MS)
+    {
+        reconnect_backoff_ms *= 2;
+    }
+}
+
+static void led_task_handler(sched_events_t events)
+{
+    (void)events;
+
+    // Several commands may have arrived since the last run, the latest wins
+    HAL_GPIO_WritePin(LD2_GPIO_Port, LD2_Pin, (led_request != 0) ? GPIO_PIN_SET : GPIO_PIN_RESET);
+
+    // Command-to-action latency: RX event interrupt -> LED written
+    if (led_request_cycles != 0)
+    {
+        metrics_observe(METRIC_HIST_CMD_LATENCY,
+                        (DWT->CYCCNT - led_request_cycles) / (SystemCoreClock / 1000000U));
+        led_request_cycles = 0;
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Timer callback posting the first event of the task pointed to by arg.
+//-----------------------------------------------------------------------------
+static void post_event(void* arg)
+{
+    sched_post(*(sched_task_id_t *)arg, 1U << 0);
+}
+
+static void post_radio_event(void* arg)
+{
+    (void)arg;
+    sched_post(app_task, APP_EVT_RADIO);
+}
+
+static void post_retry_event(void* arg)
+{
+    (void)arg;
+    sched_post(app_task, APP_EVT_RETRY);
+}
+
+static void housekeeping(void* arg)
+{
+    (void)arg;
+
+    // Push buffered log output to ITM / USART2
+    log_ring_drain();
+
+    // Duty cycle, energy and radio-on time per publish, once per POWER_REPORT_PERIOD_MS
+    power_update_metrics();
+    esp8266_power_update_metrics();
+}
+
+static void log_drain(void* arg)
+{
+    (void)arg;
+    log_ring_drain();
 }
+#endif /* !USE_FREERTOS */
@@ -0,0 +1,930 @@
+/*
+ * app_rtos.c
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+#if defined(USE_FREERTOS)
+
+/* Includes ------------------------------------------------------------------*/
+#include "app_rtos.h"
+#include "app.h"
+#include "at_builder.h"
+#include "at_scan.h"
+#include "esp8266_io.h"
+#include "esp8266_urc.h"
+#include "log_ring.h"
+#include "metrics.h"
+#include "main.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "queue.h"
+#include <stdio.h>
+#include <string.h>
+
+/* Private define ------------------------------------------------------------*/
+/* The RX task notifies the TX task with the tag of the command it completes
+   in the upper 24 bits, the esp8266_status_t in the lower 8 */
+#define COMMAND_TAG_MASK         0x00FFFFFFUL
+#define COMMAND_RESULT(tag, status) (((uint32_t)(tag) << 8) | (uint32_t)(status))
+#define COMMAND_RESULT_TAG(value)   ((value) >> 8)
+#define COMMAND_RESULT_STATUS(value) ((value) & 0xFFUL)
+
+/* Private typedef -----------------------------------------------------------*/
+/* A command for the TX task. The buffers belong to the requester, which is
+   blocked until the TX task notifies it with the esp8266_status_t result. */
+typedef struct {
+  const char*  data;
+  uint32_t     length;
+  const char*  final;          /* final line meaning success, e.g. "OK" */
+  const uint8_t* payload;      /* sent after the '>' prompt, NULL for none */
+  uint32_t     payload_length;
+  const char*  payload_final;  /* final line after the payload */
+  uint32_t     timeout_ms;
+  TaskHandle_t requester;
+  TickType_t   queued_at;
+} at_request_t;
+
+/* A line, '\0' terminated, or the payload of a message, any bytes */
+typedef struct {
+  uint8_t  message;
+  uint16_t length;
+  char     line[APP_RTOS_URC_LINE_SIZE];
+} urc_t;
+
+typedef struct {
+  const char*    name;
+  TaskFunction_t fn;
+  UBaseType_t    priority;
+  uint32_t       stack_words;
+  StackType_t*   stack;
+  StaticTask_t*  tcb;
+  TaskHandle_t   handle;
+} task_desc_t;
+
+/* Private function prototypes -----------------------------------------------*/
+static void rx_task_fn(void* arg);
+static void tx_task_fn(void* arg);
+static void urc_task_fn(void* arg);
+static void publish_task_fn(void* arg);
+static void monitor_task_fn(void* arg);
+static void rx_line_complete(const char* line);
+static void rx_message_complete(const esp8266_urc_t* message);
+static void urc_forward(const urc_t* urc);
+static uint8_t rx_command_line(const char* line);
+static void rx_command_complete(uint32_t tag, esp8266_status_t status);
+static esp8266_status_t submit(at_request_t* request);
+static uint32_t tx_exchange(const uint8_t* data, uint32_t length, const char* final, uint32_t timeout_ms);
+static BaseType_t tx_wait(uint32_t tag, uint32_t timeout_ms, uint32_t* status);
+static esp8266_status_t publish(char* cmd, const char* topic, const char* message, uint8_t qos);
+static esp8266_status_t reconnect(void);
+static void monitor_report(void);
+static void monitor_report_deadlines(void);
+static void nvic_config(void);
+
+/* Private variables ---------------------------------------------------------*/
+static StackType_t rx_stack[APP_RTOS_RX_STACK];
+static StackType_t tx_stack[APP_RTOS_TX_STACK];
+static StackType_t urc_stack[APP_RTOS_URC_STACK];
+static StackType_t publish_stack[APP_RTOS_PUBLISH_STACK];
+static StackType_t monitor_stack[APP_RTOS_MONITOR_STACK];
+static StaticTask_t rx_tcb;
+static StaticTask_t tx_tcb;
+static StaticTask_t urc_tcb;
+static StaticTask_t publish_tcb;
+static StaticTask_t monitor_tcb;
+
+static StackType_t idle_stack[configMINIMAL_STACK_SIZE];
+static StaticTask_t idle_tcb;
+
+static task_desc_t tasks[APP_RTOS_TASK_COUNT] = {
+  { "rx",      rx_task_fn,      APP_RTOS_RX_PRIORITY,      APP_RTOS_RX_STACK,      rx_stack,      &rx_tcb,      NULL },
+  { "tx",      tx_task_fn,      APP_RTOS_TX_PRIORITY,      APP_RTOS_TX_STACK,      tx_stack,      &tx_tcb,      NULL },
+  { "urc",     urc_task_fn,     APP_RTOS_URC_PRIORITY,     APP_RTOS_URC_STACK,     urc_stack,     &urc_tcb,     NULL },
+  { "publish", publish_task_fn, APP_RTOS_PUBLISH_PRIORITY, APP_RTOS_PUBLISH_STACK, publish_stack, &publish_tcb, NULL },
+  { "monitor", monitor_task_fn, APP_RTOS_MONITOR_PRIORITY, APP_RTOS_MONITOR_STACK, monitor_stack, &monitor_tcb, NULL },
+};
+#define rx_task   (tasks[0].handle)
+#define tx_task   (tasks[1].handle)
+
+static uint8_t tx_queue_storage[APP_RTOS_TX_QUEUE_LENGTH * sizeof(at_request_t)];
+static uint8_t urc_queue_storage[APP_RTOS_URC_QUEUE_LENGTH * sizeof(urc_t)];
+static StaticQueue_t tx_queue_buffer;
+static StaticQueue_t urc_queue_buffer;
+static QueueHandle_t tx_queue;
+static QueueHandle_t urc_queue;
+
+/* The command in flight: its final line, NULL when idle, and its tag, which
+   comes back with its result. The TX task sets them, the RX task clears the
+   final line, both in critical sections. After a timeout the command stays in
+   flight for APP_RTOS_LATE_ANSWER_MS, so that its late final line is taken
+   for it and not for the next command. */
+static const char* in_flight_final;
+static uint32_t in_flight_tag;
+static volatile uint32_t rx_event_cycles;
+static volatile uint8_t mqtt_connected;
+
+static char rx_frame[APP_RTOS_RX_FRAME_SIZE];
+static esp8266_urc_reader_t rx_reader;
+
+static app_rtos_stats_t stats;
+
+/* Lines the module sends on its own, between or during commands */
+static const char* const urc_prefixes[] = {
+  "+MQTTDISCONNECTED:",
+  "+MQTTCONNECTED:",
+  "WIFI DISCONNECT",
+  "WIFI GOT IP",
+};
+
+/* Exported functions -------------------------------------------------------*/
+
+/**
+  * @brief  Create the queues and the tasks, then start the kernel.
+  * @note   Called once the module is connected to the broker (bring-up uses
+  *         the blocking driver); it never returns.
+  * @retval None.
+  */
+void app_rtos_start(void)
+{
+  nvic_config();
+
+  tx_queue = xQueueCreateStatic(APP_RTOS_TX_QUEUE_LENGTH, sizeof(at_request_t), tx_queue_storage, &tx_queue_buffer);
+  urc_queue = xQueueCreateStatic(APP_RTOS_URC_QUEUE_LENGTH, sizeof(urc_t), urc_queue_storage, &urc_queue_buffer);
+
+  mqtt_connected = 1;
+  in_flight_final = NULL;
+  esp8266_urc_init(&rx_reader, rx_frame, sizeof(rx_frame));
+  memset(&stats, 0, sizeof(stats));
+
+  for (uint32_t i = 0; i < APP_RTOS_TASK_COUNT; i++)
+  {
+    tasks[i].handle = xTaskCreateStatic(tasks[i].fn, tasks[i].name, tasks[i].stack_words, NULL,
+                                        tasks[i].priority, tasks[i].stack, tasks[i].tcb);
+  }
+
+  vTaskStartScheduler();
+
+  /* Only reached if the idle task could not be created */
+  Error_Handler();
+}
+
+/**
+  * @brief  Run an AT command through the TX task. Blocks the calling task.
+  * @param  cmd: the command, CRLF included. Must stay valid until return.
+  * @param  length: its length.
+  * @param  final: final response line meaning success ("OK", "SEND OK", ">").
+  * @param  timeout_ms: maximum time between sending and the final line, 0
+  *         for the adaptive deadline of the command verb (esp8266_deadline_of()).
+  * @retval ESP8266_OK, ESP8266_ERROR on an ERROR/FAIL line, ESP8266_BUSY
+  *         when the module stayed busy, ESP8266_TIMEOUT, ESP8266_CANCELLED
+  *         after app_rtos_cancel(), ESP8266_QUEUE_FULL when the TX queue
+  *         stayed full for timeout_ms (nothing sent).
+  */
+esp8266_status_t app_rtos_at_command(const char* cmd, uint32_t length, const char* final, uint32_t timeout_ms)
+{
+  at_request_t request;
+
+  request.data = cmd;
+  request.length = length;
+  request.final = final;
+  request.payload = NULL;
+  request.payload_length = 0;
+  request.payload_final = NULL;
+  request.timeout_ms = timeout_ms;
+
+  return submit(&request);
+}
+
+/**
+  * @brief  Run an AT command answered by the '>' prompt, then send the data
+  *         (AT+MQTTPUBRAW, AT+CIPSEND). The TX task sends nothing else in
+  *         between. Blocks the calling task.
+  * @param  cmd: the command, CRLF included. Must stay valid until return.
+  * @param  length: its length.
+  * @param  data: the data, any bytes. Must stay valid until return.
+  * @param  data_length: its length, as announced in the command.
+  * @param  final: final response line after the data ("+MQTTPUB:OK", "SEND OK").
+  * @param  timeout_ms: maximum time for each of the two parts, 0 for the
+  *         adaptive deadline of the command verb.
+  * @retval As app_rtos_at_command().
+  */
+esp8266_status_t app_rtos_at_command_data(const char* cmd, uint32_t length, const uint8_t* data, uint32_t data_length,
+                                          const char* final, uint32_t timeout_ms)
+{
+  at_request_t request;
+
+  request.data = cmd;
+  request.length = length;
+  request.final = ">";
+  request.payload = data;
+  request.payload_length = data_length;
+  request.payload_final = final;
+  request.timeout_ms = timeout_ms;
+
+  return submit(&request);
+}
+
+/**
+  * @brief  Give up the command in flight: its requester gets
+  *         ESP8266_CANCELLED at once. Task context.
+  * @retval None.
+  */
+void app_rtos_cancel(void)
+{
+  rx_command_complete(in_flight_tag, ESP8266_CANCELLED);
+}
+
+/**
+  * @brief  Copy the RTOS application statistics.
+  * @param  s: destination.
+  * @retval None.
+  */
+void app_rtos_get_stats(app_rtos_stats_t* s)
+{
+  *s = stats;
+}
+
+/**
+  * @brief  Per-task stack size and high-water mark.
+  * @param  info: destination array.
+  * @param  max: its length.
+  * @retval Number of entries filled.
+  */
+uint32_t app_rtos_get_task_info(app_rtos_task_info_t* info, uint32_t max)
+{
+  uint32_t n = (max < APP_RTOS_TASK_COUNT) ? max : APP_RTOS_TASK_COUNT;
+
+  for (uint32_t i = 0; i < n; i++)
+  {
+    info[i].name = tasks[i].name;
+    info[i].stack_bytes = tasks[i].stack_words * sizeof(StackType_t);
+    info[i].unused_bytes = (tasks[i].handle != NULL) ?
+        (uint32_t)uxTaskGetStackHighWaterMark(tasks[i].handle) * sizeof(StackType_t) : 0;
+  }
+
+  return n;
+}
+
+/**
+  * @brief  UART RX event interrupt: wake up the RX task.
+  * @retval None.
+  */
+void esp8266_io_rx_event(void)
+{
+  BaseType_t woken = pdFALSE;
+
+  if (rx_task == NULL)
+  {
+    return;
+  }
+
+  if (rx_event_cycles == 0)
+  {
+    rx_event_cycles = DWT->CYCCNT | 1U;
+  }
+  vTaskNotifyGiveFromISR(rx_task, &woken);
+  portYIELD_FROM_ISR(woken);
+}
+
+/**
+  * @brief  Memory of the idle task (configSUPPORT_STATIC_ALLOCATION).
+  */
+void vApplicationGetIdleTaskMemory(StaticTask_t** tcb, StackType_t** stack, uint32_t* stack_words)
+{
+  *tcb = &idle_tcb;
+  *stack = idle_stack;
+  *stack_words = configMINIMAL_STACK_SIZE;
+}
+
+void vApplicationStackOverflowHook(TaskHandle_t task, char* name)
+{
+  (void)task;
+  (void)name;
+  Error_Handler();
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Queue a request for the TX task and wait for its result.
+  */
+static esp8266_status_t submit(at_request_t* request)
+{
+  uint32_t result;
+
+  if (request->timeout_ms == 0)
+  {
+    request->timeout_ms = esp8266_deadline_of((const uint8_t *)request->data, request->length, 0)->rto_ms;
+  }
+  request->requester = xTaskGetCurrentTaskHandle();
+  request->queued_at = xTaskGetTickCount();
+
+  /* The TX task answers each request once: nothing is pending here */
+  if (xQueueSend(tx_queue, request, pdMS_TO_TICKS(request->timeout_ms)) != pdPASS)
+  {
+    stats.queue_full++;
+    return ESP8266_QUEUE_FULL;
+  }
+  xTaskNotifyWait(0, 0xFFFFFFFFUL, &result, portMAX_DELAY);
+
+  return (esp8266_status_t)result;
+}
+
+/**
+  * @brief  Highest priority: owns the reception ring, splits it into lines,
+  *         completes the command in flight and forwards URCs.
+  */
+static void rx_task_fn(void* arg)
+{
+  uint32_t cycles_per_us = SystemCoreClock / 1000000U;
+  esp8266_urc_t urc;
+
+  (void)arg;
+
+  for (;;)
+  {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+    if (rx_event_cycles != 0)
+    {
+      uint32_t latency_us = (DWT->CYCCNT - rx_event_cycles) / cycles_per_us;
+
+      rx_event_cycles = 0;
+      metrics_observe(METRIC_HIST_DISPATCH_LATENCY, latency_us);
+      if (latency_us > stats.rx_wake_max_us)
+      {
+        stats.rx_wake_max_us = latency_us;
+      }
+    }
+    stats.rx_wakeups++;
+
+    /* A line at a time, a message by its length */
+    while (esp8266_urc_read(&rx_reader, &urc) != 0)
+    {
+      if (urc.type == ESP8266_URC_PROMPT)
+      {
+        /* The CIPSEND prompt is not followed by a line ending */
+        (void)rx_command_line(urc.line);
+      }
+      else if (urc.type == ESP8266_URC_SUBRECV)
+      {
+        rx_message_complete(&urc);
+      }
+      else
+      {
+        rx_line_complete(urc.line);
+      }
+    }
+  }
+}
+
+static void rx_line_complete(const char* line)
+{
+  if (rx_command_line(line) != 0)
+  {
+    return;
+  }
+
+  for (uint32_t i = 0; i < sizeof(urc_prefixes) / sizeof(urc_prefixes[0]); i++)
+  {
+    if (strncmp(line, urc_prefixes[i], strlen(urc_prefixes[i])) == 0)
+    {
+      urc_t urc;
+
+      urc.message = 0;
+      strncpy(urc.line, line, sizeof(urc.line) - 1);
+      urc.line[sizeof(urc.line) - 1] = '\0';
+      urc.length = (uint16_t)strlen(urc.line);
+      urc_forward(&urc);
+      return;
+    }
+  }
+
+  /* Anything else is an intermediate response line of the command */
+}
+
+/**
+  * @brief  A +MQTTSUBRECV payload, forwarded whole or not at all.
+  */
+static void rx_message_complete(const esp8266_urc_t* message)
+{
+  urc_t urc;
+
+  if ((message->truncated != 0) || (message->data_length > sizeof(urc.line)))
+  {
+    stats.message_drops++;
+    return;
+  }
+
+  urc.message = 1;
+  urc.length = (uint16_t)message->data_length;
+  memcpy(urc.line, message->data, message->data_length);
+  urc_forward(&urc);
+}
+
+static void urc_forward(const urc_t* urc)
+{
+  if (xQueueSend(urc_queue, urc, 0) == pdPASS)
+  {
+    stats.urcs++;
+  }
+  else
+  {
+    stats.urc_drops++;
+  }
+}
+
+/**
+  * @brief  Complete the command in flight if the line is its final line, or
+  *         an error or busy line.
+  * @retval 1 if the line completed it, 0 otherwise.
+  */
+static uint8_t rx_command_line(const char* line)
+{
+  const char* final;
+  uint32_t tag;
+  esp8266_status_t status;
+
+  taskENTER_CRITICAL();
+  final = in_flight_final;
+  tag = in_flight_tag;
+  taskEXIT_CRITICAL();
+
+  if (final == NULL)
+  {
+    return 0;
+  }
+
+  if (strcmp(line, final) == 0)
+  {
+    status = ESP8266_OK;
+  }
+  else if ((strcmp(line, "ERROR") == 0) || (strcmp(line, "FAIL") == 0) || (strcmp(line, "SEND FAIL") == 0))
+  {
+    status = ESP8266_ERROR;
+  }
+  else if (strncmp(line, AT_BUSY_STRING, sizeof(AT_BUSY_STRING) - 1U) == 0)
+  {
+    status = ESP8266_BUSY;
+  }
+  else
+  {
+    return 0;
+  }
+
+  rx_command_complete(tag, status);
+  return 1;
+}
+
+/**
+  * @brief  Hand the result to the TX task, unless the command tagged tag is
+  *         no longer in flight.
+  */
+static void rx_command_complete(uint32_t tag, esp8266_status_t status)
+{
+  taskENTER_CRITICAL();
+  if ((in_flight_final != NULL) && (in_flight_tag == tag))
+  {
+    in_flight_final = NULL;
+    xTaskNotify(tx_task, COMMAND_RESULT(tag, status), eSetValueWithOverwrite);
+  }
+  taskEXIT_CRITICAL();
+}
+
+/**
+  * @brief  Owns the command channel: one command in flight at a time.
+  */
+static void tx_task_fn(void* arg)
+{
+  at_request_t request;
+
+  (void)arg;
+
+  for (;;)
+  {
+    uint32_t result;
+    uint32_t attempt = 0;
+    TickType_t sent_at;
+    uint32_t elapsed_ms;
+
+    xQueueReceive(tx_queue, &request, portMAX_DELAY);
+
+    elapsed_ms = (xTaskGetTickCount() - request.queued_at) * portTICK_PERIOD_MS;
+    if (elapsed_ms > stats.queue_wait_max_ms)
+    {
+      stats.queue_wait_max_ms = elapsed_ms;
+    }
+
+    while (1)
+    {
+      sent_at = xTaskGetTickCount();
+      result = tx_exchange((const uint8_t *)request.data, request.length, request.final, request.timeout_ms);
+
+      /* Busy with the previous command: this one was dropped, sent again
+         after a pause doubling each time, ahead of the queued requests */
+      if ((result != ESP8266_BUSY) || (attempt >= ESP8266_BUSY_RETRIES))
+      {
+        break;
+      }
+      elapsed_ms = ESP8266_BUSY_BACKOFF_MS << attempt++;
+      stats.busy++;
+      stats.busy_wait_ms += elapsed_ms;
+      METRIC_INC(METRIC_AT_BUSY);
+      METRIC_ADD(METRIC_BUSY_WAIT_MS, elapsed_ms);
+      vTaskDelay(pdMS_TO_TICKS(elapsed_ms));
+    }
+
+    /* The data after the prompt, no other command in between */
+    if ((result == ESP8266_OK) && (request.payload != NULL))
+    {
+      result = tx_exchange(request.payload, request.payload_length, request.payload_final, request.timeout_ms);
+    }
+
+    if (result == ESP8266_BUSY)
+    {
+      stats.busy++;
+      METRIC_INC(METRIC_AT_BUSY);
+    }
+    else if ((result != ESP8266_OK) && (result != ESP8266_CANCELLED) && (result != ESP8266_TIMEOUT))
+    {
+      stats.command_errors++;
+      METRIC_INC(METRIC_AT_ERRORS);
+    }
+
+    elapsed_ms = (xTaskGetTickCount() - sent_at) * portTICK_PERIOD_MS;
+    if (elapsed_ms > stats.command_max_ms)
+    {
+      stats.command_max_ms = elapsed_ms;
+    }
+    if (result == ESP8266_OK)
+    {
+      esp8266_deadline_sample(esp8266_deadline_of((const uint8_t *)request.data, request.length, 0), elapsed_ms);
+    }
+    else if (result != ESP8266_BUSY)
+    {
+      esp8266_deadline_failed(esp8266_deadline_of((const uint8_t *)request.data, request.length, 0),
+                              (esp8266_status_t)result, elapsed_ms);
+    }
+    stats.commands++;
+
+    xTaskNotify(request.requester, result, eSetValueWithOverwrite);
+  }
+}
+
+/**
+  * @brief  Send one part of a command and wait for its result.
+  * @retval The esp8266_status_t result.
+  */
+static uint32_t tx_exchange(const uint8_t* data, uint32_t length, const char* final, uint32_t timeout_ms)
+{
+  uint32_t result;
+  uint32_t tag;
+
+  /* Still in flight: the previous command timed out, its final line may
+     be on the way */
+  if (in_flight_final != NULL)
+  {
+    if (tx_wait(in_flight_tag, APP_RTOS_LATE_ANSWER_MS, &result) != pdFALSE)
+    {
+      stats.late_answers++;
+    }
+    taskENTER_CRITICAL();
+    in_flight_final = NULL;
+    taskEXIT_CRITICAL();
+  }
+
+  taskENTER_CRITICAL();
+  in_flight_tag = (in_flight_tag + 1U) & COMMAND_TAG_MASK;
+  tag = in_flight_tag;
+  in_flight_final = final;
+  taskEXIT_CRITICAL();
+
+  if (esp8266_io_send((uint8_t *)data, length) < 0)
+  {
+    taskENTER_CRITICAL();
+    in_flight_final = NULL;
+    taskEXIT_CRITICAL();
+    return ESP8266_IO_ERROR;
+  }
+
+  if (tx_wait(tag, timeout_ms, &result) == pdFALSE)
+  {
+    stats.command_timeouts++;
+    METRIC_INC(METRIC_AT_TIMEOUTS);
+    return ESP8266_TIMEOUT;
+  }
+
+  return result;
+}
+
+/**
+  * @brief  Wait for the result of the command tagged tag. The results of
+  *         other tags, late answers, are dropped.
+  * @retval pdTRUE with *status set, pdFALSE on the timeout.
+  */
+static BaseType_t tx_wait(uint32_t tag, uint32_t timeout_ms, uint32_t* status)
+{
+  TickType_t start = xTaskGetTickCount();
+  TickType_t wait = pdMS_TO_TICKS(timeout_ms);
+  TickType_t elapsed = 0;
+  uint32_t value;
+
+  while (xTaskNotifyWait(0, 0xFFFFFFFFUL, &value, wait - elapsed) == pdTRUE)
+  {
+    if (COMMAND_RESULT_TAG(value) == tag)
+    {
+      *status = COMMAND_RESULT_STATUS(value);
+      return pdTRUE;
+    }
+    stats.late_answers++;
+
+    elapsed = xTaskGetTickCount() - start;
+    if (elapsed >= wait)
+    {
+      break;
+    }
+  }
+
+  return pdFALSE;
+}
+
+/**
+  * @brief  Acts on "LED ON" / "LED OFF" messages and broker disconnections.
+  */
+static void urc_task_fn(void* arg)
+{
+  static urc_t urc;
+
+  (void)arg;
+
+  for (;;)
+  {
+    xQueueReceive(urc_queue, &urc, portMAX_DELAY);
+
+    if (urc.message != 0)
+    {
+      /* Compared by length: the payload may hold any byte */
+      if ((urc.length == 6U) && (memcmp(urc.line, "LED ON", 6) == 0))
+      {
+        HAL_GPIO_WritePin(LD2_GPIO_Port, LD2_Pin, GPIO_PIN_SET);
+      }
+      else if ((urc.length == 7U) && (memcmp(urc.line, "LED OFF", 7) == 0))
+      {
+        HAL_GPIO_WritePin(LD2_GPIO_Port, LD2_Pin, GPIO_PIN_RESET);
+      }
+    }
+    else if (strncmp(urc.line, "+MQTTDISCONNECTED:", 18) == 0)
+    {
+      mqtt_connected = 0;
+    }
+  }
+}
+
+/**
+  * @brief  Periodic publish; reconnects with an exponential backoff.
+  */
+static void publish_task_fn(void* arg)
+{
+  static char cmd[MAX_AT_CMD_SIZE];
+  static char message[32];
+  TickType_t last_wake = xTaskGetTickCount();
+  uint32_t backoff_ms = APP_RECONNECT_MIN_MS;
+  uint32_t counter = 0;
+  uint8_t busy = 0;
+
+  (void)arg;
+
+  for (;;)
+  {
+    at_builder_t text;
+    TickType_t start;
+    esp8266_status_t result;
+
+    if (busy != 0)
+    {
+      vTaskDelay(pdMS_TO_TICKS(APP_BUSY_RETRY_MS));
+    }
+    else
+    {
+      vTaskDelayUntil(&last_wake, pdMS_TO_TICKS(APP_RTOS_PUBLISH_PERIOD_MS));
+    }
+    busy = 0;
+
+    if (mqtt_connected == 0)
+    {
+      if (reconnect() == ESP8266_OK)
+      {
+        mqtt_connected = 1;
+        backoff_ms = APP_RECONNECT_MIN_MS;
+        METRIC_INC(METRIC_RECONNECTS);
+      }
+      else
+      {
+        vTaskDelay(pdMS_TO_TICKS(backoff_ms));
+        backoff_ms = (backoff_ms < APP_RECONNECT_MAX_MS) ? (backoff_ms * 2) : backoff_ms;
+        last_wake = xTaskGetTickCount();
+      }
+      continue;
+    }
+
+    at_builder_init(&text, message, sizeof(message));
+    at_builder_lit(&text, "hello aws! Count: ");
+    at_builder_uint(&text, counter);
+    (void)at_builder_finish(&text);
+    start = xTaskGetTickCount();
+
+    result = publish(cmd, "topic/esp32at", message, 1);
+    if (result == ESP8266_OK)
+    {
+      counter++;
+      METRIC_INC(METRIC_PUBLISHES);
+      metrics_observe(METRIC_HIST_PUBLISH_LATENCY, (xTaskGetTickCount() - start) * portTICK_PERIOD_MS);
+    }
+    else if ((result == ESP8266_BUSY) || (result == ESP8266_QUEUE_FULL))
+    {
+      /* Still busy after the resends, or the TX queue full: the same
+         message again shortly, the session is fine */
+      busy = 1;
+      stats.busy_wait_ms += APP_BUSY_RETRY_MS;
+      METRIC_ADD(METRIC_BUSY_WAIT_MS, APP_BUSY_RETRY_MS);
+    }
+    else
+    {
+      mqtt_connected = 0;
+    }
+  }
+}
+
+static esp8266_status_t reconnect(void)
+{
+  static const char sub_cmd[] = "AT+MQTTSUB=0,\"led/cmd\",1\r\n";
+  static char cmd[MAX_AT_CMD_SIZE];
+  at_builder_t conn;
+  esp8266_status_t ret;
+
+  at_builder_init(&conn, cmd, sizeof(cmd));
+  at_builder_lit(&conn, "AT+MQTTCONN=0,");
+  at_builder_quoted(&conn, MQTT_BROKER);
+  at_builder_char(&conn, ',');
+  at_builder_uint(&conn, MQTT_PORT);
+  at_builder_lit(&conn, ",1\r\n");
+  ret = app_rtos_at_command(cmd, (uint32_t)at_builder_finish(&conn), "OK", APP_RTOS_CMD_TIMEOUT_MS);
+  if (ret != ESP8266_OK)
+  {
+    return ret;
+  }
+
+  return app_rtos_at_command(sub_cmd, sizeof(sub_cmd) - 1U, "OK", APP_RTOS_CMD_TIMEOUT_MS);
+}
+
+/**
+  * @brief  Lowest priority: drains the log ring, reports the task stacks and
+  *         latencies, and publishes the metrics.
+  */
+static void monitor_task_fn(void* arg)
+{
+  TickType_t last_wake = xTaskGetTickCount();
+  TickType_t last_report = last_wake;
+
+  (void)arg;
+
+  for (;;)
+  {
+    vTaskDelayUntil(&last_wake, pdMS_TO_TICKS(APP_RTOS_LOG_DRAIN_PERIOD_MS));
+    log_ring_drain();
+
+    if ((last_wake - last_report) >= pdMS_TO_TICKS(APP_RTOS_MONITOR_PERIOD_MS))
+    {
+      last_report = last_wake;
+      monitor_report();
+    }
+  }
+}
+
+/**
+  * @brief  The verbs that failed, with how long the failures took to show.
+  */
+static void monitor_report_deadlines(void)
+{
+  uint32_t count;
+  const esp8266_deadline_t* d = esp8266_deadline_table(&count);
+
+  for (uint32_t i = 0; i < count; i++)
+  {
+    if (d[i].failures != 0)
+    {
+      printf("verb %-9s deadline %5lu ms (srtt %lu ms), %lu failed, detected in %lu ms (max %lu ms)\r\n",
+             esp8266_deadline_label(&d[i]),
+             (unsigned long)d[i].rto_ms, (unsigned long)(d[i].srtt_x8 / 8U), (unsigned long)d[i].failures,
+             (unsigned long)d[i].fail_latency_last_ms, (unsigned long)d[i].fail_latency_max_ms);
+    }
+  }
+}
+
+static void monitor_report(void)
+{
+  static metrics_snapshot_t snapshot;
+  static char payload[METRICS_MAX_ENCODED_SIZE];
+  static char cmd[MAX_AT_CMD_SIZE];
+  app_rtos_task_info_t info[APP_RTOS_TASK_COUNT];
+  uint32_t n = app_rtos_get_task_info(info, APP_RTOS_TASK_COUNT);
+
+  for (uint32_t i = 0; i < n; i++)
+  {
+    printf("task %-8s stack %4lu B, unused %4lu B\r\n", info[i].name,
+           (unsigned long)info[i].stack_bytes, (unsigned long)info[i].unused_bytes);
+  }
+  printf("rx wake max %lu us, queue wait max %lu ms, command max %lu ms, %lu cmds, %lu err, %lu tmo, %lu urc (%lu dropped, %lu messages too long)\r\n",
+         (unsigned long)stats.rx_wake_max_us, (unsigned long)stats.queue_wait_max_ms,
+         (unsigned long)stats.command_max_ms, (unsigned long)stats.commands,
+         (unsigned long)stats.command_errors, (unsigned long)stats.command_timeouts,
+         (unsigned long)stats.urcs, (unsigned long)stats.urc_drops, (unsigned long)stats.message_drops);
+  printf("busy %lu, waited %lu ms before resending, %lu late answers, %lu queue full\r\n",
+         (unsigned long)stats.busy, (unsigned long)stats.busy_wait_ms,
+         (unsigned long)stats.late_answers, (unsigned long)stats.queue_full);
+  monitor_report_deadlines();
+
+  if (mqtt_connected == 0)
+  {
+    return;
+  }
+
+  metrics_snapshot(&snapshot);
+  if (metrics_encode(&snapshot, payload, sizeof(payload)) < 0)
+  {
+    METRIC_INC(METRIC_ENCODE_FAILURES);
+    return;
+  }
+  (void)publish(cmd, MQTT_CLIENT_ID METRICS_TOPIC_SUFFIX, payload, 0);
+}
+
+/**
+  * @brief  Publish through the TX task as esp8266_mqtt_publish() does: with
+  *         AT+MQTTPUB when the message needs no escaping and the line fits
+  *         in MAX_MQTTPUB_CMD_SIZE, with AT+MQTTPUBRAW otherwise.
+  * @param  cmd: the caller's buffer for the command, MAX_AT_CMD_SIZE bytes.
+  * @retval As app_rtos_at_command().
+  */
+static esp8266_status_t publish(char* cmd, const char* topic, const char* message, uint8_t qos)
+{
+  at_builder_t pub;
+  uint32_t length = at_scan_str(message, &at_scan_escape);
+  int32_t header;
+
+  if (message[length] == '\0')
+  {
+    at_builder_init(&pub, cmd, MAX_AT_CMD_SIZE);
+    at_builder_lit(&pub, "AT+MQTTPUB=0,");
+    at_builder_quoted(&pub, topic);
+    at_builder_lit(&pub, ",\"");
+    at_builder_mem(&pub, message, length);
+    at_builder_lit(&pub, "\",");
+    at_builder_uint(&pub, qos);
+    at_builder_lit(&pub, ",0\r\n");
+    if ((at_builder_finish(&pub) > 0) && (pub.length <= MAX_MQTTPUB_CMD_SIZE))
+    {
+      return app_rtos_at_command(cmd, pub.length, "OK", APP_RTOS_CMD_TIMEOUT_MS);
+    }
+  }
+  else
+  {
+    length = (uint32_t)strlen(message);
+  }
+
+  at_builder_init(&pub, cmd, MAX_AT_CMD_SIZE);
+  at_builder_lit(&pub, "AT+MQTTPUBRAW=0,");
+  at_builder_quoted(&pub, topic);
+  at_builder_char(&pub, ',');
+  at_builder_uint(&pub, length);
+  at_builder_char(&pub, ',');
+  at_builder_uint(&pub, qos);
+  at_builder_lit(&pub, ",0\r\n");
+  header = at_builder_finish(&pub);
+  if (header < 0)
+  {
+    return ESP8266_ERROR;
+  }
+
+  return app_rtos_at_command_data(cmd, (uint32_t)header, (const uint8_t *)message, length,
+                                  AT_MQTTPUB_OK_STRING, APP_RTOS_CMD_TIMEOUT_MS);
+}
+
+/**
+  * @brief  FreeRTOS needs 4 bits of preemption priority, and the interrupts
+  *         calling ...FromISR() functions below configMAX_SYSCALL_INTERRUPT_PRIORITY.
+  */
+static void nvic_config(void)
+{
+#if !defined(HOST_BUILD)
+  HAL_NVIC_SetPriorityGrouping(NVIC_PRIORITYGROUP_4);
+  HAL_NVIC_SetPriority(UART4_IRQn, configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY + 1, 0);
+  HAL_NVIC_SetPriority(DMA1_Stream2_IRQn, configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY + 1, 0);
+  HAL_NVIC_SetPriority(DMA1_Stream4_IRQn, configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY + 1, 0);
+  HAL_NVIC_SetPriority(USART2_IRQn, configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY + 2, 0);
+  HAL_NVIC_SetPriority(DMA1_Stream6_IRQn, configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY + 2, 0);
+#endif
+}
+
+#endif /* USE_FREERTOS */
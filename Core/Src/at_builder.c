@@ -0,0 +1,242 @@
+/*
+ * at_builder.c
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "at_builder.h"
+#include "at_scan.h"
+#include <string.h>
+
+/* Exported functions -------------------------------------------------------*/
+
+/**
+  * @brief  Start an empty command in buf.
+  * @param  b: the builder.
+  * @param  buf: the TX buffer.
+  * @param  size: its size, one byte is kept for the terminating '\0'.
+  * @retval None.
+  */
+void at_builder_init(at_builder_t* b, char* buf, uint32_t size)
+{
+  b->buf = buf;
+  b->size = size;
+  b->length = 0;
+  b->overflow = (size == 0) ? 1U : 0U;
+}
+
+/**
+  * @brief  Append length bytes as they are.
+  * @param  b: the builder.
+  * @param  data: the bytes.
+  * @param  length: their count.
+  * @retval None.
+  */
+void at_builder_mem(at_builder_t* b, const char* data, uint32_t length)
+{
+  if ((b->overflow != 0) || (length >= (b->size - b->length)))
+  {
+    b->overflow = 1;
+    return;
+  }
+
+  memcpy(&b->buf[b->length], data, length);
+  b->length += length;
+}
+
+/**
+  * @brief  Append a '\0' terminated string as it is.
+  * @param  b: the builder.
+  * @param  s: the string.
+  * @retval None.
+  */
+void at_builder_str(at_builder_t* b, const char* s)
+{
+  char* out;
+  char* end;
+
+  if (b->overflow != 0)
+  {
+    return;
+  }
+
+  /* Copy and measure in one pass */
+  out = &b->buf[b->length];
+  end = &b->buf[b->size - 1U];
+  while (*s != '\0')
+  {
+    if (out == end)
+    {
+      b->overflow = 1;
+      return;
+    }
+    *out++ = *s++;
+  }
+  b->length = (uint32_t)(out - b->buf);
+}
+
+/**
+  * @brief  Append one character.
+  * @param  b: the builder.
+  * @param  c: the character.
+  * @retval None.
+  */
+void at_builder_char(at_builder_t* b, char c)
+{
+  if ((b->overflow != 0) || ((b->length + 1U) >= b->size))
+  {
+    b->overflow = 1;
+    return;
+  }
+
+  b->buf[b->length++] = c;
+}
+
+/**
+  * @brief  Append a string parameter between double quotes. The characters
+  *         ESP-AT gives a meaning to in a parameter (" , \) are escaped with
+  *         a backslash.
+  * @param  b: the builder.
+  * @param  s: the string.
+  * @retval None.
+  */
+void at_builder_quoted(at_builder_t* b, const char* s)
+{
+  at_builder_char(b, '"');
+  at_builder_escaped(b, s);
+  at_builder_char(b, '"');
+}
+
+/**
+  * @brief  Append the inside of a quoted parameter: s with " , \ escaped.
+  * @param  b: the builder.
+  * @param  s: the string.
+  * @retval None.
+  */
+void at_builder_escaped(at_builder_t* b, const char* s)
+{
+  char* out;
+  char* end;
+  char c;
+
+  if (b->overflow != 0)
+  {
+    return;
+  }
+
+  /* Copy, escape and measure in one pass. Local pointers: stores through a
+     char pointer could alias b->length and force a reload per byte. */
+  out = &b->buf[b->length];
+  end = &b->buf[b->size - 1U];
+  while (1)
+  {
+    /* Aligned words with nothing to escape nor the terminator are copied
+       whole; an aligned load never crosses the end of the memory s is in */
+    if ((((uintptr_t)s & 3U) == 0) && ((end - out) >= 4))
+    {
+      uint32_t word;
+
+      memcpy(&word, s, sizeof(word));
+      if ((at_scan_zero_bytes(word) |
+           at_scan_zero_bytes(word ^ AT_SCAN_REPEAT('"')) |
+           at_scan_zero_bytes(word ^ AT_SCAN_REPEAT(',')) |
+           at_scan_zero_bytes(word ^ AT_SCAN_REPEAT('\\'))) == 0)
+      {
+        memcpy(out, &word, sizeof(word));
+        out += 4;
+        s += 4;
+        continue;
+      }
+    }
+
+    if ((c = *s++) == '\0')
+    {
+      break;
+    }
+    if ((c == '"') || (c == ',') || (c == '\\'))
+    {
+      if (out == end)
+      {
+        b->overflow = 1;
+        return;
+      }
+      *out++ = '\\';
+    }
+    if (out == end)
+    {
+      b->overflow = 1;
+      return;
+    }
+    *out++ = c;
+  }
+  b->length = (uint32_t)(out - b->buf);
+}
+
+/**
+  * @brief  Append an unsigned decimal.
+  * @param  b: the builder.
+  * @param  value: the number.
+  * @retval None.
+  */
+void at_builder_uint(at_builder_t* b, uint32_t value)
+{
+  char digits[10];
+  uint32_t n = sizeof(digits);
+
+  /* Least significant digit first, from the end */
+  do
+  {
+    digits[--n] = (char)('0' + (value % 10U));
+    value /= 10U;
+  } while (value != 0);
+
+  at_builder_mem(b, &digits[n], sizeof(digits) - n);
+}
+
+/**
+  * @brief  Append a signed decimal.
+  * @param  b: the builder.
+  * @param  value: the number.
+  * @retval None.
+  */
+void at_builder_int(at_builder_t* b, int32_t value)
+{
+  if (value < 0)
+  {
+    at_builder_char(b, '-');
+    /* In unsigned arithmetic: -INT32_MIN does not fit an int32_t */
+    at_builder_uint(b, 0U - (uint32_t)value);
+  }
+  else
+  {
+    at_builder_uint(b, (uint32_t)value);
+  }
+}
+
+/**
+  * @brief  Append the command terminator.
+  * @param  b: the builder.
+  * @retval None.
+  */
+void at_builder_crlf(at_builder_t* b)
+{
+  at_builder_mem(b, "\r\n", 2);
+}
+
+/**
+  * @brief  Terminate the command with '\0' (not counted in its length).
+  * @param  b: the builder.
+  * @retval The command length, -1 if it did not fit.
+  */
+int32_t at_builder_finish(at_builder_t* b)
+{
+  if (b->overflow != 0)
+  {
+    return -1;
+  }
+
+  b->buf[b->length] = '\0';
+  return (int32_t)b->length;
+}
@@ -0,0 +1,238 @@
+/*
+ * at_parse.c
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "at_parse.h"
+#include "at_scan.h"
+#include <string.h>
+
+/* Private variables ---------------------------------------------------------*/
+static const at_scan_set_t field_end = {
+    { AT_SCAN_REPEAT(',') }, 1
+};
+
+static const at_scan_set_t quote_end = {
+    { AT_SCAN_REPEAT('"'), AT_SCAN_REPEAT('\\') }, 2
+};
+
+/* Private function prototypes -----------------------------------------------*/
+static void set_field(at_field_t* field, const char* ptr, uint32_t length, uint8_t quoted);
+static void split_fields(const char* p, const char* end, at_line_t* line);
+
+/* Exported functions -------------------------------------------------------*/
+
+/**
+  * @brief  Split one response line into its verb and fields.
+  * @param  data: the line, with or without its CRLF; not modified and not
+  *         '\0' terminated. The slices of line point into it.
+  * @param  length: its size.
+  * @param  line: the result.
+  * @retval None.
+  */
+void at_parse_line(const char* data, uint32_t length, at_line_t* line)
+{
+  const char* end;
+  const char* colon;
+
+  /* Without the CRLF */
+  while ((length != 0) && ((data[length - 1U] == '\n') || (data[length - 1U] == '\r')))
+  {
+    length--;
+  }
+  end = &data[length];
+
+  set_field(&line->text, data, length, 0);
+  set_field(&line->verb, data, 0, 0);
+  line->count = 0;
+  line->truncated = 0;
+
+  colon = (const char *)memchr(data, ':', length);
+  if (colon == NULL)
+  {
+    /* Plain text: the line is its only field */
+    if (length != 0)
+    {
+      set_field(&line->field[line->count++], data, length, 0);
+    }
+    return;
+  }
+
+  if (data[0] == '+')
+  {
+    set_field(&line->verb, &data[1], (uint32_t)(colon - data) - 1U, 0);
+    split_fields(colon + 1, end, line);
+  }
+  else
+  {
+    /* <name>:<value>, the value as it is */
+    set_field(&line->verb, data, (uint32_t)(colon - data), 0);
+    set_field(&line->field[line->count++], colon + 1, (uint32_t)(end - colon) - 1U, 0);
+  }
+}
+
+/**
+  * @brief  Tell whether the verb of a line is verb.
+  * @param  line: a parsed line.
+  * @param  verb: "CIFSR" for +CIFSR: lines.
+  * @retval 1 when it is, 0 otherwise.
+  */
+uint8_t at_line_is(const at_line_t* line, const char* verb)
+{
+  return at_field_equals(&line->verb, verb);
+}
+
+/**
+  * @brief  Compare a field with a string, byte for byte (escapes included).
+  * @param  field: the field.
+  * @param  s: '\0' terminated string.
+  * @retval 1 when equal, 0 otherwise.
+  */
+uint8_t at_field_equals(const at_field_t* field, const char* s)
+{
+  return ((strlen(s) == field->length) && (memcmp(field->ptr, s, field->length) == 0)) ? 1U : 0U;
+}
+
+/**
+  * @brief  Read a field as a signed decimal. A quoted number ("8883") is
+  *         accepted.
+  * @param  field: the field.
+  * @param  value: the number.
+  * @retval 0 on success, -1 when the field is empty, not a number or too large.
+  */
+int8_t at_field_int(const at_field_t* field, int32_t* value)
+{
+  const char* p = field->ptr;
+  const char* end = &field->ptr[field->length];
+  uint32_t magnitude = 0;
+  uint8_t negative = 0;
+
+  if ((p != end) && ((*p == '-') || (*p == '+')))
+  {
+    negative = (*p++ == '-') ? 1U : 0U;
+  }
+  if (p == end)
+  {
+    return -1;
+  }
+
+  for (; p != end; p++)
+  {
+    uint32_t digit = (uint32_t)(uint8_t)*p - '0';
+
+    if ((digit > 9U) || (magnitude > ((0x7FFFFFFFU - digit) / 10U)))
+    {
+      return -1;
+    }
+    magnitude = (magnitude * 10U) + digit;
+  }
+
+  *value = (negative != 0) ? -(int32_t)magnitude : (int32_t)magnitude;
+  return 0;
+}
+
+/**
+  * @brief  Copy a field as a '\0' terminated string, escapes removed. The
+  *         only copy of the parser, for the caller's buffers.
+  * @param  field: the field.
+  * @param  dst: the destination.
+  * @param  size: its size, the copy is truncated to size - 1 characters.
+  * @retval The length copied.
+  */
+uint32_t at_field_copy(const at_field_t* field, char* dst, uint32_t size)
+{
+  const char* p = field->ptr;
+  const char* end = &field->ptr[field->length];
+  uint32_t n = 0;
+
+  if (size == 0)
+  {
+    return 0;
+  }
+
+  while ((p != end) && ((n + 1U) < size))
+  {
+    if ((field->quoted != 0) && (*p == '\\') && ((p + 1) != end))
+    {
+      p++;
+    }
+    dst[n++] = *p++;
+  }
+  dst[n] = '\0';
+
+  return n;
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+static void set_field(at_field_t* field, const char* ptr, uint32_t length, uint8_t quoted)
+{
+  field->ptr = ptr;
+  field->length = (length > 0xFFFFU) ? 0xFFFFU : (uint16_t)length;
+  field->quoted = quoted;
+}
+
+/**
+  * @brief  Split a comma separated list, "(...)" of +CWLAP included. A comma
+  *         or an escaped quote inside a quoted field does not end it.
+  */
+static void split_fields(const char* p, const char* end, at_line_t* line)
+{
+  if ((p != end) && (*p == '(') && (end[-1] == ')'))
+  {
+    p++;
+    end--;
+  }
+
+  while (1)
+  {
+    at_field_t* field;
+    uint32_t n;
+
+    if (line->count == AT_PARSE_MAX_FIELDS)
+    {
+      line->truncated = 1;
+      return;
+    }
+    field = &line->field[line->count++];
+
+    if ((p != end) && (*p == '"'))
+    {
+      const char* start = ++p;
+
+      /* Closing quote, skipping the escaped characters */
+      while (1)
+      {
+        p += at_scan((const uint8_t *)p, (uint32_t)(end - p), &quote_end);
+        if ((p == end) || (*p == '"'))
+        {
+          break;
+        }
+        p += ((p + 1) != end) ? 2 : 1;
+      }
+      set_field(field, start, (uint32_t)(p - start), 1);
+      if (p != end)
+      {
+        p++;
+      }
+
+      /* Up to the separator, whatever follows the quote */
+      p += at_scan((const uint8_t *)p, (uint32_t)(end - p), &field_end);
+    }
+    else
+    {
+      n = at_scan((const uint8_t *)p, (uint32_t)(end - p), &field_end);
+      set_field(field, p, n, 0);
+      p += n;
+    }
+
+    if (p == end)
+    {
+      return;
+    }
+    p++;
+  }
+}
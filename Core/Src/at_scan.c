@@ -0,0 +1,131 @@
+/*
+ * at_scan.c
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "at_scan.h"
+#include <string.h>
+
+/* Exported variables --------------------------------------------------------*/
+const at_scan_set_t at_scan_line = {
+    { AT_SCAN_REPEAT('\n'), AT_SCAN_REPEAT('>') }, 2
+};
+
+const at_scan_set_t at_scan_eol = {
+    { AT_SCAN_REPEAT('\n') }, 1
+};
+
+const at_scan_set_t at_scan_escape = {
+    { AT_SCAN_REPEAT('"'), AT_SCAN_REPEAT(','), AT_SCAN_REPEAT('\\') }, 3
+};
+
+/* Private function prototypes -----------------------------------------------*/
+static inline uint8_t match_byte(uint8_t c, const at_scan_set_t* set);
+
+/* Exported functions -------------------------------------------------------*/
+
+/**
+  * @brief  Fill a set from a string of up to AT_SCAN_MAX_CHARS characters.
+  * @param  set: the set.
+  * @param  chars: its characters, extra ones are ignored.
+  * @retval None.
+  */
+void at_scan_set_init(at_scan_set_t* set, const char* chars)
+{
+  set->count = 0;
+  while ((*chars != '\0') && (set->count < AT_SCAN_MAX_CHARS))
+  {
+    set->pattern[set->count++] = AT_SCAN_REPEAT(*chars++);
+  }
+}
+
+/**
+  * @brief  Find the first byte of data that belongs to set.
+  * @param  data: the bytes, any alignment.
+  * @param  length: their count.
+  * @param  set: the characters searched for.
+  * @retval Index of the first match, length if there is none.
+  */
+uint32_t at_scan(const uint8_t* data, uint32_t length, const at_scan_set_t* set)
+{
+  uint32_t i;
+
+  for (i = 0; (i + 4U) <= length; i += 4U)
+  {
+    uint32_t word;
+    uint32_t mask;
+
+    /* A single LDR: the M4 loads unaligned words */
+    memcpy(&word, &data[i], sizeof(word));
+    mask = at_scan_mask(word, set);
+    if (mask != 0)
+    {
+      /* Little endian: the first byte in memory is the least significant */
+      return i + ((uint32_t)__builtin_ctz(mask) >> 3);
+    }
+  }
+
+  for (; i < length; i++)
+  {
+    if (match_byte(data[i], set) != 0)
+    {
+      return i;
+    }
+  }
+
+  return length;
+}
+
+/**
+  * @brief  Find the first character of s that belongs to set, as strcspn().
+  * @details Byte by byte up to a word boundary, then whole aligned words: an
+  *          aligned word never crosses the end of the memory s lives in, even
+  *          when it reads past the terminator.
+  * @param  s: '\0' terminated string.
+  * @param  set: the characters searched for.
+  * @retval Index of the first match, or the length of s if there is none.
+  */
+uint32_t at_scan_str(const char* s, const at_scan_set_t* set)
+{
+  const char* p = s;
+
+  while (((uintptr_t)p & 3U) != 0)
+  {
+    if ((*p == '\0') || (match_byte((uint8_t)*p, set) != 0))
+    {
+      return (uint32_t)(p - s);
+    }
+    p++;
+  }
+
+  while (1)
+  {
+    uint32_t word;
+    uint32_t mask;
+
+    memcpy(&word, p, sizeof(word));
+    mask = at_scan_zero_bytes(word) | at_scan_mask(word, set);
+    if (mask != 0)
+    {
+      return (uint32_t)(p - s) + ((uint32_t)__builtin_ctz(mask) >> 3);
+    }
+    p += 4;
+  }
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+static inline uint8_t match_byte(uint8_t c, const at_scan_set_t* set)
+{
+  for (uint8_t i = 0; i < set->count; i++)
+  {
+    if (c == (uint8_t)set->pattern[i])
+    {
+      return 1;
+    }
+  }
+  return 0;
+}
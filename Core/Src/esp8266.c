@@ -7,20 +7,120 @@
 
 #include "esp8266.h"
 #include "esp8266_io.h"
-#include <stdio.h>
+#include "esp8266_urc.h"
+#include "at_builder.h"
+#include "at_scan.h"
+#include "at_parse.h"
+#include "metrics.h"
 #include <string.h>
 #include <stdint.h>
 #include <stdlib.h>
 
 #define CMD_TERMINATOR "\r\n"
 #define RESPONSE_OK "OK"
+#define PUB_VERB_SIZE   (sizeof("AT+MQTTPUB=0,") - 1U)
+#define QUERY_LINE_SIZE 256     /* longest response line kept whole */
 
 static char at_cmd[MAX_AT_CMD_SIZE];
 static char rx_buffer[MAX_BUFFER_SIZE];
 
+/* Set by the first successful MQTT connection, blocking or not */
+esp8266_boolean esp8266_mqtt_connected_once = ESP8266_FALSE;
+
+/* TCP server: AT+CIPMUX=1 while it runs, one entry per link */
+static uint8_t server_running;
+static esp8266_link_t server_links[ESP8266_MAX_LINKS];
+
+/* Outgoing connection of AT+CIPSTART, on ESP8266_CLIENT_LINK while the
+   server runs */
+static uint8_t client_open;
+
+/* Broker address, so that reconnects skip the DNS lookup */
+static esp8266_dns_cache_t dns_cache;
+
+/* Response deadline per AT verb, adapted between a floor and a ceiling. The
+   last two entries are for the verbs not listed and for the data sent after
+   a '>' prompt. */
+#define DEADLINE_UNKNOWN    (sizeof(deadlines) / sizeof(deadlines[0]) - 2U)
+#define DEADLINE_DATA       (sizeof(deadlines) / sizeof(deadlines[0]) - 1U)
+#define DEADLINE(verb, min_ms, max_ms)  { (verb), (min_ms), (max_ms), (max_ms), 0, 0, 0, 0, 0, 0 }
+
+static esp8266_deadline_t deadlines[] = {
+    DEADLINE("",              100,   500),      /* AT, ATE0 */
+    DEADLINE("RST",          1000,  3000),
+    DEADLINE("GMR",           100,  1000),
+    DEADLINE("CWMODE",        100,  1000),
+    DEADLINE("CWJAP",        5000, 20000),      /* scan, authentication and DHCP */
+    DEADLINE("CWQAP",         200,  2000),
+    DEADLINE("CWLAP",        2000, 10000),      /* scan of every channel */
+    DEADLINE("CIFSR",         200,  2000),
+    DEADLINE("CIPDOMAIN",    1000, 10000),      /* DNS lookup */
+    DEADLINE("CIPMUX",        100,  1000),
+    DEADLINE("CIPSTART",     1000, 10000),      /* DNS and TCP handshake */
+    DEADLINE("CIPCLOSE",      200,  2000),
+    DEADLINE("CIPSEND",       200,  2000),      /* until the '>' prompt */
+    DEADLINE("CIPSERVER",     100,  1000),
+    DEADLINE("CIPSERVERMAXCONN", 100, 1000),
+    DEADLINE("CIPSNTPCFG",    100,  1000),
+    DEADLINE("CIPSNTPTIME",   200,  2000),
+    DEADLINE("MQTTUSERCFG",   100,  1000),
+    DEADLINE("MQTTCONN",     2000, 15000),      /* DNS, TCP, TLS and CONNACK */
+    DEADLINE("MQTTSNI",       100,  1000),
+    DEADLINE("MQTTSUB",       500,  5000),      /* SUBACK from the broker */
+    DEADLINE("MQTTPUB",       500,  5000),      /* PUBACK from the broker at QoS 1 */
+    DEADLINE("MQTTPUBRAW",    200,  2000),      /* until the '>' prompt */
+    DEADLINE("SLEEP",         100,  1000),
+    DEADLINE("SLEEPWKCFG",    100,  1000),
+    DEADLINE("?",   DEFAULT_TIME_OUT, DEFAULT_TIME_OUT),
+    DEADLINE(">",             500,  5000),      /* data until SEND OK / +MQTTPUB:OK */
+};
+
+/* Private types -------------------------------------------------------------*/
+/* Called for each +VERB: line of a query response, its slices valid until it returns */
+typedef void (*query_handler_t)(const at_line_t* line, void* context);
+
+typedef struct {
+    const char*                  key;              /* "STAIP" */
+    uint8_t*                     value;
+    uint8_t                      found;
+} cifsr_query_t;
+
+typedef struct {
+    esp8266_ap_callback_t        callback;
+    void*                        context;
+} cwlap_query_t;
+
+typedef struct {
+    void*                        result;
+    uint32_t                     size;
+    uint8_t                      found;
+} query_result_t;
+
 /* Private function prototypes -----------------------------------------------*/
 static esp8266_status_t send_at_cmd(uint8_t* cmd, uint32_t Length, const uint8_t* Token);
+static esp8266_status_t send_cmd(at_builder_t* cmd, const uint8_t* Token);
+static esp8266_status_t send_frame(const esp8266_iovec_t* iov, uint32_t count, const uint8_t* Token, uint8_t data);
+static esp8266_status_t recv_token(char* Buffer, uint32_t Size, const char* Token, uint8_t Messages);
+static esp8266_status_t send_query(at_builder_t* cmd, const char* verb, query_handler_t handler, void* context);
+static esp8266_status_t recv_lines(const char* verb, query_handler_t handler, void* context);
+static esp8266_status_t command_done(esp8266_deadline_t* deadline, esp8266_status_t ret, uint32_t sent);
+static uint32_t read_message(char* segment, uint32_t length, uint32_t size, esp8266_urc_frame_t* frame);
+static void message_done(const char* message, uint32_t length, const esp8266_urc_frame_t* frame);
+static uint8_t message_holds(const char* message, uint32_t length, const char* token);
+static void cifsr_line(const at_line_t* line, void* context);
+static void sntp_line(const at_line_t* line, void* context);
+static void cwjap_line(const at_line_t* line, void* context);
+static void cwlap_line(const at_line_t* line, void* context);
+static void mqttconn_line(const at_line_t* line, void* context);
+static void cipdomain_line(const at_line_t* line, void* context);
+static esp8266_status_t dns_lookup(void);
+static void gmr_line(const at_line_t* line, void* context);
+static int8_t read_two_digits(const char* p);
+static esp8266_status_t publish_raw(const esp8266_iovec_t* header, uint32_t count,
+                                    const uint8_t* data, uint32_t length, uint32_t tick_start);
 static esp8266_status_t recv_data(uint8_t* Buffer, uint32_t Length, uint32_t* retLength);
+static void client_link(at_builder_t* cmd);
+static void deadline_backoff(esp8266_deadline_t* deadline);
 
 /* Private functions ---------------------------------------------------------*/
 
@@ -36,21 +136,23 @@ static esp8266_status_t recv_data(uint8_t* Buffer, uint32_t Length, uint32_t* re
 esp8266_status_t esp8266_init(void)
 {
   esp8266_status_t ret;
+  at_builder_t cmd;
 
   /* Configuration the IO low layer */
   if (esp8266_io_init() < 0)
   {
     return ESP8266_ERROR;
   }
+  dns_cache.sni = ESP8266_SNI_UNKNOWN;
 
   /* Disable the Echo mode */
 #if 1
   /* Construct the command */
-  memset (at_cmd, '\0', MAX_AT_CMD_SIZE);
-  sprintf((char *)at_cmd, "ATE0%c%c", '\r', '\n');
+  at_builder_init(&cmd, at_cmd, MAX_AT_CMD_SIZE);
+  at_builder_lit(&cmd, "ATE0\r\n");
 
   /* Send the command */
-  ret = send_at_cmd((uint8_t* )at_cmd, strlen((char *)at_cmd), (uint8_t*)AT_OK_STRING);
+  ret = send_cmd(&cmd, (uint8_t*)AT_OK_STRING);
 
   /* Exit in case of error */
   if (ret !=  ESP8266_OK)
@@ -61,11 +163,11 @@ esp8266_status_t esp8266_init(void)
   /* Setup the module in Station Mode*/
 
   /* Construct the command */
-  memset (at_cmd, '\0', MAX_AT_CMD_SIZE);
-  sprintf((char *)at_cmd, "AT+CWMODE=1%c%c", '\r', '\n');
+  at_builder_init(&cmd, at_cmd, MAX_AT_CMD_SIZE);
+  at_builder_lit(&cmd, "AT+CWMODE=1\r\n");
 
   /* Send the command */
-  ret = send_at_cmd((uint8_t* )at_cmd, strlen((char *)at_cmd), (uint8_t*)AT_OK_STRING);
+  ret = send_cmd(&cmd, (uint8_t*)AT_OK_STRING);
 
   return ret;
 }
@@ -80,12 +182,18 @@ esp8266_status_t esp8266_init(void)
 esp8266_status_t esp8266_deinit(void)
 {
   esp8266_status_t ret;
+  at_builder_t cmd;
 
   /* Construct the command */
-  sprintf((char *)at_cmd, "AT+RST%c%c", '\r', '\n');
+  at_builder_init(&cmd, at_cmd, MAX_AT_CMD_SIZE);
+  at_builder_lit(&cmd, "AT+RST\r\n");
 
   /* Send the command */
-  ret = send_at_cmd((uint8_t* )at_cmd, strlen((char *)at_cmd), (uint8_t*)AT_OK_STRING);
+  ret = send_cmd(&cmd, (uint8_t*)AT_OK_STRING);
+
+  /* The module answers slowly while it restarts, and forgets the SNI */
+  esp8266_deadline_backoff_all();
+  dns_cache.sni = ESP8266_SNI_UNKNOWN;
 
   /* Free resources used by the module */
   esp8266_io_deinit();
@@ -102,13 +210,18 @@ esp8266_status_t esp8266_deinit(void)
 esp8266_status_t esp8266_reset(void)
 {
   esp8266_status_t ret;
+  at_builder_t cmd;
 
   /* Construct the command */
-  memset (at_cmd, '\0', MAX_AT_CMD_SIZE);
-  sprintf((char *)at_cmd, "AT+RST%c%c", '\r', '\n');
+  at_builder_init(&cmd, at_cmd, MAX_AT_CMD_SIZE);
+  at_builder_lit(&cmd, "AT+RST\r\n");
 
   /* Send the command */
-  ret = send_at_cmd((uint8_t* )at_cmd, strlen((char *)at_cmd), (uint8_t*)AT_OK_STRING);
+  ret = send_cmd(&cmd, (uint8_t*)AT_OK_STRING);
+
+  /* The module answers slowly while it restarts, and forgets the SNI */
+  esp8266_deadline_backoff_all();
+  dns_cache.sni = ESP8266_SNI_UNKNOWN;
 
   return ret;
 }
@@ -122,28 +235,59 @@ esp8266_status_t esp8266_reset(void)
 esp8266_status_t esp8266_joint_ap(uint8_t* Ssid, uint8_t* Password)
 {
   esp8266_status_t ret;
+  at_builder_t cmd;
 
   /* List all the available Access points first
    then check whether the specified 'ssid' exists among them or not.*/
-  memset(at_cmd, '\0', MAX_AT_CMD_SIZE);
-  sprintf((char *)at_cmd, "AT+CWJAP=\"%s\",\"%s\"%c%c", Ssid, Password, '\r', '\n');
+  at_builder_init(&cmd, at_cmd, MAX_AT_CMD_SIZE);
+  at_builder_lit(&cmd, "AT+CWJAP=");
+  at_builder_quoted(&cmd, (const char *)Ssid);
+  at_builder_char(&cmd, ',');
+  at_builder_quoted(&cmd, (const char *)Password);
+  at_builder_crlf(&cmd);
 
   /* Send the command */
-  ret = send_at_cmd((uint8_t*)at_cmd, strlen((char *)at_cmd), (uint8_t*)AT_OK_STRING);
+  ret = send_cmd(&cmd, (uint8_t*)AT_OK_STRING);
 
 #if 0
   /* Disable multiple connection by default. */
 
   /* Construct the command */
-  memset (at_cmd, '\0', MAX_AT_CMD_SIZE);
-  sprintf((char *)at_cmd, "AT+CIPMUX=0%c%c", '\r', '\n');
+  at_builder_init(&cmd, at_cmd, MAX_AT_CMD_SIZE);
+  at_builder_lit(&cmd, "AT+CIPMUX=0\r\n");
 
   /* Send the command */
-  ret = send_at_cmd((uint8_t*)at_cmd, strlen((char *)at_cmd), (uint8_t*)AT_OK_STRING);
+  ret = send_cmd(&cmd, (uint8_t*)AT_OK_STRING);
 #endif
   return ret;
 }
 
+/**
+  * @brief  Join one access point of a network, by its BSSID, in fast scan
+  *         mode: AT+CWJAP takes no channel, but the scan ends on the channel
+  *         of the AP instead of sweeping every channel first.
+  * @param  ssid: the network.
+  * @param  password: its password.
+  * @param  bssid: the access point, "aa:bb:cc:dd:ee:ff".
+  * @retval ESP8266_OK on success, ESP8266_ERROR when the AP is not found or
+  *         refuses the station.
+  */
+esp8266_status_t esp8266_join_ap_bssid(const char* ssid, const char* password, const char* bssid)
+{
+  at_builder_t cmd;
+
+  at_builder_init(&cmd, at_cmd, MAX_AT_CMD_SIZE);
+  at_builder_lit(&cmd, "AT+CWJAP=");
+  at_builder_quoted(&cmd, ssid);
+  at_builder_char(&cmd, ',');
+  at_builder_quoted(&cmd, password);
+  at_builder_char(&cmd, ',');
+  at_builder_quoted(&cmd, bssid);
+  /* <pci_en>,<reconn_interval>,<listen_interval> as by default, <scan_mode> 0: fast */
+  at_builder_lit(&cmd, ",0,1,3,0\r\n");
+  return send_cmd(&cmd, (uint8_t*)AT_OK_STRING);
+}
+
 /**
   * @brief  Quit an Access point if any.
   * @param  None
@@ -152,107 +296,513 @@ esp8266_status_t esp8266_joint_ap(uint8_t* Ssid, uint8_t* Password)
 esp8266_status_t esp8266_quit_ap(void)
 {
   esp8266_status_t ret;
+  at_builder_t cmd;
 
   /* Construct the CWQAP command */
-  memset(at_cmd, '\0', MAX_AT_CMD_SIZE);
-  sprintf((char *)at_cmd, "AT+CWQAP%c%c", '\r', '\n');
+  at_builder_init(&cmd, at_cmd, MAX_AT_CMD_SIZE);
+  at_builder_lit(&cmd, "AT+CWQAP\r\n");
 
   /* Send the command */
-  ret = send_at_cmd((uint8_t*)at_cmd, strlen((char *)at_cmd), (uint8_t*)AT_OK_STRING);
+  ret = send_cmd(&cmd, (uint8_t*)AT_OK_STRING);
 
   return ret;
 }
 
 /**
-  * @brief  Get the IP address for the esp8266 in Station mode.
-  * @param  Mode: a ESP8266_ModeTypeDef to choose the Station or AccessPoint mode.
-                 only the Station Mode is supported.
-  * @param  IpAddress buffer to contain the IP address.
+  * @brief  Get the IP address of the station or of the access point.
+  * @param  Mode: ESP8266_ACCESSPOINT_MODE for the access point address, the
+  *         station address otherwise.
+  * @param  IpAddress buffer of ESP8266_IP_SIZE bytes, "0.0.0.0" when the
+  *         module has no address.
   * @retval returns ESP8266_OK on success and ESP8266_ERROR otherwise
   */
 esp8266_status_t esp8266_get_ip(esp8266_mode_t Mode, uint8_t* IpAddress)
 {
-  esp8266_status_t ret = ESP8266_OK;
-  char *Token, *temp;
+  esp8266_status_t ret;
+  at_builder_t cmd;
+  cifsr_query_t query;
 
   /* Initialize the IP address and command fields */
   strcpy((char *)IpAddress, "0.0.0.0");
-  memset(at_cmd, '\0', MAX_AT_CMD_SIZE);
+  query.key = (Mode == ESP8266_ACCESSPOINT_MODE) ? "APIP" : "STAIP";
+  query.value = IpAddress;
+  query.found = 0;
 
   /* Construct the CIFSR command */
-  sprintf((char *)at_cmd, "AT+CIFSR%c%c", '\r', '\n');
+  at_builder_init(&cmd, at_cmd, MAX_AT_CMD_SIZE);
+  at_builder_lit(&cmd, "AT+CIFSR\r\n");
 
-  /* Send the CIFSR command */
-  ret = send_at_cmd((uint8_t* )at_cmd, strlen((char *)at_cmd), (uint8_t*)AT_OK_STRING);
+  /* One +CIFSR:<key>,"<value>" line per address */
+  ret = send_query(&cmd, "CIFSR", cifsr_line, &query);
 
-  /* If ESP8266_OK is returned it means the IP Adress inside the rx_buffer
-     has already been read */
-  if ( ret == ESP8266_OK)
-  {
-    /* The IpAddress for the Station Mode is returned in the format
-     ' STAIP,"ip_address" '
-      look for the token "STAIP," , then read the ip address located
-      between two double quotes */
-    Token = strstr((char *)rx_buffer, "STAIP,");
-    Token+=7;
+  return ret;
+}
+
+/**
+  * @brief  Get the access point the station is connected to.
+  * @param  ap: its SSID, BSSID, channel and RSSI.
+  * @retval ESP8266_OK on success, ESP8266_CONNECTION_CLOSED when not
+  *         connected, ESP8266_ERROR otherwise.
+  */
+esp8266_status_t esp8266_get_ap_info(esp8266_ap_info_t* ap)
+{
+  esp8266_status_t ret;
+  at_builder_t cmd;
+  query_result_t query;
 
-    temp = strstr(Token, "\"");
-    *temp = '\0';
+  memset(ap, 0, sizeof(*ap));
+  query.result = ap;
+  query.size = sizeof(*ap);
+  query.found = 0;
 
-    /* Get the IP address value */
-    strcpy((char *)IpAddress, Token);
+  at_builder_init(&cmd, at_cmd, MAX_AT_CMD_SIZE);
+  at_builder_lit(&cmd, "AT+CWJAP?\r\n");
+
+  /* +CWJAP:"<ssid>","<bssid>",<channel>,<rssi>,... or "No AP" */
+  ret = send_query(&cmd, "CWJAP", cwjap_line, &query);
+  if ((ret == ESP8266_OK) && (query.found == 0))
+  {
+    ret = ESP8266_CONNECTION_CLOSED;
   }
 
   return ret;
 }
 
+/**
+  * @brief  Scan the access points around. Each one is reported as its line
+  *         arrives: the memory used does not depend on how many there are.
+  * @param  callback: called once per access point.
+  * @param  context: passed to callback.
+  * @retval ESP8266_OK on success, ESP8266_ERROR otherwise.
+  */
+esp8266_status_t esp8266_list_ap(esp8266_ap_callback_t callback, void* context)
+{
+  at_builder_t cmd;
+  cwlap_query_t query;
+
+  query.callback = callback;
+  query.context = context;
+
+  at_builder_init(&cmd, at_cmd, MAX_AT_CMD_SIZE);
+  at_builder_lit(&cmd, "AT+CWLAP\r\n");
+
+  /* +CWLAP:(<ecn>,"<ssid>",<rssi>,"<mac>",<channel>,...) per access point */
+  return send_query(&cmd, "CWLAP", cwlap_line, &query);
+}
+
+/**
+  * @brief  Get the version of the AT firmware.
+  * @param  version: buffer for the "AT version:" value, e.g. "3.2.0.0(...)".
+  * @param  size: its size, the version is truncated to fit.
+  * @retval ESP8266_OK on success, ESP8266_ERROR otherwise.
+  */
+esp8266_status_t esp8266_get_version(char* version, uint32_t size)
+{
+  at_builder_t cmd;
+  query_result_t query;
+
+  if (size != 0)
+  {
+    version[0] = '\0';
+  }
+  query.result = version;
+  query.size = size;
+  query.found = 0;
+
+  at_builder_init(&cmd, at_cmd, MAX_AT_CMD_SIZE);
+  at_builder_lit(&cmd, "AT+GMR\r\n");
+
+  return send_query(&cmd, "AT version", gmr_line, &query);
+}
+
 /**
   * @brief  Establish a network connection.
+  * @details A UDP connection binds local_port when it is not 0, with
+  *          connection_mode telling whether a datagram from another peer
+  *          changes the remote one (UDP_PEER_CHANGE_INVALID: the module's
+  *          default, no change). While the server runs, the connection is
+  *          made on ESP8266_CLIENT_LINK.
   * @param  Connection_info a pointer to a ESP8266_ConnectionInfoTypeDef struct containing the connection info.
   * @retval returns ESP8266_AT_COMMAND_OK on success and ESP8266_AT_COMMAND_ERROR otherwise.
   */
 esp8266_status_t esp8266_establish_connection(const esp8266_connection_info_t* connection_info)
 {
   esp8266_status_t ret;
+  at_builder_t cmd;
 
   /* Check the connection mode */
   if (connection_info->is_server)
   {
-  /* Server mode not supported for this version yet */
+    /* Listening on port, the clients are tracked per link */
+    return esp8266_server_start((uint16_t)connection_info->port);
+  }
+
+  if ((connection_info->connection_type != ESP8266_TCP_CONNECTION) &&
+      (connection_info->connection_type != ESP8266_UDP_CONNECTION))
+  {
     return ESP8266_ERROR;
   }
 
-  /* Construct the CIPSTART command */
-  memset(at_cmd, '\0', MAX_AT_CMD_SIZE);
-  sprintf((char *)at_cmd, "AT+CIPSTART=\"TCP\",\"%s\",%lu%c%c", (char *)connection_info->ip_address, connection_info->port,'\r', '\n');
+  /* Construct the CIPSTART command, AT+CIPSTART=<link>,... while the
+     server runs */
+  at_builder_init(&cmd, at_cmd, MAX_AT_CMD_SIZE);
+  at_builder_lit(&cmd, "AT+CIPSTART=");
+  client_link(&cmd);
+  if (connection_info->connection_type == ESP8266_UDP_CONNECTION)
+  {
+    at_builder_lit(&cmd, "\"UDP\",");
+  }
+  else
+  {
+    at_builder_lit(&cmd, "\"TCP\",");
+  }
+  at_builder_quoted(&cmd, (const char *)connection_info->ip_address);
+  at_builder_char(&cmd, ',');
+  at_builder_uint(&cmd, connection_info->port);
+
+  /* UDP: ,<local port>[,<peer change policy>] */
+  if ((connection_info->connection_type == ESP8266_UDP_CONNECTION) && (connection_info->local_port != 0))
+  {
+    at_builder_char(&cmd, ',');
+    at_builder_uint(&cmd, connection_info->local_port);
+
+    switch (connection_info->connection_mode)
+    {
+    case UDP_PEER_NO_CHANGE:
+    case UDP_PEER_CHANGE_ONCE:
+    case UDP_PEER_CHANGE_ALLOWED:
+      at_builder_char(&cmd, ',');
+      at_builder_uint(&cmd, (uint32_t)connection_info->connection_mode);
+      break;
+    case UDP_PEER_CHANGE_INVALID:
+      break;
+    default:
+      return ESP8266_ERROR;
+    }
+  }
+  at_builder_crlf(&cmd);
 
-  /* Send the CIPSTART command */
-  ret = send_at_cmd((uint8_t*)at_cmd, strlen((char *)at_cmd), (uint8_t*)AT_CONNECT_STRING);
+  /* Send the CIPSTART command: CONNECT, or <link>,CONNECT */
+  ret = send_cmd(&cmd, (uint8_t*)AT_CONNECT_STRING);
+  if (ret == ESP8266_OK)
+  {
+    client_open = 1;
+  }
 
   return ret;
 }
 
 /**
   * @brief   Close a network connection.
-  * @details Use the ALL_CONNECTION_ID to close all connections.
+  * @details While the server runs, channel_id is the link to close: a client,
+  *          or ESP8266_CLIENT_LINK for the outgoing connection.
   * @param   Channel_id the channel ID of the connection to close.
   * @retval  returns ESP8266_AT_COMMAND_OK on success and ESP8266_AT_COMMAND_ERROR otherwise.
   */
 esp8266_status_t esp8266_close_connection(const uint8_t channel_id)
 {
-  /* Working with a single connection, no channel_id is required */
   esp8266_status_t ret;
+  at_builder_t cmd;
 
   /* Construct the CIPCLOSE command */
-  memset(at_cmd, '\0', MAX_AT_CMD_SIZE);
-  sprintf((char *)at_cmd, "AT+CIPCLOSE%c%c", '\r', '\n');
+  at_builder_init(&cmd, at_cmd, MAX_AT_CMD_SIZE);
+  if (server_running != 0)
+  {
+    /* A client of the server or the outgoing connection: AT+CIPCLOSE=<link> */
+    if (channel_id >= ESP8266_MAX_LINKS)
+    {
+      return ESP8266_ERROR;
+    }
+    at_builder_lit(&cmd, "AT+CIPCLOSE=");
+    at_builder_uint(&cmd, channel_id);
+    at_builder_crlf(&cmd);
+  }
+  else
+  {
+    /* Working with a single connection, no channel_id is required */
+    at_builder_lit(&cmd, "AT+CIPCLOSE\r\n");
+  }
 
   /* Send the CIPCLOSE command */
-  ret = send_at_cmd((uint8_t* )at_cmd, strlen((char *)at_cmd), (uint8_t*)AT_OK_STRING);
+  ret = send_cmd(&cmd, (uint8_t*)AT_OK_STRING);
+  if ((ret == ESP8266_OK) && ((server_running == 0) || (channel_id == ESP8266_CLIENT_LINK)))
+  {
+    client_open = 0;
+  }
+  else if (ret == ESP8266_OK)
+  {
+    server_links[channel_id].connected = 0;
+  }
 
   return ret;
 }
 
+/**
+  * @brief   Start the TCP server: AT+CIPMUX=1, then AT+CIPSERVER=1,<port>.
+  * @details Up to ESP8266_CLIENT_LINK clients at once (AT+CIPSERVERMAXCONN),
+  *          each on its own link: ESP8266_CLIENT_LINK is left to the
+  *          outgoing connection. Their <link>,CONNECT and <link>,CLOSED
+  *          lines are passed to esp8266_server_handle_line() by the reader
+  *          of the URCs.
+  * @note    The module refuses AT+CIPMUX=1 while a single connection is
+  *          open: start the server before esp8266_establish_connection().
+  * @param   port: the port to listen on.
+  * @retval  ESP8266_OK on success, ESP8266_ERROR otherwise (also with an
+  *          outgoing connection open).
+  */
+esp8266_status_t esp8266_server_start(uint16_t port)
+{
+  esp8266_status_t ret;
+  at_builder_t cmd;
+
+  if (client_open != 0)
+  {
+    return ESP8266_ERROR;
+  }
+
+  /* The server needs the multiple connections mode */
+  at_builder_init(&cmd, at_cmd, MAX_AT_CMD_SIZE);
+  at_builder_lit(&cmd, "AT+CIPMUX=1\r\n");
+  ret = send_cmd(&cmd, (uint8_t*)AT_OK_STRING);
+  if (ret != ESP8266_OK)
+  {
+    return ret;
+  }
+
+  /* Never ESP8266_CLIENT_LINK for a client */
+  at_builder_init(&cmd, at_cmd, MAX_AT_CMD_SIZE);
+  at_builder_lit(&cmd, "AT+CIPSERVERMAXCONN=");
+  at_builder_uint(&cmd, ESP8266_CLIENT_LINK);
+  at_builder_crlf(&cmd);
+  ret = send_cmd(&cmd, (uint8_t*)AT_OK_STRING);
+  if (ret != ESP8266_OK)
+  {
+    return ret;
+  }
+
+  at_builder_init(&cmd, at_cmd, MAX_AT_CMD_SIZE);
+  at_builder_lit(&cmd, "AT+CIPSERVER=1,");
+  at_builder_uint(&cmd, port);
+  at_builder_crlf(&cmd);
+  ret = send_cmd(&cmd, (uint8_t*)AT_OK_STRING);
+  if (ret != ESP8266_OK)
+  {
+    return ret;
+  }
+
+  memset(server_links, 0, sizeof(server_links));
+  server_running = 1;
+  return ESP8266_OK;
+}
+
+/**
+  * @brief   Stop the TCP server, closing its clients, and go back to a
+  *          single connection.
+  * @retval  ESP8266_OK on success, ESP8266_ERROR otherwise (also with the
+  *          outgoing connection still open on ESP8266_CLIENT_LINK).
+  */
+esp8266_status_t esp8266_server_stop(void)
+{
+  esp8266_status_t ret;
+  at_builder_t cmd;
+
+  /* AT+CIPMUX=0 is refused while a link is open */
+  if (client_open != 0)
+  {
+    return ESP8266_ERROR;
+  }
+
+  at_builder_init(&cmd, at_cmd, MAX_AT_CMD_SIZE);
+  at_builder_lit(&cmd, "AT+CIPSERVER=0,1\r\n");
+  ret = send_cmd(&cmd, (uint8_t*)AT_OK_STRING);
+  if (ret != ESP8266_OK)
+  {
+    return ret;
+  }
+
+  memset(server_links, 0, sizeof(server_links));
+  server_running = 0;
+
+  at_builder_init(&cmd, at_cmd, MAX_AT_CMD_SIZE);
+  at_builder_lit(&cmd, "AT+CIPMUX=0\r\n");
+  return send_cmd(&cmd, (uint8_t*)AT_OK_STRING);
+}
+
+/**
+  * @brief   Stream length bytes to a client of the server, straight from
+  *          data: one AT+CIPSEND=<link>,<length> per segment of
+  *          ESP8266_MAX_SEGMENT_SIZE, back to back.
+  * @param   link: the link of the client.
+  * @param   data: the bytes, a data log for instance.
+  * @param   length: their count, any size.
+  * @retval  ESP8266_OK when all was sent, ESP8266_BUSY when the module
+  *          was busy, ESP8266_ERROR otherwise (the client is gone when
+  *          the link is refused).
+  */
+esp8266_status_t esp8266_server_send(uint8_t link, const uint8_t* data, uint32_t length)
+{
+  esp8266_status_t ret;
+  esp8266_iovec_t segment;
+  at_builder_t cmd;
+
+  if ((server_running == 0) || (link >= ESP8266_MAX_LINKS) || (data == NULL))
+  {
+    return ESP8266_ERROR;
+  }
+
+  while (length != 0)
+  {
+    segment.base = data;
+    segment.length = (length < ESP8266_MAX_SEGMENT_SIZE) ? length : ESP8266_MAX_SEGMENT_SIZE;
+
+    at_builder_init(&cmd, at_cmd, MAX_AT_CMD_SIZE);
+    at_builder_lit(&cmd, "AT+CIPSEND=");
+    at_builder_uint(&cmd, link);
+    at_builder_char(&cmd, ',');
+    at_builder_uint(&cmd, segment.length);
+    at_builder_crlf(&cmd);
+
+    ret = send_cmd(&cmd, (uint8_t*)AT_SEND_PROMPT_STRING);
+    if (ret == ESP8266_ERROR)
+    {
+      /* link is not valid: the client closed it before its CLOSED was read */
+      server_links[link].connected = 0;
+    }
+    if (ret == ESP8266_OK)
+    {
+      ret = send_frame(&segment, 1, (uint8_t*)AT_SEND_OK_STRING, 1);
+    }
+    if (ret != ESP8266_OK)
+    {
+      return ret;
+    }
+
+    server_links[link].bytes_sent += segment.length;
+    data += segment.length;
+    length -= segment.length;
+  }
+
+  return ESP8266_OK;
+}
+
+/**
+  * @brief   Track the clients of the server from a line sent by the module.
+  * @param   line: the line, without CRLF; "<link>,CONNECT" and
+  *          "<link>,CLOSED" are taken.
+  * @param   length: its size.
+  * @retval  1 when the line was a link event, 0 otherwise.
+  */
+uint8_t esp8266_server_handle_line(const char* line, uint32_t length)
+{
+  uint32_t link;
+
+  if ((server_running == 0) || (length < 3U) || (line[0] < '0') || (line[0] > '9') || (line[1] != ','))
+  {
+    return 0;
+  }
+
+  link = (uint32_t)(line[0] - '0');
+  if (link >= ESP8266_MAX_LINKS)
+  {
+    return 0;
+  }
+  if (link == ESP8266_CLIENT_LINK)
+  {
+    /* The outgoing connection, closed by its peer */
+    if (((length - 2U) == (sizeof("CLOSED") - 1U)) && (memcmp(&line[2], "CLOSED", length - 2U) == 0))
+    {
+      client_open = 0;
+      return 1;
+    }
+    return 0;
+  }
+  if (((length - 2U) == (sizeof("CONNECT") - 1U)) && (memcmp(&line[2], "CONNECT", length - 2U) == 0))
+  {
+    server_links[link].connected = 1;
+    server_links[link].connects++;
+    server_links[link].bytes_sent = 0;
+    return 1;
+  }
+  if ((((length - 2U) == (sizeof("CLOSED") - 1U)) && (memcmp(&line[2], "CLOSED", length - 2U) == 0)) ||
+      (((length - 2U) == (sizeof("CONNECT FAIL") - 1U)) && (memcmp(&line[2], "CONNECT FAIL", length - 2U) == 0)))
+  {
+    server_links[link].connected = 0;
+    return 1;
+  }
+  return 0;
+}
+
+/**
+  * @brief   Data of a client received while a command was waiting for its
+  *          response, in pieces as they come.
+  * @note    Overridden by the application to pass it on; dropped here.
+  * @param   link: the link of the client.
+  * @param   data: a piece of its data.
+  * @param   length: its size.
+  * @retval  None.
+  */
+__attribute__((weak)) void esp8266_ipd_received(uint8_t link, const uint8_t* data, uint32_t length)
+{
+  (void)link;
+  (void)data;
+  (void)length;
+}
+
+/**
+  * @brief   A +MQTTSUBRECV message received while a command was waiting for
+  *          its response, whole.
+  * @note    Overridden by the application to handle it as its other
+  *          messages; dropped here.
+  * @param   topic: its topic, not terminated.
+  * @param   topic_length: its size.
+  * @param   data: its payload.
+  * @param   length: the bytes of it kept.
+  * @param   truncated: 1 when longer than the receive buffer, its start only.
+  * @retval  None.
+  */
+__attribute__((weak)) void esp8266_message_received(const char* topic, uint32_t topic_length,
+                                                    const uint8_t* data, uint32_t length, uint8_t truncated)
+{
+  (void)topic;
+  (void)topic_length;
+  (void)data;
+  (void)length;
+  (void)truncated;
+}
+
+/**
+  * @brief   Called before each command is sent.
+  * @note    Overridden by the application that reads URCs between commands:
+  *          a message it has started to read must be complete first, or the
+  *          rest of it is read as the response, and the response as its
+  *          payload. Nothing to do here.
+  * @retval  None.
+  */
+__attribute__((weak)) void esp8266_command_starting(void)
+{
+}
+
+/**
+  * @brief   The clients of the server, one entry per link.
+  * @param   count: ESP8266_MAX_LINKS.
+  * @retval  The table.
+  */
+const esp8266_link_t* esp8266_server_links(uint32_t* count)
+{
+  *count = ESP8266_MAX_LINKS;
+  return server_links;
+}
+
+/**
+  * @brief   Whether the server runs: the outgoing connection is then on
+  *          ESP8266_CLIENT_LINK, AT+CIPSEND=<link>,<length>.
+  * @retval  1 while it runs, 0 otherwise.
+  */
+uint8_t esp8266_server_running(void)
+{
+  return server_running;
+}
+
 /* === Added Functions for AWS IoT MQTT and SNTP Commands === */
 
 /**
@@ -263,22 +813,42 @@ esp8266_status_t esp8266_close_connection(const uint8_t channel_id)
 esp8266_status_t esp8266_config_sntp(const char *ntp_server)
 {
   esp8266_status_t ret;
-  memset(at_cmd, '\0', MAX_AT_CMD_SIZE);
-  sprintf((char *)at_cmd, "AT+CIPSNTPCFG=1,8,\"%s\"%c%c", ntp_server, '\r', '\n');
-  ret = send_at_cmd((uint8_t*)at_cmd, strlen((char *)at_cmd), (uint8_t*)AT_OK_STRING);
+  at_builder_t cmd;
+  at_builder_init(&cmd, at_cmd, MAX_AT_CMD_SIZE);
+  at_builder_lit(&cmd, "AT+CIPSNTPCFG=1,8,");
+  at_builder_quoted(&cmd, ntp_server);
+  at_builder_crlf(&cmd);
+  ret = send_cmd(&cmd, (uint8_t*)AT_OK_STRING);
   return ret;
 }
 
 /**
   * @brief  Query the SNTP time from the module.
-  * @retval ESP8266_OK on success, ESP8266_ERROR otherwise.
+  * @param  time: the date and time, year 1970 until the module is
+  *         synchronized.
+  * @retval ESP8266_OK on success, ESP8266_ERROR otherwise (also when the
+  *         time cannot be read).
   */
-esp8266_status_t esp8266_get_sntp_time(void)
+esp8266_status_t esp8266_get_sntp_time(esp8266_time_t* time)
 {
   esp8266_status_t ret;
-  memset(at_cmd, '\0', MAX_AT_CMD_SIZE);
-  sprintf((char *)at_cmd, "AT+CIPSNTPTIME?%c%c", '\r', '\n');
-  ret = send_at_cmd((uint8_t*)at_cmd, strlen((char *)at_cmd), (uint8_t*)AT_OK_STRING);
+  at_builder_t cmd;
+  query_result_t query;
+
+  memset(time, 0, sizeof(*time));
+  query.result = time;
+  query.size = sizeof(*time);
+  query.found = 0;
+
+  at_builder_init(&cmd, at_cmd, MAX_AT_CMD_SIZE);
+  at_builder_lit(&cmd, "AT+CIPSNTPTIME?\r\n");
+
+  /* +CIPSNTPTIME:Sun Oct 18 09:30:00 2026 */
+  ret = send_query(&cmd, "CIPSNTPTIME", sntp_line, &query);
+  if ((ret == ESP8266_OK) && (query.found == 0))
+  {
+    ret = ESP8266_ERROR;
+  }
   return ret;
 }
 
@@ -292,9 +862,19 @@ esp8266_status_t esp8266_get_sntp_time(void)
 esp8266_status_t esp8266_mqtt_usercfg(const char *clientId, const char *username, const char *password)
 {
   esp8266_status_t ret;
-  memset(at_cmd, '\0', MAX_AT_CMD_SIZE);
-  sprintf((char *)at_cmd, "AT+MQTTUSERCFG=0,5,\"%s\",\"%s\",\"%s\",0,0,\"\"%c%c", clientId, username, password, '\r', '\n');
-  ret = send_at_cmd((uint8_t*)at_cmd, strlen((char *)at_cmd), (uint8_t*)AT_OK_STRING);
+  at_builder_t cmd;
+  at_builder_init(&cmd, at_cmd, MAX_AT_CMD_SIZE);
+  at_builder_lit(&cmd, "AT+MQTTUSERCFG=0,5,");
+  at_builder_quoted(&cmd, clientId);
+  at_builder_char(&cmd, ',');
+  at_builder_quoted(&cmd, username);
+  at_builder_char(&cmd, ',');
+  at_builder_quoted(&cmd, password);
+  at_builder_lit(&cmd, ",0,0,\"\"\r\n");
+  ret = send_cmd(&cmd, (uint8_t*)AT_OK_STRING);
+
+  /* A new configuration of the link, without SNI */
+  dns_cache.sni = ESP8266_SNI_UNKNOWN;
   return ret;
 }
 
@@ -308,162 +888,1429 @@ esp8266_status_t esp8266_mqtt_usercfg(const char *clientId, const char *username
 esp8266_status_t esp8266_mqtt_connect(const char *endpoint, uint16_t port, uint8_t secure)
 {
   esp8266_status_t ret;
-  memset(at_cmd, '\0', MAX_AT_CMD_SIZE);
-  sprintf((char *)at_cmd, "AT+MQTTCONN=0,\"%s\",%u,%u%c%c", endpoint, port, secure, '\r', '\n');
-  ret = send_at_cmd((uint8_t*)at_cmd, strlen((char *)at_cmd), (uint8_t*)AT_OK_STRING);
+  at_builder_t cmd;
+  at_builder_init(&cmd, at_cmd, MAX_AT_CMD_SIZE);
+  at_builder_lit(&cmd, "AT+MQTTCONN=0,");
+  at_builder_quoted(&cmd, endpoint);
+  at_builder_char(&cmd, ',');
+  at_builder_uint(&cmd, port);
+  at_builder_char(&cmd, ',');
+  at_builder_uint(&cmd, secure);
+  at_builder_crlf(&cmd);
+  ret = send_cmd(&cmd, (uint8_t*)AT_OK_STRING);
+
+  /* Every successful connection after the first one is a reconnect */
+  if (ret == ESP8266_OK)
+  {
+    if (esp8266_mqtt_connected_once == ESP8266_TRUE)
+    {
+      METRIC_INC(METRIC_RECONNECTS);
+    }
+    esp8266_mqtt_connected_once = ESP8266_TRUE;
+  }
   return ret;
 }
 
 /**
-  * @brief  Subscribe to an MQTT topic.
-  * @param  topic: MQTT topic to subscribe to (e.g., "topic/esp32at").
-  * @param  qos: Quality of Service level (typically 1).
+  * @brief  Connect to the MQTT broker by its address, looked up once with
+  *         AT+CIPDOMAIN and cached, so that reconnects skip the DNS lookup.
+  *         The host name still goes to TLS with AT+MQTTSNI. The address is
+  *         looked up again after ESP8266_DNS_TTL_MS, or when a connection to
+  *         it fails: the connection is then retried once if it changed.
+  *         Without AT+MQTTSNI or DNS answer, connects by name as
+  *         esp8266_mqtt_connect().
+  * @param  endpoint: MQTT broker host name.
+  * @param  port: Port number (e.g., 8883).
+  * @param  secure: as esp8266_mqtt_connect().
   * @retval ESP8266_OK on success, ESP8266_ERROR otherwise.
   */
-esp8266_status_t esp8266_mqtt_subscribe(const char *topic, uint8_t qos)
+esp8266_status_t esp8266_mqtt_connect_cached(const char *endpoint, uint16_t port, uint8_t secure)
 {
   esp8266_status_t ret;
-  memset(at_cmd, '\0', MAX_AT_CMD_SIZE);
-  sprintf((char *)at_cmd, "AT+MQTTSUB=0,\"%s\",%u%c%c", topic, qos, '\r', '\n');
-  ret = send_at_cmd((uint8_t*)at_cmd, strlen((char *)at_cmd), (uint8_t*)AT_OK_STRING);
+  char failed_ip[ESP8266_IP_SIZE];
+
+  if ((strlen(endpoint) >= ESP8266_HOST_SIZE) || (dns_cache.sni == ESP8266_SNI_UNSUPPORTED))
+  {
+    dns_cache.by_name++;
+    return esp8266_mqtt_connect(endpoint, port, secure);
+  }
+
+  if (strcmp(dns_cache.host, endpoint) != 0)
+  {
+    strcpy(dns_cache.host, endpoint);
+    dns_cache.ip[0] = '\0';
+    dns_cache.sni = ESP8266_SNI_UNKNOWN;
+  }
+  if ((dns_cache.ip[0] != '\0') && ((HAL_GetTick() - dns_cache.resolved_tick) >= ESP8266_DNS_TTL_MS))
+  {
+    dns_cache.ip[0] = '\0';
+    dns_cache.refreshes++;
+  }
+
+  /* The module looks the name up itself when the lookup fails here */
+  if ((dns_cache.ip[0] == '\0') && (dns_lookup() != ESP8266_OK))
+  {
+    dns_cache.by_name++;
+    return esp8266_mqtt_connect(endpoint, port, secure);
+  }
+
+  /* The certificate of the broker is for its name, not its address */
+  if (dns_cache.sni == ESP8266_SNI_UNKNOWN)
+  {
+    ret = esp8266_mqtt_set_sni(endpoint);
+    if (ret == ESP8266_ERROR)
+    {
+      dns_cache.sni = ESP8266_SNI_UNSUPPORTED;
+      dns_cache.by_name++;
+      return esp8266_mqtt_connect(endpoint, port, secure);
+    }
+    if (ret != ESP8266_OK)
+    {
+      return ret;
+    }
+    dns_cache.sni = ESP8266_SNI_SET;
+  }
+
+  ret = esp8266_mqtt_connect(dns_cache.ip, port, secure);
+  if ((ret == ESP8266_ERROR) || (ret == ESP8266_TIMEOUT))
+  {
+    /* The broker may have moved: retry only at a new address */
+    strcpy(failed_ip, dns_cache.ip);
+    dns_cache.refreshes++;
+    if ((dns_lookup() != ESP8266_OK) || (strcmp(failed_ip, dns_cache.ip) == 0))
+    {
+      return ret;
+    }
+    ret = esp8266_mqtt_connect(dns_cache.ip, port, secure);
+  }
+  if (ret == ESP8266_OK)
+  {
+    dns_cache.by_address++;
+  }
   return ret;
 }
 
 /**
-  * @brief  Publish a message to an MQTT topic.
-  * @param  topic: MQTT topic to publish to (e.g., "topic/esp32at").
-  * @param  message: The message to publish (e.g., "hello aws!").
-  * @param  qos: Quality of Service level (typically 1).
-  * @param  retain: Retain flag (0 or 1).
-  * @retval ESP8266_OK on success, ESP8266_ERROR otherwise.
+  * @brief  Give TLS the host name of the broker (server name indication and
+  *         certificate check) when connecting to its address.
+  * @param  host: the host name.
+  * @retval ESP8266_OK on success, ESP8266_ERROR when the firmware does not
+  *         support it.
   */
-esp8266_status_t esp8266_mqtt_publish(const char *topic, const char *message, uint8_t qos, uint8_t retain)
+esp8266_status_t esp8266_mqtt_set_sni(const char *host)
 {
-  esp8266_status_t ret;
+  at_builder_t cmd;
+
+  at_builder_init(&cmd, at_cmd, MAX_AT_CMD_SIZE);
+  at_builder_lit(&cmd, "AT+MQTTSNI=0,");
+  at_builder_quoted(&cmd, host);
+  at_builder_crlf(&cmd);
+  return send_cmd(&cmd, (uint8_t*)AT_OK_STRING);
+}
 
-  memset(at_cmd, '\0', MAX_AT_CMD_SIZE);
-  sprintf((char *)at_cmd, "AT+MQTTPUB=0,\"%s\",\"%s\",%u,%u%c%c", topic, message, qos, retain, '\r', '\n');
-  ret = send_at_cmd((uint8_t*)at_cmd, strlen((char *)at_cmd), (uint8_t*)AT_OK_STRING);
+/**
+  * @brief  Look up the address of a host name.
+  * @param  host: the host name.
+  * @param  ip: buffer of ESP8266_IP_SIZE bytes, "" on failure.
+  * @retval ESP8266_OK on success, ESP8266_ERROR otherwise (DNS Fail).
+  */
+esp8266_status_t esp8266_resolve(const char* host, char* ip)
+{
+  esp8266_status_t ret;
+  at_builder_t cmd;
+  query_result_t query;
+
+  ip[0] = '\0';
+  query.result = ip;
+  query.size = ESP8266_IP_SIZE;
+  query.found = 0;
+
+  at_builder_init(&cmd, at_cmd, MAX_AT_CMD_SIZE);
+  at_builder_lit(&cmd, "AT+CIPDOMAIN=");
+  at_builder_quoted(&cmd, host);
+  at_builder_crlf(&cmd);
+
+  /* +CIPDOMAIN:"<address>", not quoted before AT v2.2 */
+  ret = send_query(&cmd, "CIPDOMAIN", cipdomain_line, &query);
+  if ((ret == ESP8266_OK) && (query.found == 0))
+  {
+    ret = ESP8266_ERROR;
+  }
   return ret;
 }
 
-/* === End of Added Functions === */
+/**
+  * @brief  The cached broker address and how reconnects used it.
+  * @retval The cache.
+  */
+const esp8266_dns_cache_t* esp8266_dns_cache(void)
+{
+  return &dns_cache;
+}
 
 /**
-  * @brief  Send data over the wifi connection.
-  * @param  Buffer: the buffer to send
-  * @param  Length: the Buffer's data size.
-  * @retval returns ESP8266_OK on success and ESP8266_ERROR otherwise.
+  * @brief  Query the state of the MQTT connection.
+  * @param  info: the state, scheme, host and port of the connection.
+  * @retval ESP8266_OK on success, ESP8266_ERROR otherwise.
   */
-esp8266_status_t esp8266_send_data(uint8_t* Buffer, uint32_t Length)
+esp8266_status_t esp8266_mqtt_get_conn(esp8266_mqtt_conn_info_t* info)
 {
-  //uart_dma_restart();
-  esp8266_status_t ret = ESP8266_OK;
+  esp8266_status_t ret;
+  at_builder_t cmd;
+  query_result_t query;
 
-  if (Buffer != NULL)
-  {
-    //uint32_t tickStart;
-    /* Construct the CIPSEND command */
-    memset(at_cmd, '\0', MAX_AT_CMD_SIZE);
-    sprintf((char *)at_cmd, "AT+CIPSEND=%lu%c%c", Length, '\r', '\n');
+  memset(info, 0, sizeof(*info));
+  query.result = info;
+  query.size = sizeof(*info);
+  query.found = 0;
 
-    /* The CIPSEND command doesn't have a return command
-       until the data is actually sent. Thus we check here whether
-       we got the '>' prompt or not. */
-    ret = send_at_cmd((uint8_t* )at_cmd, strlen((char *)at_cmd), (uint8_t*)AT_SEND_PROMPT_STRING);
+  at_builder_init(&cmd, at_cmd, MAX_AT_CMD_SIZE);
+  at_builder_lit(&cmd, "AT+MQTTCONN?\r\n");
 
-    /* return Error */
-    if (ret != ESP8266_OK)
+  /* +MQTTCONN:<link>,<state>,<scheme>,"<host>",<port>,"<path>",<reconnect> */
+  ret = send_query(&cmd, "MQTTCONN", mqttconn_line, &query);
+  if ((ret == ESP8266_OK) && (query.found == 0))
   {
-      return ESP8266_ERROR;
+    ret = ESP8266_ERROR;
   }
+  return ret;
+}
 
-   /* Wait before sending data. */
-//    tickStart = HAL_GetTick();
+/**
+  * @brief  Subscribe to an MQTT topic.
+  * @param  topic: MQTT topic to subscribe to (e.g., "topic/esp32at").
+  * @param  qos: Quality of Service level (typically 1).
+  * @retval ESP8266_OK on success, ESP8266_ERROR otherwise.
+  */
+esp8266_status_t esp8266_mqtt_subscribe(const char *topic, uint8_t qos)
+{
+  esp8266_status_t ret;
+  at_builder_t cmd;
+  at_builder_init(&cmd, at_cmd, MAX_AT_CMD_SIZE);
+  at_builder_lit(&cmd, "AT+MQTTSUB=0,");
+  at_builder_quoted(&cmd, topic);
+  at_builder_char(&cmd, ',');
+  at_builder_uint(&cmd, qos);
+  at_builder_crlf(&cmd);
+  ret = send_cmd(&cmd, (uint8_t*)AT_OK_STRING);
+  return ret;
+}
+
+/**
+  * @brief  Publish a message to an MQTT topic.
+  * @details The message is sent from the caller's memory between the command
+  *          header and trailer. A message that would need escaping, or would
+  *          make the command longer than MAX_MQTTPUB_CMD_SIZE, goes through
+  *          AT+MQTTPUBRAW instead.
+  * @param  topic: MQTT topic to publish to (e.g., "topic/esp32at").
+  * @param  message: The message to publish (e.g., "hello aws!").
+  * @param  qos: Quality of Service level (typically 1).
+  * @param  retain: Retain flag (0 or 1).
+  * @retval ESP8266_OK on success, ESP8266_BUSY when the module was busy
+  *         (send it again later), ESP8266_ERROR otherwise.
+  */
+esp8266_status_t esp8266_mqtt_publish(const char *topic, const char *message, uint8_t qos, uint8_t retain)
+{
+  esp8266_status_t ret;
+  at_builder_t cmd;
+  esp8266_iovec_t frame[3];
+  uint32_t tick_start = HAL_GetTick();
+  uint32_t length = at_scan_str(message, &at_scan_escape);
+  uint32_t header;
+
+  if (message[length] != '\0')
+  {
+    return esp8266_mqtt_publish_raw(topic, (const uint8_t *)message, (uint32_t)strlen(message), qos, retain);
+  }
+
+  /* Header and trailer one after the other in at_cmd */
+  at_builder_init(&cmd, at_cmd, MAX_AT_CMD_SIZE);
+  at_builder_lit(&cmd, "AT+MQTTPUB=0,");
+  at_builder_quoted(&cmd, topic);
+  at_builder_lit(&cmd, ",\"");
+  header = cmd.length;
+  at_builder_lit(&cmd, "\",");
+  at_builder_uint(&cmd, qos);
+  at_builder_char(&cmd, ',');
+  at_builder_uint(&cmd, retain);
+  at_builder_crlf(&cmd);
+  if ((at_builder_finish(&cmd) < 0) || ((cmd.length + length) > MAX_MQTTPUB_CMD_SIZE))
+  {
+    return esp8266_mqtt_publish_raw(topic, (const uint8_t *)message, length, qos, retain);
+  }
+
+  frame[0].base = (const uint8_t *)at_cmd;
+  frame[0].length = header;
+  frame[1].base = (const uint8_t *)message;
+  frame[1].length = length;
+  frame[2].base = (const uint8_t *)&at_cmd[header];
+  frame[2].length = cmd.length - header;
+  ret = send_frame(frame, 3, (uint8_t*)AT_OK_STRING, 0);
+
+  if (ret == ESP8266_OK)
+  {
+    METRIC_INC(METRIC_PUBLISHES);
+    metrics_observe(METRIC_HIST_PUBLISH_LATENCY, HAL_GetTick() - tick_start);
+  }
+  return ret;
+}
+
+/**
+  * @brief  Publish length bytes of any value with AT+MQTTPUBRAW: the data
+  *         follows the '>' prompt as it is, without quoting nor escaping.
+  * @param  topic: MQTT topic to publish to (e.g., "topic/esp32at").
+  * @param  data: the payload, sent from the caller's memory.
+  * @param  length: its size.
+  * @param  qos: Quality of Service level (typically 1).
+  * @param  retain: Retain flag (0 or 1).
+  * @retval ESP8266_OK on success, ESP8266_BUSY when the module was busy
+  *         (send it again later), ESP8266_ERROR otherwise.
+  */
+esp8266_status_t esp8266_mqtt_publish_raw(const char *topic, const uint8_t* data, uint32_t length, uint8_t qos, uint8_t retain)
+{
+  at_builder_t cmd;
+  esp8266_iovec_t header;
+  uint32_t tick_start = HAL_GetTick();
+
+  at_builder_init(&cmd, at_cmd, MAX_AT_CMD_SIZE);
+  at_builder_lit(&cmd, "AT+MQTTPUBRAW=0,");
+  at_builder_quoted(&cmd, topic);
+  at_builder_char(&cmd, ',');
+  at_builder_uint(&cmd, length);
+  at_builder_char(&cmd, ',');
+  at_builder_uint(&cmd, qos);
+  at_builder_char(&cmd, ',');
+  at_builder_uint(&cmd, retain);
+  at_builder_crlf(&cmd);
+  if (at_builder_finish(&cmd) < 0)
+  {
+    return ESP8266_ERROR;
+  }
+
+  header.base = (const uint8_t *)at_cmd;
+  header.length = cmd.length;
+  return publish_raw(&header, 1, data, length, tick_start);
+}
+
+/**
+  * @brief  Render once the AT+MQTTPUB text before and after the payload.
+  * @param  handle: the handle to fill.
+  * @param  topic: MQTT topic to publish to (e.g., "topic/esp32at").
+  * @param  qos: Quality of Service level (typically 1).
+  * @param  retain: Retain flag (0 or 1).
+  * @retval ESP8266_OK on success, ESP8266_ERROR if the topic is too long.
+  */
+esp8266_status_t esp8266_mqtt_publish_register(esp8266_pub_handle_t* handle, const char *topic, uint8_t qos, uint8_t retain)
+{
+  at_builder_t text;
+  int32_t length;
+
+  at_builder_init(&text, handle->prefix, sizeof(handle->prefix));
+  at_builder_lit(&text, "AT+MQTTPUB=0,");
+  at_builder_quoted(&text, topic);
+  at_builder_lit(&text, ",\"");
+  length = at_builder_finish(&text);
+  if (length < 0)
+  {
+    return ESP8266_ERROR;
+  }
+  handle->prefix_length = (uint8_t)length;
+
+  at_builder_init(&text, handle->suffix, sizeof(handle->suffix));
+  at_builder_lit(&text, "\",");
+  at_builder_uint(&text, qos);
+  at_builder_char(&text, ',');
+  at_builder_uint(&text, retain);
+  at_builder_crlf(&text);
+  length = at_builder_finish(&text);
+  if (length < 0)
+  {
+    return ESP8266_ERROR;
+  }
+  handle->suffix_length = (uint8_t)length;
+
+  return ESP8266_OK;
+}
+
+/**
+  * @brief  Publish a message with a registered handle: the message is sent
+  *         from the caller's memory between the pre-rendered prefix and
+  *         suffix. As with esp8266_mqtt_publish(), a message that would need
+  *         escaping goes through AT+MQTTPUBRAW, with the same topic text.
+  * @param  handle: filled by esp8266_mqtt_publish_register().
+  * @param  message: The message to publish (e.g., "hello aws!").
+  * @retval ESP8266_OK on success, ESP8266_BUSY when the module was busy
+  *         (send it again later), ESP8266_ERROR otherwise.
+  */
+esp8266_status_t esp8266_mqtt_publish_handle(const esp8266_pub_handle_t* handle, const char *message)
+{
+  esp8266_status_t ret;
+  at_builder_t cmd;
+  esp8266_iovec_t frame[3];
+  uint32_t tick_start = HAL_GetTick();
+  uint32_t length = at_scan_str(message, &at_scan_escape);
+
+  if ((message[length] != '\0') || ((handle->prefix_length + length + handle->suffix_length) > MAX_MQTTPUB_CMD_SIZE))
+  {
+    length += (uint32_t)strlen(&message[length]);
+
+    /* AT+MQTTPUBRAW=0,"<topic>",<length>,<qos>,<retain>: the topic is the
+       prefix without its verb and last quote, qos and retain the suffix
+       without its first quote */
+    at_builder_init(&cmd, at_cmd, MAX_AT_CMD_SIZE);
+    at_builder_uint(&cmd, length);
+    at_builder_mem(&cmd, &handle->suffix[1], handle->suffix_length - 1U);
+    at_builder_finish(&cmd);    /* at most 10 + MAX_PUB_SUFFIX_SIZE bytes */
+
+    frame[0].base = (const uint8_t *)"AT+MQTTPUBRAW=0,";
+    frame[0].length = sizeof("AT+MQTTPUBRAW=0,") - 1U;
+    frame[1].base = (const uint8_t *)&handle->prefix[PUB_VERB_SIZE];
+    frame[1].length = handle->prefix_length - PUB_VERB_SIZE - 1U;
+    frame[2].base = (const uint8_t *)at_cmd;
+    frame[2].length = cmd.length;
+    return publish_raw(frame, 3, (const uint8_t *)message, length, tick_start);
+  }
+
+  frame[0].base = (const uint8_t *)handle->prefix;
+  frame[0].length = handle->prefix_length;
+  frame[1].base = (const uint8_t *)message;
+  frame[1].length = length;
+  frame[2].base = (const uint8_t *)handle->suffix;
+  frame[2].length = handle->suffix_length;
+  ret = send_frame(frame, 3, (uint8_t*)AT_OK_STRING, 0);
+
+  if (ret == ESP8266_OK)
+  {
+    METRIC_INC(METRIC_PUBLISHES);
+    metrics_observe(METRIC_HIST_PUBLISH_LATENCY, HAL_GetTick() - tick_start);
+  }
+  return ret;
+}
+
+/**
+  * @brief  Set the sleep mode of the module.
+  * @param  mode: ESP8266_SLEEP_DISABLE keeps the radio on. ESP8266_SLEEP_LIGHT
+  *         needs a wakeup source, see esp8266_sleep_wakeup_gpio().
+  * @retval ESP8266_OK on success, ESP8266_ERROR otherwise.
+  */
+esp8266_status_t esp8266_sleep(esp8266_sleep_mode_t mode)
+{
+  esp8266_status_t ret;
+  at_builder_t cmd;
+  at_builder_init(&cmd, at_cmd, MAX_AT_CMD_SIZE);
+  at_builder_lit(&cmd, "AT+SLEEP=");
+  at_builder_uint(&cmd, (uint32_t)mode);
+  at_builder_crlf(&cmd);
+  ret = send_cmd(&cmd, (uint8_t*)AT_OK_STRING);
+  return ret;
+}
+
+/**
+  * @brief  Wake the module up from light sleep with one of its GPIOs.
+  * @param  gpio: the module GPIO number, driven by the MCU.
+  * @param  level: the level that wakes the module up (0 or 1).
+  * @retval ESP8266_OK on success, ESP8266_ERROR otherwise.
+  */
+esp8266_status_t esp8266_sleep_wakeup_gpio(uint8_t gpio, uint8_t level)
+{
+  esp8266_status_t ret;
+  at_builder_t cmd;
+  at_builder_init(&cmd, at_cmd, MAX_AT_CMD_SIZE);
+  at_builder_lit(&cmd, "AT+SLEEPWKCFG=2,");
+  at_builder_uint(&cmd, gpio);
+  at_builder_char(&cmd, ',');
+  at_builder_uint(&cmd, level);
+  at_builder_crlf(&cmd);
+  ret = send_cmd(&cmd, (uint8_t*)AT_OK_STRING);
+  return ret;
+}
+
+/* === End of Added Functions === */
+
+/**
+  * @brief  Send data over the wifi connection.
+  * @param  Buffer: the buffer to send
+  * @param  Length: the Buffer's data size.
+  * @retval returns ESP8266_OK on success, ESP8266_BUSY when the module was
+  *         busy and ESP8266_ERROR otherwise.
+  */
+esp8266_status_t esp8266_send_data(uint8_t* Buffer, uint32_t Length)
+{
+  //uart_dma_restart();
+  esp8266_status_t ret = ESP8266_OK;
+  esp8266_iovec_t payload;
+  at_builder_t cmd;
+
+  if (Buffer != NULL)
+  {
+    //uint32_t tickStart;
+    /* Construct the CIPSEND command */
+    at_builder_init(&cmd, at_cmd, MAX_AT_CMD_SIZE);
+    at_builder_lit(&cmd, "AT+CIPSEND=");
+    client_link(&cmd);
+    at_builder_uint(&cmd, Length);
+    at_builder_crlf(&cmd);
+
+    /* The CIPSEND command doesn't have a return command
+       until the data is actually sent. Thus we check here whether
+       we got the '>' prompt or not. */
+    ret = send_cmd(&cmd, (uint8_t*)AT_SEND_PROMPT_STRING);
+
+    /* Busy, timeout or error: as it is */
+    if (ret != ESP8266_OK)
+  {
+      return ret;
+  }
+
+   /* Wait before sending data. */
+//    tickStart = HAL_GetTick();
 //    while (HAL_GetTick() - tickStart < 500)
 //    {
 //    }
 
 
-  /* Send the data */
-  ret = send_at_cmd(Buffer, Length, (uint8_t*)AT_SEND_OK_STRING);
+  /* Send the data, straight from Buffer */
+  payload.base = Buffer;
+  payload.length = Length;
+  ret = send_frame(&payload, 1, (uint8_t*)AT_SEND_OK_STRING, 1);
+  }
+
+  return ret;
+}
+
+
+/**
+  * @brief  Send one datagram over the UDP connection, straight from data.
+  * @details Fire and forget: SEND OK only tells the module sent it, nothing
+  *          comes back from the peer. The prompt and SEND OK are the only
+  *          round trips, no MQTT nor TLS framing.
+  * @param  data: the payload, any byte.
+  * @param  length: its size, 1 to ESP8266_MAX_DATAGRAM_SIZE.
+  * @param  remote_ip: the peer of this datagram only, NULL for the peer of
+  *         the connection.
+  * @param  remote_port: its port, ignored without remote_ip.
+  * @retval ESP8266_OK when sent, ESP8266_BUSY when the module was busy,
+  *         ESP8266_ERROR otherwise.
+  */
+esp8266_status_t esp8266_send_datagram(const uint8_t* data, uint32_t length, const char* remote_ip, uint32_t remote_port)
+{
+  esp8266_status_t ret;
+  esp8266_iovec_t payload;
+  at_builder_t cmd;
+
+  if ((data == NULL) || (length == 0) || (length > ESP8266_MAX_DATAGRAM_SIZE))
+  {
+    return ESP8266_ERROR;
+  }
+
+  /* AT+CIPSEND=[<link>,]<length>[,"<remote ip>",<remote port>] */
+  at_builder_init(&cmd, at_cmd, MAX_AT_CMD_SIZE);
+  at_builder_lit(&cmd, "AT+CIPSEND=");
+  client_link(&cmd);
+  at_builder_uint(&cmd, length);
+  if (remote_ip != NULL)
+  {
+    at_builder_char(&cmd, ',');
+    at_builder_quoted(&cmd, remote_ip);
+    at_builder_char(&cmd, ',');
+    at_builder_uint(&cmd, remote_port);
+  }
+  at_builder_crlf(&cmd);
+
+  ret = send_cmd(&cmd, (uint8_t*)AT_SEND_PROMPT_STRING);
+  if (ret != ESP8266_OK)
+  {
+    return ret;
+  }
+
+  payload.base = data;
+  payload.length = length;
+  ret = send_frame(&payload, 1, (uint8_t*)AT_SEND_OK_STRING, 1);
+  if (ret == ESP8266_OK)
+  {
+    METRIC_INC(METRIC_DATAGRAMS);
+  }
+
+  return ret;
+}
+
+/**
+  * @brief  receive data over the wifi connection.
+  * @param  pData the buffer to fill will the received data.
+  * @param  Length the maximum data size to receive.
+  * @param retLength the actual data received.
+  * @retval returns ESP8266_OK on success and ESP8266_ERROR otherwise.
+  */
+esp8266_status_t esp8266_recv_data(uint8_t* pData, uint32_t Length, uint32_t* retLength)
+{
+  esp8266_status_t ret;
+
+  /* Receive the data from the host */
+  ret = recv_data(pData, Length, retLength);
+
+  return ret;
+}
+
+/**
+  * @brief  Give up the command in progress before its deadline: it fails
+  *         with what was received so far. Interrupt or other task context.
+  * @retval None.
+  */
+void esp8266_cancel(void)
+{
+  esp8266_io_cancel();
+}
+
+/**
+  * @brief  Find the deadline of a command from its verb.
+  * @param  cmd: the command, or its first segment ("AT+VERB=..." or "AT\r\n").
+  * @param  length: its length.
+  * @param  data: 1 for the data sent after a prompt, whatever its bytes.
+  * @retval The entry of data, of the verb, or of unknown verbs.
+  */
+esp8266_deadline_t* esp8266_deadline_of(const uint8_t* cmd, uint32_t length, uint8_t data)
+{
+  uint32_t verb_length = 0;
+
+  if (data != 0)
+  {
+    return &deadlines[DEADLINE_DATA];
+  }
+  if ((length < 3U) || (cmd[0] != 'A') || (cmd[1] != 'T'))
+  {
+    return &deadlines[DEADLINE_UNKNOWN];
+  }
+  if (cmd[2] != '+')
+  {
+    return &deadlines[0];
+  }
+
+  cmd += 3;
+  length -= 3U;
+  while ((verb_length < length) && (cmd[verb_length] >= 'A') && (cmd[verb_length] <= 'Z'))
+  {
+    verb_length++;
+  }
+
+  for (uint32_t i = 1; i < DEADLINE_UNKNOWN; i++)
+  {
+    if ((strncmp(deadlines[i].verb, (const char *)cmd, verb_length) == 0) && (deadlines[i].verb[verb_length] == '\0'))
+    {
+      return &deadlines[i];
+    }
+  }
+  return &deadlines[DEADLINE_UNKNOWN];
+}
+
+/**
+  * @brief  Update the deadline of a verb with the round trip of a command
+  *         that completed: SRTT + K x RTTVAR, RFC 6298 with the gains 1/8
+  *         and 1/4, kept in fixed point. Ends a backoff.
+  * @param  deadline: the entry of its verb.
+  * @param  rtt_ms: time from the command sent to its final response.
+  * @retval None.
+  */
+void esp8266_deadline_sample(esp8266_deadline_t* deadline, uint32_t rtt_ms)
+{
+  uint32_t rto;
+
+  if (deadline->samples == 0)
+  {
+    deadline->srtt_x8 = rtt_ms * 8U;
+    deadline->rttvar_x4 = rtt_ms * 2U;
+  }
+  else
+  {
+    uint32_t srtt = deadline->srtt_x8 / 8U;
+    uint32_t error = (rtt_ms > srtt) ? (rtt_ms - srtt) : (srtt - rtt_ms);
+
+    /* RTTVAR += (|SRTT - R| - RTTVAR) / 4, then SRTT += (R - SRTT) / 8 */
+    deadline->rttvar_x4 = deadline->rttvar_x4 - (deadline->rttvar_x4 / 4U) + error;
+    deadline->srtt_x8 = deadline->srtt_x8 - (deadline->srtt_x8 / 8U) + rtt_ms;
+  }
+  deadline->samples++;
+
+  /* At least one tick of variation, as the clock granularity of RFC 6298 */
+  rto = (deadline->srtt_x8 / 8U) + (ESP8266_RTO_K * ((deadline->rttvar_x4 / 4U) + 1U));
+  if (rto < deadline->min_ms)
+  {
+    rto = deadline->min_ms;
+  }
+  if (rto > deadline->max_ms)
+  {
+    rto = deadline->max_ms;
+  }
+  deadline->rto_ms = rto;
+}
+
+/**
+  * @brief  Record a failed command. A timeout doubles the deadline of its
+  *         verb, up to max_ms, until a command of the verb completes.
+  * @param  deadline: the entry of its verb.
+  * @param  status: ESP8266_TIMEOUT, ESP8266_ERROR, ESP8266_CANCELLED...
+  * @param  latency_ms: time from the command sent to the failure detected.
+  * @retval None.
+  */
+void esp8266_deadline_failed(esp8266_deadline_t* deadline, esp8266_status_t status, uint32_t latency_ms)
+{
+  if (status == ESP8266_TIMEOUT)
+  {
+    deadline_backoff(deadline);
+  }
+
+  deadline->failures++;
+  deadline->fail_latency_last_ms = latency_ms;
+  if (latency_ms > deadline->fail_latency_max_ms)
+  {
+    deadline->fail_latency_max_ms = latency_ms;
+  }
+}
+
+/**
+  * @brief  Back off every deadline, e.g. after a reset of the module, whose
+  *         first answers are slow.
+  * @retval None.
+  */
+void esp8266_deadline_backoff_all(void)
+{
+  for (uint32_t i = 0; i < (sizeof(deadlines) / sizeof(deadlines[0])); i++)
+  {
+    deadline_backoff(&deadlines[i]);
+  }
+}
+
+/**
+  * @brief  The deadline table, with the failures of each verb.
+  * @param  count: set to the number of entries.
+  * @retval The first entry.
+  */
+const esp8266_deadline_t* esp8266_deadline_table(uint32_t* count)
+{
+  *count = sizeof(deadlines) / sizeof(deadlines[0]);
+  return deadlines;
+}
+
+/**
+  * @brief  The name of a deadline entry in reports: its verb, or "AT" (AT and
+  *         ATE0), "data" (the data after a prompt), "other" (the verbs not
+  *         listed).
+  * @param  deadline: the entry.
+  * @retval The name.
+  */
+const char* esp8266_deadline_label(const esp8266_deadline_t* deadline)
+{
+  switch (deadline->verb[0])
+  {
+    case '\0':
+      return "AT";
+    case '>':
+      return "data";
+    case '?':
+      return "other";
+    default:
+      return deadline->verb;
+  }
+}
+
+/**
+  * @brief  Run the AT command built in cmd
+  * @param  cmd the command builder, finished here.
+  * @param  Token the expected output if command runs successfully
+  * @retval returns ESP8266_OK on success and ESP8266_ERROR otherwise.
+  */
+static esp8266_status_t send_cmd(at_builder_t* cmd, const uint8_t* Token)
+{
+  int32_t length = at_builder_finish(cmd);
+
+  /* Never send a truncated command */
+  if (length < 0)
+  {
+    return ESP8266_ERROR;
+  }
+
+  return send_at_cmd((uint8_t *)cmd->buf, (uint32_t)length, Token);
+}
+
+/**
+  * @brief  Run the AT command
+  * @param  cmd the buffer to fill will the received data.
+  * @param  Length the maximum data size to receive.
+  * @param  Token the expected output if command runs successfully
+  * @retval returns ESP8266_OK on success and ESP8266_ERROR otherwise.
+  */
+static esp8266_status_t send_at_cmd(uint8_t* cmd, uint32_t Length, const uint8_t* Token)
+{
+  esp8266_iovec_t iov;
+
+  iov.base = cmd;
+  iov.length = Length;
+  return send_frame(&iov, 1, Token, 0);
+}
+
+/**
+  * @brief  Send a command made of several segments, then wait for Token
+  *         until the deadline of its verb.
+  * @param  iov the segments, sent in order as one command.
+  * @param  count the number of segments.
+  * @param  Token the expected output if command runs successfully
+  * @param  data 1 for the data after a prompt, 0 for a command.
+  * @retval returns ESP8266_OK on success, ESP8266_BUSY when the module
+  *         was busy (dropped without running, the caller sends it again
+  *         later), ESP8266_CANCELLED after esp8266_cancel() and
+  *         ESP8266_ERROR otherwise.
+  */
+static esp8266_status_t send_frame(const esp8266_iovec_t* iov, uint32_t count, const uint8_t* Token, uint8_t data)
+{
+  esp8266_status_t ret;
+  esp8266_deadline_t* deadline = esp8266_deadline_of(iov[0].base, iov[0].length, data);
+  uint32_t sent;
+
+  /* The data goes right after the prompt, nothing may come in between */
+  if (data == 0)
+  {
+    esp8266_command_starting();
+  }
+  sent = HAL_GetTick();
+
+  /* One deadline for the whole response, whatever the pauses in it */
+  esp8266_io_deadline_set(sent + deadline->rto_ms);
+
+  /* Send the command */
+  if (esp8266_io_sendv(iov, count) < 0)
+  {
+    ret = ESP8266_IO_ERROR;
+  }
+  else
+  {
+    /* Wait for reception */
+    ret = recv_token(rx_buffer, MAX_BUFFER_SIZE, (const char *)Token, 0);
+  }
+  esp8266_io_deadline_clear();
+
+  return command_done(deadline, ret, sent);
+}
+
+/**
+  * @brief  Send a query, then hand each line of its response starting with
+  *         +verb: (or verb: for a line without '+') to handler, until OK or
+  *         ERROR or the deadline of the verb. The lines are received one at
+  *         a time into the same buffer and parsed where they are.
+  * @param  cmd the command builder, finished here.
+  * @param  verb the lines wanted, e.g. "CIFSR".
+  * @param  handler called for each of them.
+  * @param  context passed to handler.
+  * @retval returns ESP8266_OK on success, ESP8266_BUSY when the module
+  *         was busy (dropped without running, the caller sends it again
+  *         later), ESP8266_CANCELLED after esp8266_cancel() and
+  *         ESP8266_ERROR otherwise.
+  */
+static esp8266_status_t send_query(at_builder_t* cmd, const char* verb, query_handler_t handler, void* context)
+{
+  esp8266_status_t ret;
+  esp8266_deadline_t* deadline;
+  int32_t length = at_builder_finish(cmd);
+  uint32_t sent;
+
+  /* Never send a truncated command */
+  if (length < 0)
+  {
+    return ESP8266_ERROR;
+  }
+
+  deadline = esp8266_deadline_of((const uint8_t *)cmd->buf, (uint32_t)length, 0);
+  esp8266_command_starting();
+  sent = HAL_GetTick();
+  esp8266_io_deadline_set(sent + deadline->rto_ms);
+
+  if (esp8266_io_send((uint8_t *)cmd->buf, (uint32_t)length) < 0)
+  {
+    ret = ESP8266_IO_ERROR;
+  }
+  else
+  {
+    ret = recv_lines(verb, handler, context);
+  }
+  esp8266_io_deadline_clear();
+
+  return command_done(deadline, ret, sent);
+}
+
+/**
+  * @brief  Account for the end of a command: metrics and deadline of its verb.
+  * @param  deadline the entry of its verb.
+  * @param  ret how it ended.
+  * @param  sent HAL_GetTick() when it was sent.
+  * @retval ret, ESP8266_ERROR for any failure but a cancel or a busy module.
+  */
+static esp8266_status_t command_done(esp8266_deadline_t* deadline, esp8266_status_t ret, uint32_t sent)
+{
+  if (ret == ESP8266_TIMEOUT)
+  {
+    METRIC_INC(METRIC_AT_TIMEOUTS);
+  }
+  else if (ret == ESP8266_ERROR)
+  {
+    METRIC_INC(METRIC_AT_ERRORS);
+  }
+
+  if (ret == ESP8266_BUSY)
+  {
+    /* Answered at once without running the command: says nothing of its
+       round trip, nor of a module that stopped answering */
+    METRIC_INC(METRIC_AT_BUSY);
+  }
+  else if (ret == ESP8266_OK)
+  {
+    esp8266_deadline_sample(deadline, HAL_GetTick() - sent);
+  }
+  else
+  {
+    esp8266_deadline_failed(deadline, ret, HAL_GetTick() - sent);
+  }
+
+  return ((ret == ESP8266_OK) || (ret == ESP8266_CANCELLED) || (ret == ESP8266_BUSY)) ? ret : ESP8266_ERROR;
+}
+
+/**
+  * @brief  Receive the response into Buffer until it holds Token or
+  *         AT_ERROR_STRING, one line (or '>' prompt) at a time: the tokens
+  *         are searched for once per line, only where they can be.
+  * @param  Buffer where to store the response, '\0' terminated.
+  * @param  Size its size.
+  * @param  Token the expected output if command runs successfully
+  * @param  Messages 1 when waiting for a +MQTTSUBRECV message holding Token,
+  *         0 for a command response: the other messages received meanwhile
+  *         go to esp8266_message_received(), whatever their payload holds.
+  * @retval ESP8266_OK, ESP8266_ERROR on an error line, ESP8266_BUSY on a
+  *         busy line, ESP8266_TIMEOUT when the wait is over (see
+  *         esp8266_io_recv_until()), ESP8266_CANCELLED after esp8266_cancel(),
+  *         ESP8266_IO_ERROR when full.
+  */
+static esp8266_status_t recv_token(char* Buffer, uint32_t Size, const char* Token, uint8_t Messages)
+{
+  uint32_t idx = 0;
+  uint32_t token_length = (uint32_t)strlen(Token);
+
+  Buffer[0] = '\0';
+  while ((idx + 1U) < Size)
+  {
+    uint32_t start = idx;
+    int32_t n = esp8266_io_recv_until((uint8_t *)&Buffer[idx], Size - 1U - idx, &at_scan_line);
+    esp8266_urc_frame_t frame;
+    uint32_t m;
+
+    if (n <= 0)
+    {
+      return (esp8266_io_cancelled() != 0) ? ESP8266_CANCELLED : ESP8266_TIMEOUT;
+    }
+    /* A message is read by its length: its payload may hold any token */
+    m = read_message(&Buffer[idx], (uint32_t)n, Size - 1U - idx, &frame);
+    if (m != 0)
+    {
+      if ((Messages != 0) && (message_holds(&Buffer[idx], m, Token) != 0))
+      {
+        Buffer[idx + m] = '\0';
+        return ESP8266_OK;
+      }
+      message_done(&Buffer[idx], m, &frame);
+      Buffer[idx] = '\0';
+      continue;
+    }
+    idx += (uint32_t)n;
+    Buffer[idx] = '\0';
+
+    /* Both strings may have started in the previous lines */
+    if (strstr(&Buffer[(start > token_length) ? (start - token_length) : 0], Token) != NULL)
+    {
+      return ESP8266_OK;
+    }
+    if (strstr(&Buffer[(start > (sizeof(AT_ERROR_STRING) - 1U)) ? (start - (sizeof(AT_ERROR_STRING) - 1U)) : 0],
+               AT_ERROR_STRING) != NULL)
+    {
+      return ESP8266_ERROR;
+    }
+    /* Failed join of AT firmware before v2.0: +CWJAP:<code> then FAIL */
+    if (strncmp(&Buffer[start], AT_FAIL_STRING, sizeof(AT_FAIL_STRING) - 1U) == 0)
+    {
+      return ESP8266_ERROR;
+    }
+    /* Still running the previous command: this one is dropped */
+    if (strncmp(&Buffer[start], AT_BUSY_STRING, sizeof(AT_BUSY_STRING) - 1U) == 0)
+    {
+      return ESP8266_BUSY;
+    }
+
+    /* A line cut short with room left: the module stalled in the middle */
+    if ((Buffer[idx - 1U] != '\n') && (Buffer[idx - 1U] != '>') && ((idx + 1U) < Size))
+    {
+      return (esp8266_io_cancelled() != 0) ? ESP8266_CANCELLED : ESP8266_TIMEOUT;
+    }
   }
 
-  return ret;
+  return ESP8266_IO_ERROR;
 }
 
-
 /**
-  * @brief  receive data over the wifi connection.
-  * @param  pData the buffer to fill will the received data.
-  * @param  Length the maximum data size to receive.
-  * @param retLength the actual data received.
-  * @retval returns ESP8266_OK on success and ESP8266_ERROR otherwise.
+  * @brief  Receive a query response one line at a time into rx_buffer: the
+  *         memory used is one line, however long the response. The part of
+  *         a line past QUERY_LINE_SIZE is dropped.
+  * @param  verb the lines handed to handler.
+  * @param  handler called for each of them.
+  * @param  context passed to handler.
+  * @retval ESP8266_OK on OK, ESP8266_ERROR on ERROR or FAIL, ESP8266_BUSY on
+  *         busy p... or busy s..., ESP8266_TIMEOUT when the wait is over,
+  *         ESP8266_CANCELLED after esp8266_cancel().
   */
-esp8266_status_t esp8266_recv_data(uint8_t* pData, uint32_t Length, uint32_t* retLength)
+static esp8266_status_t recv_lines(const char* verb, query_handler_t handler, void* context)
 {
-  esp8266_status_t ret;
+  at_line_t line;
 
-  /* Receive the data from the host */
-  ret = recv_data(pData, Length, retLength);
+  while (1)
+  {
+    int32_t n = esp8266_io_recv_until((uint8_t *)rx_buffer, QUERY_LINE_SIZE, &at_scan_eol);
+    esp8266_urc_frame_t frame;
+    uint32_t m;
+    uint8_t complete;
 
-  return ret;
+    if (n <= 0)
+    {
+      return (esp8266_io_cancelled() != 0) ? ESP8266_CANCELLED : ESP8266_TIMEOUT;
+    }
+    /* A message is kept whole: the buffer holds one line only otherwise */
+    m = read_message(rx_buffer, (uint32_t)n, MAX_BUFFER_SIZE - 1U, &frame);
+    if (m != 0)
+    {
+      message_done(rx_buffer, m, &frame);
+      continue;
+    }
+    complete = (rx_buffer[n - 1] == '\n') ? 1U : 0U;
+
+    /* A line cut short with room left: the module stalled in the middle */
+    if ((complete == 0) && ((uint32_t)n < QUERY_LINE_SIZE))
+    {
+      return (esp8266_io_cancelled() != 0) ? ESP8266_CANCELLED : ESP8266_TIMEOUT;
+    }
+
+    at_parse_line(rx_buffer, (uint32_t)n, &line);
+    if (at_field_equals(&line.text, RESPONSE_OK) != 0)
+    {
+      return ESP8266_OK;
+    }
+    if ((at_field_equals(&line.text, "ERROR") != 0) || (at_field_equals(&line.text, "FAIL") != 0))
+    {
+      return ESP8266_ERROR;
+    }
+    if (strncmp(rx_buffer, AT_BUSY_STRING, sizeof(AT_BUSY_STRING) - 1U) == 0)
+    {
+      return ESP8266_BUSY;
+    }
+    if (at_line_is(&line, verb) != 0)
+    {
+      handler(&line, context);
+    }
+
+    /* Drop the rest of an overlong line */
+    while (complete == 0)
+    {
+      n = esp8266_io_recv_until((uint8_t *)rx_buffer, QUERY_LINE_SIZE, &at_scan_eol);
+      if (n <= 0)
+      {
+        return (esp8266_io_cancelled() != 0) ? ESP8266_CANCELLED : ESP8266_TIMEOUT;
+      }
+      complete = (rx_buffer[n - 1] == '\n') ? 1U : 0U;
+    }
+  }
 }
 
 /**
-  * @brief  Run the AT command
-  * @param  cmd the buffer to fill will the received data.
-  * @param  Length the maximum data size to receive.
-  * @param  Token the expected output if command runs successfully
-  * @retval returns ESP8266_OK on success and ESP8266_ERROR otherwise.
+  * @brief  Complete a +MQTTSUBRECV message or +IPD data received while
+  *         waiting: its payload is read by its declared length, so a token
+  *         it holds is not mistaken for the end of a response. +IPD data is
+  *         handed to esp8266_ipd_received() as it comes.
+  * @param  segment the bytes just received, up to a '\n' or '>'.
+  * @param  length their count.
+  * @param  size the room at segment, the payload past it is dropped.
+  * @param  frame where the topic and the payload are in segment.
+  * @retval The bytes of the message kept in segment, 0 when segment does
+  *         not start a message.
   */
-static esp8266_status_t send_at_cmd(uint8_t* cmd, uint32_t Length, const uint8_t* Token)
+static uint32_t read_message(char* segment, uint32_t length, uint32_t size, esp8266_urc_frame_t* frame)
 {
-  uint32_t idx = 0;
-  uint8_t RxChar;
+  uint32_t end;
 
-  /* Reset the Rx buffer to make sure no previous data exist */
-  memset(rx_buffer, '\0', MAX_BUFFER_SIZE);
-
-  /* Send the command */
-  if (esp8266_io_send(cmd, Length) < 0)
+  if (esp8266_urc_parse_frame(segment, length, frame) == 0)
   {
-    return ESP8266_ERROR;
+    return 0;
   }
 
-  /* Wait for reception */
-  while (1)
+  /* Its CRLF comes next as an empty line */
+  end = frame->data_start + frame->data_length;
+  if ((frame->type == ESP8266_URC_IPD) && (length > frame->data_start))
   {
-  /* Wait to receive data */
-    if (esp8266_io_recv(&RxChar, 1) != 0)
+    esp8266_ipd_received(frame->link, (const uint8_t *)&segment[frame->data_start],
+                         ((length < end) ? length : end) - frame->data_start);
+  }
+  while (length < end)
+  {
+    uint8_t skip[32];
+    uint8_t* dst = skip;
+    uint32_t want = ((end - length) < sizeof(skip)) ? (end - length) : sizeof(skip);
+    int32_t n;
+
+    if (length < size)
     {
-      rx_buffer[idx++] = RxChar;
+      dst = (uint8_t *)&segment[length];
+      want = ((end - length) < (size - length)) ? (end - length) : (size - length);
     }
-    else
+    n = esp8266_io_recv(dst, want);
+    if (n <= 0)
     {
       break;
     }
+    if (frame->type == ESP8266_URC_IPD)
+    {
+      esp8266_ipd_received(frame->link, dst, (uint32_t)n);
+    }
+    length += (uint32_t)n;
+  }
 
-  /* Check that max buffer size has not been reached */
-    if (idx == MAX_BUFFER_SIZE)
+  return (length < size) ? length : size;
+}
+
+/**
+  * @brief  Hand a +MQTTSUBRECV message read by read_message() to
+  *         esp8266_message_received(); +IPD data is handed over already.
+  * @param  message the message, from its header.
+  * @param  length the bytes of it kept.
+  * @param  frame where its topic and its payload are.
+  */
+static void message_done(const char* message, uint32_t length, const esp8266_urc_frame_t* frame)
+{
+  uint32_t end = frame->data_start + frame->data_length;
+  uint32_t kept = (length > frame->data_start) ? (((length < end) ? length : end) - frame->data_start) : 0;
+
+  if (frame->type == ESP8266_URC_SUBRECV)
+  {
+    esp8266_message_received(&message[frame->topic_start], frame->topic_length,
+                             (const uint8_t *)&message[frame->data_start], kept,
+                             (kept < frame->data_length) ? 1U : 0U);
+  }
+}
+
+/**
+  * @brief  Search token in a message, '\0' bytes included.
+  * @retval 1 when found, 0 otherwise.
+  */
+static uint8_t message_holds(const char* message, uint32_t length, const char* token)
+{
+  uint32_t token_length = (uint32_t)strlen(token);
+
+  for (uint32_t i = 0; (i + token_length) <= length; i++)
+  {
+    if (memcmp(&message[i], token, token_length) == 0)
     {
-      break;
+      return 1;
     }
+  }
+  return 0;
+}
+
+/**
+  * @brief  +CIFSR:<key>,"<address>": copy the address of the key wanted.
+  */
+static void cifsr_line(const at_line_t* line, void* context)
+{
+  cifsr_query_t* query = (cifsr_query_t *)context;
+
+  if ((line->count >= 2U) && (at_field_equals(&line->field[0], query->key) != 0))
+  {
+    at_field_copy(&line->field[1], (char *)query->value, ESP8266_IP_SIZE);
+    query->found = 1;
+  }
+}
+
+/**
+  * @brief  +CIPSNTPTIME:<weekday> <month> <day> <hh:mm:ss> <year>, the day
+  *         possibly padded with a space.
+  */
+static void sntp_line(const at_line_t* line, void* context)
+{
+  static const char months[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+  query_result_t* query = (query_result_t *)context;
+  esp8266_time_t* time = (esp8266_time_t *)query->result;
+  at_field_t word[5];
+  const char* p;
+  const char* end;
+  uint8_t count = 0;
+  int32_t day;
+  int32_t year;
+  int8_t hour;
+  int8_t minute;
+  int8_t second;
+
+  if (line->count != 1U)
+  {
+    return;
+  }
+
+  /* Split on the spaces, without copy */
+  p = line->field[0].ptr;
+  end = &p[line->field[0].length];
+  while ((p != end) && (count < 5U))
+  {
+    const char* start;
 
-    /* Extract the Token */
-    if (strstr((char *)rx_buffer, (char *)Token) != NULL)
+    while ((p != end) && (*p == ' '))
     {
-      return ESP8266_OK;
+      p++;
+    }
+    start = p;
+    while ((p != end) && (*p != ' '))
+    {
+      p++;
     }
+    if (p != start)
+    {
+      word[count].ptr = start;
+      word[count].length = (uint16_t)(p - start);
+      word[count].quoted = 0;
+      count++;
+    }
+  }
+  if ((count != 5U) || (word[1].length != 3U) || (word[3].length != 8U) ||
+      (word[3].ptr[2] != ':') || (word[3].ptr[5] != ':') ||
+      (at_field_int(&word[2], &day) != 0) || (at_field_int(&word[4], &year) != 0))
+  {
+    return;
+  }
 
-  /* Check if the message contains error code */
-    if (strstr((char *)rx_buffer, AT_ERROR_STRING) != NULL)
+  hour = read_two_digits(&word[3].ptr[0]);
+  minute = read_two_digits(&word[3].ptr[3]);
+  second = read_two_digits(&word[3].ptr[6]);
+  if ((hour < 0) || (minute < 0) || (second < 0))
+  {
+    return;
+  }
+
+  for (uint8_t month = 0; month < 12U; month++)
+  {
+    if (memcmp(&months[month * 3U], word[1].ptr, 3) == 0)
     {
-      return ESP8266_ERROR;
+      time->year = (uint16_t)year;
+      time->month = (uint8_t)(month + 1U);
+      time->day = (uint8_t)day;
+      time->hour = (uint8_t)hour;
+      time->minute = (uint8_t)minute;
+      time->second = (uint8_t)second;
+      query->found = 1;
+      return;
     }
   }
+}
+
+/**
+  * @brief  +CWJAP:"<ssid>","<bssid>",<channel>,<rssi>,...
+  */
+static void cwjap_line(const at_line_t* line, void* context)
+{
+  query_result_t* query = (query_result_t *)context;
+  esp8266_ap_info_t* ap = (esp8266_ap_info_t *)query->result;
+  int32_t value;
+
+  if (line->count < 4U)
+  {
+    return;
+  }
+
+  at_field_copy(&line->field[0], ap->ssid, sizeof(ap->ssid));
+  at_field_copy(&line->field[1], ap->bssid, sizeof(ap->bssid));
+  if (at_field_int(&line->field[2], &value) == 0)
+  {
+    ap->channel = (uint8_t)value;
+  }
+  if (at_field_int(&line->field[3], &value) == 0)
+  {
+    ap->rssi = (int8_t)value;
+  }
+  query->found = 1;
+}
+
+/**
+  * @brief  +CWLAP:(<ecn>,"<ssid>",<rssi>,"<mac>",<channel>,...), handed over
+  *         to the caller at once.
+  */
+static void cwlap_line(const at_line_t* line, void* context)
+{
+  cwlap_query_t* query = (cwlap_query_t *)context;
+  esp8266_ap_info_t ap;
+  int32_t value;
+
+  if (line->count < 5U)
+  {
+    return;
+  }
+
+  memset(&ap, 0, sizeof(ap));
+  if (at_field_int(&line->field[0], &value) == 0)
+  {
+    ap.encryption = (esp8266_encryption_t)value;
+  }
+  at_field_copy(&line->field[1], ap.ssid, sizeof(ap.ssid));
+  if (at_field_int(&line->field[2], &value) == 0)
+  {
+    ap.rssi = (int8_t)value;
+  }
+  at_field_copy(&line->field[3], ap.bssid, sizeof(ap.bssid));
+  if (at_field_int(&line->field[4], &value) == 0)
+  {
+    ap.channel = (uint8_t)value;
+  }
+
+  query->callback(&ap, query->context);
+}
+
+/**
+  * @brief  +MQTTCONN:<link>,<state>,<scheme>,"<host>",<port>,"<path>",<reconnect>
+  */
+static void mqttconn_line(const at_line_t* line, void* context)
+{
+  query_result_t* query = (query_result_t *)context;
+  esp8266_mqtt_conn_info_t* info = (esp8266_mqtt_conn_info_t *)query->result;
+  int32_t value;
+
+  if (line->count < 5U)
+  {
+    return;
+  }
+
+  if (at_field_int(&line->field[1], &value) == 0)
+  {
+    info->state = (uint8_t)value;
+  }
+  if (at_field_int(&line->field[2], &value) == 0)
+  {
+    info->scheme = (uint8_t)value;
+  }
+  at_field_copy(&line->field[3], info->host, sizeof(info->host));
+  if (at_field_int(&line->field[4], &value) == 0)
+  {
+    info->port = (uint16_t)value;
+  }
+  if ((line->count >= 7U) && (at_field_int(&line->field[6], &value) == 0))
+  {
+    info->reconnect = (uint8_t)value;
+  }
+  query->found = 1;
+}
+
+/**
+  * @brief  +CIPDOMAIN:"<address>" or +CIPDOMAIN:<address>.
+  */
+static void cipdomain_line(const at_line_t* line, void* context)
+{
+  query_result_t* query = (query_result_t *)context;
+
+  if (line->count >= 1U)
+  {
+    at_field_copy(&line->field[0], (char *)query->result, query->size);
+    query->found = 1;
+  }
+}
+
+/**
+  * @brief  Look the cached host name up again.
+  */
+static esp8266_status_t dns_lookup(void)
+{
+  esp8266_status_t ret = esp8266_resolve(dns_cache.host, dns_cache.ip);
+
+  if (ret == ESP8266_OK)
+  {
+    dns_cache.resolved_tick = HAL_GetTick();
+    dns_cache.lookups++;
+  }
+  return ret;
+}
+
+/**
+  * @brief  AT version:<version>
+  */
+static void gmr_line(const at_line_t* line, void* context)
+{
+  query_result_t* query = (query_result_t *)context;
+
+  at_field_copy(&line->field[0], (char *)query->result, query->size);
+  query->found = 1;
+}
+
+/**
+  * @brief  Two decimal digits.
+  * @retval Their value, -1 when they are not digits.
+  */
+static int8_t read_two_digits(const char* p)
+{
+  if ((p[0] < '0') || (p[0] > '9') || (p[1] < '0') || (p[1] > '9'))
+  {
+    return -1;
+  }
+  return (int8_t)(((p[0] - '0') * 10) + (p[1] - '0'));
+}
+
+/**
+  * @brief  Second half of a publish through AT+MQTTPUBRAW: send the header,
+  *         then the data after the '>' prompt.
+  * @param  header the AT+MQTTPUBRAW command, in segments.
+  * @param  count the number of segments.
+  * @param  data the payload, sent from the caller's memory.
+  * @param  length its size, as announced in the header.
+  * @param  tick_start HAL_GetTick() at the start of the publish.
+  * @retval returns ESP8266_OK on success and ESP8266_ERROR otherwise.
+  */
+static esp8266_status_t publish_raw(const esp8266_iovec_t* header, uint32_t count,
+                                    const uint8_t* data, uint32_t length, uint32_t tick_start)
+{
+  esp8266_status_t ret;
+  esp8266_iovec_t payload;
+
+  ret = send_frame(header, count, (uint8_t*)AT_SEND_PROMPT_STRING, 0);
+  if (ret != ESP8266_OK)
+  {
+    return ret;
+  }
+
+  payload.base = data;
+  payload.length = length;
+  ret = send_frame(&payload, 1, (uint8_t*)AT_MQTTPUB_OK_STRING, 1);
+
+  if (ret == ESP8266_OK)
+  {
+    METRIC_INC(METRIC_PUBLISHES);
+    metrics_observe(METRIC_HIST_PUBLISH_LATENCY, HAL_GetTick() - tick_start);
+  }
+  return ret;
+}
+
+/**
+  * @brief  Double the deadline of a verb, up to its ceiling.
+  */
+static void deadline_backoff(esp8266_deadline_t* deadline)
+{
+  deadline->rto_ms = ((deadline->rto_ms * 2U) < deadline->max_ms) ? (deadline->rto_ms * 2U) : deadline->max_ms;
+}
 
-  return ESP8266_ERROR;
+/**
+  * @brief  "<link>," of the outgoing connection while the server runs: the
+  *         module then takes the multiple connections form of AT+CIPSTART
+  *         and AT+CIPSEND only.
+  * @param  cmd the command being built.
+  */
+static void client_link(at_builder_t* cmd)
+{
+  if (server_running != 0)
+  {
+    at_builder_uint(cmd, ESP8266_CLIENT_LINK);
+    at_builder_char(cmd, ',');
+  }
 }
 
 /**
@@ -477,8 +2324,8 @@ static esp8266_status_t recv_data(uint8_t* Buffer, uint32_t Length, uint32_t* re
 {
   uint8_t RxChar;
   uint32_t idx = 0;
-  uint8_t LengthString[4];
-  uint32_t LengthValue;
+  uint8_t LengthString[8];
+  uint32_t LengthValue = 0;
   uint8_t i = 0;
   esp8266_boolean newChunk  = ESP8266_FALSE;
 
@@ -548,11 +2395,18 @@ static esp8266_status_t recv_data(uint8_t* Buffer, uint32_t Length, uint32_t* re
     if ((strstr((char *)rx_buffer, AT_IPD_STRING) != NULL) && (newChunk == ESP8266_FALSE))
     {
       i = 0;
-      memset(LengthString, '\0', 4);
+      memset(LengthString, '\0', sizeof(LengthString));
       do
       {
-        esp8266_io_recv(&RxChar, 1);
-        LengthString[i++] = RxChar;
+        if (esp8266_io_recv(&RxChar, 1) == 0)
+        {
+          return ESP8266_ERROR;
+        }
+        /* "1460:" is 5 bytes, keep room for the terminator */
+        if (i < (sizeof(LengthString) - 1))
+        {
+          LengthString[i++] = RxChar;
+        }
       }
       while(RxChar != ':');
 
@@ -586,45 +2440,20 @@ static esp8266_status_t recv_data(uint8_t* Buffer, uint32_t Length, uint32_t* re
   */
 esp8266_status_t catch_incoming_message(uint8_t* messageBuffer, uint32_t maxBufferLength, const uint8_t* token)
 {
-    uint32_t idx = 0;
-    uint8_t RxChar;
+    if (maxBufferLength < 2U)
+    {
+        return ESP8266_ERROR;
+    }
 
     /* Clear the messageBuffer */
     memset(messageBuffer, '\0', maxBufferLength);
 
-    /* Continuously receive data until no more data is available or the token is found */
-    while (1)
+    /* Receive until the token or an error string is found, or until no more
+       data is available */
+    if (recv_token((char *)messageBuffer, maxBufferLength, (const char *)token, 1) != ESP8266_OK)
     {
-        /* Attempt to receive one byte (non-blocking) */
-        if (esp8266_io_recv(&RxChar, 1) != 0)
-        {
-            messageBuffer[idx++] = RxChar;
-        }
-        else
-        {
-            /* No more data available at this moment, exit the loop */
-            break;
-        }
-
-        /* Prevent buffer overflow */
-        if (idx == maxBufferLength)
-        {
-            break;
-        }
-
-        /* Check if the expected token is in the accumulated message */
-        if (strstr((char *)messageBuffer, (char *)token) != NULL)
-        {
-            return ESP8266_OK;
-        }
-
-        /* Also check if an error string is present */
-        if (strstr((char *)messageBuffer, AT_ERROR_STRING) != NULL)
-        {
-            return ESP8266_ERROR;
-        }
+        return ESP8266_ERROR;
     }
 
-    /* If we exit the loop without finding the token, return an error */
-    return ESP8266_ERROR;
+    return ESP8266_OK;
 }
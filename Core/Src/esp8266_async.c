@@ -0,0 +1,561 @@
+/*
+ * esp8266_async.c
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "esp8266_async.h"
+#include "esp8266_io.h"
+#include "esp8266_urc.h"
+#include "at_builder.h"
+#include "at_scan.h"
+#include "metrics.h"
+#include <string.h>
+
+/* Private define ------------------------------------------------------------*/
+/* Start of the line being received kept: room for a +MQTTSUBRECV header */
+#define RX_LINE_SIZE        128U
+
+/* Private variables ---------------------------------------------------------*/
+/* Command of the channel owner: one buffer for all the operations, and the
+   segments sent (header and trailer in tx_cmd, the payload in between) */
+static char tx_cmd[MAX_AT_CMD_SIZE];
+static esp8266_iovec_t tx_frame[3];
+static uint32_t tx_count;
+
+/* Response of the channel owner: the current line, and the payload bytes
+   left of a message received meanwhile */
+static char rx_line[RX_LINE_SIZE];
+static uint32_t rx_length;
+static esp8266_urc_frame_t rx_frame;
+static uint32_t rx_skip;
+
+/* Ticket lock on the command channel, FIFO */
+static uint16_t next_ticket;
+static uint16_t now_serving;
+
+/* Private function prototypes -----------------------------------------------*/
+static void op_start(esp8266_op_t* op, esp8266_op_kind_t kind);
+static PT_THREAD(op_run(esp8266_op_t* op));
+static PT_THREAD(at_command(esp8266_op_t* op, const esp8266_iovec_t* iov, uint32_t count, const char* token, uint8_t data));
+static uint8_t at_response(esp8266_op_t* op);
+static void command_failed(esp8266_op_t* op, esp8266_status_t status, uint32_t now);
+static uint8_t token_step(const char* token, uint8_t matched, uint8_t c, uint8_t line_start);
+static int8_t format_cmd(esp8266_op_t* op, uint8_t step);
+
+/* Exported functions -------------------------------------------------------*/
+
+/**
+  * @brief  Start esp8266_init(): IO init, echo off, station mode.
+  * @param  op: the operation context.
+  * @retval None.
+  */
+void esp8266_init_async(esp8266_op_t* op)
+{
+  op_start(op, ESP8266_OP_INIT);
+}
+
+/**
+  * @brief  Start esp8266_joint_ap().
+  * @param  op: the operation context.
+  * @param  ssid: the access point id.
+  * @param  password: the access point password.
+  * @retval None.
+  */
+void esp8266_joint_ap_async(esp8266_op_t* op, const char* ssid, const char* password)
+{
+  op_start(op, ESP8266_OP_JOIN_AP);
+  op->args.join.ssid = ssid;
+  op->args.join.password = password;
+}
+
+/**
+  * @brief  Start esp8266_mqtt_connect().
+  * @param  op: the operation context.
+  * @param  endpoint: MQTT broker endpoint.
+  * @param  port: port number.
+  * @param  secure: 1 for a TLS connection.
+  * @retval None.
+  */
+void esp8266_mqtt_connect_async(esp8266_op_t* op, const char* endpoint, uint16_t port, uint8_t secure)
+{
+  op_start(op, ESP8266_OP_MQTT_CONNECT);
+  op->args.connect.endpoint = endpoint;
+  op->args.connect.port = port;
+  op->args.connect.secure = secure;
+}
+
+/**
+  * @brief  Start esp8266_mqtt_subscribe().
+  * @param  op: the operation context.
+  * @param  topic: MQTT topic to subscribe to.
+  * @param  qos: quality of service level.
+  * @retval None.
+  */
+void esp8266_mqtt_subscribe_async(esp8266_op_t* op, const char* topic, uint8_t qos)
+{
+  op_start(op, ESP8266_OP_MQTT_SUB);
+  op->args.sub.topic = topic;
+  op->args.sub.qos = qos;
+}
+
+/**
+  * @brief  Start esp8266_mqtt_publish().
+  * @param  op: the operation context.
+  * @param  topic: MQTT topic to publish to.
+  * @param  message: the message to publish.
+  * @param  qos: quality of service level.
+  * @param  retain: retain flag.
+  * @retval None.
+  */
+void esp8266_mqtt_publish_async(esp8266_op_t* op, const char* topic, const char* message, uint8_t qos, uint8_t retain)
+{
+  op_start(op, ESP8266_OP_MQTT_PUB);
+  op->args.pub.topic = topic;
+  op->args.pub.message = message;
+  op->args.pub.qos = qos;
+  op->args.pub.retain = retain;
+}
+
+/**
+  * @brief  Start esp8266_send_data().
+  * @param  op: the operation context.
+  * @param  data: the data to send.
+  * @param  length: its size.
+  * @retval None.
+  */
+void esp8266_send_data_async(esp8266_op_t* op, const uint8_t* data, uint32_t length)
+{
+  op_start(op, ESP8266_OP_SEND_DATA);
+  op->args.send.data = data;
+  op->args.send.length = length;
+}
+
+/**
+  * @brief  Advance an operation as far as the received bytes allow.
+  * @param  op: the operation context.
+  * @retval ESP8266_TRUE once completed, the result is then in op->status.
+  */
+esp8266_boolean esp8266_op_poll(esp8266_op_t* op)
+{
+  /* Completed: not started again, the channel was already handed over */
+  if (op->done != 0)
+  {
+    return ESP8266_TRUE;
+  }
+
+  if (PT_SCHEDULE(op_run(op)))
+  {
+    return ESP8266_FALSE;
+  }
+
+  /* Hand the channel over to the next operation in line */
+  op->done = 1;
+  now_serving++;
+  return ESP8266_TRUE;
+}
+
+/**
+  * @brief  Give up an operation: its command in flight fails at the next
+  *         poll, or it completes as soon as its turn comes. It must still be
+  *         polled until it completes. Interrupt or other task context.
+  * @param  op: the operation context.
+  * @retval None.
+  */
+void esp8266_op_cancel(esp8266_op_t* op)
+{
+  op->cancel = 1;
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+static void op_start(esp8266_op_t* op, esp8266_op_kind_t kind)
+{
+  memset(op, 0, sizeof(*op));
+  PT_INIT(&op->pt);
+  op->kind = (uint8_t)kind;
+  op->status = ESP8266_BUSY;
+}
+
+/**
+  * @brief  The steps of every operation: take the channel, then one or two
+  *         commands, as in the blocking version.
+  */
+static PT_THREAD(op_run(esp8266_op_t* op))
+{
+  PT_BEGIN(&op->pt);
+
+  op->ticket = next_ticket++;
+  PT_WAIT_UNTIL(&op->pt, op->ticket == now_serving);
+  op->started = HAL_GetTick();
+
+  /* Cancelled while in line: the channel is handed over at once */
+  if (op->cancel != 0)
+  {
+    op->status = ESP8266_CANCELLED;
+    PT_EXIT(&op->pt);
+  }
+
+  if ((op->kind == ESP8266_OP_INIT) && (esp8266_io_init() < 0))
+  {
+    op->status = ESP8266_ERROR;
+    PT_EXIT(&op->pt);
+  }
+
+  /* First command, never sent truncated */
+  if (format_cmd(op, 0) < 0)
+  {
+    op->status = ESP8266_ERROR;
+    PT_EXIT(&op->pt);
+  }
+  PT_SPAWN(&op->pt, &op->child, at_command(op, tx_frame, tx_count,
+           ((op->kind == ESP8266_OP_SEND_DATA) || ((op->kind == ESP8266_OP_MQTT_PUB) && (op->args.pub.raw != 0))) ?
+           AT_SEND_PROMPT_STRING : AT_OK_STRING, 0));
+
+  if (op->status != ESP8266_OK)
+  {
+    PT_EXIT(&op->pt);
+  }
+
+  /* Second command: station mode after echo off, the data after the prompt */
+  if (op->kind == ESP8266_OP_INIT)
+  {
+    format_cmd(op, 1);    /* constant, always fits */
+    PT_SPAWN(&op->pt, &op->child, at_command(op, tx_frame, tx_count, AT_OK_STRING, 0));
+  }
+  else if (op->kind == ESP8266_OP_SEND_DATA)
+  {
+    tx_frame[0].base = op->args.send.data;
+    tx_frame[0].length = op->args.send.length;
+    PT_SPAWN(&op->pt, &op->child, at_command(op, tx_frame, 1, AT_SEND_OK_STRING, 1));
+  }
+  else if ((op->kind == ESP8266_OP_MQTT_PUB) && (op->args.pub.raw != 0))
+  {
+    tx_frame[0].base = (const uint8_t *)op->args.pub.message;
+    tx_frame[0].length = op->args.pub.length;
+    PT_SPAWN(&op->pt, &op->child, at_command(op, tx_frame, 1, AT_MQTTPUB_OK_STRING, 1));
+  }
+
+  if (op->status == ESP8266_OK)
+  {
+    if (op->kind == ESP8266_OP_MQTT_CONNECT)
+    {
+      /* Every successful connection after the first one is a reconnect */
+      if (esp8266_mqtt_connected_once == ESP8266_TRUE)
+      {
+        METRIC_INC(METRIC_RECONNECTS);
+      }
+      esp8266_mqtt_connected_once = ESP8266_TRUE;
+    }
+    else if (op->kind == ESP8266_OP_MQTT_PUB)
+    {
+      METRIC_INC(METRIC_PUBLISHES);
+      metrics_observe(METRIC_HIST_PUBLISH_LATENCY, HAL_GetTick() - op->started);
+    }
+  }
+
+  PT_END(&op->pt);
+}
+
+/**
+  * @brief  Send a command, then wait for its token, AT_ERROR_STRING or
+  *         AT_BUSY_STRING. Answered busy, it was dropped: sent again after a
+  *         pause doubling from ESP8266_BUSY_BACKOFF_MS, the other operations
+  *         running meanwhile, up to ESP8266_BUSY_RETRIES times. data is 1
+  *         for the data after a prompt, never sent twice.
+  */
+static PT_THREAD(at_command(esp8266_op_t* op, const esp8266_iovec_t* iov, uint32_t count, const char* token, uint8_t data))
+{
+  PT_BEGIN(&op->child);
+
+  op->attempt = 0;
+
+  while (1)
+  {
+    op->token = token;
+    op->match = 0;
+    op->error_match = 0;
+    op->busy_match = 0;
+    op->verb = esp8266_deadline_of(iov[0].base, iov[0].length, data);
+    op->sent = HAL_GetTick();
+    rx_length = 0;
+    rx_skip = 0;
+    op->deadline = op->sent + op->verb->rto_ms;
+
+    if (esp8266_io_sendv(iov, count) < 0)
+    {
+      op->status = ESP8266_ERROR;
+      PT_EXIT(&op->child);
+    }
+
+    PT_WAIT_UNTIL(&op->child, at_response(op));
+
+    if ((op->status != ESP8266_BUSY) || (data != 0) || (op->attempt >= ESP8266_BUSY_RETRIES) || (op->cancel != 0))
+    {
+      break;
+    }
+
+    METRIC_ADD(METRIC_BUSY_WAIT_MS, ESP8266_BUSY_BACKOFF_MS << op->attempt);
+    op->deadline = HAL_GetTick() + (ESP8266_BUSY_BACKOFF_MS << op->attempt);
+    op->attempt++;
+    PT_WAIT_UNTIL(&op->child, ((int32_t)(HAL_GetTick() - op->deadline) >= 0) || (op->cancel != 0));
+  }
+
+  PT_END(&op->child);
+}
+
+/**
+  * @brief  Feed the received bytes to the token matchers, never waits.
+  * @details The tokens are matched at the start of a line only. The payload
+  *          of a +MQTTSUBRECV message or +IPD data received meanwhile is
+  *          read by its declared length, whatever it holds; +IPD data is
+  *          handed to esp8266_ipd_received(). Stops right after the token:
+  *          what follows (e.g. a URC) stays in the ring. The command fails
+  *          at the deadline of its verb, counted from the command sent, or
+  *          once cancelled; its round trip updates that deadline when it
+  *          completes.
+  * @retval 1 when the command is complete (op->status set), 0 otherwise.
+  */
+static uint8_t at_response(esp8266_op_t* op)
+{
+  uint32_t now = HAL_GetTick();
+  uint8_t line_start;
+  uint8_t c;
+
+  if (op->cancel != 0)
+  {
+    command_failed(op, ESP8266_CANCELLED, now);
+    return 1;
+  }
+
+  while (esp8266_io_rx_pending() != 0)
+  {
+    esp8266_io_recv(&c, 1);
+
+    if (rx_skip != 0)
+    {
+      rx_skip--;
+      if (rx_frame.type == ESP8266_URC_IPD)
+      {
+        esp8266_ipd_received(rx_frame.link, &c, 1);
+      }
+      continue;
+    }
+
+    line_start = (rx_length == 0) ? 1U : 0U;
+    if (rx_length < RX_LINE_SIZE)
+    {
+      rx_line[rx_length] = (char)c;
+    }
+    rx_length++;
+    if (c == '\n')
+    {
+      rx_length = 0;
+    }
+    else if (((c == ',') || (c == ':')) && (rx_length <= RX_LINE_SIZE) &&
+             (esp8266_urc_parse_frame(rx_line, rx_length, &rx_frame) != 0))
+    {
+      /* Header complete: its CRLF comes after the payload, as an empty line */
+      rx_skip = rx_frame.data_length;
+      rx_length = 0;
+      op->match = 0;
+      op->error_match = 0;
+      op->busy_match = 0;
+      continue;
+    }
+
+    op->match = token_step(op->token, op->match, c, line_start);
+    if (op->token[op->match] == '\0')
+    {
+      esp8266_deadline_sample(op->verb, now - op->sent);
+      op->status = ESP8266_OK;
+      return 1;
+    }
+
+    op->error_match = token_step(AT_ERROR_STRING, op->error_match, c, line_start);
+    if (AT_ERROR_STRING[op->error_match] == '\0')
+    {
+      METRIC_INC(METRIC_AT_ERRORS);
+      command_failed(op, ESP8266_ERROR, now);
+      return 1;
+    }
+
+    /* busy p...: dropped at once without running it, which says nothing of
+       its round trip */
+    op->busy_match = token_step(AT_BUSY_STRING, op->busy_match, c, line_start);
+    if (AT_BUSY_STRING[op->busy_match] == '\0')
+    {
+      METRIC_INC(METRIC_AT_BUSY);
+      op->status = ESP8266_BUSY;
+      return 1;
+    }
+  }
+
+  if ((int32_t)(now - op->deadline) >= 0)
+  {
+    METRIC_INC(METRIC_AT_TIMEOUTS);
+    command_failed(op, ESP8266_TIMEOUT, now);
+    return 1;
+  }
+
+  return 0;
+}
+
+/**
+  * @brief  End the command in flight with status, recording how long the
+  *         failure took to be detected since the command was sent.
+  */
+static void command_failed(esp8266_op_t* op, esp8266_status_t status, uint32_t now)
+{
+  esp8266_deadline_failed(op->verb, status, now - op->sent);
+  op->status = status;
+}
+
+/**
+  * @brief  Streaming line match: next matched length of token after c, a
+  *         match starting at the start of a line only.
+  * @details On a mismatch, c may start the token again only when it starts
+  *          a line: none of the tokens repeats its start after one of its
+  *          own line endings.
+  */
+static uint8_t token_step(const char* token, uint8_t matched, uint8_t c, uint8_t line_start)
+{
+  if (((matched != 0) || (line_start != 0)) && ((uint8_t)token[matched] == c))
+  {
+    return matched + 1;
+  }
+
+  return ((line_start != 0) && ((uint8_t)token[0] == c)) ? 1U : 0U;
+}
+
+/**
+  * @brief  Build the command of an operation step in the shared buffer.
+  * @retval 0 on success, -1 if it does not fit.
+  */
+static int8_t format_cmd(esp8266_op_t* op, uint8_t step)
+{
+  at_builder_t cmd;
+  int32_t length;
+  uint32_t split = 0;     /* header length when the payload goes in between */
+
+  at_builder_init(&cmd, tx_cmd, sizeof(tx_cmd));
+
+  switch (op->kind)
+  {
+    case ESP8266_OP_INIT:
+      if (step == 0)
+      {
+        at_builder_lit(&cmd, "ATE0\r\n");
+      }
+      else
+      {
+        at_builder_lit(&cmd, "AT+CWMODE=1\r\n");
+      }
+      break;
+
+    case ESP8266_OP_JOIN_AP:
+      at_builder_lit(&cmd, "AT+CWJAP=");
+      at_builder_quoted(&cmd, op->args.join.ssid);
+      at_builder_char(&cmd, ',');
+      at_builder_quoted(&cmd, op->args.join.password);
+      at_builder_crlf(&cmd);
+      break;
+
+    case ESP8266_OP_MQTT_CONNECT:
+      at_builder_lit(&cmd, "AT+MQTTCONN=0,");
+      at_builder_quoted(&cmd, op->args.connect.endpoint);
+      at_builder_char(&cmd, ',');
+      at_builder_uint(&cmd, op->args.connect.port);
+      at_builder_char(&cmd, ',');
+      at_builder_uint(&cmd, op->args.connect.secure);
+      at_builder_crlf(&cmd);
+      break;
+
+    case ESP8266_OP_MQTT_SUB:
+      at_builder_lit(&cmd, "AT+MQTTSUB=0,");
+      at_builder_quoted(&cmd, op->args.sub.topic);
+      at_builder_char(&cmd, ',');
+      at_builder_uint(&cmd, op->args.sub.qos);
+      at_builder_crlf(&cmd);
+      break;
+
+    case ESP8266_OP_MQTT_PUB:
+      /* As esp8266_mqtt_publish(): the message between header and trailer,
+         or after the AT+MQTTPUBRAW prompt if it needs escaping */
+      op->args.pub.length = at_scan_str(op->args.pub.message, &at_scan_escape);
+      op->args.pub.raw = (op->args.pub.message[op->args.pub.length] != '\0') ? 1U : 0U;
+      if (op->args.pub.raw == 0)
+      {
+        at_builder_lit(&cmd, "AT+MQTTPUB=0,");
+        at_builder_quoted(&cmd, op->args.pub.topic);
+        at_builder_lit(&cmd, ",\"");
+        split = cmd.length;
+        at_builder_lit(&cmd, "\",");
+        at_builder_uint(&cmd, op->args.pub.qos);
+        at_builder_char(&cmd, ',');
+        at_builder_uint(&cmd, op->args.pub.retain);
+        at_builder_crlf(&cmd);
+        if ((cmd.overflow != 0) || ((cmd.length + op->args.pub.length) > MAX_MQTTPUB_CMD_SIZE))
+        {
+          at_builder_init(&cmd, tx_cmd, sizeof(tx_cmd));
+          split = 0;
+          op->args.pub.raw = 1;
+        }
+      }
+      else
+      {
+        op->args.pub.length += (uint32_t)strlen(&op->args.pub.message[op->args.pub.length]);
+      }
+
+      if (op->args.pub.raw != 0)
+      {
+        at_builder_lit(&cmd, "AT+MQTTPUBRAW=0,");
+        at_builder_quoted(&cmd, op->args.pub.topic);
+        at_builder_char(&cmd, ',');
+        at_builder_uint(&cmd, op->args.pub.length);
+        at_builder_char(&cmd, ',');
+        at_builder_uint(&cmd, op->args.pub.qos);
+        at_builder_char(&cmd, ',');
+        at_builder_uint(&cmd, op->args.pub.retain);
+        at_builder_crlf(&cmd);
+      }
+      break;
+
+    case ESP8266_OP_SEND_DATA:
+      at_builder_lit(&cmd, "AT+CIPSEND=");
+      if (esp8266_server_running() != 0)
+      {
+        at_builder_uint(&cmd, ESP8266_CLIENT_LINK);
+        at_builder_char(&cmd, ',');
+      }
+      at_builder_uint(&cmd, op->args.send.length);
+      at_builder_crlf(&cmd);
+      break;
+
+    default:
+      break;
+  }
+
+  length = at_builder_finish(&cmd);
+  if (length < 0)
+  {
+    tx_count = 0;
+    return -1;
+  }
+
+  tx_frame[0].base = (const uint8_t *)tx_cmd;
+  tx_frame[0].length = (uint32_t)length;
+  tx_count = 1;
+  if (split != 0)
+  {
+    tx_frame[0].length = split;
+    tx_frame[1].base = (const uint8_t *)op->args.pub.message;
+    tx_frame[1].length = op->args.pub.length;
+    tx_frame[2].base = (const uint8_t *)&tx_cmd[split];
+    tx_frame[2].length = (uint32_t)length - split;
+    tx_count = 3;
+  }
+  return 0;
+}
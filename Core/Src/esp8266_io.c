@@ -8,10 +8,14 @@
 /* Includes ------------------------------------------------------------------*/
 #include "esp8266_io.h"
 #include "main.h"
+#include "metrics.h"
+#include "power.h"
 #include <string.h>
 
 /* Private define ------------------------------------------------------------*/
 #define RING_BUFFER_SIZE        (1024 * 8)
+#define TX_DMA_MAX_SIZE         0xFFFFU     /* NDTR is 16-bit */
+#define TX_BITS_PER_BYTE        11U         /* start, 8 data, parity, stop: the longest frame */
 
 /* Private typedef -----------------------------------------------------------*/
 typedef struct
@@ -25,9 +29,18 @@ typedef struct
 ring_buffer_t wifi_rx_buffer;
 UART_HandleTypeDef *wifi_uart_handle;
 DMA_HandleTypeDef *wifi_dma_handle;
+static uint16_t dma_write_pos;
+
+/* Command in progress: absolute deadline of its response, early cancel */
+static uint32_t rx_deadline;
+static uint8_t rx_deadline_armed;
+static volatile uint8_t rx_cancel;
 
 /* Private function prototypes -----------------------------------------------*/
 static void esp8266_io_error_handler(void);
+static int8_t tx_wait(uint16_t length);
+static uint8_t rx_wait_over(uint32_t tick_start, uint32_t partial);
+static uint32_t ring_read(uint8_t* buffer, uint32_t length, const at_scan_set_t* set, uint8_t* delimited);
 
 /* Exported functions -------------------------------------------------------*/
 
@@ -39,6 +52,7 @@ int8_t esp8266_io_init(void)
 {
   wifi_rx_buffer.head = 0;
   wifi_rx_buffer.tail = 0;
+  dma_write_pos = 0;
 
   // Start UART in DMA mode with Idle line detection
   if (HAL_UARTEx_ReceiveToIdle_DMA(wifi_uart_handle, wifi_rx_buffer.data, RING_BUFFER_SIZE) != HAL_OK)
@@ -67,10 +81,51 @@ void esp8266_io_deinit(void)
   */
 int8_t esp8266_io_send(uint8_t* p_data, uint32_t length)
 {
-  if (HAL_UART_Transmit(wifi_uart_handle, p_data, length, DEFAULT_TIME_OUT) != HAL_OK)
+  esp8266_iovec_t iov;
+
+  iov.base = p_data;
+  iov.length = length;
+  return esp8266_io_sendv(&iov, 1);
+}
+
+/**
+  * @brief  Send one frame made of several segments, each one from its own
+  *         memory: one TX DMA transfer per segment, the next one started as
+  *         soon as the previous one completes. Nothing is copied.
+  * @note   Returns once the last byte is out: the segments can be reused by
+  *         the caller afterwards. The wait is accounted as CPU idle time.
+  * @param  iov: the segments, in order. Empty segments are skipped.
+  * @param  count: number of segments.
+  * @retval 0 on success, -1 otherwise.
+  */
+int8_t esp8266_io_sendv(const esp8266_iovec_t* iov, uint32_t count)
+{
+  uint32_t total = 0;
+
+  for (uint32_t i = 0; i < count; i++)
   {
-      return -1;
+    const uint8_t* base = iov[i].base;
+    uint32_t remaining = iov[i].length;
+
+    while (remaining != 0)
+    {
+      uint16_t chunk = (remaining > TX_DMA_MAX_SIZE) ? TX_DMA_MAX_SIZE : (uint16_t)remaining;
+
+      if (HAL_UART_Transmit_DMA(wifi_uart_handle, base, chunk) != HAL_OK)
+      {
+        return -1;
+      }
+      if (tx_wait(chunk) < 0)
+      {
+        return -1;
+      }
+      base += chunk;
+      remaining -= chunk;
+    }
+    total += iov[i].length;
   }
+
+  METRIC_ADD(METRIC_TX_BYTES, total);
   return 0;
 }
 
@@ -82,28 +137,129 @@ int8_t esp8266_io_send(uint8_t* p_data, uint32_t length)
   */
 int32_t esp8266_io_recv(uint8_t* buffer, uint32_t length)
 {
-    uint32_t read_data = 0;
+  return esp8266_io_recv_until(buffer, length, NULL);
+}
+
+/**
+  * @brief  Receive data up to and including the first byte of set, e.g. one
+  *         response line. The ring is scanned and copied a run at a time.
+  * @param  buffer: Pointer to the buffer to store received data.
+  * @param  length: Maximum length of the buffer.
+  * @param  set: the delimiters, NULL to fill the buffer.
+  * @retval Number of bytes received, less than length without a delimiter
+  *         only when the wait is over: the command deadline passed (or
+  *         DEFAULT_TIME_OUT without bytes when there is none), the line
+  *         stalled for IDLE_TIME_OUT, or esp8266_io_cancel() was called.
+  */
+int32_t esp8266_io_recv_until(uint8_t* buffer, uint32_t length, const at_scan_set_t* set)
+{
+  uint32_t read_data = 0;
+  uint8_t delimited = 0;
+
+  while ((read_data < length) && (rx_cancel == 0))
+  {
+    uint32_t tick_start = HAL_GetTick();
+    uint32_t n;
+
+    /* Time spent waiting for the module is accounted as CPU idle time */
+    if (wifi_rx_buffer.head == wifi_rx_buffer.tail)
+    {
+      metrics_idle_enter();
+      while ((wifi_rx_buffer.head == wifi_rx_buffer.tail) && (rx_wait_over(tick_start, read_data) == 0))
+      {
+        /* Sleep until the next RX event or SysTick (1 ms), never Stop */
+        power_idle(0);
+      }
+      metrics_idle_exit();
+    }
+
+    n = ring_read(&buffer[read_data], length - read_data, set, &delimited);
+    if (n == 0)
+    {
+      break;
+    }
+    read_data += n;
 
-    while (length--)
+    if (delimited != 0)
     {
-        uint32_t tick_start = HAL_GetTick();
-        do
-        {
-            if (wifi_rx_buffer.head != wifi_rx_buffer.tail)
-            {
-                *buffer++ = wifi_rx_buffer.data[wifi_rx_buffer.head++];
-                read_data++;
-
-                if (wifi_rx_buffer.head >= RING_BUFFER_SIZE)
-                {
-                    wifi_rx_buffer.head = 0;
-                }
-                break;
-            }
-        } while ((HAL_GetTick() - tick_start) < DEFAULT_TIME_OUT);
+      break;
     }
+  }
+
+  return (int32_t)read_data;
+}
+
+/**
+  * @brief  Read the bytes already received, never waits: up to length bytes,
+  *         stopping after the first byte of set.
+  * @param  buffer: Pointer to the buffer to store received data.
+  * @param  length: Maximum length of the buffer.
+  * @param  set: the delimiters, NULL for none.
+  * @retval Number of bytes read.
+  */
+uint32_t esp8266_io_read(uint8_t* buffer, uint32_t length, const at_scan_set_t* set)
+{
+  uint8_t delimited;
+
+  return ring_read(buffer, length, set, &delimited);
+}
+
+/**
+  * @brief  Start the wait for the response of a command: the receive calls
+  *         give up at deadline instead of DEFAULT_TIME_OUT after the last
+  *         byte. Clears a previous cancel.
+  * @param  deadline: HAL_GetTick() by which the response must be complete.
+  * @retval None.
+  */
+void esp8266_io_deadline_set(uint32_t deadline)
+{
+  rx_deadline = deadline;
+  rx_deadline_armed = 1;
+  rx_cancel = 0;
+}
+
+/**
+  * @brief  End of the command: back to DEFAULT_TIME_OUT of silence.
+  * @retval None.
+  */
+void esp8266_io_deadline_clear(void)
+{
+  rx_deadline_armed = 0;
+  rx_cancel = 0;
+}
+
+/**
+  * @brief  Give up the wait for the command in progress, which returns with
+  *         what it received so far. Interrupt or other task context.
+  * @retval None.
+  */
+void esp8266_io_cancel(void)
+{
+  if (rx_deadline_armed != 0)
+  {
+    rx_cancel = 1;
+  }
+}
+
+/**
+  * @brief  Tell whether the command in progress was cancelled.
+  * @retval 1 when cancelled, 0 otherwise.
+  */
+uint8_t esp8266_io_cancelled(void)
+{
+  return rx_cancel;
+}
 
-    return read_data;
+/**
+  * @brief  Number of received bytes not read yet.
+  * @retval Bytes waiting in the reception ring.
+  */
+uint32_t esp8266_io_rx_pending(void)
+{
+  uint16_t head = wifi_rx_buffer.head;
+  uint16_t tail = wifi_rx_buffer.tail;
+
+  return (tail >= head) ? (uint32_t)(tail - head) : (uint32_t)(RING_BUFFER_SIZE - head + tail);
 }
 
 /**
@@ -116,21 +272,48 @@ void HAL_UARTEx_RxEventCallback(UART_HandleTypeDef *huart, uint16_t size)
 {
   if (huart == wifi_uart_handle)
   {
-    static uint16_t tail_pos = 0;
+    /* The DMA is circular: size is its write position in the ring, and the
+       transfer complete event reports the full ring size when it wraps. The
+       reception keeps running, there is nothing to restart. */
+    uint16_t pos = (size >= RING_BUFFER_SIZE) ? 0 : size;
+    uint32_t received;
+    uint32_t fill;
 
-    if (size > tail_pos){
-      tail_pos = size;
-      if (tail_pos != wifi_rx_buffer.head)
-      {
-        wifi_rx_buffer.tail = tail_pos;
-      }
+    received = (pos >= dma_write_pos) ? (pos - dma_write_pos)
+                                      : (RING_BUFFER_SIZE - dma_write_pos + pos);
+    if (received == 0)
+    {
+      return;
+    }
+
+    /* Ring occupancy once the new bytes are in. Reaching the ring size means
+       the DMA overwrote bytes the reader had not consumed yet. */
+    fill = (dma_write_pos >= wifi_rx_buffer.head) ? (dma_write_pos - wifi_rx_buffer.head)
+                                                  : (RING_BUFFER_SIZE - wifi_rx_buffer.head + dma_write_pos);
+    fill += received;
+    METRIC_ADD(METRIC_RX_BYTES, received);
+    METRIC_MAX(METRIC_RING_HWM, fill);
+    if (fill >= RING_BUFFER_SIZE)
+    {
+      METRIC_INC(METRIC_DMA_OVERRUNS);
     }
 
-    // Restart DMA reception
-    HAL_UARTEx_ReceiveToIdle_DMA(wifi_uart_handle, &wifi_rx_buffer.data[wifi_rx_buffer.tail], RING_BUFFER_SIZE);
+    dma_write_pos = pos;
+    wifi_rx_buffer.tail = pos;
+
+    esp8266_io_rx_event();
   }
 }
 
+/**
+  * @brief  Called from the RX event interrupt once new bytes are in the ring.
+  * @note   Overridden by the application to wake up its reception task.
+  * @retval None.
+  */
+__attribute__((weak)) void esp8266_io_rx_event(void)
+{
+}
+
 /**
   * @brief  Rx Transfer completed callbacks.
   * @param  huart  Pointer to a UART_HandleTypeDef structure that contains
@@ -149,11 +332,132 @@ void HAL_UART_RxCpltCallback(UART_HandleTypeDef *huart)
   */
 void HAL_UART_ErrorCallback(UART_HandleTypeDef *huart)
 {
+    /* Not METRIC_DMA_OVERRUNS: that one is owned by the RX event interrupt */
+    if (huart->ErrorCode & (HAL_UART_ERROR_ORE | HAL_UART_ERROR_DMA))
+    {
+        METRIC_INC(METRIC_UART_ERRORS);
+    }
     esp8266_io_error_handler();
 }
 
 /* Private functions ---------------------------------------------------------*/
 
+/**
+  * @brief  Copy the received bytes out of the ring, a run at a time (at most
+  *         two: up to the end of the ring, then from its start).
+  * @param  delimited: set to 1 when the read stopped after a byte of set.
+  * @retval Number of bytes read.
+  */
+static uint32_t ring_read(uint8_t* buffer, uint32_t length, const at_scan_set_t* set, uint8_t* delimited)
+{
+  uint32_t read_data = 0;
+  uint16_t head = wifi_rx_buffer.head;
+
+  *delimited = 0;
+
+  while (read_data < length)
+  {
+    uint16_t tail = wifi_rx_buffer.tail;
+    uint32_t run = (tail >= head) ? (uint32_t)(tail - head) : (uint32_t)(RING_BUFFER_SIZE - head);
+    uint32_t found;
+
+    if (run == 0)
+    {
+      break;
+    }
+    if (run > (length - read_data))
+    {
+      run = length - read_data;
+    }
+
+    found = (set != NULL) ? at_scan(&wifi_rx_buffer.data[head], run, set) : run;
+    if (found < run)
+    {
+      run = found + 1U;
+      *delimited = 1;
+    }
+
+    memcpy(&buffer[read_data], &wifi_rx_buffer.data[head], run);
+    read_data += run;
+    head += run;
+    if (head >= RING_BUFFER_SIZE)
+    {
+      head = 0;
+    }
+    wifi_rx_buffer.head = head;
+
+    if (*delimited != 0)
+    {
+      break;
+    }
+  }
+
+  return read_data;
+}
+
+/**
+  * @brief  Tell whether a receive call must stop waiting for more bytes.
+  * @param  tick_start: HAL_GetTick() when the ring was found empty.
+  * @param  partial: bytes of the current line already received.
+  * @retval 1 when the wait is over, 0 otherwise.
+  */
+static uint8_t rx_wait_over(uint32_t tick_start, uint32_t partial)
+{
+  uint32_t now = HAL_GetTick();
+
+  if (rx_cancel != 0)
+  {
+    return 1;
+  }
+
+  /* A line in progress comes in one go: a gap means the module stalled */
+  if ((partial != 0) && ((now - tick_start) >= IDLE_TIME_OUT))
+  {
+    return 1;
+  }
+
+  if (rx_deadline_armed != 0)
+  {
+    return ((int32_t)(now - rx_deadline) >= 0) ? 1U : 0U;
+  }
+  return ((now - tick_start) >= DEFAULT_TIME_OUT) ? 1U : 0U;
+}
+
+/**
+  * @brief  Wait for the TX DMA transfer in progress: the UART is ready again
+  *         once its last byte left the shift register. Gives up
+  *         DEFAULT_TIME_OUT after the time its bytes take at the baud rate
+  *         (5.7 s for a full chunk at 115200 baud).
+  * @param  length: bytes of the transfer.
+  * @retval 0 on success, -1 on timeout (the transfer is aborted).
+  */
+static int8_t tx_wait(uint16_t length)
+{
+  uint32_t tick_start;
+  uint32_t timeout = DEFAULT_TIME_OUT + ((uint32_t)length * TX_BITS_PER_BYTE * 1000U) / wifi_uart_handle->Init.BaudRate;
+
+  if (wifi_uart_handle->gState == HAL_UART_STATE_READY)
+  {
+    return 0;
+  }
+
+  tick_start = HAL_GetTick();
+  metrics_idle_enter();
+  while ((wifi_uart_handle->gState != HAL_UART_STATE_READY) && ((HAL_GetTick() - tick_start) < timeout))
+  {
+    /* Woken up by the DMA and UART transfer complete interrupts */
+    power_idle(0);
+  }
+  metrics_idle_exit();
+
+  if (wifi_uart_handle->gState != HAL_UART_STATE_READY)
+  {
+    HAL_UART_AbortTransmit(wifi_uart_handle);
+    return -1;
+  }
+  return 0;
+}
+
 /**
   * @brief  Handle UART errors by deinitializing the interface.
   * @retval None.
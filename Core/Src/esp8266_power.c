@@ -0,0 +1,261 @@
+/*
+ * esp8266_power.c
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "esp8266_power.h"
+#include "metrics.h"
+#include "power.h"
+#include "main.h"
+#include <string.h>
+
+/* Private variables ---------------------------------------------------------*/
+static esp8266_power_stats_t stats;
+static uint32_t awake_since;            /* HAL_GetTick() when the radio came on */
+
+/* Report window */
+static uint32_t window_start_tick;
+static uint64_t window_radio_on_ms;
+static uint32_t window_publishes;
+static uint32_t window_jitter_ms;
+
+/* Private function prototypes -----------------------------------------------*/
+static uint64_t radio_on_now(void);
+
+/* Exported functions -------------------------------------------------------*/
+
+/**
+  * @brief  Select the sleep mode and configure its wakeup source. Light sleep
+  *         without a wake-up line falls back to modem sleep.
+  * @retval ESP8266_OK on success, the status of AT+SLEEPWKCFG otherwise.
+  */
+esp8266_status_t esp8266_power_init(void)
+{
+  esp8266_status_t ret = ESP8266_OK;
+
+  memset(&stats, 0, sizeof(stats));
+  stats.mode = ESP8266_POWER_SLEEP_MODE;
+  stats.wake_lead_ms = ESP8266_POWER_WAKE_MARGIN_MS;
+  awake_since = HAL_GetTick();
+
+  window_start_tick = awake_since;
+  window_radio_on_ms = 0;
+  window_publishes = metric_values[METRIC_PUBLISHES];
+  window_jitter_ms = 0;
+
+#if defined(ESP8266_WAKE_Pin)
+  {
+    GPIO_InitTypeDef GPIO_InitStruct = {0};
+
+    HAL_GPIO_WritePin(ESP8266_WAKE_GPIO_Port, ESP8266_WAKE_Pin, GPIO_PIN_SET);
+    GPIO_InitStruct.Pin = ESP8266_WAKE_Pin;
+    GPIO_InitStruct.Mode = GPIO_MODE_OUTPUT_PP;
+    GPIO_InitStruct.Pull = GPIO_NOPULL;
+    GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_LOW;
+    HAL_GPIO_Init(ESP8266_WAKE_GPIO_Port, &GPIO_InitStruct);
+  }
+
+  if (stats.mode == ESP8266_SLEEP_LIGHT)
+  {
+    ret = esp8266_sleep_wakeup_gpio(ESP8266_WAKE_MODULE_GPIO, 0);
+    if (ret != ESP8266_OK)
+    {
+      stats.mode = ESP8266_SLEEP_MODEM;
+    }
+  }
+#else
+  if (stats.mode == ESP8266_SLEEP_LIGHT)
+  {
+    stats.mode = ESP8266_SLEEP_MODEM;
+  }
+#endif
+
+  return ret;
+}
+
+/**
+  * @brief  Put the module to sleep when it has nothing to do for idle_ms.
+  * @details The sleep is cut short at the MQTT keepalive deadline (the module
+  *          is idle since the command just completed) and ends the wake-up
+  *          lead early, so that the deadline is met at full speed.
+  * @param  idle_ms: time until the next command to the module.
+  * @retval Delay after which esp8266_power_wake() must be called, 0 when the
+  *         module stays awake.
+  */
+uint32_t esp8266_power_sleep(uint32_t idle_ms)
+{
+  uint32_t now = HAL_GetTick();
+
+  if ((stats.mode == ESP8266_SLEEP_DISABLE) || (stats.asleep != 0))
+  {
+    return 0;
+  }
+
+  if (idle_ms > ESP8266_POWER_KEEPALIVE_MS)
+  {
+    idle_ms = ESP8266_POWER_KEEPALIVE_MS;
+  }
+
+  if (idle_ms < (stats.wake_lead_ms + ESP8266_POWER_MIN_SLEEP_MS))
+  {
+    return 0;
+  }
+
+  if (esp8266_sleep((esp8266_sleep_mode_t)stats.mode) != ESP8266_OK)
+  {
+    return 0;
+  }
+
+  stats.asleep = 1;
+  stats.sleeps++;
+  stats.radio_on_ms += now - awake_since;
+
+  return idle_ms - stats.wake_lead_ms;
+}
+
+/**
+  * @brief  Wake the module up, measuring how long it takes. Returns at once
+  *         when the module is awake. Must precede any command while asleep.
+  * @retval ESP8266_OK on success, the status of AT+SLEEP=0 otherwise.
+  */
+esp8266_status_t esp8266_power_wake(void)
+{
+  esp8266_status_t ret;
+  uint32_t start;
+  uint32_t latency;
+  uint32_t decayed;
+
+  if (stats.asleep == 0)
+  {
+    return ESP8266_OK;
+  }
+
+  start = HAL_GetTick();
+
+#if defined(ESP8266_WAKE_Pin)
+  if (stats.mode == ESP8266_SLEEP_LIGHT)
+  {
+    HAL_GPIO_WritePin(ESP8266_WAKE_GPIO_Port, ESP8266_WAKE_Pin, GPIO_PIN_RESET);
+    HAL_Delay(ESP8266_POWER_WAKE_PULSE_MS);
+    HAL_GPIO_WritePin(ESP8266_WAKE_GPIO_Port, ESP8266_WAKE_Pin, GPIO_PIN_SET);
+  }
+#endif
+
+  /* Radio on until the next esp8266_power_sleep(), even if the module does not answer */
+  ret = esp8266_sleep(ESP8266_SLEEP_DISABLE);
+  latency = HAL_GetTick() - start;
+  stats.asleep = 0;
+  awake_since = start;
+
+  metrics_observe(METRIC_HIST_WAKE_LATENCY, latency);
+  if (latency > stats.wake_latency_max_ms)
+  {
+    stats.wake_latency_max_ms = latency;
+  }
+
+  /* Lead: the worst recent wake-up, forgotten by 1/8 per wake-up */
+  decayed = stats.wake_lead_ms - ((stats.wake_lead_ms - ESP8266_POWER_WAKE_MARGIN_MS) / 8U);
+  stats.wake_lead_ms = ((latency + ESP8266_POWER_WAKE_MARGIN_MS) > decayed) ?
+                       (latency + ESP8266_POWER_WAKE_MARGIN_MS) : decayed;
+
+  /* Too slow for the commands waiting on it: sleep less deeply */
+  if (latency > ESP8266_POWER_MAX_WAKE_MS)
+  {
+    stats.mode = (stats.mode == ESP8266_SLEEP_LIGHT) ? ESP8266_SLEEP_MODEM : ESP8266_SLEEP_DISABLE;
+    stats.fallbacks++;
+  }
+
+  return ret;
+}
+
+/**
+  * @brief  Tell whether the module is asleep.
+  * @retval 1 when asleep, 0 otherwise.
+  */
+uint8_t esp8266_power_asleep(void)
+{
+  return stats.asleep;
+}
+
+/**
+  * @brief  Record how late a publish started after its schedule. A publish
+  *         later than ESP8266_POWER_MAX_JITTER_MS moves the next wake-ups
+  *         earlier by as much.
+  * @param  late_ms: publish start - scheduled time.
+  * @retval None.
+  */
+void esp8266_power_publish_started(uint32_t late_ms)
+{
+  if (late_ms > window_jitter_ms)
+  {
+    window_jitter_ms = late_ms;
+  }
+  if (late_ms > stats.jitter_max_ms)
+  {
+    stats.jitter_max_ms = late_ms;
+  }
+
+  if (late_ms > ESP8266_POWER_MAX_JITTER_MS)
+  {
+    stats.late_publishes++;
+    stats.wake_lead_ms += late_ms;
+    if (stats.wake_lead_ms > (ESP8266_POWER_MAX_WAKE_MS + ESP8266_POWER_WAKE_MARGIN_MS))
+    {
+      stats.wake_lead_ms = ESP8266_POWER_MAX_WAKE_MS + ESP8266_POWER_WAKE_MARGIN_MS;
+    }
+  }
+}
+
+/**
+  * @brief  Update the radio-on time per message and publish jitter metrics
+  *         once per POWER_REPORT_PERIOD_MS. Main loop context.
+  * @retval None.
+  */
+void esp8266_power_update_metrics(void)
+{
+  uint32_t now = HAL_GetTick();
+  uint64_t radio_on_ms;
+  uint32_t publishes;
+
+  if ((now - window_start_tick) < POWER_REPORT_PERIOD_MS)
+  {
+    return;
+  }
+  window_start_tick = now;
+
+  radio_on_ms = radio_on_now();
+  publishes = metric_values[METRIC_PUBLISHES] - window_publishes;
+  window_publishes = metric_values[METRIC_PUBLISHES];
+
+  stats.radio_on_per_msg_ms = (publishes != 0) ? (uint32_t)((radio_on_ms - window_radio_on_ms) / publishes) : 0;
+  window_radio_on_ms = radio_on_ms;
+
+  METRIC_SET(METRIC_RADIO_ON_PER_MSG, stats.radio_on_per_msg_ms);
+  METRIC_SET(METRIC_PUBLISH_JITTER, window_jitter_ms);
+  window_jitter_ms = 0;
+}
+
+/**
+  * @brief  Copy the module sleep statistics.
+  * @param  s: destination.
+  * @retval None.
+  */
+void esp8266_power_get_stats(esp8266_power_stats_t* s)
+{
+  *s = stats;
+  s->radio_on_ms = radio_on_now();
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Radio-on time including the current awake period. In modem sleep
+  *         the radio still listens to the DTIM beacons: not counted.
+  */
+static uint64_t radio_on_now(void)
+{
+  return stats.radio_on_ms + ((stats.asleep == 0) ? (HAL_GetTick() - awake_since) : 0U);
+}
@@ -0,0 +1,356 @@
+/*
+ * esp8266_urc.c
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "esp8266_urc.h"
+#include "esp8266_io.h"
+#include "at_scan.h"
+#include <string.h>
+
+/* Private define ------------------------------------------------------------*/
+/* Looked for from the start of the line, up to where they are in an intact
+   header ("+MQTTSUBRECV:", "+IPD,") plus ESP8266_URC_RESYNC_BYTES */
+#define SUBRECV_TAG         "SUBRECV:"
+#define SUBRECV_TAG_SIZE    (sizeof(SUBRECV_TAG) - 1U)
+#define SUBRECV_TAG_OFFSET  5U
+#define IPD_TAG             "IPD,"
+#define IPD_TAG_SIZE        (sizeof(IPD_TAG) - 1U)
+#define IPD_TAG_OFFSET      1U
+
+/* Private function prototypes -----------------------------------------------*/
+static uint8_t parse_uint(const char* p, const char* end, const char** next, uint32_t* value);
+static uint32_t drop(uint32_t length, const at_scan_set_t* set, char* last);
+static uint8_t parse_ipd(const char* buf, uint32_t length, esp8266_urc_frame_t* frame);
+static const char* find_tag(const char* buf, uint32_t length, const char* tag, uint32_t tag_size, uint32_t offset);
+
+/* Exported functions -------------------------------------------------------*/
+
+/**
+  * @brief  Start reading into buf.
+  * @param  reader: the reader.
+  * @param  buf: holds one line, or one +MQTTSUBRECV header and its payload.
+  * @param  size: its size.
+  * @retval None.
+  */
+void esp8266_urc_init(esp8266_urc_reader_t* reader, char* buf, uint32_t size)
+{
+  memset(reader, 0, sizeof(*reader));
+  reader->buf = buf;
+  reader->size = size;
+}
+
+/**
+  * @brief  Read what is already received, up to the end of the next URC.
+  *         Never waits: a URC not complete yet is resumed by the next call.
+  * @param  reader: the reader.
+  * @param  urc: the URC read.
+  * @retval 1 when urc is complete, 0 when the received bytes are exhausted.
+  */
+uint8_t esp8266_urc_read(esp8266_urc_reader_t* reader, esp8266_urc_t* urc)
+{
+  char* buf = reader->buf;
+  uint8_t truncated = 0;
+  uint32_t n;
+  char last;
+
+  if (reader->done != 0)
+  {
+    reader->done = 0;
+    reader->length = 0;
+  }
+
+  while (1)
+  {
+    if (reader->frame.data_start != 0)
+    {
+      /* Payload: exactly the declared length, whatever its bytes */
+      uint32_t end = reader->frame.data_start + reader->frame.data_length;
+
+      if (end > reader->size)
+      {
+        end = reader->size;
+      }
+      if (reader->length < end)
+      {
+        n = esp8266_io_read((uint8_t *)&buf[reader->length], end - reader->length, NULL);
+        if (n == 0)
+        {
+          return 0;
+        }
+        reader->length += n;
+        continue;
+      }
+      if (reader->skip != 0)
+      {
+        n = drop(reader->skip, NULL, &last);
+        if (n == 0)
+        {
+          return 0;
+        }
+        reader->skip -= n;
+        continue;
+      }
+
+      /* The CRLF after the payload comes as an empty line, ignored */
+      urc->type = reader->frame.type;
+      urc->link = reader->frame.link;
+      urc->line = buf;
+      urc->length = reader->frame.data_start;
+      urc->topic = &buf[reader->frame.topic_start];
+      urc->topic_length = reader->frame.topic_length;
+      urc->data = (const uint8_t *)&buf[reader->frame.data_start];
+      urc->data_length = end - reader->frame.data_start;
+      urc->truncated = (urc->data_length < reader->frame.data_length) ? 1U : 0U;
+      reader->frame.data_start = 0;
+      reader->done = 1;
+      return 1;
+    }
+
+    if (reader->overflow != 0)
+    {
+      /* Line too long: the rest of it is dropped */
+      n = drop(0xFFFFFFFFU, &at_scan_line, &last);
+      if (n == 0)
+      {
+        return 0;
+      }
+      if (last != '\n')
+      {
+        continue;
+      }
+      reader->overflow = 0;
+      truncated = 1;
+    }
+    else
+    {
+      n = esp8266_io_read((uint8_t *)&buf[reader->length], reader->size - 1U - reader->length, &at_scan_line);
+      if (n == 0)
+      {
+        return 0;
+      }
+      reader->length += n;
+      last = buf[reader->length - 1U];
+
+      if (esp8266_urc_parse_frame(buf, reader->length, &reader->frame) != 0)
+      {
+        uint32_t end = reader->frame.data_start + reader->frame.data_length;
+
+        reader->skip = (end > reader->size) ? (end - reader->size) : 0;
+        /* Read past the payload only up to its CRLF: dropped */
+        if (reader->length > end)
+        {
+          reader->length = end;
+        }
+        continue;
+      }
+
+      if ((last == '>') && (reader->length == 1U))
+      {
+        urc->type = ESP8266_URC_PROMPT;
+        urc->line = ">";
+        urc->length = 1;
+        urc->truncated = 0;
+        reader->done = 1;
+        return 1;
+      }
+
+      if (last != '\n')
+      {
+        if (reader->length == (reader->size - 1U))
+        {
+          reader->overflow = 1;
+        }
+        continue;
+      }
+    }
+
+    /* End of line */
+    while ((reader->length != 0) && ((buf[reader->length - 1U] == '\n') || (buf[reader->length - 1U] == '\r')))
+    {
+      reader->length--;
+    }
+    if (reader->length == 0)
+    {
+      continue;
+    }
+    buf[reader->length] = '\0';
+
+    urc->type = ESP8266_URC_LINE;
+    urc->line = buf;
+    urc->length = reader->length;
+    urc->truncated = truncated;
+    reader->done = 1;
+    return 1;
+  }
+}
+
+/**
+  * @brief  Tell whether a URC is partly read, its rest still to come.
+  * @param  reader: the reader.
+  * @retval 1 in the middle of a URC, 0 between two.
+  */
+uint8_t esp8266_urc_partial(const esp8266_urc_reader_t* reader)
+{
+  if ((reader->frame.data_start != 0) || (reader->overflow != 0))
+  {
+    return 1;
+  }
+  return ((reader->done == 0) && (reader->length != 0)) ? 1U : 0U;
+}
+
+/**
+  * @brief  Recognize a complete +MQTTSUBRECV:<link>,"<topic>",<length>,
+  *         or +IPD,[<link>,]<length>: header at the start of buf. The '+'
+  *         may be missing or garbled: the first byte of a line that wakes
+  *         the MCU from Stop.
+  * @param  buf: the bytes received, the payload may follow.
+  * @param  length: their count.
+  * @param  frame: where the topic and the payload are in buf.
+  * @retval 1 with frame filled, 0 when buf does not start with a header.
+  */
+uint8_t esp8266_urc_parse_frame(const char* buf, uint32_t length, esp8266_urc_frame_t* frame)
+{
+  const char* end = &buf[length];
+  const char* p;
+  const char* quote;
+  uint32_t link;
+  uint32_t data_length;
+
+  p = find_tag(buf, length, SUBRECV_TAG, SUBRECV_TAG_SIZE, SUBRECV_TAG_OFFSET);
+  if (p == NULL)
+  {
+    return parse_ipd(buf, length, frame);
+  }
+
+  if ((parse_uint(p, end, &p, &link) == 0) || ((end - p) < 2) || (p[0] != ',') || (p[1] != '"'))
+  {
+    return 0;
+  }
+  p += 2;
+
+  /* Topics are not escaped, they cannot hold a '"' */
+  quote = (const char *)memchr(p, '"', (size_t)(end - p));
+  if ((quote == NULL) || ((end - quote) < 2) || (quote[1] != ','))
+  {
+    return 0;
+  }
+  frame->topic_start = (uint32_t)(p - buf);
+  frame->topic_length = (uint32_t)(quote - p);
+  p = quote + 2;
+
+  if ((parse_uint(p, end, &p, &data_length) == 0) || (p == end) || (*p != ','))
+  {
+    return 0;
+  }
+
+  frame->type = ESP8266_URC_SUBRECV;
+  frame->link = (uint8_t)link;
+  frame->data_start = (uint32_t)(p + 1 - buf);
+  frame->data_length = data_length;
+  return 1;
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Read a decimal.
+  * @retval 1 with next after its last digit, 0 without a digit.
+  */
+static uint8_t parse_uint(const char* p, const char* end, const char** next, uint32_t* value)
+{
+  const char* start = p;
+
+  *value = 0;
+  while ((p != end) && (*p >= '0') && (*p <= '9') && (*value < 0x0FFFFFFFU))
+  {
+    *value = (*value * 10U) + (uint32_t)(*p - '0');
+    p++;
+  }
+  *next = p;
+  return (p != start) ? 1U : 0U;
+}
+
+/**
+  * @brief  Recognize +IPD,<link>,<length>: (AT+CIPMUX=1) or +IPD,<length>:.
+  * @retval 1 with frame filled, 0 otherwise.
+  */
+static uint8_t parse_ipd(const char* buf, uint32_t length, esp8266_urc_frame_t* frame)
+{
+  const char* end = &buf[length];
+  const char* p;
+  uint32_t first;
+  uint32_t data_length;
+
+  p = find_tag(buf, length, IPD_TAG, IPD_TAG_SIZE, IPD_TAG_OFFSET);
+  if (p == NULL)
+  {
+    return 0;
+  }
+
+  if ((parse_uint(p, end, &p, &first) == 0) || (p == end))
+  {
+    return 0;
+  }
+  frame->link = 0;
+  data_length = first;
+  if (*p == ',')
+  {
+    if ((first > 0xFFU) || (parse_uint(p + 1, end, &p, &data_length) == 0) || (p == end))
+    {
+      return 0;
+    }
+    frame->link = (uint8_t)first;
+  }
+  if (*p != ':')
+  {
+    return 0;
+  }
+
+  frame->type = ESP8266_URC_IPD;
+  frame->topic_start = 0;
+  frame->topic_length = 0;
+  frame->data_start = (uint32_t)(p + 1 - buf);
+  frame->data_length = data_length;
+  return 1;
+}
+
+/**
+  * @brief  Find the tag of a header whose first bytes may have been lost
+  *         (earlier than offset) or garbled (up to ESP8266_URC_RESYNC_BYTES
+  *         later, bytes of a framing error in between).
+  * @retval The byte after the tag, NULL if the line does not hold it there
+  *         or nothing follows it.
+  */
+static const char* find_tag(const char* buf, uint32_t length, const char* tag, uint32_t tag_size, uint32_t offset)
+{
+  for (uint32_t i = 0; (i <= (offset + ESP8266_URC_RESYNC_BYTES)) && ((i + tag_size) < length); i++)
+  {
+    if (memcmp(&buf[i], tag, tag_size) == 0)
+    {
+      return &buf[i + tag_size];
+    }
+  }
+
+  return NULL;
+}
+
+/**
+  * @brief  Drop up to length received bytes, up to the first of set.
+  * @retval The number of bytes dropped, last the last one.
+  */
+static uint32_t drop(uint32_t length, const at_scan_set_t* set, char* last)
+{
+  uint8_t skip[16];
+  uint32_t n;
+
+  n = esp8266_io_read(skip, (length < sizeof(skip)) ? length : sizeof(skip), set);
+  if (n != 0)
+  {
+    *last = (char)skip[n - 1U];
+  }
+  return n;
+}
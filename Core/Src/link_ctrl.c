@@ -0,0 +1,270 @@
+/*
+ * link_ctrl.c
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "link_ctrl.h"
+#include "main.h"
+#include "metrics.h"
+#include <string.h>
+
+/* Private variables ---------------------------------------------------------*/
+static const link_policy_t policies[LINK_LEVEL_COUNT][LINK_CLASS_COUNT] = {
+    /* LINK_GOOD: every sample at once, acknowledged */
+    { { 1, 1, 1, 1 }, { 1, 0, 1, 1 } },
+    /* LINK_FAIR: fewer publishes, still acknowledged */
+    { { 1, 1, 4, 1 }, { 1, 0, 1, 1 } },
+    /* LINK_POOR: half the samples, unacknowledged, no metrics */
+    { { 1, 0, 8, 2 }, { 0, 0, 1, 1 } },
+};
+
+static link_ctrl_config_t config = {
+    .adaptive          = 1,
+    .target_latency_ms = LINK_TARGET_LATENCY_MS,
+    .rssi_period_ms    = LINK_RSSI_PERIOD_MS,
+    .rssi_fair         = LINK_RSSI_FAIR,
+    .rssi_poor         = LINK_RSSI_POOR,
+    .rssi_hysteresis   = LINK_RSSI_HYSTERESIS,
+};
+
+static link_ctrl_stats_t stats;
+static uint32_t latency_x4;             /* smoothed latency, times 4; 0 before the first */
+static uint32_t level_since;
+static uint32_t settle;                 /* publishes left before the level is judged */
+static uint32_t good_streak;
+static uint32_t last_rssi_tick;
+static uint8_t rssi_sampled;
+static uint8_t probing;                 /* moved up, not yet confirmed by recover_hold samples */
+
+/* Private function prototypes -----------------------------------------------*/
+static void evaluate(uint8_t failed);
+static void change_level(link_level_t level);
+static int8_t threshold(link_level_t level);
+
+/* Exported functions -------------------------------------------------------*/
+
+/**
+  * @brief  Set the configuration; kept over link_ctrl_reset().
+  * @param  new_config: the configuration.
+  * @retval None.
+  */
+void link_ctrl_configure(const link_ctrl_config_t* new_config)
+{
+  config = *new_config;
+}
+
+/**
+  * @brief  Get the configuration.
+  * @param  out: the configuration.
+  * @retval None.
+  */
+void link_ctrl_get_config(link_ctrl_config_t* out)
+{
+  *out = config;
+}
+
+/**
+  * @brief  Start at LINK_GOOD with no measurement; the RSSI is due at once.
+  * @retval None.
+  */
+void link_ctrl_reset(void)
+{
+  memset(&stats, 0, sizeof(stats));
+  stats.recover_hold = LINK_RECOVER_SAMPLES;
+  latency_x4 = 0;
+  level_since = HAL_GetTick();
+  settle = LINK_SETTLE_SAMPLES;
+  good_streak = 0;
+  rssi_sampled = 0;
+  probing = 0;
+  METRIC_SET(METRIC_LINK_LEVEL, LINK_GOOD);
+}
+
+/**
+  * @brief  Account a publish: its round trip, from the command to the last
+  *         reply, and its status.
+  * @param  latency_ms: the round trip.
+  * @param  status: ESP8266_OK, or why it failed.
+  * @param  samples: samples it carried.
+  * @param  qos: its QoS.
+  * @retval None.
+  */
+void link_ctrl_publish_done(uint32_t latency_ms, esp8266_status_t status, uint32_t samples, uint8_t qos)
+{
+  uint8_t failed = (status != ESP8266_OK) ? 1U : 0U;
+
+  stats.publishes++;
+  if (failed != 0)
+  {
+    stats.failed++;
+  }
+  else
+  {
+    stats.samples += samples;
+    if (qos != 0)
+    {
+      stats.samples_qos1 += samples;
+    }
+  }
+  if (latency_ms > config.target_latency_ms)
+  {
+    stats.over_target++;
+  }
+  stats.latency_sum_ms += latency_ms;
+  if (latency_ms > stats.latency_max_ms)
+  {
+    stats.latency_max_ms = latency_ms;
+  }
+
+  /* EWMA, 1/4 of the new sample: a slow link shows within 3 publishes; the
+     first one taken whole */
+  latency_x4 = (latency_x4 == 0) ? (latency_ms * 4U) : (latency_x4 - (latency_x4 / 4U) + latency_ms);
+  stats.latency_ms = latency_x4 / 4U;
+
+  if (settle != 0)
+  {
+    settle--;
+  }
+  evaluate(failed);
+}
+
+/**
+  * @brief  Whether the RSSI should be sampled now.
+  * @retval 1 when due, 0 otherwise.
+  */
+uint8_t link_ctrl_rssi_due(void)
+{
+  return ((rssi_sampled == 0) || ((HAL_GetTick() - last_rssi_tick) >= config.rssi_period_ms)) ? 1U : 0U;
+}
+
+/**
+  * @brief  Account an RSSI sample of the AP.
+  * @param  rssi: in dBm.
+  * @retval None.
+  */
+void link_ctrl_rssi(int8_t rssi)
+{
+  stats.rssi = rssi;
+  stats.rssi_samples++;
+  rssi_sampled = 1;
+  last_rssi_tick = HAL_GetTick();
+  evaluate(0);
+}
+
+/**
+  * @brief  The policy of a message class at the current level.
+  * @param  message_class: the class.
+  * @retval The policy.
+  */
+const link_policy_t* link_ctrl_policy(link_class_t message_class)
+{
+  return &policies[stats.level][message_class];
+}
+
+/**
+  * @brief  Get the counters, with the time spent at the current level so far.
+  * @param  out: the counters.
+  * @retval None.
+  */
+void link_ctrl_get_stats(link_ctrl_stats_t* out)
+{
+  *out = stats;
+  out->level_ms[stats.level] += HAL_GetTick() - level_since;
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Move down at the first sign of a worse link, up after a run of
+  *         good samples.
+  */
+static void evaluate(uint8_t failed)
+{
+  link_level_t level = stats.level;
+  uint8_t rssi_low = ((rssi_sampled != 0) && (level < LINK_POOR) && (stats.rssi < threshold(level))) ? 1U : 0U;
+  uint8_t slow = ((latency_x4 != 0) && (stats.latency_ms > config.target_latency_ms)) ? 1U : 0U;
+
+  if (config.adaptive == 0)
+  {
+    return;
+  }
+
+  if ((level < LINK_POOR) && ((rssi_low != 0) || (((failed != 0) || (slow != 0)) && (settle == 0))))
+  {
+    /* A level left before it was confirmed: wait longer next time */
+    if (probing != 0)
+    {
+      stats.recover_hold *= 2U;
+      if (stats.recover_hold > LINK_RECOVER_MAX_SAMPLES)
+      {
+        stats.recover_hold = LINK_RECOVER_MAX_SAMPLES;
+      }
+    }
+    change_level((link_level_t)(level + 1));
+    return;
+  }
+
+  if ((failed != 0) || (slow != 0))
+  {
+    good_streak = 0;
+    return;
+  }
+
+  /* Confirmed: the next recovery may be fast again */
+  if ((probing != 0) && (++good_streak >= stats.recover_hold))
+  {
+    probing = 0;
+    good_streak = 0;
+    stats.recover_hold = LINK_RECOVER_SAMPLES;
+    return;
+  }
+
+  if ((level > LINK_GOOD) && (probing == 0))
+  {
+    uint8_t rssi_ok = ((rssi_sampled == 0) ||
+                       (stats.rssi >= (threshold((link_level_t)(level - 1)) + config.rssi_hysteresis))) ? 1U : 0U;
+    uint8_t fast = ((latency_x4 == 0) || (stats.latency_ms <= (config.target_latency_ms / 2U))) ? 1U : 0U;
+
+    if ((rssi_ok != 0) && (fast != 0))
+    {
+      if (++good_streak >= stats.recover_hold)
+      {
+        change_level((link_level_t)(level - 1));
+        probing = 1;
+      }
+    }
+    else
+    {
+      good_streak = 0;
+    }
+  }
+}
+
+static void change_level(link_level_t level)
+{
+  uint32_t now = HAL_GetTick();
+
+  stats.level_ms[stats.level] += now - level_since;
+  level_since = now;
+  stats.level = level;
+  stats.level_changes++;
+  METRIC_SET(METRIC_LINK_LEVEL, level);
+
+  /* The smoothed latency was of the old policy */
+  latency_x4 = 0;
+  stats.latency_ms = 0;
+  settle = LINK_SETTLE_SAMPLES;
+  good_streak = 0;
+  probing = 0;
+}
+
+/**
+  * @brief  The RSSI under which a level is left for the next worse one.
+  */
+static int8_t threshold(link_level_t level)
+{
+  return (level == LINK_GOOD) ? config.rssi_fair : config.rssi_poor;
+}
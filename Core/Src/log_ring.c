@@ -0,0 +1,307 @@
+/*
+ * log_ring.c
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "log_ring.h"
+#include "metrics.h"
+#include "main.h"
+#include <string.h>
+
+/* Private define ------------------------------------------------------------*/
+#define LOG_RING_MASK           (LOG_RING_SIZE - 1U)
+#define LOG_RECORD_READY        0x80000000U
+#define LOG_RECORD_LEN_MASK     0x0000FFFFU
+#define LOG_RECORD_SPAN(len)    (4U + (((len) + 3U) & ~3U))
+
+#if (LOG_RING_SIZE & LOG_RING_MASK) != 0
+#error "LOG_RING_SIZE must be a power of two"
+#endif
+
+/* Private variables ---------------------------------------------------------*/
+extern UART_HandleTypeDef huart2;
+
+/*
+ * Records are a 32-bit header followed by the payload padded to a word, so a
+ * header never straddles the end of the ring. Producers (thread or any ISR)
+ * reserve space by advancing ring_head with a CAS, copy their bytes and only
+ * then publish the header with the READY bit. The single consumer (idle loop)
+ * stops at the first reserved-but-unpublished record.
+ */
+static uint32_t ring_words[LOG_RING_SIZE / 4];
+static volatile uint32_t ring_head;   /* free running, owned by producers */
+static volatile uint32_t ring_tail;   /* free running, owned by the consumer */
+
+static uint8_t staging[LOG_RING_STAGING_SIZE];
+static uint32_t staging_len;
+static uint32_t staging_pos;
+
+static const log_sink_t* log_sink;
+static log_ring_stats_t log_stats;
+
+/* Private function prototypes -----------------------------------------------*/
+static int8_t log_ring_put_record(const uint8_t* data, uint32_t length);
+static uint32_t log_ring_fill_staging(void);
+static uint8_t itm_sink_ready(void);
+static uint32_t itm_sink_write(const uint8_t* data, uint32_t length);
+static uint8_t uart_dma_sink_ready(void);
+static uint32_t uart_dma_sink_write(const uint8_t* data, uint32_t length);
+
+/* Exported variables --------------------------------------------------------*/
+const log_sink_t log_sink_itm      = { itm_sink_ready, itm_sink_write };
+const log_sink_t log_sink_uart_dma = { uart_dma_sink_ready, uart_dma_sink_write };
+
+/* Exported functions -------------------------------------------------------*/
+
+/**
+  * @brief  Initialize the log ring and select its sink.
+  * @param  sink: where the idle loop drains the log to.
+  * @retval None.
+  */
+void log_ring_init(const log_sink_t* sink)
+{
+  ring_head = 0;
+  ring_tail = 0;
+  staging_len = 0;
+  staging_pos = 0;
+  memset(ring_words, 0, sizeof(ring_words));
+  memset(&log_stats, 0, sizeof(log_stats));
+
+  /* The cycle counter is used to measure the cost of each message */
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+  log_sink = sink;
+}
+
+/**
+  * @brief  Change the sink at runtime. Pending staged bytes go to the new sink.
+  * @param  sink: the new sink.
+  * @retval None.
+  */
+void log_ring_set_sink(const log_sink_t* sink)
+{
+  log_sink = sink;
+}
+
+/**
+  * @brief  Append bytes to the log ring. Never blocks, safe from any ISR.
+  * @param  data: the bytes to log.
+  * @param  length: number of bytes.
+  * @retval Number of bytes stored, the rest was dropped because the ring was full.
+  */
+int32_t log_ring_write(const void* data, uint32_t length)
+{
+  const uint8_t* p = (const uint8_t *)data;
+  uint32_t start = DWT->CYCCNT;
+  uint32_t stored = 0;
+  uint32_t cycles;
+
+  while (stored < length)
+  {
+    uint32_t chunk = length - stored;
+
+    if (chunk > LOG_RING_MAX_RECORD)
+    {
+      chunk = LOG_RING_MAX_RECORD;
+    }
+
+    if (log_ring_put_record(p + stored, chunk) != 0)
+    {
+      __atomic_fetch_add(&log_stats.dropped, 1U, __ATOMIC_RELAXED);
+      break;
+    }
+
+    __atomic_fetch_add(&log_stats.written, 1U, __ATOMIC_RELAXED);
+    stored += chunk;
+  }
+
+  cycles = DWT->CYCCNT - start;
+  log_stats.last_cycles = cycles;
+  if (cycles > log_stats.max_cycles)
+  {
+    log_stats.max_cycles = cycles;
+  }
+
+  return (int32_t)stored;
+}
+
+/**
+  * @brief  Move logged bytes to the sink. Call from the idle loop only.
+  * @retval None.
+  */
+void log_ring_drain(void)
+{
+  const log_sink_t* sink = log_sink;
+  uint32_t accepted;
+
+  while ((sink != NULL) && (sink->ready() != 0))
+  {
+    if (staging_pos == staging_len)
+    {
+      staging_pos = 0;
+      staging_len = log_ring_fill_staging();
+      if (staging_len == 0)
+      {
+        break;
+      }
+    }
+
+    accepted = sink->write(&staging[staging_pos], staging_len - staging_pos);
+    staging_pos += accepted;
+
+    if (accepted == 0)
+    {
+      break;
+    }
+  }
+
+  METRIC_SET(METRIC_LOG_DROPS, log_stats.dropped);
+  METRIC_SET(METRIC_LOG_CYCLES_MAX, log_stats.max_cycles);
+}
+
+/**
+  * @brief  Read the log ring statistics.
+  * @param  stats: destination of the statistics.
+  * @retval None.
+  */
+void log_ring_get_stats(log_ring_stats_t* stats)
+{
+  *stats = log_stats;
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Reserve, fill and publish one record.
+  * @param  data: the payload.
+  * @param  length: the payload length, at most LOG_RING_MAX_RECORD.
+  * @retval 0 on success, -1 if the ring is full.
+  */
+static int8_t log_ring_put_record(const uint8_t* data, uint32_t length)
+{
+  uint8_t* bytes = (uint8_t *)ring_words;
+  uint32_t span = LOG_RECORD_SPAN(length);
+  uint32_t head = __atomic_load_n(&ring_head, __ATOMIC_RELAXED);
+  uint32_t idx;
+
+  do
+  {
+    if (span > (LOG_RING_SIZE - (head - __atomic_load_n(&ring_tail, __ATOMIC_ACQUIRE))))
+    {
+      return -1;
+    }
+  } while (!__atomic_compare_exchange_n(&ring_head, &head, head + span, 1,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+
+  idx = (head + 4U) & LOG_RING_MASK;
+  if ((idx + length) <= LOG_RING_SIZE)
+  {
+    memcpy(&bytes[idx], data, length);
+  }
+  else
+  {
+    uint32_t first = LOG_RING_SIZE - idx;
+    memcpy(&bytes[idx], data, first);
+    memcpy(&bytes[0], data + first, length - first);
+  }
+
+  __atomic_store_n(&ring_words[(head & LOG_RING_MASK) >> 2], LOG_RECORD_READY | length, __ATOMIC_RELEASE);
+
+  return 0;
+}
+
+/**
+  * @brief  Copy as many published records as fit into the staging buffer.
+  * @retval Number of bytes staged.
+  */
+static uint32_t log_ring_fill_staging(void)
+{
+  const uint8_t* bytes = (const uint8_t *)ring_words;
+  uint32_t tail = ring_tail;
+  uint32_t len = 0;
+
+  while (tail != __atomic_load_n(&ring_head, __ATOMIC_ACQUIRE))
+  {
+    uint32_t* header = &ring_words[(tail & LOG_RING_MASK) >> 2];
+    uint32_t word = __atomic_load_n(header, __ATOMIC_ACQUIRE);
+    uint32_t rec_len = word & LOG_RECORD_LEN_MASK;
+    uint32_t idx = (tail + 4U) & LOG_RING_MASK;
+
+    /* Reserved by a producer that has not finished writing yet */
+    if ((word & LOG_RECORD_READY) == 0)
+    {
+      break;
+    }
+
+    if ((len + rec_len) > LOG_RING_STAGING_SIZE)
+    {
+      break;
+    }
+
+    for (uint32_t i = 0; i < rec_len; i++)
+    {
+      staging[len++] = bytes[(idx + i) & LOG_RING_MASK];
+    }
+
+    *header = 0;
+    tail += LOG_RECORD_SPAN(rec_len);
+    __atomic_store_n(&ring_tail, tail, __ATOMIC_RELEASE);
+  }
+
+  return len;
+}
+
+/**
+  * @brief  The ITM sink is always ready: it pushes what the FIFO takes.
+  */
+static uint8_t itm_sink_ready(void)
+{
+  return 1;
+}
+
+/**
+  * @brief  Write to ITM stimulus port 0 without waiting on the FIFO.
+  * @details With no debugger attached the port is disabled and the bytes are
+  *          discarded instead of spinning forever.
+  */
+static uint32_t itm_sink_write(const uint8_t* data, uint32_t length)
+{
+  uint32_t i = 0;
+
+  if (((ITM->TCR & ITM_TCR_ITMENA_Msk) == 0) || ((ITM->TER & 1UL) == 0))
+  {
+    return length;
+  }
+
+  while ((i < length) && (ITM->PORT[0U].u32 != 0UL))
+  {
+    ITM->PORT[0U].u8 = data[i++];
+  }
+
+  return i;
+}
+
+/**
+  * @brief  The USART2 sink is ready once the previous DMA transfer is done.
+  */
+static uint8_t uart_dma_sink_ready(void)
+{
+  return (huart2.gState == HAL_UART_STATE_READY) ? 1 : 0;
+}
+
+/**
+  * @brief  Start a DMA transfer of the staged chunk on USART2.
+  */
+static uint32_t uart_dma_sink_write(const uint8_t* data, uint32_t length)
+{
+  if (HAL_UART_Transmit_DMA(&huart2, (uint8_t *)data, (uint16_t)length) != HAL_OK)
+  {
+    return 0;
+  }
+
+  return length;
+}
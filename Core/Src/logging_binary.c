@@ -0,0 +1,43 @@
+/*
+ * logging_binary.c
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "logging_binary.h"
+#include "log_ring.h"
+#include <string.h>
+
+/* Private define ------------------------------------------------------------*/
+#define LOGBIN_HEADER_SIZE      6       /* sync, nargs, id */
+
+/* Exported functions -------------------------------------------------------*/
+
+/**
+  * @brief  Write one binary log frame to the log ring.
+  * @details The frame is sync byte, argument count, message ID and the raw
+  *          argument words, all little endian. It is committed as a single
+  *          log ring record so frames from ISRs never interleave.
+  * @param  id: message ID, the address of the format string in ".logstr".
+  * @param  args: args[0] is the argument count, followed by the arguments.
+  * @retval None.
+  */
+void logbin_write(uint32_t id, const uint32_t* args)
+{
+  uint8_t frame[LOGBIN_HEADER_SIZE + (4 * LOGBIN_MAX_ARGS)];
+  uint32_t nargs = args[0];
+
+  if (nargs > LOGBIN_MAX_ARGS)
+  {
+    nargs = LOGBIN_MAX_ARGS;
+  }
+
+  frame[0] = LOGBIN_SYNC;
+  frame[1] = (uint8_t)nargs;
+  memcpy(&frame[2], &id, sizeof(id));
+  memcpy(&frame[LOGBIN_HEADER_SIZE], &args[1], 4 * nargs);
+
+  log_ring_write(frame, LOGBIN_HEADER_SIZE + (4 * nargs));
+}
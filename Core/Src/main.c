@@ -25,6 +25,12 @@
 #include "esp8266_io.h"
 #include <stdio.h>
 #include "app.h"
+#include "metrics.h"
+#include "log_ring.h"
+#include "sched.h"
+#include "app_rtos.h"
+#include "power.h"
+#include "wifi_join.h"
 /* USER CODE END Includes */
 
 /* Private typedef -----------------------------------------------------------*/
@@ -39,6 +45,9 @@
 
 /* Private macro -------------------------------------------------------------*/
 /* USER CODE BEGIN PM */
+/* Bring-up command: the driver does not wait on a busy module, the same
+   command goes again after APP_BUSY_RETRY_MS, nothing else runs yet */
+#define BRING_UP(call)  while ((status = (call)) == ESP8266_BUSY) { HAL_Delay(APP_BUSY_RETRY_MS); }
 
 /* USER CODE END PM */
 
@@ -46,8 +55,14 @@
 UART_HandleTypeDef huart4;
 UART_HandleTypeDef huart2;
 DMA_HandleTypeDef hdma_uart4_rx;
+DMA_HandleTypeDef hdma_uart4_tx;
+DMA_HandleTypeDef hdma_usart2_tx;
 
 /* USER CODE BEGIN PV */
+static const wifi_network_t wifi_networks[] = {
+    { WIFI_SSID,     WIFI_PASSWORD     },
+    { WIFI_SSID_ALT, WIFI_PASSWORD_ALT },
+};
 
 /* USER CODE END PV */
 
@@ -69,8 +84,9 @@ static void MX_UART4_Init(void);
  * The project shown below uses MQTT APIs to send and receive MQTT packets
  * over the TLS connection established using mbedTLS.
  *
- * The project is single threaded, uses statically allocated memory, and
- * uses QOS1 for publishing messages to the broker.
+ * The project is single threaded (or, built with USE_FREERTOS, runs RX,
+ * TX and application tasks on FreeRTOS), uses statically allocated memory,
+ * and uses QOS1 for publishing messages to the broker.
  */
 /* USER CODE END 0 */
 
@@ -83,6 +99,7 @@ int main(void)
 
   /* USER CODE BEGIN 1 */
   esp8266_status_t status;
+  esp8266_time_t sntp_time;
   /* USER CODE END 1 */
 
   /* MCU Configuration--------------------------------------------------------*/
@@ -108,46 +125,67 @@ int main(void)
   MX_UART4_Init();
   /* USER CODE BEGIN 2 */
   wifi_uart_handle = &huart4;
-  status = esp8266_init();
+  metrics_init();
+  power_init();
+#if defined(LOG_SINK_UART)
+  log_ring_init(&log_sink_uart_dma);
+#else
+  log_ring_init(&log_sink_itm);
+#endif
+  BRING_UP(esp8266_init());
 
   if (status != ESP8266_OK){
     Error_Handler();
   }
 
-  /* Keep attempting to connect to the specified Wi-Fi access point until successful */
-  while(esp8266_joint_ap((uint8_t *)WIFI_SSID, (uint8_t *)WIFI_PASSWORD) != ESP8266_OK);
+  /* Keep attempting to join the strongest configured network until successful */
+  wifi_join_init(wifi_networks, sizeof(wifi_networks) / sizeof(wifi_networks[0]));
+  while(wifi_join() != ESP8266_OK);
 
 
   /* Configure SNTP with "pool.ntp.org" */
-  if(esp8266_config_sntp("pool.ntp.org") != ESP8266_OK)
+  BRING_UP(esp8266_config_sntp("pool.ntp.org"));
+  if(status != ESP8266_OK)
   {
       Error_Handler();
   }
 
   /* Query SNTP time */
-  if(esp8266_get_sntp_time() != ESP8266_OK)
+  BRING_UP(esp8266_get_sntp_time(&sntp_time));
+  if(status != ESP8266_OK)
   {
       Error_Handler();
   }
 
   /* Configure MQTT client parameters */
-  if(esp8266_mqtt_usercfg("esp32", "espressif", "1234567890") != ESP8266_OK)
+  BRING_UP(esp8266_mqtt_usercfg(MQTT_CLIENT_ID, "espressif", "1234567890"));
+  if(status != ESP8266_OK)
   {
       Error_Handler();
   }
 
-  /* Connect to the MQTT broker (replace <endpoint> with your AWS IoT endpoint) */
-  if(esp8266_mqtt_connect(MQTT_BROKER, MQTT_PORT, 1) != ESP8266_OK)
+  /* Connect to the MQTT broker (replace <endpoint> with your AWS IoT endpoint),
+     by its address once looked up */
+  BRING_UP(esp8266_mqtt_connect_cached(MQTT_BROKER, MQTT_PORT, 1));
+  if(status != ESP8266_OK)
   {
       Error_Handler();
   }
 
   /* Subscribe to a topic */
-  if(esp8266_mqtt_subscribe("led/cmd", 1) != ESP8266_OK)
+  BRING_UP(esp8266_mqtt_subscribe("led/cmd", 1));
+  if(status != ESP8266_OK)
   {
       Error_Handler();
   }
 
+#if defined(USE_FREERTOS)
+  /* RX parser, TX and application tasks; does not return */
+  app_rtos_start();
+#else
+  /* Publishing, URC parsing, reconnection and LED now run as scheduler tasks */
+  app_init();
+#endif
 
   /* USER CODE END 2 */
 
@@ -158,9 +196,8 @@ int main(void)
     /* USER CODE END WHILE */
 
     /* USER CODE BEGIN 3 */
-    if (publish_and_process_incoming_message() != 0)
-    {
-    }
+    /* Timers, deferred work and tasks; sleeps in WFI when nothing is pending */
+    sched_run_once();
   }
   /* USER CODE END 3 */
 }
@@ -298,6 +335,12 @@ static void MX_DMA_Init(void)
   /* DMA1_Stream2_IRQn interrupt configuration */
   HAL_NVIC_SetPriority(DMA1_Stream2_IRQn, 0, 0);
   HAL_NVIC_EnableIRQ(DMA1_Stream2_IRQn);
+  /* DMA1_Stream4_IRQn interrupt configuration */
+  HAL_NVIC_SetPriority(DMA1_Stream4_IRQn, 0, 0);
+  HAL_NVIC_EnableIRQ(DMA1_Stream4_IRQn);
+  /* DMA1_Stream6_IRQn interrupt configuration */
+  HAL_NVIC_SetPriority(DMA1_Stream6_IRQn, 0, 0);
+  HAL_NVIC_EnableIRQ(DMA1_Stream6_IRQn);
 
 }
 
@@ -0,0 +1,384 @@
+/*
+ * metrics.c
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "metrics.h"
+#include "at_builder.h"
+#include "esp8266.h"
+#include "main.h"
+#include <string.h>
+#include <stddef.h>
+
+/* Private define ------------------------------------------------------------*/
+#define STACK_PAINT_PATTERN     0xC5C5C5C5U
+#define STACK_PAINT_MARGIN      64      /* bytes kept free below the live SP */
+
+#define METRICS_DESC_ENTRY(id, key, type)   [id] = { key, type },
+#define METRICS_HIST_KEY_ENTRY(id, key)     [id] = key,
+#define METRICS_KEY_CHECK(id, key, ...)     _Static_assert(sizeof(key) <= (METRICS_KEY_MAX_SIZE + 1U), \
+                                                           "key of " #id " longer than METRICS_KEY_MAX_SIZE");
+
+/* METRICS_MAX_ENCODED_SIZE holds every key */
+METRICS_SCALAR_TABLE(METRICS_KEY_CHECK)
+METRICS_HISTOGRAM_TABLE(METRICS_KEY_CHECK)
+
+/* Private variables ---------------------------------------------------------*/
+volatile uint32_t metric_values[METRIC_SCALAR_COUNT];
+metric_histogram_t metric_histograms[METRIC_HISTOGRAM_COUNT];
+
+const metric_desc_t metric_desc[METRIC_SCALAR_COUNT] = {
+    METRICS_SCALAR_TABLE(METRICS_DESC_ENTRY)
+};
+
+static const char* const metric_hist_keys[METRIC_HISTOGRAM_COUNT] = {
+    METRICS_HISTOGRAM_TABLE(METRICS_HIST_KEY_ENTRY)
+};
+
+static uint32_t publish_period_ms = METRICS_PUBLISH_PERIOD_MS;
+static uint32_t window_start_tick;
+static uint32_t idle_enter_cycles;
+static uint64_t idle_cycles;
+static uint32_t* stack_paint_start;
+
+/* Private function prototypes -----------------------------------------------*/
+#if !defined(HOST_BUILD)
+extern void *_sbrk(ptrdiff_t incr);
+#endif
+static void metrics_paint_stack(void);
+static uint32_t metrics_stack_used(void);
+static uint32_t metrics_heap_used(void);
+static uint32_t metrics_percentile(const metric_histogram_t* hist, uint32_t per_mille);
+
+/* Exported functions -------------------------------------------------------*/
+
+/**
+  * @brief  Initialize the metrics registry.
+  * @details Starts the DWT cycle counter used for idle accounting and paints
+  *          the free stack area so the high-water mark can be measured later.
+  *          Must be called once from main() before the scheduler/super-loop.
+  * @retval None.
+  */
+void metrics_init(void)
+{
+  memset((void *)metric_values, 0, sizeof(metric_values));
+  memset(metric_histograms, 0, sizeof(metric_histograms));
+
+  /* Enable the cycle counter */
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CYCCNT = 0;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+  idle_cycles = 0;
+  window_start_tick = HAL_GetTick();
+
+  metrics_paint_stack();
+}
+
+/**
+  * @brief  Record a sample into a histogram.
+  * @param  id: histogram identifier.
+  * @param  value: the sample (e.g. a latency in ms).
+  * @retval None.
+  */
+void metrics_observe(metric_hist_id_t id, uint32_t value)
+{
+  uint32_t idx = (value == 0) ? 0 : (32 - __builtin_clz(value));
+
+  if (idx >= METRICS_HIST_BUCKETS)
+  {
+    idx = METRICS_HIST_BUCKETS - 1;
+  }
+
+  metric_histograms[id].bucket[idx]++;
+  metric_histograms[id].count++;
+  metric_histograms[id].sum += value;
+}
+
+/**
+  * @brief  Mark the start of a period where the CPU has nothing to do.
+  * @retval None.
+  */
+void metrics_idle_enter(void)
+{
+  idle_enter_cycles = DWT->CYCCNT;
+}
+
+/**
+  * @brief  Mark the end of an idle period started with metrics_idle_enter().
+  * @retval None.
+  */
+void metrics_idle_exit(void)
+{
+  idle_cycles += (uint32_t)(DWT->CYCCNT - idle_enter_cycles);
+}
+
+/**
+  * @brief  Account idle time the cycle counter did not see (Stop mode).
+  * @param  ms: idle time in ms.
+  * @retval None.
+  */
+void metrics_idle_add_ms(uint32_t ms)
+{
+  idle_cycles += (uint64_t)ms * (SystemCoreClock / 1000U);
+}
+
+/**
+  * @brief  Read all metrics without starting a new window: the percentiles
+  *         are those of the window so far, the idle share is not updated.
+  * @param  snapshot: destination of the values.
+  * @retval None.
+  */
+void metrics_peek(metrics_snapshot_t* snapshot)
+{
+  for (uint32_t i = 0; i < METRIC_SCALAR_COUNT; i++)
+  {
+    snapshot->value[i] = metric_values[i];
+  }
+
+  for (uint32_t i = 0; i < METRIC_HISTOGRAM_COUNT; i++)
+  {
+    snapshot->p50[i] = metrics_percentile(&metric_histograms[i], 500);
+    snapshot->p99[i] = metrics_percentile(&metric_histograms[i], 990);
+    snapshot->count[i] = metric_histograms[i].count;
+    snapshot->sum[i] = metric_histograms[i].sum;
+  }
+
+  snapshot->uptime_ms = HAL_GetTick();
+}
+
+/**
+  * @brief  Take a snapshot of all metrics and start a new histogram window.
+  * @param  snapshot: destination of the snapshot.
+  * @retval None.
+  */
+void metrics_snapshot(metrics_snapshot_t* snapshot)
+{
+  uint32_t now = HAL_GetTick();
+  uint64_t window_cycles = (uint64_t)(now - window_start_tick) * (SystemCoreClock / 1000U);
+
+  if (window_cycles != 0)
+  {
+    uint64_t idle = (idle_cycles > window_cycles) ? window_cycles : idle_cycles;
+    METRIC_SET(METRIC_CPU_IDLE_PCT, (idle * 100U) / window_cycles);
+  }
+  METRIC_MAX(METRIC_HEAP_HWM, metrics_heap_used());
+  METRIC_MAX(METRIC_STACK_HWM, metrics_stack_used());
+
+  for (uint32_t i = 0; i < METRIC_SCALAR_COUNT; i++)
+  {
+    snapshot->value[i] = metric_values[i];
+  }
+
+  for (uint32_t i = 0; i < METRIC_HISTOGRAM_COUNT; i++)
+  {
+    snapshot->p50[i] = metrics_percentile(&metric_histograms[i], 500);
+    snapshot->p99[i] = metrics_percentile(&metric_histograms[i], 990);
+    snapshot->count[i] = metric_histograms[i].count;
+    snapshot->sum[i] = metric_histograms[i].sum;
+    memset((void *)metric_histograms[i].bucket, 0, sizeof(metric_histograms[i].bucket));
+  }
+
+  snapshot->uptime_ms = now;
+  idle_cycles = 0;
+  window_start_tick = now;
+}
+
+/**
+  * @brief  Encode a snapshot in the compact "key=value;" wire format.
+  * @details The output only uses characters that need no escaping inside a
+  *          quoted AT+MQTTPUB parameter; a buffer of METRICS_MAX_ENCODED_SIZE
+  *          bytes always holds it.
+  * @param  snapshot: the snapshot to encode.
+  * @param  buffer: destination buffer.
+  * @param  size: size of the destination buffer.
+  * @retval Number of characters written, -1 if the buffer is too small.
+  */
+int32_t metrics_encode(const metrics_snapshot_t* snapshot, char* buffer, uint32_t size)
+{
+  at_builder_t out;
+
+  at_builder_init(&out, buffer, size);
+  at_builder_lit(&out, "up=");
+  at_builder_uint(&out, snapshot->uptime_ms / 1000U);
+
+  for (uint32_t i = 0; i < METRIC_SCALAR_COUNT; i++)
+  {
+    at_builder_char(&out, ';');
+    at_builder_str(&out, metric_desc[i].key);
+    at_builder_char(&out, '=');
+    at_builder_uint(&out, snapshot->value[i]);
+  }
+
+  for (uint32_t i = 0; i < METRIC_HISTOGRAM_COUNT; i++)
+  {
+    at_builder_char(&out, ';');
+    at_builder_str(&out, metric_hist_keys[i]);
+    at_builder_lit(&out, "50=");
+    at_builder_uint(&out, snapshot->p50[i]);
+    at_builder_char(&out, ';');
+    at_builder_str(&out, metric_hist_keys[i]);
+    at_builder_lit(&out, "99=");
+    at_builder_uint(&out, snapshot->p99[i]);
+  }
+
+  return at_builder_finish(&out);
+}
+
+/**
+  * @brief  Change the telemetry period at runtime.
+  * @param  period_ms: new period in ms, 0 disables the publication.
+  * @retval None.
+  */
+void metrics_set_period(uint32_t period_ms)
+{
+  publish_period_ms = period_ms;
+}
+
+/**
+  * @brief  Publish a metrics snapshot to "<client id>/$metrics" when the
+  *         configured period has elapsed since the previous snapshot.
+  * @retval 1 if a snapshot was published, 0 if not due yet, -1 on error.
+  */
+int8_t metrics_publish_if_due(void)
+{
+  static metrics_snapshot_t snapshot;
+  static char payload[METRICS_MAX_ENCODED_SIZE];
+  int32_t length;
+
+  if ((publish_period_ms == 0) || ((HAL_GetTick() - window_start_tick) < publish_period_ms))
+  {
+    return 0;
+  }
+
+  metrics_snapshot(&snapshot);
+
+  length = metrics_encode(&snapshot, payload, sizeof(payload));
+  if (length < 0)
+  {
+    METRIC_INC(METRIC_ENCODE_FAILURES);
+    return -1;
+  }
+
+  /* Longer than an AT+MQTTPUB line once all counters have grown */
+  if (esp8266_mqtt_publish_raw(MQTT_CLIENT_ID METRICS_TOPIC_SUFFIX, (const uint8_t *)payload,
+                               (uint32_t)length, 0, 0) != ESP8266_OK)
+  {
+    return -1;
+  }
+
+  return 1;
+}
+
+/* Private functions ---------------------------------------------------------*/
+#if !defined(HOST_BUILD)
+
+/**
+  * @brief  Fill the unused stack area with a known pattern.
+  * @retval None.
+  */
+static void metrics_paint_stack(void)
+{
+  uint32_t* p = (uint32_t *)(((uint32_t)_sbrk(0) + 3U) & ~3U);
+  uint32_t* sp = (uint32_t *)(__get_MSP() - STACK_PAINT_MARGIN);
+
+  stack_paint_start = p;
+  while (p < sp)
+  {
+    *p++ = STACK_PAINT_PATTERN;
+  }
+}
+
+/**
+  * @brief  Measure the deepest stack usage seen since metrics_init().
+  * @retval Stack usage in bytes.
+  */
+static uint32_t metrics_stack_used(void)
+{
+  extern uint8_t _estack;
+  uint32_t* p = stack_paint_start;
+  uint32_t* heap_end = (uint32_t *)(((uint32_t)_sbrk(0) + 3U) & ~3U);
+
+  /* The heap may have grown over the painted area since the last check */
+  if (p < heap_end)
+  {
+    p = heap_end;
+  }
+
+  while ((p < (uint32_t *)&_estack) && (*p == STACK_PAINT_PATTERN))
+  {
+    p++;
+  }
+
+  return (uint32_t)&_estack - (uint32_t)p;
+}
+
+/**
+  * @brief  Measure the newlib heap usage; _sbrk() never shrinks so this is
+  *         also the high-water mark.
+  * @retval Heap usage in bytes.
+  */
+static uint32_t metrics_heap_used(void)
+{
+  extern uint8_t _end;
+
+  return (uint32_t)_sbrk(0) - (uint32_t)&_end;
+}
+
+#else /* HOST_BUILD: no linker symbols for the heap and the stack */
+
+static void metrics_paint_stack(void)
+{
+  stack_paint_start = NULL;
+}
+
+static uint32_t metrics_stack_used(void)
+{
+  return 0;
+}
+
+static uint32_t metrics_heap_used(void)
+{
+  return 0;
+}
+
+#endif /* HOST_BUILD */
+
+/**
+  * @brief  Estimate a percentile from a log2 histogram.
+  * @param  hist: the histogram.
+  * @param  per_mille: the percentile, in 1/1000 (500 = p50).
+  * @retval Upper bound of the bucket holding the percentile, 0 if empty.
+  */
+static uint32_t metrics_percentile(const metric_histogram_t* hist, uint32_t per_mille)
+{
+  uint32_t total = 0;
+  uint32_t acc = 0;
+  uint32_t target;
+
+  for (uint32_t i = 0; i < METRICS_HIST_BUCKETS; i++)
+  {
+    total += hist->bucket[i];
+  }
+
+  if (total == 0)
+  {
+    return 0;
+  }
+
+  target = (total * per_mille + 999U) / 1000U;
+
+  for (uint32_t i = 0; i < METRICS_HIST_BUCKETS; i++)
+  {
+    acc += hist->bucket[i];
+    if (acc >= target)
+    {
+      return (i == 0) ? 0 : ((1U << i) - 1U);
+    }
+  }
+
+  return (1U << (METRICS_HIST_BUCKETS - 1)) - 1U;
+}
@@ -0,0 +1,502 @@
+/*
+ * metrics_http.c
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "metrics_http.h"
+#include "metrics.h"
+#include "esp8266.h"
+#include "at_builder.h"
+#include "main.h"
+#include <string.h>
+
+/* Private define ------------------------------------------------------------*/
+#define REQUEST_PREFIX          "GET /metrics"
+#define REQUEST_PREFIX_SIZE     (sizeof(REQUEST_PREFIX) - 1U)
+#define REQUEST_METRICS         0xFEU   /* position: the prefix and a ' ' or '?' matched */
+#define REQUEST_OTHER           0xFFU
+#define HEADERS_END             0x0D0A0D0AU     /* "\r\n\r\n" as the last four bytes */
+#define CHUNK_HEADER_SIZE       5U              /* "<up to 3 hex digits>\r\n" */
+#define LAST_CHUNK              "\r\n0\r\n\r\n"
+
+#define NAME_ENTRY(id, ...)     [id] = #id,
+#define SCALAR_PREFIX_SIZE      (sizeof("METRIC_") - 1U)
+#define HIST_PREFIX_SIZE        (sizeof("METRIC_HIST_") - 1U)
+#define AT_FAMILY_COUNT         (sizeof(at_families) / sizeof(at_families[0]))
+
+#define RESPONSE_OK             "HTTP/1.1 200 OK\r\n" \
+                                "Content-Type: text/plain; version=0.0.4\r\n" \
+                                "Transfer-Encoding: chunked\r\n" \
+                                "Connection: close\r\n\r\n"
+#define RESPONSE_NOT_FOUND      "HTTP/1.1 404 Not Found\r\n" \
+                                "Content-Length: 0\r\n" \
+                                "Connection: close\r\n\r\n"
+
+/* Private typedef -----------------------------------------------------------*/
+/* The request of one link, read as it comes */
+typedef struct {
+    uint8_t                      position;         /* in REQUEST_PREFIX, then REQUEST_METRICS or _OTHER */
+    uint8_t                      pending;          /* headers complete, not answered yet */
+    uint32_t                     tail;             /* last four bytes */
+    uint32_t                     pending_tick;
+} request_t;
+
+typedef enum {
+    PHASE_IDLE                   = 0,
+    PHASE_HEADER                 = 1,
+    PHASE_BODY                   = 2,
+    PHASE_CLOSE                  = 3,
+} phase_t;
+
+/* The scrape being answered */
+typedef struct {
+    phase_t                      phase;
+    uint8_t                      link;
+    uint8_t                      found;            /* GET /metrics, not a 404 */
+    uint32_t                     item;             /* next item of the body */
+} scrape_t;
+
+/* Per-verb families from esp8266_deadline_table() */
+typedef struct {
+    const char*                  name;
+    const char*                  type;
+} at_family_t;
+
+/* Private variables ---------------------------------------------------------*/
+static const char* const scalar_names[METRIC_SCALAR_COUNT] = {
+    METRICS_SCALAR_TABLE(NAME_ENTRY)
+};
+
+static const char* const hist_names[METRIC_HISTOGRAM_COUNT] = {
+    METRICS_HISTOGRAM_TABLE(NAME_ENTRY)
+};
+
+static const at_family_t at_families[] = {
+    { "esp_at_rtt_ms",           "gauge"   },      /* smoothed round trip */
+    { "esp_at_commands_total",   "counter" },
+    { "esp_at_failures_total",   "counter" },
+};
+
+static request_t requests[ESP8266_MAX_LINKS];
+static scrape_t scrape;
+static metrics_snapshot_t snapshot;
+static char chunk[CHUNK_HEADER_SIZE + METRICS_HTTP_CHUNK_SIZE + sizeof(LAST_CHUNK)];
+static metrics_http_stats_t stats;
+
+/* Private function prototypes -----------------------------------------------*/
+static int8_t serve(void);
+static int8_t send_text(const char* text, uint32_t length);
+static int8_t render_body(uint32_t* start, uint32_t* length, uint8_t* done);
+static uint8_t render_item(at_builder_t* b, uint32_t item);
+static void render_name(at_builder_t* b, const char* id, uint32_t skip, const char* suffix);
+static void render_type(at_builder_t* b, const char* id, uint32_t skip, const char* suffix, const char* type);
+static void abort_scrape(void);
+static void end_scrape(void);
+
+/* Exported functions -------------------------------------------------------*/
+
+/**
+  * @brief  Forget the requests and the scrape in progress.
+  * @retval None.
+  */
+void metrics_http_init(void)
+{
+  memset(requests, 0, sizeof(requests));
+  memset(&scrape, 0, sizeof(scrape));
+}
+
+/**
+  * @brief  Read a piece of the request of a client, as it comes.
+  * @param  link: the link of the client.
+  * @param  data: the piece, any size.
+  * @param  length: its size.
+  * @retval 1 when its request is complete and waits for metrics_http_step(),
+  *         0 otherwise.
+  */
+uint8_t metrics_http_receive(uint8_t link, const uint8_t* data, uint32_t length)
+{
+  request_t* r;
+
+  if (link >= ESP8266_MAX_LINKS)
+  {
+    return 0;
+  }
+  r = &requests[link];
+
+  /* What follows the headers (a body, a second request) is ignored */
+  for (uint32_t i = 0; (i < length) && (r->pending == 0); i++)
+  {
+    uint8_t c = data[i];
+
+    if (r->position < REQUEST_PREFIX_SIZE)
+    {
+      r->position = (c == (uint8_t)REQUEST_PREFIX[r->position]) ? (uint8_t)(r->position + 1U) : REQUEST_OTHER;
+    }
+    else if (r->position == REQUEST_PREFIX_SIZE)
+    {
+      r->position = ((c == ' ') || (c == '?')) ? REQUEST_METRICS : REQUEST_OTHER;
+    }
+
+    r->tail = (r->tail << 8) | c;
+    if (r->tail == HEADERS_END)
+    {
+      r->pending = 1;
+      r->pending_tick = HAL_GetTick();
+    }
+  }
+
+  return r->pending;
+}
+
+/**
+  * @brief  Send the next part of the response in progress, or start the
+  *         next request: one command at most (one chunk, or the close).
+  * @retval 1 when more steps are needed, 0 when nothing is left to do,
+  *         -1 when a scrape was aborted.
+  */
+int8_t metrics_http_step(void)
+{
+  uint32_t start = DWT->CYCCNT;
+  uint32_t elapsed_us;
+  int8_t ret;
+
+  ret = serve();
+  if (ret == 0)
+  {
+    return 0;
+  }
+
+  elapsed_us = (DWT->CYCCNT - start) / (SystemCoreClock / 1000000U);
+  stats.steps++;
+  if (elapsed_us > stats.step_max_us)
+  {
+    stats.step_max_us = elapsed_us;
+  }
+
+  return ret;
+}
+
+/**
+  * @brief  Copy the counters of the responder.
+  * @param  stats_out: the copy.
+  * @retval None.
+  */
+void metrics_http_get_stats(metrics_http_stats_t* stats_out)
+{
+  *stats_out = stats;
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+static int8_t serve(void)
+{
+  uint32_t start;
+  uint32_t length;
+  uint8_t done;
+
+  if (scrape.phase == PHASE_IDLE)
+  {
+    /* The first complete request. Its client may be gone: its CLOSED line
+       may have come during a command, the first send tells. */
+    for (uint32_t i = 0; (i < ESP8266_MAX_LINKS) && (scrape.phase == PHASE_IDLE); i++)
+    {
+      if (requests[i].pending == 0)
+      {
+        continue;
+      }
+      scrape.phase = PHASE_HEADER;
+      scrape.link = (uint8_t)i;
+      scrape.found = (requests[i].position == REQUEST_METRICS) ? 1U : 0U;
+      scrape.item = 0;
+    }
+    if (scrape.phase == PHASE_IDLE)
+    {
+      return 0;
+    }
+  }
+
+  switch (scrape.phase)
+  {
+  case PHASE_HEADER:
+    if (scrape.found != 0)
+    {
+      /* The values of one instant, the histograms left as they are */
+      metrics_peek(&snapshot);
+      if (send_text(RESPONSE_OK, sizeof(RESPONSE_OK) - 1U) != 0)
+      {
+        return -1;
+      }
+      scrape.phase = PHASE_BODY;
+    }
+    else
+    {
+      if (send_text(RESPONSE_NOT_FOUND, sizeof(RESPONSE_NOT_FOUND) - 1U) != 0)
+      {
+        return -1;
+      }
+      scrape.phase = PHASE_CLOSE;
+    }
+    return 1;
+
+  case PHASE_BODY:
+    if (render_body(&start, &length, &done) != 0)
+    {
+      /* Closed without the last chunk: the client sees the body cut short */
+      abort_scrape();
+      return -1;
+    }
+    if (send_text(&chunk[start], length) != 0)
+    {
+      return -1;
+    }
+    if (done != 0)
+    {
+      scrape.phase = PHASE_CLOSE;
+    }
+    return 1;
+
+  case PHASE_CLOSE:
+  default:
+    esp8266_close_connection(scrape.link);
+    if (scrape.found != 0)
+    {
+      stats.scrapes++;
+    }
+    else
+    {
+      stats.not_found++;
+    }
+    if ((HAL_GetTick() - requests[scrape.link].pending_tick) > stats.scrape_max_ms)
+    {
+      stats.scrape_max_ms = HAL_GetTick() - requests[scrape.link].pending_tick;
+    }
+    end_scrape();
+    return 1;
+  }
+}
+
+/**
+  * @brief  Send to the client of the scrape, aborting it on failure.
+  * @retval 0 on success, -1 otherwise.
+  */
+static int8_t send_text(const char* text, uint32_t length)
+{
+  if (esp8266_server_send(scrape.link, (const uint8_t *)text, length) != ESP8266_OK)
+  {
+    abort_scrape();
+    return -1;
+  }
+  stats.bytes += length;
+  return 0;
+}
+
+/**
+  * @brief  Render the next whole items into one chunk, framed for the
+  *         chunked transfer encoding, the last chunk after the last item.
+  * @param  start: where the framed chunk starts in chunk.
+  * @param  length: the size of the framed chunk.
+  * @param  done: 1 once the body is complete.
+  * @retval 0 on success, -1 when the next item is larger than a chunk.
+  */
+static int8_t render_body(uint32_t* start, uint32_t* length, uint8_t* done)
+{
+  at_builder_t b;
+  at_builder_t header;
+  char size_digits[4];
+  uint32_t body;
+  uint32_t n = 0;
+
+  *done = 0;
+  at_builder_init(&b, &chunk[CHUNK_HEADER_SIZE], METRICS_HTTP_CHUNK_SIZE + 1U);
+  while (1)
+  {
+    uint32_t mark = b.length;
+
+    if (render_item(&b, scrape.item) == 0)
+    {
+      *done = 1;
+      break;
+    }
+    if (b.overflow != 0)
+    {
+      /* Whole items only: this one goes to the next chunk, unless it
+         is alone and still does not fit */
+      if (mark == 0)
+      {
+        return -1;
+      }
+      b.overflow = 0;
+      b.length = mark;
+      break;
+    }
+    scrape.item++;
+  }
+  body = b.length;
+
+  /* <size in hex>\r\n right before the body, \r\n after it */
+  for (uint32_t v = body; (v != 0) || (n == 0); v >>= 4)
+  {
+    size_digits[n++] = "0123456789abcdef"[v & 0xFU];
+  }
+  *start = CHUNK_HEADER_SIZE - n - 2U;
+  at_builder_init(&header, &chunk[*start], n + 3U);
+  while (n != 0)
+  {
+    at_builder_char(&header, size_digits[--n]);
+  }
+  at_builder_crlf(&header);
+
+  if ((*done != 0) && (body != 0))
+  {
+    memcpy(&chunk[CHUNK_HEADER_SIZE + body], LAST_CHUNK, sizeof(LAST_CHUNK) - 1U);
+    body += sizeof(LAST_CHUNK) - 1U;
+  }
+  else
+  {
+    /* Nothing left: the size 0 is the last chunk, "0\r\n\r\n" */
+    memcpy(&chunk[CHUNK_HEADER_SIZE + body], "\r\n", 2);
+    body += 2U;
+  }
+
+  *length = (CHUNK_HEADER_SIZE - *start) + body;
+  return 0;
+}
+
+/**
+  * @brief  Render one item of the body: the uptime, a scalar, a histogram,
+  *         the # TYPE line of a per-verb family or one of its samples.
+  * @retval 1 when item exists (it may render nothing), 0 past the last one.
+  */
+static uint8_t render_item(at_builder_t* b, uint32_t item)
+{
+  uint32_t count;
+  const esp8266_deadline_t* deadlines = esp8266_deadline_table(&count);
+
+  if (item == 0)
+  {
+    at_builder_lit(b, "# TYPE esp_uptime_seconds gauge\nesp_uptime_seconds ");
+    at_builder_uint(b, snapshot.uptime_ms / 1000U);
+    at_builder_char(b, '\n');
+    return 1;
+  }
+  item--;
+
+  if (item < METRIC_SCALAR_COUNT)
+  {
+    const char* suffix = (metric_desc[item].type == METRIC_COUNTER) ? "_total" : "";
+
+    render_type(b, scalar_names[item], SCALAR_PREFIX_SIZE, suffix,
+                (metric_desc[item].type == METRIC_COUNTER) ? "counter" : "gauge");
+    render_name(b, scalar_names[item], SCALAR_PREFIX_SIZE, suffix);
+    at_builder_char(b, ' ');
+    at_builder_uint(b, snapshot.value[item]);
+    at_builder_char(b, '\n');
+    return 1;
+  }
+  item -= METRIC_SCALAR_COUNT;
+
+  if (item < METRIC_HISTOGRAM_COUNT)
+  {
+    render_type(b, hist_names[item], HIST_PREFIX_SIZE, "", "summary");
+    render_name(b, hist_names[item], HIST_PREFIX_SIZE, "{quantile=\"0.5\"} ");
+    at_builder_uint(b, snapshot.p50[item]);
+    at_builder_char(b, '\n');
+    render_name(b, hist_names[item], HIST_PREFIX_SIZE, "{quantile=\"0.99\"} ");
+    at_builder_uint(b, snapshot.p99[item]);
+    at_builder_char(b, '\n');
+    render_name(b, hist_names[item], HIST_PREFIX_SIZE, "_sum ");
+    at_builder_uint(b, snapshot.sum[item]);
+    at_builder_char(b, '\n');
+    render_name(b, hist_names[item], HIST_PREFIX_SIZE, "_count ");
+    at_builder_uint(b, snapshot.count[item]);
+    at_builder_char(b, '\n');
+    return 1;
+  }
+  item -= METRIC_HISTOGRAM_COUNT;
+
+  /* A family is grouped: its # TYPE line, then one sample per verb used */
+  for (uint32_t f = 0; f < AT_FAMILY_COUNT; f++)
+  {
+    const esp8266_deadline_t* d;
+
+    if (item == 0)
+    {
+      at_builder_lit(b, "# TYPE ");
+      at_builder_str(b, at_families[f].name);
+      at_builder_char(b, ' ');
+      at_builder_str(b, at_families[f].type);
+      at_builder_char(b, '\n');
+      return 1;
+    }
+    item--;
+
+    if (item >= count)
+    {
+      item -= count;
+      continue;
+    }
+
+    d = &deadlines[item];
+    if ((d->samples != 0) || (d->failures != 0))
+    {
+      at_builder_str(b, at_families[f].name);
+      at_builder_lit(b, "{verb=\"");
+      at_builder_str(b, esp8266_deadline_label(d));
+      at_builder_lit(b, "\"} ");
+      at_builder_uint(b, (f == 0) ? (d->srtt_x8 / 8U) : (f == 1) ? d->samples : d->failures);
+      at_builder_char(b, '\n');
+    }
+    return 1;
+  }
+
+  /* The cost of the scrapes themselves */
+  if (item == 0)
+  {
+    at_builder_lit(b, "# TYPE esp_http_step_max_us gauge\nesp_http_step_max_us ");
+    at_builder_uint(b, stats.step_max_us);
+    at_builder_lit(b, "\n# TYPE esp_http_scrapes_total counter\nesp_http_scrapes_total ");
+    at_builder_uint(b, stats.scrapes);
+    at_builder_char(b, '\n');
+    return 1;
+  }
+
+  return 0;
+}
+
+/**
+  * @brief  esp_<id in lower case, without its prefix><suffix>.
+  */
+static void render_name(at_builder_t* b, const char* id, uint32_t skip, const char* suffix)
+{
+  at_builder_lit(b, "esp_");
+  for (const char* p = &id[skip]; *p != '\0'; p++)
+  {
+    at_builder_char(b, ((*p >= 'A') && (*p <= 'Z')) ? (char)(*p - 'A' + 'a') : *p);
+  }
+  at_builder_str(b, suffix);
+}
+
+static void render_type(at_builder_t* b, const char* id, uint32_t skip, const char* suffix, const char* type)
+{
+  at_builder_lit(b, "# TYPE ");
+  render_name(b, id, skip, suffix);
+  at_builder_char(b, ' ');
+  at_builder_str(b, type);
+  at_builder_char(b, '\n');
+}
+
+static void abort_scrape(void)
+{
+  esp8266_close_connection(scrape.link);
+  stats.aborted++;
+  end_scrape();
+}
+
+static void end_scrape(void)
+{
+  memset(&requests[scrape.link], 0, sizeof(requests[scrape.link]));
+  memset(&scrape, 0, sizeof(scrape));
+}
@@ -0,0 +1,379 @@
+/*
+ * power.c
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "power.h"
+#include "metrics.h"
+#include "main.h"
+#include <string.h>
+
+/* Private define ------------------------------------------------------------*/
+#define RTC_PREDIV_A            31      /* LSI / 32: ~1 kHz sub-second counter */
+#define RTC_PREDIV_S            999
+#define RTC_WUT_DIV             16      /* wakeup timer clock: RTCCLK / 16 */
+#define RTC_WUT_MAX_TICKS       0xFFFFU
+#define RTC_DAY_TICKS           (86400UL * (RTC_PREDIV_S + 1))
+#define LSI_CALIBRATION_MS      100
+
+/* Private variables ---------------------------------------------------------*/
+static power_stats_t stats;
+static uint64_t run_cycles;
+static uint64_t sleep_cycles;
+static uint32_t last_cycles;
+static uint8_t stop_allowed;
+
+/* Report window */
+static uint32_t window_start_tick;
+static uint64_t window_run_us;
+static uint64_t window_sleep_us;
+static uint64_t window_stop_us;
+static uint32_t window_publishes;
+
+#if (POWER_STOP_ENABLE == 1) && !defined(HOST_BUILD)
+static uint32_t rtc_apre_hz;            /* measured sub-second counter rate */
+#endif
+
+/* Private function prototypes -----------------------------------------------*/
+static void power_account_run(void);
+static uint32_t power_cycles_per_us(void);
+#if (POWER_STOP_ENABLE == 1) && !defined(HOST_BUILD)
+static void power_rtc_init(void);
+static uint32_t power_rtc_ticks(void);
+static void power_stop(uint32_t sleep_ms);
+#endif
+
+/* Exported functions -------------------------------------------------------*/
+
+/**
+  * @brief  Reset the accounting; with POWER_STOP_ENABLE, start the RTC (LSI)
+  *         used to wake up from Stop mode and measure the time spent in it.
+  * @retval None.
+  */
+void power_init(void)
+{
+  memset(&stats, 0, sizeof(stats));
+  run_cycles = 0;
+  sleep_cycles = 0;
+  stop_allowed = 0;
+  last_cycles = DWT->CYCCNT;
+
+  window_start_tick = HAL_GetTick();
+  window_run_us = 0;
+  window_sleep_us = 0;
+  window_stop_us = 0;
+  window_publishes = metric_values[METRIC_PUBLISHES];
+
+#if (POWER_STOP_ENABLE == 1) && !defined(HOST_BUILD)
+  power_rtc_init();
+#endif
+}
+
+/**
+  * @brief  Sleep until the next interrupt, or until budget_ms has elapsed.
+  * @details Stop mode is used when it is enabled, allowed by the application
+  *          and the budget is at least POWER_STOP_MIN_MS; otherwise WFI, woken
+  *          by any interrupt (UART IDLE / DMA, SysTick within 1 ms).
+  * @param  budget_ms: time until the next deadline, 0 when a response is
+  *         expected (WFI only).
+  * @retval None.
+  */
+void power_idle(uint32_t budget_ms)
+{
+  uint32_t start;
+
+  power_account_run();
+
+#if (POWER_STOP_ENABLE == 1) && !defined(HOST_BUILD)
+  if ((stop_allowed != 0) && (budget_ms >= POWER_STOP_MIN_MS))
+  {
+    power_stop(budget_ms - POWER_STOP_MARGIN_MS);
+    last_cycles = DWT->CYCCNT;
+    return;
+  }
+#else
+  (void)budget_ms;
+#endif
+
+  start = DWT->CYCCNT;
+  __WFI();
+  last_cycles = DWT->CYCCNT;
+  sleep_cycles += (uint32_t)(last_cycles - start);
+}
+
+/**
+  * @brief  Allow Stop mode while idle.
+  * @details Leaving Stop mode takes up to a few hundred microseconds for the
+  *          clock to restart, so the byte waking the MCU up and the next ones,
+  *          2 or 3 at 115200 bd, are lost or garbled. The URC reader still
+  *          recognizes a header that lost up to ESP8266_URC_RESYNC_BYTES;
+  *          only allow it when a command answer may be lost as well.
+  * @param  allowed: 1 to allow, 0 to use WFI only.
+  * @retval None.
+  */
+void power_set_stop_allowed(uint8_t allowed)
+{
+  stop_allowed = allowed;
+}
+
+/**
+  * @brief  Update the duty cycle and energy per publish metrics once per
+  *         POWER_REPORT_PERIOD_MS. Main loop context.
+  * @retval None.
+  */
+void power_update_metrics(void)
+{
+  uint32_t now = HAL_GetTick();
+  uint32_t cycles_per_us = power_cycles_per_us();
+  uint64_t run_us;
+  uint64_t sleep_us;
+  uint64_t stop_us;
+  uint64_t total_us;
+  uint64_t energy_uj;
+  uint32_t publishes;
+
+  if ((now - window_start_tick) < POWER_REPORT_PERIOD_MS)
+  {
+    return;
+  }
+  window_start_tick = now;
+
+  power_account_run();
+  stats.run_us = run_cycles / cycles_per_us;
+  stats.sleep_us = sleep_cycles / cycles_per_us;
+
+  run_us = stats.run_us - window_run_us;
+  sleep_us = stats.sleep_us - window_sleep_us;
+  stop_us = stats.stop_us - window_stop_us;
+  total_us = run_us + sleep_us + stop_us;
+  window_run_us = stats.run_us;
+  window_sleep_us = stats.sleep_us;
+  window_stop_us = stats.stop_us;
+
+  /* us * uA * mV = 1e-15 J */
+  energy_uj = (run_us * POWER_RUN_UA + sleep_us * POWER_SLEEP_UA + stop_us * POWER_STOP_UA) *
+              POWER_SUPPLY_MV / 1000000000ULL;
+  stats.energy_uj += energy_uj;
+
+  publishes = metric_values[METRIC_PUBLISHES] - window_publishes;
+  window_publishes = metric_values[METRIC_PUBLISHES];
+
+  stats.duty_pct = (total_us != 0) ? (uint32_t)((run_us * 100U) / total_us) : 0;
+  stats.energy_per_publish_uj = (publishes != 0) ? (uint32_t)(energy_uj / publishes) : 0;
+
+  METRIC_SET(METRIC_DUTY_PCT, stats.duty_pct);
+  METRIC_SET(METRIC_ENERGY_PER_PUB, stats.energy_per_publish_uj);
+}
+
+/**
+  * @brief  Copy the power statistics.
+  * @param  s: destination.
+  * @retval None.
+  */
+void power_get_stats(power_stats_t* s)
+{
+  uint32_t cycles_per_us = power_cycles_per_us();
+
+  power_account_run();
+  stats.run_us = run_cycles / cycles_per_us;
+  stats.sleep_us = sleep_cycles / cycles_per_us;
+  *s = stats;
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Everything since the last sleep was run time. Called at least
+  *         once per DWT wrap (~23 s at 180 MHz): every idle period does.
+  */
+static void power_account_run(void)
+{
+  uint32_t now = DWT->CYCCNT;
+
+  run_cycles += (uint32_t)(now - last_cycles);
+  last_cycles = now;
+}
+
+static uint32_t power_cycles_per_us(void)
+{
+  uint32_t cycles_per_us = SystemCoreClock / 1000000U;
+
+  return (cycles_per_us != 0) ? cycles_per_us : 1;
+}
+
+#if (POWER_STOP_ENABLE == 1) && !defined(HOST_BUILD)
+
+/**
+  * @brief  RTC on LSI: ~1 kHz sub-second counter and the wakeup timer, both
+  *         routed to EXTI events (no interrupt handler needed). The LSI is
+  *         only accurate to tens of percent: its rate is measured against
+  *         SysTick. The UART4 RX pin (PA1) also wakes up on a falling edge.
+  */
+static void power_rtc_init(void)
+{
+  uint32_t start_ticks;
+  uint32_t start_ms;
+
+  RCC->CSR |= RCC_CSR_LSION;
+  while ((RCC->CSR & RCC_CSR_LSIRDY) == 0)
+  {
+  }
+
+  HAL_PWR_EnableBkUpAccess();
+  if ((RCC->BDCR & RCC_BDCR_RTCSEL) != RCC_BDCR_RTCSEL_1)
+  {
+    RCC->BDCR |= RCC_BDCR_BDRST;
+    RCC->BDCR &= ~RCC_BDCR_BDRST;
+    RCC->BDCR |= RCC_BDCR_RTCSEL_1;
+  }
+  RCC->BDCR |= RCC_BDCR_RTCEN;
+
+  RTC->WPR = 0xCA;
+  RTC->WPR = 0x53;
+  RTC->ISR |= RTC_ISR_INIT;
+  while ((RTC->ISR & RTC_ISR_INITF) == 0)
+  {
+  }
+  RTC->PRER = RTC_PREDIV_S;
+  RTC->PRER |= (RTC_PREDIV_A << RTC_PRER_PREDIV_A_Pos);
+  RTC->TR = 0;
+  RTC->ISR &= ~RTC_ISR_INIT;
+  RTC->WPR = 0xFF;
+
+  /* EXTI 22: RTC wakeup, EXTI 1: PA1 (UART4 RX start bit) */
+  EXTI->RTSR |= EXTI_RTSR_TR22;
+  EXTI->FTSR |= EXTI_FTSR_TR1;
+  SYSCFG->EXTICR[0] &= ~SYSCFG_EXTICR1_EXTI1;
+
+  /* Any pending interrupt, even masked, ends a WFE */
+  SCB->SCR |= SCB_SCR_SEVONPEND_Msk;
+
+  start_ms = HAL_GetTick();
+  start_ticks = power_rtc_ticks();
+  while ((HAL_GetTick() - start_ms) < LSI_CALIBRATION_MS)
+  {
+  }
+  rtc_apre_hz = ((power_rtc_ticks() - start_ticks + RTC_DAY_TICKS) % RTC_DAY_TICKS) * (1000U / LSI_CALIBRATION_MS);
+  if (rtc_apre_hz == 0)
+  {
+    rtc_apre_hz = 1000;
+  }
+}
+
+/**
+  * @brief  Time of day in sub-second counter ticks.
+  */
+static uint32_t power_rtc_ticks(void)
+{
+  uint32_t ssr = RTC->SSR;
+  uint32_t tr = RTC->TR;
+  uint32_t seconds;
+
+  (void)RTC->DR;        /* unlock the shadow registers */
+
+  seconds = (((tr & RTC_TR_HT) >> RTC_TR_HT_Pos) * 10U + ((tr & RTC_TR_HU) >> RTC_TR_HU_Pos)) * 3600U +
+            (((tr & RTC_TR_MNT) >> RTC_TR_MNT_Pos) * 10U + ((tr & RTC_TR_MNU) >> RTC_TR_MNU_Pos)) * 60U +
+            (((tr & RTC_TR_ST) >> RTC_TR_ST_Pos) * 10U + ((tr & RTC_TR_SU) >> RTC_TR_SU_Pos));
+
+  return seconds * (RTC_PREDIV_S + 1) + (RTC_PREDIV_S - ssr);
+}
+
+/**
+  * @brief  Stop mode until the wakeup timer or a UART start bit, then restore
+  *         the clocks and move the HAL tick forward by the time spent.
+  */
+static void power_stop(uint32_t sleep_ms)
+{
+  uint32_t wut_ticks = (uint32_t)(((uint64_t)sleep_ms * rtc_apre_hz * (RTC_PREDIV_A + 1)) / (RTC_WUT_DIV * 1000U));
+  RCC_OscInitTypeDef osc;
+  RCC_ClkInitTypeDef clk;
+  uint32_t flash_latency;
+  uint32_t overdrive;
+  uint32_t start_ticks;
+  uint32_t elapsed_ms;
+  uint32_t wake_cycles;
+  uint32_t hsi_cycles;
+  uint32_t pll_cycles;
+  uint32_t wake_us;
+
+  if (wut_ticks > RTC_WUT_MAX_TICKS)
+  {
+    wut_ticks = RTC_WUT_MAX_TICKS;
+  }
+  if (wut_ticks == 0)
+  {
+    return;
+  }
+
+  /* Wakeup timer: RTCCLK / 16, event on EXTI 22 */
+  RTC->WPR = 0xCA;
+  RTC->WPR = 0x53;
+  RTC->CR &= ~RTC_CR_WUTE;
+  while ((RTC->ISR & RTC_ISR_WUTWF) == 0)
+  {
+  }
+  RTC->WUTR = wut_ticks - 1U;
+  RTC->CR &= ~RTC_CR_WUCKSEL;
+  RTC->ISR &= ~RTC_ISR_WUTF;
+  RTC->CR |= RTC_CR_WUTIE | RTC_CR_WUTE;
+  RTC->WPR = 0xFF;
+  EXTI->PR = EXTI_PR_PR22 | EXTI_PR_PR1;
+  EXTI->EMR |= EXTI_EMR_MR22 | EXTI_EMR_MR1;
+
+  /* The clocks as they are, restored as they were: only the PLL (and the
+     HSE if it feeds it) and the over-drive are off after Stop mode */
+  HAL_RCC_GetOscConfig(&osc);
+  HAL_RCC_GetClockConfig(&clk, &flash_latency);
+  osc.OscillatorType = (osc.PLL.PLLSource == RCC_PLLSOURCE_HSE) ? RCC_OSCILLATORTYPE_HSE : RCC_OSCILLATORTYPE_NONE;
+  overdrive = PWR->CR & PWR_CR_ODEN;
+
+  start_ticks = power_rtc_ticks();
+  stats.stop_entries++;
+
+  HAL_SuspendTick();
+  HAL_PWR_EnterSTOPMode(PWR_LOWPOWERREGULATOR_ON, PWR_STOPENTRY_WFE);
+
+  /* On HSI (16 MHz) until the PLL locks and the over-drive is back, then on
+     the PLL from the switch: each part counted at its own clock */
+  wake_cycles = DWT->CYCCNT;
+  if ((HAL_RCC_OscConfig(&osc) != HAL_OK) ||
+      ((overdrive != 0) && (HAL_PWREx_EnableOverDrive() != HAL_OK)))
+  {
+    Error_Handler();
+  }
+  hsi_cycles = DWT->CYCCNT - wake_cycles;
+  if (HAL_RCC_ClockConfig(&clk, flash_latency) != HAL_OK)
+  {
+    Error_Handler();
+  }
+  pll_cycles = DWT->CYCCNT - wake_cycles - hsi_cycles;
+  wake_us = (hsi_cycles / (HSI_VALUE / 1000000U)) + (pll_cycles / power_cycles_per_us());
+  HAL_ResumeTick();
+
+  EXTI->EMR &= ~(EXTI_EMR_MR22 | EXTI_EMR_MR1);
+  RTC->WPR = 0xCA;
+  RTC->WPR = 0x53;
+  RTC->CR &= ~(RTC_CR_WUTE | RTC_CR_WUTIE);
+  RTC->ISR &= ~(RTC_ISR_WUTF | RTC_ISR_RSF);
+  RTC->WPR = 0xFF;
+  EXTI->PR = EXTI_PR_PR22 | EXTI_PR_PR1;
+
+  /* The calendar shadow registers are stale until the next synchronisation */
+  while ((RTC->ISR & RTC_ISR_RSF) == 0)
+  {
+  }
+  elapsed_ms = (uint32_t)((((uint64_t)((power_rtc_ticks() - start_ticks + RTC_DAY_TICKS) % RTC_DAY_TICKS)) * 1000U) / rtc_apre_hz);
+
+  uwTick += elapsed_ms;
+  stats.stop_us += (uint64_t)elapsed_ms * 1000U;
+  if (wake_us > stats.stop_wake_max_us)
+  {
+    stats.stop_wake_max_us = wake_us;
+  }
+  metrics_idle_add_ms(elapsed_ms);
+}
+
+#endif /* POWER_STOP_ENABLE && !HOST_BUILD */
@@ -0,0 +1,349 @@
+/*
+ * sched.c
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "sched.h"
+#include "metrics.h"
+#include "power.h"
+#include "main.h"
+#include <stddef.h>
+#include <string.h>
+
+/* Private typedef -----------------------------------------------------------*/
+typedef struct {
+  sched_task_fn_t         fn;
+  volatile sched_events_t events;       /* posted, not dispatched yet */
+  volatile uint32_t       posted_at;    /* DWT cycles of the first pending post */
+} sched_task_t;
+
+/* Private variables ---------------------------------------------------------*/
+static sched_task_t tasks[SCHED_MAX_TASKS];
+static uint8_t task_count;
+static volatile uint32_t ready_mask;    /* bit n: task n has events */
+
+static sched_timer_t* timer_head;       /* sorted by deadline */
+static sched_work_t* volatile work_head;  /* LIFO pushed from any context */
+
+static sched_stats_t stats;
+
+/* Private function prototypes -----------------------------------------------*/
+static uint8_t sched_run_timers(void);
+static uint8_t sched_run_work(void);
+static uint8_t sched_run_tasks(void);
+static void sched_timer_insert(sched_timer_t* timer);
+static void sched_idle(void);
+
+/* Exported functions -------------------------------------------------------*/
+
+/**
+  * @brief  Reset the scheduler: no task, no timer, no pending work.
+  * @retval None.
+  */
+void sched_init(void)
+{
+  memset(tasks, 0, sizeof(tasks));
+  memset(&stats, 0, sizeof(stats));
+  task_count = 0;
+  ready_mask = 0;
+  timer_head = NULL;
+  work_head = NULL;
+}
+
+/**
+  * @brief  Register a task. Tasks created first are dispatched first.
+  * @param  fn: the task handler, called with the pending events.
+  * @param  id: receives the task identifier used with sched_post().
+  * @retval 0 on success, -1 if the task table is full.
+  */
+int8_t sched_task_create(sched_task_fn_t fn, sched_task_id_t* id)
+{
+  if ((fn == NULL) || (task_count == SCHED_MAX_TASKS))
+  {
+    return -1;
+  }
+
+  tasks[task_count].fn = fn;
+  tasks[task_count].events = 0;
+  *id = task_count++;
+  return 0;
+}
+
+/**
+  * @brief  Post events to a task. Safe from any ISR.
+  * @param  task: the task identifier.
+  * @param  events: event bits, merged with the ones already pending.
+  * @retval None.
+  */
+void sched_post(sched_task_id_t task, sched_events_t events)
+{
+  sched_task_t* t;
+
+  if ((task >= task_count) || (events == 0))
+  {
+    return;
+  }
+  t = &tasks[task];
+
+  /* The first post since the last dispatch starts the latency measurement */
+  if (__atomic_fetch_or(&t->events, events, __ATOMIC_RELAXED) == 0)
+  {
+    t->posted_at = DWT->CYCCNT;
+  }
+  __atomic_fetch_or(&ready_mask, 1UL << task, __ATOMIC_RELEASE);
+}
+
+/**
+  * @brief  Start (or restart) a software timer. Main loop context only.
+  * @param  timer: caller-owned timer.
+  * @param  fn: callback run in the main loop on expiry.
+  * @param  arg: callback argument.
+  * @param  delay_ms: delay before the first expiry.
+  * @param  period_ms: reload period, 0 for a one shot timer.
+  * @retval None.
+  */
+void sched_timer_start(sched_timer_t* timer, sched_work_fn_t fn, void* arg, uint32_t delay_ms, uint32_t period_ms)
+{
+  sched_timer_stop(timer);
+
+  timer->fn = fn;
+  timer->arg = arg;
+  timer->deadline = HAL_GetTick() + delay_ms;
+  timer->period = period_ms;
+  sched_timer_insert(timer);
+}
+
+/**
+  * @brief  Stop a software timer. Stopping an inactive timer is a no-op.
+  * @param  timer: the timer.
+  * @retval None.
+  */
+void sched_timer_stop(sched_timer_t* timer)
+{
+  sched_timer_t** p = &timer_head;
+
+  if (timer->active == 0)
+  {
+    return;
+  }
+
+  while (*p != NULL)
+  {
+    if (*p == timer)
+    {
+      *p = timer->next;
+      break;
+    }
+    p = &(*p)->next;
+  }
+  timer->active = 0;
+}
+
+/**
+  * @brief  Queue a work item to run once in the main loop. Safe from any ISR.
+  * @param  work: caller-owned work item.
+  * @param  fn: function to run.
+  * @param  arg: its argument.
+  * @retval None.
+  */
+void sched_defer(sched_work_t* work, sched_work_fn_t fn, void* arg)
+{
+  sched_work_t* head;
+
+  if (__atomic_exchange_n(&work->queued, 1, __ATOMIC_ACQUIRE) != 0)
+  {
+    return;
+  }
+
+  work->fn = fn;
+  work->arg = arg;
+
+  head = work_head;
+  do
+  {
+    work->next = head;
+  }
+  while (!__atomic_compare_exchange_n(&work_head, &head, work, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+/**
+  * @brief  One pass of the event loop: expired timers, deferred work, then
+  *         every task with pending events, in priority order. When there was
+  *         nothing to do, sleep until the next interrupt.
+  * @retval None.
+  */
+void sched_run_once(void)
+{
+  uint8_t ran = 0;
+
+  ran |= sched_run_timers();
+  ran |= sched_run_work();
+  ran |= sched_run_tasks();
+
+  if (ran == 0)
+  {
+    sched_idle();
+  }
+}
+
+/**
+  * @brief  Copy the scheduler statistics.
+  * @param  s: destination.
+  * @retval None.
+  */
+void sched_get_stats(sched_stats_t* s)
+{
+  *s = stats;
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Keep the timer list sorted by deadline (wrap-safe comparison).
+  */
+static void sched_timer_insert(sched_timer_t* timer)
+{
+  sched_timer_t** p = &timer_head;
+
+  while ((*p != NULL) && ((int32_t)((*p)->deadline - timer->deadline) <= 0))
+  {
+    p = &(*p)->next;
+  }
+  timer->next = *p;
+  *p = timer;
+  timer->active = 1;
+}
+
+static uint8_t sched_run_timers(void)
+{
+  uint32_t now = HAL_GetTick();
+  uint8_t ran = 0;
+
+  while ((timer_head != NULL) && ((int32_t)(now - timer_head->deadline) >= 0))
+  {
+    sched_timer_t* timer = timer_head;
+
+    timer_head = timer->next;
+    timer->active = 0;
+
+    /* Reload before the callback so that it can stop or restart the timer.
+       A late periodic timer skips the periods it missed instead of bursting. */
+    if (timer->period != 0)
+    {
+      timer->deadline += timer->period;
+      if ((int32_t)(now - timer->deadline) >= 0)
+      {
+        timer->deadline = now + timer->period;
+      }
+      sched_timer_insert(timer);
+    }
+
+    stats.timers_fired++;
+    timer->fn(timer->arg);
+    ran = 1;
+  }
+
+  return ran;
+}
+
+static uint8_t sched_run_work(void)
+{
+  sched_work_t* list = __atomic_exchange_n(&work_head, NULL, __ATOMIC_ACQUIRE);
+  sched_work_t* fifo = NULL;
+
+  if (list == NULL)
+  {
+    return 0;
+  }
+
+  /* Pushed LIFO, run in queueing order */
+  while (list != NULL)
+  {
+    sched_work_t* next = list->next;
+
+    list->next = fifo;
+    fifo = list;
+    list = next;
+  }
+
+  while (fifo != NULL)
+  {
+    sched_work_t* work = fifo;
+
+    fifo = work->next;
+    __atomic_store_n(&work->queued, 0, __ATOMIC_RELEASE);
+    work->fn(work->arg);
+    stats.work_done++;
+  }
+
+  return 1;
+}
+
+static uint8_t sched_run_tasks(void)
+{
+  uint32_t ready = __atomic_load_n(&ready_mask, __ATOMIC_ACQUIRE);
+  uint32_t cycles_per_us = SystemCoreClock / 1000000U;
+  uint8_t ran = 0;
+
+  while (ready != 0)
+  {
+    uint32_t id = (uint32_t)__builtin_ctz(ready);
+    sched_task_t* t = &tasks[id];
+    sched_events_t events;
+    uint32_t latency_us;
+
+    ready &= ~(1UL << id);
+    __atomic_fetch_and(&ready_mask, ~(1UL << id), __ATOMIC_ACQUIRE);
+    events = __atomic_exchange_n(&t->events, 0, __ATOMIC_ACQUIRE);
+    if (events == 0)
+    {
+      continue;
+    }
+
+    latency_us = (uint32_t)(DWT->CYCCNT - t->posted_at) / cycles_per_us;
+    if (latency_us > stats.max_latency_us)
+    {
+      stats.max_latency_us = latency_us;
+    }
+    metrics_observe(METRIC_HIST_DISPATCH_LATENCY, latency_us);
+    METRIC_INC(METRIC_SCHED_DISPATCHES);
+
+    stats.dispatches++;
+    t->fn(events);
+    ran = 1;
+  }
+
+  return ran;
+}
+
+/**
+  * @brief  Sleep until the next interrupt if nothing became ready meanwhile.
+  * @details Interrupts are masked around the last check so that an event
+  *          posted just before sleeping is not missed: a pending interrupt
+  *          still wakes the core and its handler runs once they are unmasked.
+  *          In WFI the SysTick interrupt bounds the sleep to 1 ms; Stop mode
+  *          (power.c) is given the time left until the next timer.
+  */
+static void sched_idle(void)
+{
+  uint32_t budget_ms = UINT32_MAX;
+
+  __disable_irq();
+  if (timer_head != NULL)
+  {
+    int32_t left = (int32_t)(timer_head->deadline - HAL_GetTick());
+
+    budget_ms = (left > 0) ? (uint32_t)left : 0;
+  }
+
+  if ((ready_mask == 0) && (work_head == NULL) && (budget_ms != 0))
+  {
+    metrics_idle_enter();
+    power_idle(budget_ms);
+    metrics_idle_exit();
+  }
+  __enable_irq();
+}
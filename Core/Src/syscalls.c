@@ -29,6 +29,7 @@
 #include <time.h>
 #include <sys/time.h>
 #include <sys/times.h>
+#include "log_ring.h"
 
 
 //Debug Exception and Monitor Control Register base address
@@ -102,13 +103,10 @@ __attribute__((weak)) int _read(int file, char *ptr, int len)
 __attribute__((weak)) int _write(int file, char *ptr, int len)
 {
   (void)file;
-  int DataIdx;
 
-  for (DataIdx = 0; DataIdx < len; DataIdx++)
-  {
-    //__io_putchar(*ptr++);
-    ITM_SendChar(*ptr++);
-  }
+  /* Never wait on the SWO here: the bytes go to the log ring and are drained
+     to ITM or USART2 from the idle loop. Bytes that do not fit are dropped. */
+  log_ring_write(ptr, len);
   return len;
 }
 
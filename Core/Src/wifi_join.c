@@ -0,0 +1,190 @@
+/*
+ * wifi_join.c
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "wifi_join.h"
+#include "main.h"
+#include <string.h>
+
+/* Private typedef -----------------------------------------------------------*/
+/* The APs of a scan worth trying, strongest first */
+typedef struct {
+    wifi_join_ap_t               ap[WIFI_JOIN_MAX_CANDIDATES];
+    uint32_t                     count;
+    uint32_t                     seen;             /* bit n: network n is in range */
+} candidates_t;
+
+/* Private variables ---------------------------------------------------------*/
+static const wifi_network_t* networks;
+static uint32_t network_count;
+static wifi_join_ap_t last_ap;
+static wifi_join_stats_t stats;
+
+/* Private function prototypes -----------------------------------------------*/
+static void scan_ap(const esp8266_ap_info_t* ap, void* context);
+static esp8266_status_t join_candidate(const wifi_join_ap_t* ap);
+static esp8266_status_t joined(uint32_t start, uint32_t* max_ms);
+
+/* Exported functions -------------------------------------------------------*/
+
+/**
+  * @brief  Set the networks to join, and forget the last AP (RAM only, a
+  *         reset forgets it as well).
+  * @param  list: the networks, kept by reference; at most 32.
+  * @param  count: their count.
+  * @retval None.
+  */
+void wifi_join_init(const wifi_network_t* list, uint32_t count)
+{
+  networks = list;
+  network_count = (count > 32U) ? 32U : count;
+  memset(&last_ap, 0, sizeof(last_ap));
+  memset(&stats, 0, sizeof(stats));
+}
+
+/**
+  * @brief  Join the last AP directly, or else the strongest AP of the
+  *         configured networks found by a scan.
+  * @retval ESP8266_OK when joined, the status of the last attempt otherwise.
+  */
+esp8266_status_t wifi_join(void)
+{
+  uint32_t start = HAL_GetTick();
+  candidates_t candidates;
+  esp8266_status_t ret = ESP8266_ERROR;
+
+  /* The last AP, the fast scan stopping on its channel */
+  if (last_ap.valid != 0)
+  {
+    ret = join_candidate(&last_ap);
+    if (ret == ESP8266_OK)
+    {
+      stats.fast_joins++;
+      return joined(start, &stats.fast_max_ms);
+    }
+    stats.fast_failures++;
+    last_ap.valid = 0;
+  }
+
+  memset(&candidates, 0, sizeof(candidates));
+  stats.scans++;
+  if (esp8266_list_ap(scan_ap, &candidates) == ESP8266_OK)
+  {
+    for (uint32_t i = 0; i < candidates.count; i++)
+    {
+      ret = join_candidate(&candidates.ap[i]);
+      if (ret == ESP8266_OK)
+      {
+        last_ap = candidates.ap[i];
+        return joined(start, &stats.scan_max_ms);
+      }
+    }
+  }
+
+  /* Hidden networks do not answer a scan: by name */
+  for (uint32_t i = 0; i < network_count; i++)
+  {
+    if ((candidates.seen & (1UL << i)) == 0)
+    {
+      ret = esp8266_joint_ap((uint8_t *)networks[i].ssid, (uint8_t *)networks[i].password);
+      if (ret == ESP8266_OK)
+      {
+        return joined(start, &stats.scan_max_ms);
+      }
+    }
+  }
+
+  stats.failures++;
+  stats.last_ms = HAL_GetTick() - start;
+  return ret;
+}
+
+/**
+  * @brief  The AP of the last join, valid only when found by a scan.
+  * @retval The AP.
+  */
+const wifi_join_ap_t* wifi_join_last_ap(void)
+{
+  return &last_ap;
+}
+
+/**
+  * @brief  Get the join counters and times.
+  * @param  out: the counters.
+  * @retval None.
+  */
+void wifi_join_get_stats(wifi_join_stats_t* out)
+{
+  *out = stats;
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  An AP of the scan: kept among the strongest when its network is
+  *         configured.
+  */
+static void scan_ap(const esp8266_ap_info_t* ap, void* context)
+{
+  candidates_t* candidates = (candidates_t *)context;
+  uint32_t network;
+  uint32_t i;
+
+  for (network = 0; network < network_count; network++)
+  {
+    if (strcmp(ap->ssid, networks[network].ssid) == 0)
+    {
+      break;
+    }
+  }
+  if (network == network_count)
+  {
+    return;
+  }
+  candidates->seen |= (1UL << network);
+
+  /* Sorted insertion, the weakest dropped when full */
+  i = (candidates->count < WIFI_JOIN_MAX_CANDIDATES) ? candidates->count++ : WIFI_JOIN_MAX_CANDIDATES;
+  while ((i != 0) && (candidates->ap[i - 1U].rssi < ap->rssi))
+  {
+    if (i < WIFI_JOIN_MAX_CANDIDATES)
+    {
+      candidates->ap[i] = candidates->ap[i - 1U];
+    }
+    i--;
+  }
+  if (i < WIFI_JOIN_MAX_CANDIDATES)
+  {
+    wifi_join_ap_t* entry = &candidates->ap[i];
+
+    entry->valid = 1;
+    entry->network = (uint8_t)network;
+    strcpy(entry->bssid, ap->bssid);
+    entry->rssi = ap->rssi;
+  }
+}
+
+static esp8266_status_t join_candidate(const wifi_join_ap_t* ap)
+{
+  const wifi_network_t* network = &networks[ap->network];
+
+  return esp8266_join_ap_bssid(network->ssid, network->password, ap->bssid);
+}
+
+/**
+  * @brief  Count a successful join and its time.
+  */
+static esp8266_status_t joined(uint32_t start, uint32_t* max_ms)
+{
+  stats.joins++;
+  stats.last_ms = HAL_GetTick() - start;
+  if (stats.last_ms > *max_ms)
+  {
+    *max_ms = stats.last_ms;
+  }
+  return ESP8266_OK;
+}
@@ -6,36 +6,81 @@
 # Add inputs and outputs from these tool invocations to the build variables 
 C_SRCS += \
 ../Core/Src/app.c \
+../Core/Src/app_rtos.c \
+../Core/Src/at_builder.c \
+../Core/Src/at_parse.c \
+../Core/Src/at_scan.c \
 ../Core/Src/esp8266.c \
+../Core/Src/esp8266_async.c \
 ../Core/Src/esp8266_io.c \
+../Core/Src/esp8266_power.c \
+../Core/Src/esp8266_urc.c \
+../Core/Src/link_ctrl.c \
+../Core/Src/log_ring.c \
+../Core/Src/logging_binary.c \
 ../Core/Src/main.c \
+../Core/Src/metrics.c \
+../Core/Src/metrics_http.c \
+../Core/Src/power.c \
+../Core/Src/sched.c \
 ../Core/Src/stm32f4xx_hal_msp.c \
 ../Core/Src/stm32f4xx_it.c \
 ../Core/Src/syscalls.c \
 ../Core/Src/sysmem.c \
-../Core/Src/system_stm32f4xx.c 
+../Core/Src/system_stm32f4xx.c \
+../Core/Src/wifi_join.c 
 
 OBJS += \
 ./Core/Src/app.o \
+./Core/Src/app_rtos.o \
+./Core/Src/at_builder.o \
+./Core/Src/at_parse.o \
+./Core/Src/at_scan.o \
 ./Core/Src/esp8266.o \
+./Core/Src/esp8266_async.o \
 ./Core/Src/esp8266_io.o \
+./Core/Src/esp8266_power.o \
+./Core/Src/esp8266_urc.o \
+./Core/Src/link_ctrl.o \
+./Core/Src/log_ring.o \
+./Core/Src/logging_binary.o \
 ./Core/Src/main.o \
+./Core/Src/metrics.o \
+./Core/Src/metrics_http.o \
+./Core/Src/power.o \
+./Core/Src/sched.o \
 ./Core/Src/stm32f4xx_hal_msp.o \
 ./Core/Src/stm32f4xx_it.o \
 ./Core/Src/syscalls.o \
 ./Core/Src/sysmem.o \
-./Core/Src/system_stm32f4xx.o 
+./Core/Src/system_stm32f4xx.o \
+./Core/Src/wifi_join.o 
 
 C_DEPS += \
 ./Core/Src/app.d \
+./Core/Src/app_rtos.d \
+./Core/Src/at_builder.d \
+./Core/Src/at_parse.d \
+./Core/Src/at_scan.d \
 ./Core/Src/esp8266.d \
+./Core/Src/esp8266_async.d \
 ./Core/Src/esp8266_io.d \
+./Core/Src/esp8266_power.d \
+./Core/Src/esp8266_urc.d \
+./Core/Src/link_ctrl.d \
+./Core/Src/log_ring.d \
+./Core/Src/logging_binary.d \
 ./Core/Src/main.d \
+./Core/Src/metrics.d \
+./Core/Src/metrics_http.d \
+./Core/Src/power.d \
+./Core/Src/sched.d \
 ./Core/Src/stm32f4xx_hal_msp.d \
 ./Core/Src/stm32f4xx_it.d \
 ./Core/Src/syscalls.d \
 ./Core/Src/sysmem.d \
-./Core/Src/system_stm32f4xx.d 
+./Core/Src/system_stm32f4xx.d \
+./Core/Src/wifi_join.d 
 
 
 # Each subdirectory must supply rules for building sources it contributes
@@ -45,7 +90,7 @@ Core/Src/%.o Core/Src/%.su Core/Src/%.cyclo: ../Core/Src/%.c Core/Src/subdir.mk
 clean: clean-Core-2f-Src
 
 clean-Core-2f-Src:
-	-$(RM) ./Core/Src/app.cyclo ./Core/Src/app.d ./Core/Src/app.o ./Core/Src/app.su ./Core/Src/esp8266.cyclo ./Core/Src/esp8266.d ./Core/Src/esp8266.o ./Core/Src/esp8266.su ./Core/Src/esp8266_io.cyclo ./Core/Src/esp8266_io.d ./Core/Src/esp8266_io.o ./Core/Src/esp8266_io.su ./Core/Src/main.cyclo ./Core/Src/main.d ./Core/Src/main.o ./Core/Src/main.su ./Core/Src/stm32f4xx_hal_msp.cyclo ./Core/Src/stm32f4xx_hal_msp.d ./Core/Src/stm32f4xx_hal_msp.o ./Core/Src/stm32f4xx_hal_msp.su ./Core/Src/stm32f4xx_it.cyclo ./Core/Src/stm32f4xx_it.d ./Core/Src/stm32f4xx_it.o ./Core/Src/stm32f4xx_it.su ./Core/Src/syscalls.cyclo ./Core/Src/syscalls.d ./Core/Src/syscalls.o ./Core/Src/syscalls.su ./Core/Src/sysmem.cyclo ./Core/Src/sysmem.d ./Core/Src/sysmem.o ./Core/Src/sysmem.su ./Core/Src/system_stm32f4xx.cyclo ./Core/Src/system_stm32f4xx.d ./Core/Src/system_stm32f4xx.o ./Core/Src/system_stm32f4xx.su
+	-$(RM) ./Core/Src/app.cyclo ./Core/Src/app.d ./Core/Src/app.o ./Core/Src/app.su ./Core/Src/app_rtos.cyclo ./Core/Src/app_rtos.d ./Core/Src/app_rtos.o ./Core/Src/app_rtos.su ./Core/Src/at_builder.cyclo ./Core/Src/at_builder.d ./Core/Src/at_builder.o ./Core/Src/at_builder.su ./Core/Src/at_parse.cyclo ./Core/Src/at_parse.d ./Core/Src/at_parse.o ./Core/Src/at_parse.su ./Core/Src/at_scan.cyclo ./Core/Src/at_scan.d ./Core/Src/at_scan.o ./Core/Src/at_scan.su ./Core/Src/esp8266.cyclo ./Core/Src/esp8266.d ./Core/Src/esp8266.o ./Core/Src/esp8266.su ./Core/Src/esp8266_async.cyclo ./Core/Src/esp8266_async.d ./Core/Src/esp8266_async.o ./Core/Src/esp8266_async.su ./Core/Src/esp8266_io.cyclo ./Core/Src/esp8266_io.d ./Core/Src/esp8266_io.o ./Core/Src/esp8266_io.su ./Core/Src/esp8266_power.cyclo ./Core/Src/esp8266_power.d ./Core/Src/esp8266_power.o ./Core/Src/esp8266_power.su ./Core/Src/esp8266_urc.cyclo ./Core/Src/esp8266_urc.d ./Core/Src/esp8266_urc.o ./Core/Src/esp8266_urc.su ./Core/Src/link_ctrl.cyclo ./Core/Src/link_ctrl.d ./Core/Src/link_ctrl.o ./Core/Src/link_ctrl.su ./Core/Src/log_ring.cyclo ./Core/Src/log_ring.d ./Core/Src/log_ring.o ./Core/Src/log_ring.su ./Core/Src/logging_binary.cyclo ./Core/Src/logging_binary.d ./Core/Src/logging_binary.o ./Core/Src/logging_binary.su ./Core/Src/main.cyclo ./Core/Src/main.d ./Core/Src/main.o ./Core/Src/main.su ./Core/Src/metrics.cyclo ./Core/Src/metrics.d ./Core/Src/metrics.o ./Core/Src/metrics.su ./Core/Src/metrics_http.cyclo ./Core/Src/metrics_http.d ./Core/Src/metrics_http.o ./Core/Src/metrics_http.su ./Core/Src/power.cyclo ./Core/Src/power.d ./Core/Src/power.o ./Core/Src/power.su ./Core/Src/sched.cyclo ./Core/Src/sched.d ./Core/Src/sched.o ./Core/Src/sched.su ./Core/Src/stm32f4xx_hal_msp.cyclo ./Core/Src/stm32f4xx_hal_msp.d ./Core/Src/stm32f4xx_hal_msp.o ./Core/Src/stm32f4xx_hal_msp.su ./Core/Src/stm32f4xx_it.cyclo ./Core/Src/stm32f4xx_it.d ./Core/Src/stm32f4xx_it.o ./Core/Src/stm32f4xx_it.su ./Core/Src/syscalls.cyclo ./Core/Src/syscalls.d ./Core/Src/syscalls.o ./Core/Src/syscalls.su ./Core/Src/sysmem.cyclo ./Core/Src/sysmem.d ./Core/Src/sysmem.o ./Core/Src/sysmem.su ./Core/Src/system_stm32f4xx.cyclo ./Core/Src/system_stm32f4xx.d ./Core/Src/system_stm32f4xx.o ./Core/Src/system_stm32f4xx.su ./Core/Src/wifi_join.cyclo ./Core/Src/wifi_join.d ./Core/Src/wifi_join.o ./Core/Src/wifi_join.su
 
 .PHONY: clean-Core-2f-Src
 
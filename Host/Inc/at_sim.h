@@ -0,0 +1,90 @@
+/*
+ * at_sim.h
+ *
+ *  Scripted ESP-AT modem simulator for the host build. It sits on the other
+ *  end of the UART socketpair and answers the CW*, CIP*, MQTT* and SLEEP
+ *  commands used by esp8266.c (with the data of AT+CIPSEND and
+ *  AT+MQTTPUBRAW; over AT+CIPSTART="UDP" the data really goes out as a
+ *  datagram from a loopback socket, and AT+CIPSERVER listens on a loopback
+ *  TCP port, one link per client; AT+CIPDOMAIN resolves the broker host name) with configurable latency, reply chunking (each chunk is
+ *  an IDLE event for the driver), injected URCs, hangs and busy answers.
+ *  A link profile scripts the radio over time: RSSI of AT+CWJAP?, PUBACK
+ *  round trip of AT+MQTTPUB and busy answers.
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+#ifndef HOST_AT_SIM_H_
+#define HOST_AT_SIM_H_
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+/* Exported types ------------------------------------------------------------*/
+/* The link from at_ms after at_sim_set_profile() until the next step */
+typedef struct {
+    uint32_t    at_ms;
+    int8_t      rssi;                /* of AT+CWJAP? */
+    uint32_t    rtt_ms;              /* extra delay of AT+MQTTPUB at QoS 1, a quarter of it at QoS 0 */
+    uint32_t    busy_every;          /* replaces the configured one */
+} at_sim_link_step_t;
+
+typedef struct {
+    uint32_t    latency_ms;          /* delay before every reply */
+    uint32_t    join_latency_ms;     /* extra delay of AT+CWJAP, the AP found */
+    uint32_t    scan_latency_ms;     /* of a scan of every channel: AT+CWLAP, AT+CWJAP without fast scan */
+    uint32_t    connect_latency_ms;  /* extra delay of AT+MQTTCONN / AT+CIPSTART */
+    uint32_t    dns_latency_ms;      /* extra delay of a lookup: AT+CIPDOMAIN, AT+MQTTCONN to a host name */
+    uint32_t    wake_latency_ms;     /* extra delay of the first command after AT+SLEEP */
+    uint32_t    chunk_size;          /* split replies in chunks of that size, 0 = whole */
+    uint32_t    chunk_gap_us;        /* pause between two chunks */
+    uint32_t    urc_period_ms;       /* inject `urc` periodically, 0 = never */
+    const char* urc;                 /* line to inject, without CRLF */
+    uint32_t    urc_message_size;    /* inject +MQTTSUBRECV binary messages of that size instead, 0 = off */
+    uint32_t    hang_every;          /* leave every Nth command unanswered, 0 = never */
+    uint32_t    busy_every;          /* answer every Nth command busy p... without running it, 0 = never */
+    uint8_t     echo;                /* echo commands until ATE0, like the real module */
+    uint8_t     no_sni;              /* answer AT+MQTTSNI with ERROR, as older firmware */
+} at_sim_config_t;
+
+typedef struct {
+    uint32_t    commands;            /* complete command lines handled */
+    uint32_t    errors;              /* commands answered with ERROR */
+    uint32_t    urcs;                /* URCs injected */
+    uint32_t    messages;            /* +MQTTSUBRECV messages among them */
+    uint32_t    message_bytes;       /* payload bytes of the messages injected */
+    uint32_t    sleeps;              /* AT+SLEEP=1 or 2 */
+    uint32_t    raw_publishes;       /* AT+MQTTPUBRAW with all its data */
+    uint32_t    hangs;               /* commands left unanswered */
+    uint32_t    busy;                /* commands answered busy p... */
+    uint32_t    datagrams;           /* sent to the UDP peer of AT+CIPSTART="UDP" */
+    uint32_t    datagram_bytes;
+    uint32_t    peer_changes;        /* UDP peer changed by a datagram from another one */
+    uint32_t    links_accepted;      /* clients of AT+CIPSERVER */
+    uint32_t    link_bytes;          /* sent to them */
+    uint32_t    dns_lookups;         /* AT+CIPDOMAIN and AT+MQTTCONN to a host name */
+    uint32_t    connects_by_ip;      /* AT+MQTTCONN to the broker address */
+    uint32_t    sni_set;             /* AT+MQTTSNI */
+    uint32_t    scanned_channels;    /* by AT+CWLAP and AT+CWJAP */
+    uint32_t    publishes;           /* AT+MQTTPUB */
+    uint32_t    publishes_qos1;      /* AT+MQTTPUB and AT+MQTTPUBRAW */
+    uint32_t    rx_bytes;            /* bytes received from the MCU */
+    uint32_t    tx_bytes;            /* bytes sent to the MCU */
+} at_sim_stats_t;
+
+/* Exported functions ------------------------------------------------------- */
+void at_sim_default_config(at_sim_config_t* config);
+int at_sim_start(const at_sim_config_t* config, int fd);
+void at_sim_stop(void);
+void at_sim_inject(const char* line);
+void at_sim_set_urc_period(uint32_t period_ms);
+void at_sim_move_broker(const char* ip);
+int at_sim_add_ap(const char* ssid, const char* bssid, int8_t rssi, uint8_t channel);
+void at_sim_remove_ap(const char* bssid);
+void at_sim_set_profile(const at_sim_link_step_t* steps, uint32_t count);
+void at_sim_inject_message(const char* topic, const uint8_t* data, uint32_t length);
+void at_sim_message_pattern(uint8_t* data, uint32_t length);
+void at_sim_get_stats(at_sim_stats_t* stats);
+
+#endif /* HOST_AT_SIM_H_ */
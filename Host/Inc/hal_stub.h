@@ -0,0 +1,34 @@
+/*
+ * hal_stub.h
+ *
+ *  Host-only controls of the HAL stand-in: how the UART is wired, how time
+ *  flows, and hooks used by the benchmarks.
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+#ifndef HOST_HAL_STUB_H_
+#define HOST_HAL_STUB_H_
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm32f4xx_hal.h"
+
+/* Exported types ------------------------------------------------------------*/
+typedef void (*hal_stub_tx_hook_t)(const uint8_t* data, uint32_t length);
+typedef void (*hal_stub_rx_pump_t)(void);
+
+/* Exported functions ------------------------------------------------------- */
+void hal_stub_attach_uart(UART_HandleTypeDef* huart, int fd);
+void hal_stub_detach_uart(UART_HandleTypeDef* huart);
+void hal_stub_set_tx_hook(hal_stub_tx_hook_t hook);
+void hal_stub_dma_rx(const uint8_t* data, uint32_t length);
+void hal_stub_set_rx_pump(hal_stub_rx_pump_t pump);
+void hal_stub_set_rx_polling(int enable);
+uint32_t hal_stub_poll_rx(void);
+
+void hal_stub_set_virtual_clock(uint32_t step_ms);
+void hal_stub_advance_ms(uint32_t ms);
+uint64_t hal_stub_now_ns(void);
+
+#endif /* HOST_HAL_STUB_H_ */
@@ -0,0 +1,78 @@
+/*
+ * FreeRTOS.h
+ *
+ *  Host stand-in for the FreeRTOS kernel (make -C Host rtos-shim): the subset
+ *  of the API app_rtos.c and rtos_host_main.c use, on one pthread per task.
+ *  It behaves as a single core: one task runs at a time, the highest priority
+ *  ready one, switching when it blocks or at the next kernel call after a
+ *  higher priority task became ready. There is no preemption in between, so
+ *  measured latencies are those of the cooperative switch, not of the port.
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+#ifndef HOST_RTOS_SHIM_FREERTOS_H_
+#define HOST_RTOS_SHIM_FREERTOS_H_
+
+/* Includes ------------------------------------------------------------------*/
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "FreeRTOSConfig.h"
+
+/* Exported types ------------------------------------------------------------*/
+typedef unsigned long StackType_t;      /* as the POSIX port */
+typedef long BaseType_t;
+typedef unsigned long UBaseType_t;
+typedef uint32_t TickType_t;
+typedef void (*TaskFunction_t)(void* arg);
+
+/* Task control block, in the memory given to xTaskCreateStatic() */
+typedef struct StaticTask_s {
+    pthread_t              thread;
+    pthread_cond_t         run;                /* signalled when it becomes the running task */
+    const char*            name;
+    TaskFunction_t         fn;
+    void*                  arg;
+    UBaseType_t            priority;
+    StackType_t*           stack;
+    uint32_t               stack_words;
+    uint8_t                blocked;
+    uint8_t                woken;              /* by the event, not the timeout */
+    uint8_t                forever;            /* blocked without a timeout */
+    uint8_t                notify_state;
+    TickType_t             wake_tick;
+    uint32_t               notify_value;
+    const void*            wait_queue;
+    uint8_t                wait_send;
+    uint32_t               critical_nesting;
+} StaticTask_t;
+
+typedef struct {
+    uint8_t*               storage;
+    UBaseType_t            length;
+    UBaseType_t            item_size;
+    UBaseType_t            count;
+    UBaseType_t            head;
+} StaticQueue_t;
+
+typedef StaticTask_t* TaskHandle_t;
+typedef StaticQueue_t* QueueHandle_t;
+
+/* Exported constants --------------------------------------------------------*/
+#define pdFALSE                  ((BaseType_t)0)
+#define pdTRUE                   ((BaseType_t)1)
+#define pdFAIL                   pdFALSE
+#define pdPASS                   pdTRUE
+#define portMAX_DELAY            ((TickType_t)0xFFFFFFFFUL)
+#define portTICK_PERIOD_MS       ((TickType_t)1000 / configTICK_RATE_HZ)
+#define pdMS_TO_TICKS(ms)        ((TickType_t)(((TickType_t)(ms) * (TickType_t)configTICK_RATE_HZ) / (TickType_t)1000U))
+#define tskIDLE_PRIORITY         ((UBaseType_t)0U)
+
+/* Exported functions ------------------------------------------------------- */
+void rtos_shim_yield(void);
+
+#define portYIELD_FROM_ISR(woken) do { if ((woken) != pdFALSE) { rtos_shim_yield(); } } while (0)
+
+#endif /* HOST_RTOS_SHIM_FREERTOS_H_ */
@@ -0,0 +1,21 @@
+/*
+ * queue.h
+ *
+ *  Host stand-in for the FreeRTOS queue API, see FreeRTOS.h.
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+#ifndef HOST_RTOS_SHIM_QUEUE_H_
+#define HOST_RTOS_SHIM_QUEUE_H_
+
+/* Includes ------------------------------------------------------------------*/
+#include "FreeRTOS.h"
+
+/* Exported functions ------------------------------------------------------- */
+QueueHandle_t xQueueCreateStatic(UBaseType_t length, UBaseType_t item_size, uint8_t* storage, StaticQueue_t* queue);
+BaseType_t xQueueSend(QueueHandle_t queue, const void* item, TickType_t ticks);
+BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t ticks);
+
+#endif /* HOST_RTOS_SHIM_QUEUE_H_ */
@@ -0,0 +1,51 @@
+/*
+ * task.h
+ *
+ *  Host stand-in for the FreeRTOS task API, see FreeRTOS.h.
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+#ifndef HOST_RTOS_SHIM_TASK_H_
+#define HOST_RTOS_SHIM_TASK_H_
+
+/* Includes ------------------------------------------------------------------*/
+#include "FreeRTOS.h"
+
+/* Exported types ------------------------------------------------------------*/
+typedef enum {
+    eNoAction                 = 0,
+    eSetBits                  = 1,
+    eIncrement                = 2,
+    eSetValueWithOverwrite    = 3,
+    eSetValueWithoutOverwrite = 4,
+} eNotifyAction;
+
+/* Exported macro ------------------------------------------------------------*/
+#define taskENTER_CRITICAL()     vTaskEnterCritical()
+#define taskEXIT_CRITICAL()      vTaskExitCritical()
+
+/* Exported functions ------------------------------------------------------- */
+TaskHandle_t xTaskCreateStatic(TaskFunction_t fn, const char* name, uint32_t stack_words, void* arg,
+                               UBaseType_t priority, StackType_t* stack, StaticTask_t* tcb);
+void vTaskStartScheduler(void);
+void vTaskSuspendAll(void);
+void vTaskEnterCritical(void);
+void vTaskExitCritical(void);
+void vTaskDelay(TickType_t ticks);
+void vTaskDelayUntil(TickType_t* previous_wake, TickType_t increment);
+TickType_t xTaskGetTickCount(void);
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task);
+
+BaseType_t xTaskNotify(TaskHandle_t task, uint32_t value, eNotifyAction action);
+BaseType_t xTaskNotifyWait(uint32_t clear_on_entry, uint32_t clear_on_exit, uint32_t* value, TickType_t ticks);
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks);
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t* higher_priority_woken);
+
+/* Provided by the application, as with configSUPPORT_STATIC_ALLOCATION */
+void vApplicationGetIdleTaskMemory(StaticTask_t** tcb, StackType_t** stack, uint32_t* stack_words);
+void vApplicationStackOverflowHook(TaskHandle_t task, char* name);
+
+#endif /* HOST_RTOS_SHIM_TASK_H_ */
@@ -0,0 +1,154 @@
+/*
+ * stm32f4xx_hal.h
+ *
+ *  Host build stand-in for the STM32F4 HAL. It declares just the part of the
+ *  HAL and CMSIS used by the driver and application sources so that they can
+ *  be compiled unchanged on Linux. The behaviour lives in hal_stub.c.
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+#ifndef HOST_STM32F4XX_HAL_H_
+#define HOST_STM32F4XX_HAL_H_
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include <stddef.h>
+
+/* Exported types ------------------------------------------------------------*/
+typedef enum
+{
+  HAL_OK       = 0x00U,
+  HAL_ERROR    = 0x01U,
+  HAL_BUSY     = 0x02U,
+  HAL_TIMEOUT  = 0x03U
+} HAL_StatusTypeDef;
+
+typedef enum
+{
+  HAL_UART_STATE_RESET   = 0x00U,
+  HAL_UART_STATE_READY   = 0x20U,
+  HAL_UART_STATE_BUSY    = 0x24U,
+  HAL_UART_STATE_BUSY_TX = 0x21U,
+  HAL_UART_STATE_BUSY_RX = 0x22U
+} HAL_UART_StateTypeDef;
+
+typedef struct
+{
+  uint32_t Instance;
+} DMA_HandleTypeDef;
+
+typedef struct
+{
+  uint32_t BaudRate;
+} UART_InitTypeDef;
+
+typedef struct
+{
+  uint32_t                       Instance;
+  UART_InitTypeDef               Init;
+  volatile HAL_UART_StateTypeDef gState;
+  volatile HAL_UART_StateTypeDef RxState;
+  volatile uint32_t              ErrorCode;
+  DMA_HandleTypeDef*             hdmatx;
+  DMA_HandleTypeDef*             hdmarx;
+  int                            host_fd;      /* host side: the simulated wire */
+} UART_HandleTypeDef;
+
+typedef struct
+{
+  uint32_t ODR;
+} GPIO_TypeDef;
+
+typedef enum
+{
+  GPIO_PIN_RESET = 0,
+  GPIO_PIN_SET
+} GPIO_PinState;
+
+/* Minimal CMSIS core peripherals: the cycle counter follows the host clock */
+typedef struct
+{
+  volatile uint32_t CTRL;
+  volatile uint32_t CYCCNT;
+} DWT_Type;
+
+typedef struct
+{
+  volatile uint32_t DEMCR;
+} CoreDebug_Type;
+
+typedef struct
+{
+  union
+  {
+    volatile uint8_t  u8;
+    volatile uint32_t u32;
+  } PORT[32U];
+  volatile uint32_t TER;
+  volatile uint32_t TCR;
+} ITM_Type;
+
+/* Exported constants --------------------------------------------------------*/
+#define HAL_UART_ERROR_NONE            0x00000000U
+#define HAL_UART_ERROR_PE              0x00000001U
+#define HAL_UART_ERROR_NE              0x00000002U
+#define HAL_UART_ERROR_FE              0x00000004U
+#define HAL_UART_ERROR_ORE             0x00000008U
+#define HAL_UART_ERROR_DMA             0x00000010U
+
+#define GPIO_PIN_0                     ((uint16_t)0x0001)
+#define GPIO_PIN_1                     ((uint16_t)0x0002)
+#define GPIO_PIN_2                     ((uint16_t)0x0004)
+#define GPIO_PIN_3                     ((uint16_t)0x0008)
+#define GPIO_PIN_4                     ((uint16_t)0x0010)
+#define GPIO_PIN_5                     ((uint16_t)0x0020)
+#define GPIO_PIN_13                    ((uint16_t)0x2000)
+#define GPIO_PIN_14                    ((uint16_t)0x4000)
+
+extern GPIO_TypeDef host_gpio[8];
+#define GPIOA                          (&host_gpio[0])
+#define GPIOB                          (&host_gpio[1])
+#define GPIOC                          (&host_gpio[2])
+#define GPIOH                          (&host_gpio[7])
+
+#define CoreDebug_DEMCR_TRCENA_Msk     (1UL << 24)
+#define DWT_CTRL_CYCCNTENA_Msk         (1UL << 0)
+#define ITM_TCR_ITMENA_Msk             (1UL << 0)
+
+extern DWT_Type host_dwt;
+extern CoreDebug_Type host_core_debug;
+extern ITM_Type host_itm;
+extern uint32_t SystemCoreClock;
+
+/* Every access to DWT refreshes CYCCNT from the host monotonic clock */
+#define DWT                            (host_dwt_sample())
+#define CoreDebug                      (&host_core_debug)
+#define ITM                            (&host_itm)
+
+#define __WFI()                        host_wfi()
+#define __disable_irq()                ((void)0)
+#define __enable_irq()                 ((void)0)
+
+/* Exported functions ------------------------------------------------------- */
+DWT_Type* host_dwt_sample(void);
+void host_wfi(void);
+
+uint32_t HAL_GetTick(void);
+void HAL_Delay(uint32_t Delay);
+void HAL_GPIO_WritePin(GPIO_TypeDef* GPIOx, uint16_t GPIO_Pin, GPIO_PinState PinState);
+void HAL_GPIO_TogglePin(GPIO_TypeDef* GPIOx, uint16_t GPIO_Pin);
+
+HAL_StatusTypeDef HAL_UART_Transmit(UART_HandleTypeDef *huart, const uint8_t *pData, uint16_t Size, uint32_t Timeout);
+HAL_StatusTypeDef HAL_UART_Transmit_DMA(UART_HandleTypeDef *huart, const uint8_t *pData, uint16_t Size);
+HAL_StatusTypeDef HAL_UARTEx_ReceiveToIdle_DMA(UART_HandleTypeDef *huart, uint8_t *pData, uint16_t Size);
+HAL_StatusTypeDef HAL_UART_DMAStop(UART_HandleTypeDef *huart);
+HAL_StatusTypeDef HAL_UART_AbortTransmit(UART_HandleTypeDef *huart);
+HAL_StatusTypeDef HAL_UART_DeInit(UART_HandleTypeDef *huart);
+
+void HAL_UARTEx_RxEventCallback(UART_HandleTypeDef *huart, uint16_t Size);
+void HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart);
+void HAL_UART_ErrorCallback(UART_HandleTypeDef *huart);
+
+#endif /* HOST_STM32F4XX_HAL_H_ */
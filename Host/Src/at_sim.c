@@ -0,0 +1,1474 @@
+/*
+ * at_sim.c
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "at_sim.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Private define ------------------------------------------------------------*/
+#define SIM_LINE_SIZE           1024
+#define SIM_REPLY_SIZE          1024
+#define SIM_MESSAGE_SIZE        4096
+#define SIM_POLL_MS             10
+#define SIM_DATAGRAM_SIZE       2048    /* largest AT+CIPSEND over UDP or to a link */
+#define SIM_LINKS               5       /* of AT+CIPMUX=1 */
+#define SIM_MAX_APS             16
+#define SIM_CHANNELS            13      /* swept in order by a scan */
+
+/* Private typedef -----------------------------------------------------------*/
+/* mode is '=' for a set command, '?' for a query and 0 for an execute command */
+typedef void (*sim_handler_t)(char mode, const char* args);
+
+typedef struct {
+    const char*     verb;
+    sim_handler_t   handler;
+} sim_command_t;
+
+typedef struct {
+    char            ssid[33];
+    char            bssid[18];
+    int8_t          rssi;
+    uint8_t         channel;
+    uint8_t         ecn;
+} sim_ap_t;
+
+/* Private variables ---------------------------------------------------------*/
+static at_sim_config_t sim_config;
+static at_sim_stats_t sim_stats;
+static int sim_fd = -1;
+static pthread_t sim_thread;
+static volatile int sim_running;
+static pthread_mutex_t sim_tx_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static uint8_t sim_echo;
+static uint8_t sim_wifi_connected;
+static sim_ap_t sim_joined;             /* of AT+CWJAP? */
+
+/* Access points in range, AT+CWLAP lists them and AT+CWJAP scans for them */
+static pthread_mutex_t sim_ap_lock = PTHREAD_MUTEX_INITIALIZER;
+static sim_ap_t sim_aps[SIM_MAX_APS] = {
+    { "sim-ap",     "aa:bb:cc:dd:ee:01", -52,  6, 3 },
+    { "cafe,2\"G\"", "aa:bb:cc:dd:ee:02", -71,  1, 4 },
+    { "guest>",     "aa:bb:cc:dd:ee:03", -85, 11, 0 },
+};
+static uint32_t sim_ap_count = 3;
+static uint8_t sim_sleep_mode;         /* of AT+SLEEP: 1 modem, 2 light */
+static uint8_t sim_asleep;
+static uint32_t sim_data_expected;
+static uint32_t sim_data_received;
+static uint8_t sim_data_publish;        /* data of AT+MQTTPUBRAW, not AT+CIPSEND */
+static uint8_t sim_data_qos;            /* of that AT+MQTTPUBRAW */
+static uint8_t sim_data[SIM_DATAGRAM_SIZE];
+static struct sockaddr_in sim_data_peer;    /* of this datagram only, AT+CIPSEND=<len>,"<ip>",<port> */
+static uint8_t sim_data_peer_set;
+
+/* UDP link of AT+CIPSTART="UDP": datagrams really go to the peer */
+static int sim_udp_fd = -1;
+static struct sockaddr_in sim_udp_peer;
+static int32_t sim_udp_policy;          /* 0 fixed peer, 1 changes once, 2 follows every sender */
+
+/* TCP server of AT+CIPSERVER: a real listening socket, one client per link */
+static uint8_t sim_mux;
+static int sim_listen_fd = -1;
+static int sim_link_fd[SIM_LINKS];
+static int32_t sim_data_link = -1;      /* of the AT+CIPSEND=<link>,<length> in progress */
+static uint32_t sim_max_conn;           /* of AT+CIPSERVERMAXCONN */
+static int32_t sim_client_link = -1;    /* of AT+CIPSTART=<link>,... with AT+CIPMUX=1 */
+
+/* Address of every host name, the broker; AT+MQTTCONN to another address fails */
+static pthread_mutex_t sim_broker_lock = PTHREAD_MUTEX_INITIALIZER;
+static char sim_broker_ip[16] = "10.0.0.7";
+
+/* Periodic URCs of the configuration, at_sim_set_urc_period() changes them */
+static pthread_mutex_t sim_urc_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint32_t sim_urc_period_ms;
+static uint64_t sim_next_urc;
+
+/* Link profile, steps in time order; NULL: the configuration and sim_joined */
+static pthread_mutex_t sim_profile_lock = PTHREAD_MUTEX_INITIALIZER;
+static const at_sim_link_step_t* sim_profile;
+static uint32_t sim_profile_count;
+static uint64_t sim_profile_start;
+
+/* Private function prototypes -----------------------------------------------*/
+static void* sim_thread_main(void* arg);
+static void sim_handle_line(const char* line);
+static void sim_handle_data(uint8_t byte);
+static void sim_write(const char* data, size_t length);
+static void sim_reply(uint32_t extra_latency_ms, const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+static uint64_t sim_now_ms(void);
+static void sim_sleep_ms(uint32_t ms);
+static int sim_parse_peer(const char* p, const char** next, struct sockaddr_in* peer);
+static int sim_parse_host(const char* p, char* host, size_t size);
+static const char* sim_parse_quoted(const char* p, char* out, size_t size);
+static void sim_escape(const char* in, char* out, size_t size);
+static void sim_udp_close(void);
+static void sim_udp_receive(void);
+static void sim_server_close(void);
+static void sim_server_accept(void);
+static void sim_link_receive(uint32_t link);
+static int sim_link_step(at_sim_link_step_t* step);
+
+static void sim_ok(char mode, const char* args);
+static void sim_echo_off(char mode, const char* args);
+static void sim_echo_on(char mode, const char* args);
+static void sim_rst(char mode, const char* args);
+static void sim_gmr(char mode, const char* args);
+static void sim_cwjap(char mode, const char* args);
+static void sim_cwqap(char mode, const char* args);
+static void sim_cwlap(char mode, const char* args);
+static void sim_cifsr(char mode, const char* args);
+static void sim_sntptime(char mode, const char* args);
+static void sim_cipstart(char mode, const char* args);
+static void sim_cipclose(char mode, const char* args);
+static void sim_cipsend(char mode, const char* args);
+static void sim_cipmux(char mode, const char* args);
+static void sim_cipservermaxconn(char mode, const char* args);
+static void sim_cipserver(char mode, const char* args);
+static void sim_mqttpub(char mode, const char* args);
+static void sim_mqttpubraw(char mode, const char* args);
+static void sim_mqttconn(char mode, const char* args);
+static void sim_mqttsni(char mode, const char* args);
+static void sim_cipdomain(char mode, const char* args);
+static void sim_sleep(char mode, const char* args);
+
+/* Command table, looked up by exact verb (text before '=' or '?') */
+static const sim_command_t sim_commands[] = {
+    { "AT",               sim_ok        },
+    { "ATE0",             sim_echo_off  },
+    { "ATE1",             sim_echo_on   },
+    { "AT+RST",           sim_rst       },
+    { "AT+GMR",           sim_gmr       },
+    { "AT+CWMODE",        sim_ok        },
+    { "AT+CWJAP",         sim_cwjap     },
+    { "AT+CWQAP",         sim_cwqap     },
+    { "AT+CWLAP",         sim_cwlap     },
+    { "AT+CIFSR",         sim_cifsr     },
+    { "AT+CIPDOMAIN",     sim_cipdomain },
+    { "AT+CIPMUX",        sim_cipmux    },
+    { "AT+CIPSERVER",     sim_cipserver },
+    { "AT+CIPSERVERMAXCONN", sim_cipservermaxconn },
+    { "AT+CIPSNTPCFG",    sim_ok        },
+    { "AT+CIPSNTPTIME",   sim_sntptime  },
+    { "AT+CIPSTART",      sim_cipstart  },
+    { "AT+CIPCLOSE",      sim_cipclose  },
+    { "AT+CIPSEND",       sim_cipsend   },
+    { "AT+MQTTUSERCFG",   sim_ok        },
+    { "AT+MQTTCONN",      sim_mqttconn  },
+    { "AT+MQTTSNI",       sim_mqttsni   },
+    { "AT+MQTTSUB",       sim_ok        },
+    { "AT+MQTTUNSUB",     sim_ok        },
+    { "AT+MQTTPUB",       sim_mqttpub   },
+    { "AT+MQTTPUBRAW",    sim_mqttpubraw },
+    { "AT+MQTTCLEAN",     sim_ok        },
+    { "AT+SLEEP",         sim_sleep     },
+    { "AT+SLEEPWKCFG",    sim_ok        },
+};
+
+/* Exported functions -------------------------------------------------------*/
+
+/**
+  * @brief  Fill a configuration with the behaviour of an idle, healthy module.
+  */
+void at_sim_default_config(at_sim_config_t* config)
+{
+  memset(config, 0, sizeof(*config));
+  config->latency_ms = 2;
+  config->join_latency_ms = 50;
+  config->scan_latency_ms = 130;
+  config->connect_latency_ms = 20;
+  config->dns_latency_ms = 30;
+  config->wake_latency_ms = 3;
+  config->urc = "+MQTTSUBRECV:0,\"led/cmd\",6,LED ON";
+  config->echo = 1;
+}
+
+/**
+  * @brief  Start the simulator thread on one end of the UART socketpair.
+  * @retval 0 on success, -1 otherwise.
+  */
+int at_sim_start(const at_sim_config_t* config, int fd)
+{
+  sim_config = *config;
+  memset(&sim_stats, 0, sizeof(sim_stats));
+  sim_fd = fd;
+  sim_echo = config->echo;
+  sim_wifi_connected = 0;
+  sim_sleep_mode = 0;
+  sim_asleep = 0;
+  sim_data_expected = 0;
+  sim_udp_fd = -1;
+  sim_mux = 0;
+  sim_listen_fd = -1;
+  sim_max_conn = SIM_LINKS;
+  sim_client_link = -1;
+  sim_urc_period_ms = config->urc_period_ms;
+  sim_next_urc = sim_now_ms() + config->urc_period_ms;
+  for (uint32_t i = 0; i < SIM_LINKS; i++)
+  {
+    sim_link_fd[i] = -1;
+  }
+  sim_running = 1;
+
+  if (pthread_create(&sim_thread, NULL, sim_thread_main, NULL) != 0)
+  {
+    sim_running = 0;
+    return -1;
+  }
+  return 0;
+}
+
+/**
+  * @brief  Stop the simulator thread.
+  */
+void at_sim_stop(void)
+{
+  if (sim_running != 0)
+  {
+    sim_running = 0;
+    pthread_join(sim_thread, NULL);
+  }
+  sim_udp_close();
+  sim_server_close();
+}
+
+/**
+  * @brief  Send an unsolicited line (URC) to the MCU now.
+  * @param  line: the URC without CRLF.
+  */
+void at_sim_inject(const char* line)
+{
+  sim_write(line, strlen(line));
+  sim_write("\r\n", 2);
+  sim_stats.urcs++;
+  if (strncmp(line, "+MQTTSUBRECV:", 13) == 0)
+  {
+    sim_stats.messages++;
+  }
+}
+
+/**
+  * @brief  Inject the URC of the configuration at another period from now
+  *         on, 0 to stop: none is sent once this returns.
+  * @param  period_ms: the new period.
+  */
+void at_sim_set_urc_period(uint32_t period_ms)
+{
+  pthread_mutex_lock(&sim_urc_lock);
+  sim_urc_period_ms = period_ms;
+  sim_next_urc = sim_now_ms() + period_ms;
+  pthread_mutex_unlock(&sim_urc_lock);
+}
+
+/**
+  * @brief  Put an access point in range.
+  * @param  ssid: its network.
+  * @param  bssid: its MAC address, "aa:bb:cc:dd:ee:ff".
+  * @param  rssi: its signal, dBm.
+  * @param  channel: 1 to 13, a scan for it stops there.
+  * @retval 0 on success, -1 when the table is full.
+  */
+int at_sim_add_ap(const char* ssid, const char* bssid, int8_t rssi, uint8_t channel)
+{
+  int ret = -1;
+
+  pthread_mutex_lock(&sim_ap_lock);
+  if (sim_ap_count < SIM_MAX_APS)
+  {
+    sim_ap_t* ap = &sim_aps[sim_ap_count++];
+
+    snprintf(ap->ssid, sizeof(ap->ssid), "%s", ssid);
+    snprintf(ap->bssid, sizeof(ap->bssid), "%s", bssid);
+    ap->rssi = rssi;
+    ap->channel = channel;
+    ap->ecn = 3;
+    ret = 0;
+  }
+  pthread_mutex_unlock(&sim_ap_lock);
+  return ret;
+}
+
+/**
+  * @brief  Take an access point out of range (switched off or moved).
+  * @param  bssid: its MAC address.
+  */
+void at_sim_remove_ap(const char* bssid)
+{
+  pthread_mutex_lock(&sim_ap_lock);
+  for (uint32_t i = 0; i < sim_ap_count; i++)
+  {
+    if (strcmp(sim_aps[i].bssid, bssid) == 0)
+    {
+      sim_aps[i] = sim_aps[--sim_ap_count];
+      break;
+    }
+  }
+  pthread_mutex_unlock(&sim_ap_lock);
+}
+
+/**
+  * @brief  Script the link from now on, the last step held until the next
+  *         call; NULL goes back to the configuration.
+  * @param  steps: the steps, kept by reference, at_ms increasing.
+  * @param  count: their count.
+  */
+void at_sim_set_profile(const at_sim_link_step_t* steps, uint32_t count)
+{
+  pthread_mutex_lock(&sim_profile_lock);
+  sim_profile = steps;
+  sim_profile_count = (steps != NULL) ? count : 0;
+  sim_profile_start = sim_now_ms();
+  pthread_mutex_unlock(&sim_profile_lock);
+}
+
+/**
+  * @brief  Give the broker host name another address, as a DNS change does:
+  *         AT+MQTTCONN to the old address fails from now on.
+  * @param  ip: the new address.
+  */
+void at_sim_move_broker(const char* ip)
+{
+  pthread_mutex_lock(&sim_broker_lock);
+  snprintf(sim_broker_ip, sizeof(sim_broker_ip), "%s", ip);
+  pthread_mutex_unlock(&sim_broker_lock);
+}
+
+/**
+  * @brief  Send a +MQTTSUBRECV message to the MCU now, its payload framed
+  *         by its length only, as the module does.
+  * @param  topic: the topic.
+  * @param  data: the payload, any bytes.
+  * @param  length: its size.
+  */
+void at_sim_inject_message(const char* topic, const uint8_t* data, uint32_t length)
+{
+  char header[96];
+  int n = snprintf(header, sizeof(header), "+MQTTSUBRECV:0,\"%s\",%u,", topic, length);
+
+  sim_write(header, (size_t)n);
+  sim_write((const char *)data, length);
+  sim_write("\r\n", 2);
+  sim_stats.urcs++;
+  sim_stats.messages++;
+  sim_stats.message_bytes += length;
+}
+
+/**
+  * @brief  Fill a payload with what a line parser gets wrong: '\0', CRLF,
+  *         "OK", '>' and a URC line, between pseudo-random bytes.
+  * @param  data: the payload.
+  * @param  length: its size.
+  */
+void at_sim_message_pattern(uint8_t* data, uint32_t length)
+{
+  static const char traps[] = "\r\nOK\r\n>\r\n+MQTTDISCONNECTED:0\r\nERROR\r\n";
+
+  /* Every byte value once per 256 bytes (131 is odd), '\0' included */
+  for (uint32_t i = 0; i < length; i++)
+  {
+    data[i] = (uint8_t)((i * 131U) + 7U);
+  }
+  for (uint32_t i = 16; (i + sizeof(traps) - 1U) <= length; i += 256U)
+  {
+    memcpy(&data[i], traps, sizeof(traps) - 1U);
+  }
+}
+
+/**
+  * @brief  Read the simulator counters.
+  */
+void at_sim_get_stats(at_sim_stats_t* stats)
+{
+  *stats = sim_stats;
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+static void* sim_thread_main(void* arg)
+{
+  char line[SIM_LINE_SIZE];
+  size_t line_len = 0;
+  (void)arg;
+
+  while (sim_running != 0)
+  {
+    /* Descriptors at -1 are ignored */
+    struct pollfd pfd[3 + SIM_LINKS] = {
+        { .fd = sim_fd, .events = POLLIN },
+        { .fd = sim_udp_fd, .events = POLLIN },
+        { .fd = sim_listen_fd, .events = POLLIN },
+    };
+    uint8_t chunk[256];
+    ssize_t n;
+
+    pthread_mutex_lock(&sim_urc_lock);
+    if ((sim_urc_period_ms != 0) && (sim_now_ms() >= sim_next_urc))
+    {
+      if (sim_config.urc_message_size != 0)
+      {
+        static uint8_t message[SIM_MESSAGE_SIZE];
+        uint32_t size = (sim_config.urc_message_size < sizeof(message)) ? sim_config.urc_message_size : sizeof(message);
+
+        at_sim_message_pattern(message, size);
+        at_sim_inject_message("led/cmd", message, size);
+      }
+      else
+      {
+        at_sim_inject(sim_config.urc);
+      }
+      sim_next_urc += sim_urc_period_ms;
+    }
+    pthread_mutex_unlock(&sim_urc_lock);
+
+    for (uint32_t i = 0; i < SIM_LINKS; i++)
+    {
+      pfd[3 + i].fd = sim_link_fd[i];
+      pfd[3 + i].events = POLLIN;
+    }
+
+    if (poll(pfd, 3 + SIM_LINKS, SIM_POLL_MS) <= 0)
+    {
+      continue;
+    }
+    if ((pfd[1].revents & POLLIN) != 0)
+    {
+      sim_udp_receive();
+    }
+    if ((pfd[2].revents & POLLIN) != 0)
+    {
+      sim_server_accept();
+    }
+    for (uint32_t i = 0; i < SIM_LINKS; i++)
+    {
+      if ((pfd[3 + i].revents & (POLLIN | POLLHUP)) != 0)
+      {
+        sim_link_receive(i);
+      }
+    }
+    if ((pfd[0].revents & (POLLIN | POLLHUP)) == 0)
+    {
+      continue;
+    }
+
+    n = read(sim_fd, chunk, sizeof(chunk));
+    if (n <= 0)
+    {
+      if ((n < 0) && (errno == EINTR))
+      {
+        continue;
+      }
+      break;
+    }
+    sim_stats.rx_bytes += (uint32_t)n;
+
+    for (ssize_t i = 0; i < n; i++)
+    {
+      if (sim_data_expected != 0)
+      {
+        sim_handle_data(chunk[i]);
+        continue;
+      }
+
+      if (line_len < (SIM_LINE_SIZE - 1))
+      {
+        line[line_len++] = (char)chunk[i];
+      }
+
+      if ((line_len >= 2) && (line[line_len - 2] == '\r') && (line[line_len - 1] == '\n'))
+      {
+        if (sim_echo != 0)
+        {
+          sim_write(line, line_len);
+        }
+        line[line_len - 2] = '\0';
+        sim_handle_line(line);
+        line_len = 0;
+      }
+    }
+  }
+
+  return NULL;
+}
+
+static void sim_handle_line(const char* line)
+{
+  size_t verb_len = strcspn(line, "=?");
+  char mode = line[verb_len];
+  const char* args = (mode != '\0') ? &line[verb_len + 1] : "";
+  at_sim_link_step_t step;
+  uint32_t busy_every;
+
+  if (line[0] == '\0')
+  {
+    return;
+  }
+
+  sim_stats.commands++;
+
+  /* A hung module: the command is swallowed */
+  if ((sim_config.hang_every != 0) && ((sim_stats.commands % sim_config.hang_every) == 0))
+  {
+    sim_stats.hangs++;
+    return;
+  }
+
+  /* Still busy with an earlier command: this one is dropped at once */
+  busy_every = (sim_link_step(&step) != 0) ? step.busy_every : sim_config.busy_every;
+  if ((busy_every != 0) && ((sim_stats.commands % busy_every) == 0))
+  {
+    sim_stats.busy++;
+    sim_reply(0, "busy p...\r\n");
+    return;
+  }
+
+  /* In light sleep the UART is off: without the wake-up line, which the host
+     build has not, the command is lost */
+  if ((sim_asleep != 0) && (sim_sleep_mode == 2))
+  {
+    sim_stats.hangs++;
+    return;
+  }
+
+  /* The module is woken up by this command (modem sleep): it answers later */
+  if (sim_asleep != 0)
+  {
+    sim_asleep = 0;
+    sim_sleep_ms(sim_config.wake_latency_ms);
+  }
+
+  for (size_t i = 0; i < (sizeof(sim_commands) / sizeof(sim_commands[0])); i++)
+  {
+    if ((strlen(sim_commands[i].verb) == verb_len) && (strncmp(sim_commands[i].verb, line, verb_len) == 0))
+    {
+      sim_commands[i].handler(mode, args);
+      return;
+    }
+  }
+
+  sim_stats.errors++;
+  sim_reply(0, "\r\nERROR\r\n");
+}
+
+static void sim_handle_data(uint8_t byte)
+{
+  if (sim_data_received < sizeof(sim_data))
+  {
+    sim_data[sim_data_received] = byte;
+  }
+  sim_data_received++;
+  if (--sim_data_expected == 0)
+  {
+    if (sim_data_publish != 0)
+    {
+      at_sim_link_step_t step;
+      uint32_t rtt_ms = (sim_link_step(&step) != 0) ? step.rtt_ms : 0;
+
+      sim_stats.raw_publishes++;
+      if (sim_data_qos != 0)
+      {
+        sim_stats.publishes_qos1++;
+      }
+      sim_reply((sim_data_qos != 0) ? rtt_ms : (rtt_ms / 4U), "\r\n+MQTTPUB:OK\r\n");
+      return;
+    }
+
+    if (sim_data_link >= 0)
+    {
+      /* To the client, whole: the module buffers what TCP cannot take yet */
+      for (uint32_t sent = 0; sent < sim_data_received; )
+      {
+        ssize_t n = write(sim_link_fd[sim_data_link], &sim_data[sent], sim_data_received - sent);
+
+        if (n <= 0)
+        {
+          if ((n < 0) && (errno == EINTR))
+          {
+            continue;
+          }
+          sim_stats.errors++;
+          sim_reply(0, "\r\nRecv %u bytes\r\n\r\nSEND FAIL\r\n", sim_data_received);
+          return;
+        }
+        sent += (uint32_t)n;
+      }
+      sim_stats.link_bytes += sim_data_received;
+    }
+    else if (sim_udp_fd >= 0)
+    {
+      const struct sockaddr_in* peer = (sim_data_peer_set != 0) ? &sim_data_peer : &sim_udp_peer;
+
+      if (sendto(sim_udp_fd, sim_data, sim_data_received, 0, (const struct sockaddr *)peer, sizeof(*peer)) < 0)
+      {
+        sim_stats.errors++;
+        sim_reply(0, "\r\nRecv %u bytes\r\n\r\nSEND FAIL\r\n", sim_data_received);
+        return;
+      }
+      sim_stats.datagrams++;
+      sim_stats.datagram_bytes += sim_data_received;
+    }
+    sim_reply(0, "\r\nRecv %u bytes\r\n\r\nSEND OK\r\n", sim_data_received);
+  }
+}
+
+static void sim_write(const char* data, size_t length)
+{
+  pthread_mutex_lock(&sim_tx_lock);
+  while (length != 0)
+  {
+    size_t chunk = length;
+    ssize_t n;
+
+    if ((sim_config.chunk_size != 0) && (chunk > sim_config.chunk_size))
+    {
+      chunk = sim_config.chunk_size;
+    }
+
+    n = write(sim_fd, data, chunk);
+    if (n < 0)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+      break;
+    }
+
+    sim_stats.tx_bytes += (uint32_t)n;
+    data += n;
+    length -= (size_t)n;
+
+    if ((length != 0) && (sim_config.chunk_gap_us != 0))
+    {
+      usleep(sim_config.chunk_gap_us);
+    }
+  }
+  pthread_mutex_unlock(&sim_tx_lock);
+}
+
+static void sim_reply(uint32_t extra_latency_ms, const char* fmt, ...)
+{
+  char reply[SIM_REPLY_SIZE];
+  va_list ap;
+  int len;
+
+  sim_sleep_ms(sim_config.latency_ms + extra_latency_ms);
+
+  va_start(ap, fmt);
+  len = vsnprintf(reply, sizeof(reply), fmt, ap);
+  va_end(ap);
+
+  if (len > 0)
+  {
+    sim_write(reply, ((size_t)len < sizeof(reply)) ? (size_t)len : (sizeof(reply) - 1));
+  }
+}
+
+static uint64_t sim_now_ms(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ((uint64_t)ts.tv_sec * 1000ULL) + ((uint64_t)ts.tv_nsec / 1000000ULL);
+}
+
+static void sim_sleep_ms(uint32_t ms)
+{
+  if (ms != 0)
+  {
+    usleep(ms * 1000U);
+  }
+}
+
+/* Command handlers ----------------------------------------------------------*/
+
+static void sim_ok(char mode, const char* args)
+{
+  (void)mode;
+  (void)args;
+  sim_reply(0, "\r\nOK\r\n");
+}
+
+static void sim_echo_off(char mode, const char* args)
+{
+  sim_echo = 0;
+  sim_ok(mode, args);
+}
+
+static void sim_echo_on(char mode, const char* args)
+{
+  sim_echo = 1;
+  sim_ok(mode, args);
+}
+
+static void sim_rst(char mode, const char* args)
+{
+  sim_ok(mode, args);
+  sim_echo = sim_config.echo;
+  sim_wifi_connected = 0;
+  sim_reply(100, "\r\nready\r\n");
+}
+
+static void sim_gmr(char mode, const char* args)
+{
+  (void)mode;
+  (void)args;
+  sim_reply(0, "AT version:3.2.0.0(s-ec2dec2 - ESP8266 - Jul 28 2023 07:05:28)\r\n"
+               "SDK version:v3.4-22-g967752e2\r\n"
+               "compile time(6800286):Aug  4 2023 14:19:37\r\n"
+               "Bin version:2.2.1(ESP8266_1MB)\r\n\r\nOK\r\n");
+}
+
+/*
+ * "<ssid>","<pwd>"[,"<bssid>"[,<pci_en>,<reconn_interval>,<listen_interval>,<scan_mode>]]:
+ * a scan sweeps the channels, up to the AP only in fast mode (scan_mode 0)
+ * with a BSSID, then the strongest AP of the network is joined. A network
+ * not in range at all is joined as a hidden one, after a full scan, unless
+ * a BSSID is given.
+ */
+static void sim_cwjap(char mode, const char* args)
+{
+  char ssid[33];
+  char password[65];
+  char bssid[18] = "";
+  char escaped[80];
+  const char* p;
+  const sim_ap_t* best = NULL;
+  uint32_t scan_mode = 1;
+  uint32_t channels = SIM_CHANNELS;
+  uint8_t in_range = 0;
+
+  if (mode == '?')
+  {
+    if (sim_wifi_connected != 0)
+    {
+      at_sim_link_step_t step;
+      int rssi = (sim_link_step(&step) != 0) ? step.rssi : sim_joined.rssi;
+
+      sim_escape(sim_joined.ssid, escaped, sizeof(escaped));
+      sim_reply(0, "+CWJAP:\"%s\",\"%s\",%u,%d,0,1,3,0,1\r\n\r\nOK\r\n",
+                escaped, sim_joined.bssid, sim_joined.channel, rssi);
+    }
+    else
+    {
+      sim_reply(0, "No AP\r\n\r\nOK\r\n");
+    }
+    return;
+  }
+
+  if (((p = sim_parse_quoted(args, ssid, sizeof(ssid))) == NULL) || (*p++ != ',') ||
+      ((p = sim_parse_quoted(p, password, sizeof(password))) == NULL) ||
+      ((*p == ',') && ((p = sim_parse_quoted(p + 1, bssid, sizeof(bssid))) == NULL)))
+  {
+    sim_stats.errors++;
+    sim_reply(0, "\r\nERROR\r\n");
+    return;
+  }
+  /* scan_mode is the fourth number after the BSSID */
+  for (uint32_t i = 0; (i < 4U) && (*p == ','); i++)
+  {
+    scan_mode = (uint32_t)strtoul(p + 1, (char **)&p, 10);
+  }
+
+  pthread_mutex_lock(&sim_ap_lock);
+  for (uint32_t i = 0; i < sim_ap_count; i++)
+  {
+    if (strcmp(sim_aps[i].ssid, ssid) != 0)
+    {
+      continue;
+    }
+    in_range = 1;
+    if (((bssid[0] == '\0') || (strcmp(sim_aps[i].bssid, bssid) == 0)) &&
+        ((best == NULL) || (sim_aps[i].rssi > best->rssi)))
+    {
+      best = &sim_aps[i];
+    }
+  }
+  if (best != NULL)
+  {
+    sim_joined = *best;
+    if ((scan_mode == 0) && (bssid[0] != '\0'))
+    {
+      channels = best->channel;
+    }
+  }
+  pthread_mutex_unlock(&sim_ap_lock);
+
+  sim_wifi_connected = 0;
+  if ((best == NULL) && ((in_range != 0) || (bssid[0] != '\0')))
+  {
+    /* 3: the AP was not found */
+    sim_stats.errors++;
+    sim_reply(sim_config.scan_latency_ms, "+CWJAP:3\r\n\r\nERROR\r\n");
+    return;
+  }
+  if (best == NULL)
+  {
+    memset(&sim_joined, 0, sizeof(sim_joined));
+    snprintf(sim_joined.ssid, sizeof(sim_joined.ssid), "%s", ssid);
+    snprintf(sim_joined.bssid, sizeof(sim_joined.bssid), "aa:bb:cc:dd:ee:00");
+    sim_joined.rssi = -60;
+    sim_joined.channel = 1;
+  }
+
+  sim_wifi_connected = 1;
+  sim_stats.scanned_channels += channels;
+  sim_reply(((sim_config.scan_latency_ms * channels) / SIM_CHANNELS) + sim_config.join_latency_ms,
+            "WIFI CONNECTED\r\nWIFI GOT IP\r\n\r\nOK\r\n");
+}
+
+static void sim_cwqap(char mode, const char* args)
+{
+  sim_wifi_connected = 0;
+  sim_ok(mode, args);
+  sim_reply(0, "WIFI DISCONNECT\r\n");
+}
+
+/* Every AP in range, after a scan of every channel */
+static void sim_cwlap(char mode, const char* args)
+{
+  static char reply[SIM_MAX_APS * 96];
+  char escaped[80];
+  size_t n = 0;
+
+  (void)mode;
+  (void)args;
+  pthread_mutex_lock(&sim_ap_lock);
+  for (uint32_t i = 0; i < sim_ap_count; i++)
+  {
+    const sim_ap_t* ap = &sim_aps[i];
+
+    sim_escape(ap->ssid, escaped, sizeof(escaped));
+    n += (size_t)snprintf(&reply[n], sizeof(reply) - n, "+CWLAP:(%u,\"%s\",%d,\"%s\",%u,-1,-1,4,4,7,%u)\r\n",
+                          ap->ecn, escaped, ap->rssi, ap->bssid, ap->channel, (ap->ecn == 4U) ? 1U : 0U);
+  }
+  pthread_mutex_unlock(&sim_ap_lock);
+
+  sim_stats.scanned_channels += SIM_CHANNELS;
+  sim_reply(sim_config.scan_latency_ms, "%s\r\nOK\r\n", reply);
+}
+
+static void sim_cifsr(char mode, const char* args)
+{
+  (void)mode;
+  (void)args;
+  sim_reply(0, "+CIFSR:STAIP,\"192.168.4.50\"\r\n+CIFSR:STAMAC,\"5c:cf:7f:00:00:01\"\r\n\r\nOK\r\n");
+}
+
+static void sim_sntptime(char mode, const char* args)
+{
+  (void)mode;
+  (void)args;
+  sim_reply(0, "+CIPSNTPTIME:Sun Oct 18 09:30:00 2026\r\nOK\r\n");
+}
+
+/* [<link>,]"TCP"|"UDP","<ip>",<port>[,<local port>[,<peer change policy>]] (UDP only),
+   the link with AT+CIPMUX=1 */
+static void sim_cipstart(char mode, const char* args)
+{
+  struct sockaddr_in local = { .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+  const char* p = args;
+  long policy = 0;
+  char connect[16] = "CONNECT";
+
+  (void)mode;
+  if (sim_mux != 0)
+  {
+    uint32_t link = (uint32_t)strtoul(args, (char **)&p, 10);
+
+    if ((p == args) || (*p != ',') || (link >= SIM_LINKS) || (sim_link_fd[link] >= 0) ||
+        (sim_client_link >= 0))
+    {
+      sim_stats.errors++;
+      sim_reply(0, "\r\nERROR\r\n");
+      return;
+    }
+    args = p + 1;
+    sim_client_link = (int32_t)link;
+    snprintf(connect, sizeof(connect), "%u,CONNECT", link);
+  }
+  if (strncmp(args, "\"UDP\",", 6) != 0)
+  {
+    sim_reply(sim_config.connect_latency_ms, "%s\r\n\r\nOK\r\n", connect);
+    return;
+  }
+
+  /* The peer, then the local port and the policy when given */
+  sim_udp_close();
+  if (sim_parse_peer(&args[6], &p, &sim_udp_peer) != 0)
+  {
+    sim_client_link = -1;
+    sim_stats.errors++;
+    sim_reply(0, "\r\nERROR\r\n");
+    return;
+  }
+  if (*p == ',')
+  {
+    local.sin_port = htons((uint16_t)strtoul(p + 1, (char **)&p, 10));
+    if (*p == ',')
+    {
+      policy = strtol(p + 1, (char **)&p, 10);
+    }
+  }
+
+  sim_udp_fd = socket(AF_INET, SOCK_DGRAM, 0);
+  if ((sim_udp_fd < 0) || (policy < 0) || (policy > 2) ||
+      (bind(sim_udp_fd, (const struct sockaddr *)&local, sizeof(local)) != 0))
+  {
+    sim_udp_close();
+    sim_client_link = -1;
+    sim_stats.errors++;
+    sim_reply(0, "\r\nERROR\r\n");
+    return;
+  }
+  sim_udp_policy = (int32_t)policy;
+  sim_reply(sim_config.connect_latency_ms, "%s\r\n\r\nOK\r\n", connect);
+}
+
+static void sim_cipclose(char mode, const char* args)
+{
+  uint32_t link;
+
+  if (sim_mux != 0)
+  {
+    /* =<link>, 5 for all of them */
+    link = (uint32_t)strtoul(args, NULL, 10);
+    if ((mode != '=') || (link > SIM_LINKS) ||
+        ((link < SIM_LINKS) && (sim_link_fd[link] < 0) && ((int32_t)link != sim_client_link)))
+    {
+      sim_stats.errors++;
+      sim_reply(0, "\r\nERROR\r\n");
+      return;
+    }
+    if ((sim_client_link >= 0) && (((int32_t)link == sim_client_link) || (link == SIM_LINKS)))
+    {
+      sim_udp_close();
+      sim_reply(0, "%d,CLOSED\r\n", (int)sim_client_link);
+      sim_client_link = -1;
+    }
+    for (uint32_t i = 0; i < SIM_LINKS; i++)
+    {
+      if (((i == link) || (link == SIM_LINKS)) && (sim_link_fd[i] >= 0))
+      {
+        close(sim_link_fd[i]);
+        sim_link_fd[i] = -1;
+        sim_reply(0, "%u,CLOSED\r\n", i);
+      }
+    }
+    sim_reply(0, "\r\nOK\r\n");
+    return;
+  }
+
+  sim_udp_close();
+  sim_reply(0, "CLOSED\r\n\r\nOK\r\n");
+}
+
+/* [<link>,]<length>[,"<remote ip>",<remote port>], the link with AT+CIPMUX=1,
+   the remote for UDP only */
+static void sim_cipsend(char mode, const char* args)
+{
+  const char* p;
+  uint32_t length = (uint32_t)strtoul(args, (char **)&p, 10);
+
+  sim_data_link = -1;
+  if (sim_mux != 0)
+  {
+    uint32_t link = length;
+
+    if ((*p != ',') || (link >= SIM_LINKS) || ((sim_link_fd[link] < 0) && ((int32_t)link != sim_client_link)))
+    {
+      sim_stats.errors++;
+      sim_reply(0, "link is not valid\r\n\r\nERROR\r\n");
+      return;
+    }
+    length = (uint32_t)strtoul(p + 1, (char **)&p, 10);
+    if (length > SIM_DATAGRAM_SIZE)
+    {
+      length = 0;
+    }
+    /* The outgoing connection: to the UDP peer, as without AT+CIPMUX=1 */
+    sim_data_link = ((int32_t)link != sim_client_link) ? (int32_t)link : -1;
+  }
+
+  sim_data_peer_set = 0;
+  if ((*p == ',') && (sim_udp_fd >= 0) && (sim_parse_peer(p + 1, &p, &sim_data_peer) == 0))
+  {
+    sim_data_peer_set = 1;
+  }
+
+  if ((mode != '=') || (length == 0) || (*p != '\0') ||
+      ((sim_udp_fd >= 0) && (length > SIM_DATAGRAM_SIZE)))
+  {
+    sim_stats.errors++;
+    sim_reply(0, "\r\nERROR\r\n");
+    return;
+  }
+
+  sim_data_received = 0;
+  sim_data_expected = length;
+  sim_data_publish = 0;
+  sim_reply(0, "\r\nOK\r\n\r\n>");
+}
+
+/* 0 or 1, not while the server runs nor with a connection open */
+static void sim_cipmux(char mode, const char* args)
+{
+  uint8_t mux = (uint8_t)strtoul(args, NULL, 10);
+
+  if ((mode == '=') && (mux <= 1U) && ((mux != 0) || (sim_listen_fd < 0)) &&
+      (sim_udp_fd < 0) && (sim_client_link < 0))
+  {
+    sim_mux = mux;
+    sim_reply(0, "\r\nOK\r\n");
+    return;
+  }
+  sim_stats.errors++;
+  sim_reply(0, "\r\nERROR\r\n");
+}
+
+/* <count>: clients of the server at once, before it starts */
+static void sim_cipservermaxconn(char mode, const char* args)
+{
+  uint32_t count = (uint32_t)strtoul(args, NULL, 10);
+
+  if ((mode == '=') && (count >= 1U) && (count <= SIM_LINKS) && (sim_listen_fd < 0))
+  {
+    sim_max_conn = count;
+    sim_reply(0, "\r\nOK\r\n");
+    return;
+  }
+  sim_stats.errors++;
+  sim_reply(0, "\r\nERROR\r\n");
+}
+
+/* 1,<port> listens on 127.0.0.1 with AT+CIPMUX=1; 0[,<close all>] stops */
+static void sim_cipserver(char mode, const char* args)
+{
+  struct sockaddr_in local = { .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+  const char* p;
+  int one = 1;
+
+  if ((mode == '=') && (strtoul(args, (char **)&p, 10) == 0))
+  {
+    sim_server_close();
+    sim_reply(0, "\r\nOK\r\n");
+    return;
+  }
+
+  if ((mode != '=') || (sim_mux == 0) || (sim_listen_fd >= 0) || (*p != ','))
+  {
+    sim_stats.errors++;
+    sim_reply(0, "\r\nERROR\r\n");
+    return;
+  }
+
+  local.sin_port = htons((uint16_t)strtoul(p + 1, NULL, 10));
+  sim_listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+  setsockopt(sim_listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  if ((sim_listen_fd < 0) || (bind(sim_listen_fd, (const struct sockaddr *)&local, sizeof(local)) != 0) ||
+      (listen(sim_listen_fd, SIM_LINKS) != 0))
+  {
+    sim_server_close();
+    sim_stats.errors++;
+    sim_reply(0, "\r\nERROR\r\n");
+    return;
+  }
+  sim_reply(0, "\r\nOK\r\n");
+}
+
+/* 0,"<topic>",<length>,<qos>,<retain>: the topic may hold escaped quotes */
+/* 0,"<topic>","<data>",<qos>,<retain>: at QoS 1 the reply waits for the PUBACK */
+static void sim_mqttpub(char mode, const char* args)
+{
+  const char* retain = strrchr(args, ',');
+  const char* qos = NULL;
+  at_sim_link_step_t step;
+  uint32_t rtt_ms = (sim_link_step(&step) != 0) ? step.rtt_ms : 0;
+
+  /* The data may hold commas, the QoS is the last field but one */
+  for (const char* p = args; (retain != NULL) && (p < retain); p++)
+  {
+    if (*p == ',')
+    {
+      qos = p + 1;
+    }
+  }
+  /* ESP-AT takes AT+MQTTPUB lines of 256 bytes at most, "AT+MQTTPUB=" and CRLF included */
+  if ((mode != '=') || (qos == NULL) || ((*qos != '0') && (*qos != '1') && (*qos != '2')) ||
+      ((strlen(args) + 13U) > 256U))
+  {
+    sim_stats.errors++;
+    sim_reply(0, "\r\nERROR\r\n");
+    return;
+  }
+
+  sim_stats.publishes++;
+  if (*qos != '0')
+  {
+    sim_stats.publishes_qos1++;
+    sim_reply(rtt_ms, "\r\nOK\r\n");
+  }
+  else
+  {
+    /* Sent without waiting for the broker, retries on the air only */
+    sim_reply(rtt_ms / 4U, "\r\nOK\r\n");
+  }
+}
+
+static void sim_mqttpubraw(char mode, const char* args)
+{
+  const char* p = strchr(args, '"');
+  uint32_t length = 0;
+
+  if ((mode == '=') && (p != NULL))
+  {
+    for (p++; (*p != '\0') && (*p != '"'); p++)
+    {
+      if ((*p == '\\') && (p[1] != '\0'))
+      {
+        p++;
+      }
+    }
+    if ((p[0] == '"') && (p[1] == ','))
+    {
+      char* end;
+
+      length = (uint32_t)strtoul(&p[2], &end, 10);
+      sim_data_qos = ((end[0] == ',') && (end[1] != '0')) ? 1U : 0U;
+    }
+  }
+
+  if (length == 0)
+  {
+    sim_stats.errors++;
+    sim_reply(0, "\r\nERROR\r\n");
+    return;
+  }
+
+  sim_data_received = 0;
+  sim_data_expected = length;
+  sim_data_publish = 1;
+  sim_reply(0, "\r\nOK\r\n\r\n>");
+}
+
+/* 0,"<host>",<port>,<reconnect>: a host name is looked up first, an address must be the broker's */
+static void sim_mqttconn(char mode, const char* args)
+{
+  struct in_addr addr;
+  char host[64];
+  char broker_ip[16];
+
+  if (mode == '?')
+  {
+    sim_reply(0, "+MQTTCONN:0,4,1,\"sim-broker\",\"8883\",\"\",1\r\n\r\nOK\r\n");
+    return;
+  }
+
+  if ((strncmp(args, "0,", 2) != 0) || (sim_parse_host(&args[2], host, sizeof(host)) != 0))
+  {
+    sim_stats.errors++;
+    sim_reply(0, "\r\nERROR\r\n");
+    return;
+  }
+
+  pthread_mutex_lock(&sim_broker_lock);
+  memcpy(broker_ip, sim_broker_ip, sizeof(broker_ip));
+  pthread_mutex_unlock(&sim_broker_lock);
+
+  if (inet_pton(AF_INET, host, &addr) != 1)
+  {
+    sim_stats.dns_lookups++;
+    sim_reply(sim_config.dns_latency_ms + sim_config.connect_latency_ms,
+              "+MQTTCONNECTED:0,1,\"%s\",\"8883\",\"\",1\r\n\r\nOK\r\n", host);
+    return;
+  }
+
+  /* Nobody answers at an old address: the TCP connect times out */
+  if (strcmp(host, broker_ip) != 0)
+  {
+    sim_stats.errors++;
+    sim_reply(sim_config.connect_latency_ms, "\r\nERROR\r\n");
+    return;
+  }
+  sim_stats.connects_by_ip++;
+  sim_reply(sim_config.connect_latency_ms, "+MQTTCONNECTED:0,1,\"%s\",\"8883\",\"\",1\r\n\r\nOK\r\n", host);
+}
+
+/* 0,"<host name for TLS>", ERROR on firmware without it */
+static void sim_mqttsni(char mode, const char* args)
+{
+  char host[64];
+
+  if ((sim_config.no_sni != 0) || (mode != '=') || (strncmp(args, "0,", 2) != 0) ||
+      (sim_parse_host(&args[2], host, sizeof(host)) != 0))
+  {
+    sim_stats.errors++;
+    sim_reply(0, "\r\nERROR\r\n");
+    return;
+  }
+  sim_stats.sni_set++;
+  sim_reply(0, "\r\nOK\r\n");
+}
+
+/* "<host name>": every name is the broker's */
+static void sim_cipdomain(char mode, const char* args)
+{
+  char host[64];
+  char broker_ip[16];
+
+  if ((mode != '=') || (sim_parse_host(args, host, sizeof(host)) != 0) || (host[0] == '\0'))
+  {
+    sim_stats.errors++;
+    sim_reply(sim_config.dns_latency_ms, "DNS Fail\r\nERROR\r\n");
+    return;
+  }
+
+  sim_stats.dns_lookups++;
+  pthread_mutex_lock(&sim_broker_lock);
+  memcpy(broker_ip, sim_broker_ip, sizeof(broker_ip));
+  pthread_mutex_unlock(&sim_broker_lock);
+  sim_reply(sim_config.dns_latency_ms, "+CIPDOMAIN:\"%s\"\r\n\r\nOK\r\n", broker_ip);
+}
+
+static void sim_sleep(char mode, const char* args)
+{
+  if (mode == '?')
+  {
+    sim_reply(0, "+SLEEP:%u\r\n\r\nOK\r\n", sim_sleep_mode);
+    return;
+  }
+
+  sim_sleep_mode = (uint8_t)strtoul(args, NULL, 10);
+  sim_ok(mode, args);
+
+  /* Replies first: the module goes to sleep once idle */
+  if (sim_sleep_mode != 0)
+  {
+    sim_asleep = 1;
+    sim_stats.sleeps++;
+  }
+}
+
+/* The step of the link profile in force now, 0 without a profile */
+static int sim_link_step(at_sim_link_step_t* step)
+{
+  int ret = 0;
+
+  pthread_mutex_lock(&sim_profile_lock);
+  if (sim_profile_count != 0)
+  {
+    uint64_t elapsed = sim_now_ms() - sim_profile_start;
+    uint32_t i = 0;
+
+    while (((i + 1U) < sim_profile_count) && (sim_profile[i + 1U].at_ms <= elapsed))
+    {
+      i++;
+    }
+    *step = sim_profile[i];
+    ret = 1;
+  }
+  pthread_mutex_unlock(&sim_profile_lock);
+  return ret;
+}
+
+/* "<ip>",<port>: next after the port, 0 on success */
+static int sim_parse_peer(const char* p, const char** next, struct sockaddr_in* peer)
+{
+  char ip[16];
+  const char* quote;
+
+  if ((p[0] != '"') || ((quote = strchr(&p[1], '"')) == NULL) ||
+      ((size_t)(quote - p - 1) >= sizeof(ip)) || (quote[1] != ','))
+  {
+    return -1;
+  }
+  memcpy(ip, &p[1], (size_t)(quote - p - 1));
+  ip[quote - p - 1] = '\0';
+
+  memset(peer, 0, sizeof(*peer));
+  peer->sin_family = AF_INET;
+  peer->sin_port = htons((uint16_t)strtoul(&quote[2], (char **)next, 10));
+  return (inet_pton(AF_INET, ip, &peer->sin_addr) == 1) ? 0 : -1;
+}
+
+/* "<host>": the text between the quotes, 0 on success */
+static int sim_parse_host(const char* p, char* host, size_t size)
+{
+  const char* quote;
+
+  if ((p[0] != '"') || ((quote = strchr(&p[1], '"')) == NULL) || ((size_t)(quote - p - 1) >= size))
+  {
+    return -1;
+  }
+  memcpy(host, &p[1], (size_t)(quote - p - 1));
+  host[quote - p - 1] = '\0';
+  return 0;
+}
+
+/* "<text>" with \-escapes: the text unescaped, the character after the quote returned, NULL on error */
+static const char* sim_parse_quoted(const char* p, char* out, size_t size)
+{
+  size_t n = 0;
+
+  if (*p++ != '"')
+  {
+    return NULL;
+  }
+  while ((*p != '\0') && (*p != '"'))
+  {
+    if ((*p == '\\') && (p[1] != '\0'))
+    {
+      p++;
+    }
+    if ((n + 1U) >= size)
+    {
+      return NULL;
+    }
+    out[n++] = *p++;
+  }
+  out[n] = '\0';
+  return (*p == '"') ? (p + 1) : NULL;
+}
+
+/* The escapes of the module in quoted strings: ',', '"' and '\\' */
+static void sim_escape(const char* in, char* out, size_t size)
+{
+  size_t n = 0;
+
+  for (; (*in != '\0') && ((n + 2U) < size); in++)
+  {
+    if ((*in == ',') || (*in == '"') || (*in == '\\'))
+    {
+      out[n++] = '\\';
+    }
+    out[n++] = *in;
+  }
+  out[n] = '\0';
+}
+
+static void sim_udp_close(void)
+{
+  if (sim_udp_fd >= 0)
+  {
+    close(sim_udp_fd);
+    sim_udp_fd = -1;
+  }
+}
+
+/* A datagram for the module: +IPD to the MCU, the peer changed as the policy allows */
+static void sim_udp_receive(void)
+{
+  static uint8_t datagram[SIM_DATAGRAM_SIZE];     /* not sim_data: may come during an AT+CIPSEND */
+  struct sockaddr_in from;
+  socklen_t from_len = sizeof(from);
+  char header[32];
+  ssize_t n = recvfrom(sim_udp_fd, datagram, sizeof(datagram), 0, (struct sockaddr *)&from, &from_len);
+
+  if (n <= 0)
+  {
+    return;
+  }
+  if ((sim_udp_policy != 0) &&
+      ((from.sin_addr.s_addr != sim_udp_peer.sin_addr.s_addr) || (from.sin_port != sim_udp_peer.sin_port)))
+  {
+    sim_udp_peer = from;
+    sim_stats.peer_changes++;
+    if (sim_udp_policy == 1)
+    {
+      sim_udp_policy = 0;
+    }
+  }
+
+  if (sim_client_link >= 0)
+  {
+    snprintf(header, sizeof(header), "\r\n+IPD,%d,%d:", (int)sim_client_link, (int)n);
+  }
+  else
+  {
+    snprintf(header, sizeof(header), "\r\n+IPD,%d:", (int)n);
+  }
+  sim_write(header, strlen(header));
+  sim_write((const char *)datagram, (size_t)n);
+}
+
+static void sim_server_close(void)
+{
+  if (sim_listen_fd >= 0)
+  {
+    close(sim_listen_fd);
+    sim_listen_fd = -1;
+  }
+  for (uint32_t i = 0; i < SIM_LINKS; i++)
+  {
+    if (sim_link_fd[i] >= 0)
+    {
+      close(sim_link_fd[i]);
+      sim_link_fd[i] = -1;
+    }
+  }
+}
+
+/* A new client: the first free link, <link>,CONNECT to the MCU, up to
+   AT+CIPSERVERMAXCONN clients */
+static void sim_server_accept(void)
+{
+  char event[16];
+  uint32_t clients = 0;
+  int fd = accept(sim_listen_fd, NULL, NULL);
+
+  if (fd < 0)
+  {
+    return;
+  }
+  for (uint32_t i = 0; i < SIM_LINKS; i++)
+  {
+    clients += (sim_link_fd[i] >= 0) ? 1U : 0U;
+  }
+  for (uint32_t i = 0; (i < SIM_LINKS) && (clients < sim_max_conn); i++)
+  {
+    if ((sim_link_fd[i] < 0) && ((int32_t)i != sim_client_link))
+    {
+      sim_link_fd[i] = fd;
+      sim_stats.links_accepted++;
+      snprintf(event, sizeof(event), "%u,CONNECT", i);
+      at_sim_inject(event);
+      return;
+    }
+  }
+  close(fd);
+}
+
+/* Data of a client as +IPD,<link>,<length>:, or its end as <link>,CLOSED */
+static void sim_link_receive(uint32_t link)
+{
+  static uint8_t data[SIM_DATAGRAM_SIZE];
+  char header[32];
+  ssize_t n = read(sim_link_fd[link], data, sizeof(data));
+
+  if (n <= 0)
+  {
+    close(sim_link_fd[link]);
+    sim_link_fd[link] = -1;
+    snprintf(header, sizeof(header), "%u,CLOSED", link);
+    at_sim_inject(header);
+    return;
+  }
+
+  snprintf(header, sizeof(header), "\r\n+IPD,%u,%d:", link, (int)n);
+  sim_write(header, strlen(header));
+  sim_write((const char *)data, (size_t)n);
+}
@@ -0,0 +1,1140 @@
+/*
+ * bench_main.c
+ *
+ *  Benchmarks of the AT driver hot paths on the host: the RX ring callback,
+ *  send_at_cmd() (through esp8266_mqtt_subscribe()), recv_data() (through
+ *  esp8266_recv_data()), catch_incoming_message() and the publish formatting.
+ *
+ *  Responses are synthetic streams from 16 B to 8 KB, with and without
+ *  +MQTTSUBRECV URCs interleaved. The stream is handed to the DMA emulation
+ *  in bursts while the driver waits, single threaded, and a virtual clock
+ *  makes the final timeout immediate, so only driver CPU time is measured.
+ *
+ *  Every case runs on a painted stack to report its peak stack use (host
+ *  x86-64 frames: compare runs with each other, not with the target).
+ *
+ *  cmd_build compares the AT+MQTTPUB construction alone: at_builder.c
+ *  against the memset / sprintf / strlen sequence it replaced, and a
+ *  registered publish handle (only the payload is written per message).
+ *  publish/handle is the whole publish with a handle. Publishes send the
+ *  payload from the caller's memory (esp8266_io_sendv()); publish/raw has
+ *  a payload that needs escaping, published through AT+MQTTPUBRAW instead.
+ *
+ *  scan compares the search of the line delimiters ('\n' '>') in a stream
+ *  of responses: at_scan.c, four bytes at a time, against a byte loop.
+ *  escape compares at_builder_escaped() (runs found by at_scan_str() and
+ *  copied whole) against the byte loop it replaced, on a payload with one
+ *  character to escape per 32 bytes. Their bytes per ns are printed last.
+ *
+ *  query/cwlap runs esp8266_list_ap() on a scan result of size bytes, one
+ *  +CWLAP: line per access point: the response is parsed a line at a time
+ *  where it was received, so its stack does not grow with the size.
+ *
+ *  subrecv/frame reads SUBRECV_FRAMES +MQTTSUBRECV messages of size binary
+ *  bytes (at_sim_message_pattern(): '\0', CRLF, "OK", '>' included) with
+ *  esp8266_urc_read(), the stream arriving in RX_EVENT_SIZE bursts: each
+ *  payload is completed in place over several RX events, then compared.
+ *
+ *  The esp8266_async.c coroutines are compared with the blocking calls:
+ *  publish/async against publish/format, and op_switch/pt (size operations
+ *  waiting for the channel, each resumed and yielding again once per op)
+ *  against op_switch/ucontext (size round trips between two stacks, as a
+ *  task switch would do). For op_switch the ns/byte column is the cost of
+ *  one switch. The RAM each operation in progress needs is printed last.
+ *
+ *  usage: esp_bench [-o results.json] [-f filter] [-t target_ms]
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "main.h"
+#include "esp8266.h"
+#include "esp8266_io.h"
+#include "esp8266_async.h"
+#include "at_builder.h"
+#include "at_scan.h"
+#include "esp8266_urc.h"
+#include "at_sim.h"
+#include "metrics.h"
+#include "hal_stub.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+/* Private define ------------------------------------------------------------*/
+#define STREAM_MAX_SIZE         (1024 * 16)
+#define RX_BURST_SIZE           512
+#define RX_PENDING_LIMIT        (1024 * 4)
+#define BENCH_STACK_SIZE        (1024 * 1024)
+#define BENCH_STACK_PAINT       0xA5
+#define BENCH_ROUNDS            9
+#define BENCH_MAX_ITERATIONS    100000
+#define BENCH_MAX_RESULTS       128
+#define IPD_CHUNK_SIZE          1460
+#define OP_SWITCH_MAX           32
+#define SWITCH_STACK_SIZE       (1024 * 64)
+#define SUBRECV_FRAMES          8
+#define SUBRECV_MAX_SIZE        1024
+#define RX_EVENT_SIZE           256
+
+#define NOISE_LINE  "+CWLAP:(3,\"bench-ap\",-61,\"aa:bb:cc:dd:ee:ff\",6)\r\n"
+#define URC_LINE    "+MQTTSUBRECV:0,\"led/cmd\",16,0123456789abcdef\r\n"
+#define OK_TAIL     "\r\nOK\r\n"
+#define RAW_TAIL    "\r\nOK\r\n\r\n>\r\n+MQTTPUB:OK\r\n"
+#define SEND_TAIL   "\r\nOK\r\n\r\n>\r\nRecv 192 bytes\r\n\r\nSEND OK\r\n"
+#define LED_URC     "+MQTTSUBRECV:0,\"led/cmd\",6,LED ON"
+
+/* Private typedef -----------------------------------------------------------*/
+typedef struct bench_case bench_case_t;
+
+struct bench_case
+{
+  const char* name;
+  const char* variant;
+  uint32_t    size;                             /* stream or payload size */
+  uint32_t    urc_every;                        /* 0: no URC, N: every Nth line */
+  void        (*prepare)(bench_case_t* bc);
+  int         (*run)(bench_case_t* bc);         /* one operation, 0 on success */
+  uint32_t    bytes;                            /* bytes processed per operation */
+  void        (*cleanup)(bench_case_t* bc);     /* optional */
+};
+
+typedef struct
+{
+  const bench_case_t* bc;
+  uint32_t iterations;
+  double   ns_per_op;
+  uint32_t stack_bytes;
+  uint32_t ring_hwm;
+  int      failed;
+} bench_result_t;
+
+/* Private variables ---------------------------------------------------------*/
+UART_HandleTypeDef huart4;
+UART_HandleTypeDef huart2;
+
+static uint8_t stream[STREAM_MAX_SIZE];
+static uint32_t stream_length;
+static uint32_t stream_pos;
+static volatile int stream_armed;
+static uint8_t sink[STREAM_MAX_SIZE];
+static char payload[256];
+static uint32_t scan_expected;
+static uint32_t ap_expected;
+static uint8_t message[SUBRECV_MAX_SIZE];
+static char frame_buf[SUBRECV_MAX_SIZE + 128];
+static esp8266_urc_reader_t frame_reader;
+
+static uint8_t bench_stack[BENCH_STACK_SIZE] __attribute__((aligned(64)));
+static double target_ns = 20e6;
+
+static esp8266_op_t ops[OP_SWITCH_MAX + 1];
+static esp8266_pub_handle_t pub_handle;
+static ucontext_t switch_main;
+static ucontext_t switch_coroutine;
+static uint8_t switch_stack[SWITCH_STACK_SIZE];
+
+static bench_result_t results[BENCH_MAX_RESULTS];
+static uint32_t result_count;
+
+/* Private function prototypes -----------------------------------------------*/
+static void tx_hook(const uint8_t* data, uint32_t length);
+static void rx_pump(void);
+static void rx_flush(void);
+static void fill_lines(uint32_t length, uint32_t urc_every);
+static void append(const char* text);
+
+static void prepare_rx_ring(bench_case_t* bc);
+static int run_rx_ring(bench_case_t* bc);
+static void prepare_send_at_cmd(bench_case_t* bc);
+static int run_send_at_cmd(bench_case_t* bc);
+static void prepare_recv_data(bench_case_t* bc);
+static int run_recv_data(bench_case_t* bc);
+static void prepare_catch_incoming(bench_case_t* bc);
+static int run_catch_incoming(bench_case_t* bc);
+static void prepare_publish(bench_case_t* bc);
+static int run_publish(bench_case_t* bc);
+static void prepare_publish_raw(bench_case_t* bc);
+static int run_publish_raw(bench_case_t* bc);
+static void prepare_datagram(bench_case_t* bc);
+static int run_datagram(bench_case_t* bc);
+static int run_publish_async(bench_case_t* bc);
+static int run_cmd_sprintf(bench_case_t* bc);
+static int run_cmd_builder(bench_case_t* bc);
+static void prepare_handle(bench_case_t* bc);
+static int run_cmd_handle(bench_case_t* bc);
+static int run_publish_handle(bench_case_t* bc);
+static void prepare_scan(bench_case_t* bc);
+static int run_scan_bytes(bench_case_t* bc);
+static int run_scan_word(bench_case_t* bc);
+static void prepare_escape(bench_case_t* bc);
+static int run_escape_bytes(bench_case_t* bc);
+static int run_escape_builder(bench_case_t* bc);
+static void prepare_query_cwlap(bench_case_t* bc);
+static int run_query_cwlap(bench_case_t* bc);
+static void count_ap(const esp8266_ap_info_t* ap, void* context);
+static void prepare_subrecv(bench_case_t* bc);
+static int run_subrecv(bench_case_t* bc);
+static void prepare_op_switch(bench_case_t* bc);
+static int run_op_switch(bench_case_t* bc);
+static void cleanup_op_switch(bench_case_t* bc);
+static void prepare_ucontext(bench_case_t* bc);
+static int run_ucontext(bench_case_t* bc);
+static void switch_entry(void);
+
+static uint64_t cpu_now_ns(void);
+static void* bench_thread(void* arg);
+static void bench_run_case(bench_case_t* bc);
+static uint32_t stack_of(const char* name, const char* variant, uint32_t size);
+static double bytes_per_ns(const char* name, const char* variant, uint32_t size);
+static int write_json(const char* path);
+
+/* Private variables (case table) --------------------------------------------*/
+#define STREAM_SIZES(X, name, variant, urc, prep, run) \
+    X(name, variant, 16, urc, prep, run)               \
+    X(name, variant, 64, urc, prep, run)               \
+    X(name, variant, 256, urc, prep, run)              \
+    X(name, variant, 1024, urc, prep, run)             \
+    X(name, variant, 4096, urc, prep, run)             \
+    X(name, variant, 8064, urc, prep, run)
+
+#define CASE(name, variant, size, urc, prep, run)  { name, variant, size, urc, prep, run, 0, NULL },
+#define CASE_CLEANUP(name, variant, size, prep, run, cleanup) \
+    { name, variant, size, 0, prep, run, 0, cleanup },
+
+static bench_case_t cases[] =
+{
+  STREAM_SIZES(CASE, "rx_ring", "idle", 0, prepare_rx_ring, run_rx_ring)
+  STREAM_SIZES(CASE, "send_at_cmd", "plain", 0, prepare_send_at_cmd, run_send_at_cmd)
+  STREAM_SIZES(CASE, "send_at_cmd", "urc", 2, prepare_send_at_cmd, run_send_at_cmd)
+  STREAM_SIZES(CASE, "recv_data", "plain", 0, prepare_recv_data, run_recv_data)
+  STREAM_SIZES(CASE, "recv_data", "urc", 1, prepare_recv_data, run_recv_data)
+  STREAM_SIZES(CASE, "catch_incoming", "plain", 0, prepare_catch_incoming, run_catch_incoming)
+  STREAM_SIZES(CASE, "catch_incoming", "urc", 2, prepare_catch_incoming, run_catch_incoming)
+  CASE("publish", "format", 16, 0, prepare_publish, run_publish)
+  CASE("publish", "format", 64, 0, prepare_publish, run_publish)
+  CASE("publish", "format", 128, 0, prepare_publish, run_publish)
+  CASE("publish", "format", 192, 0, prepare_publish, run_publish)
+  CASE("publish", "async", 16, 0, prepare_publish, run_publish_async)
+  CASE("publish", "async", 64, 0, prepare_publish, run_publish_async)
+  CASE("publish", "async", 128, 0, prepare_publish, run_publish_async)
+  CASE("publish", "async", 192, 0, prepare_publish, run_publish_async)
+  CASE("publish", "handle", 16, 0, prepare_handle, run_publish_handle)
+  CASE("publish", "handle", 64, 0, prepare_handle, run_publish_handle)
+  CASE("publish", "handle", 128, 0, prepare_handle, run_publish_handle)
+  CASE("publish", "handle", 192, 0, prepare_handle, run_publish_handle)
+  CASE("publish", "raw", 16, 0, prepare_publish_raw, run_publish_raw)
+  CASE("publish", "raw", 192, 0, prepare_publish_raw, run_publish_raw)
+  CASE("datagram", "send", 16, 0, prepare_datagram, run_datagram)
+  CASE("datagram", "send", 192, 0, prepare_datagram, run_datagram)
+  CASE("cmd_build", "sprintf", 16, 0, prepare_publish, run_cmd_sprintf)
+  CASE("cmd_build", "sprintf", 192, 0, prepare_publish, run_cmd_sprintf)
+  CASE("cmd_build", "builder", 16, 0, prepare_publish, run_cmd_builder)
+  CASE("cmd_build", "builder", 192, 0, prepare_publish, run_cmd_builder)
+  CASE("cmd_build", "handle", 16, 0, prepare_handle, run_cmd_handle)
+  CASE("cmd_build", "handle", 192, 0, prepare_handle, run_cmd_handle)
+  STREAM_SIZES(CASE, "scan", "bytes", 0, prepare_scan, run_scan_bytes)
+  STREAM_SIZES(CASE, "scan", "word", 0, prepare_scan, run_scan_word)
+  CASE("escape", "bytes", 16, 0, prepare_escape, run_escape_bytes)
+  CASE("escape", "bytes", 192, 0, prepare_escape, run_escape_bytes)
+  CASE("escape", "builder", 16, 0, prepare_escape, run_escape_builder)
+  CASE("escape", "builder", 192, 0, prepare_escape, run_escape_builder)
+  CASE("query", "cwlap", 256, 0, prepare_query_cwlap, run_query_cwlap)
+  CASE("query", "cwlap", 8064, 0, prepare_query_cwlap, run_query_cwlap)
+  CASE("subrecv", "frame", 64, 0, prepare_subrecv, run_subrecv)
+  CASE("subrecv", "frame", 1024, 0, prepare_subrecv, run_subrecv)
+  CASE_CLEANUP("op_switch", "pt", 1, prepare_op_switch, run_op_switch, cleanup_op_switch)
+  CASE_CLEANUP("op_switch", "pt", 8, prepare_op_switch, run_op_switch, cleanup_op_switch)
+  CASE_CLEANUP("op_switch", "pt", 32, prepare_op_switch, run_op_switch, cleanup_op_switch)
+  CASE("op_switch", "ucontext", 1, 0, prepare_ucontext, run_ucontext)
+  CASE("op_switch", "ucontext", 32, 0, prepare_ucontext, run_ucontext)
+};
+
+/* Exported functions -------------------------------------------------------*/
+
+int main(int argc, char** argv)
+{
+  const char* output = NULL;
+  const char* filter = NULL;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "o:f:t:")) != -1)
+  {
+    switch (opt)
+    {
+      case 'o': output = optarg; break;
+      case 'f': filter = optarg; break;
+      case 't': target_ns = strtod(optarg, NULL) * 1e6; break;
+      default:
+        fprintf(stderr, "usage: %s [-o results.json] [-f filter] [-t target_ms]\n", argv[0]);
+        return 2;
+    }
+  }
+
+  hal_stub_attach_uart(&huart4, -1);
+  hal_stub_set_tx_hook(tx_hook);
+  hal_stub_set_rx_pump(rx_pump);
+  hal_stub_set_virtual_clock(DEFAULT_TIME_OUT);
+  wifi_uart_handle = &huart4;
+  metrics_init();
+
+  if (esp8266_io_init() < 0)
+  {
+    fprintf(stderr, "esp8266_io_init() failed\n");
+    return 1;
+  }
+
+  printf("%-16s %-7s %6s %10s %12s %10s %8s %8s\n",
+         "case", "variant", "size", "iters", "ns/op", "ns/byte", "stack", "ring");
+
+  for (uint32_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+  {
+    char label[64];
+
+    snprintf(label, sizeof(label), "%s/%s/%u", cases[i].name, cases[i].variant, cases[i].size);
+    if ((filter != NULL) && (strstr(label, filter) == NULL))
+    {
+      continue;
+    }
+    bench_run_case(&cases[i]);
+  }
+
+  printf("RAM per operation in progress: async %u B (esp8266_op_t) + %u B shared once;"
+         " blocking: one stack each, publish peak %u B (host frames)\n",
+         (uint32_t)sizeof(esp8266_op_t), (uint32_t)MAX_AT_CMD_SIZE, stack_of("publish", "format", 192));
+  printf("Bytes per ns: scan 8064 B bytes %.2f word %.2f; escape 192 B bytes %.2f builder %.2f;"
+         " subrecv 1024 B %.2f\n",
+         bytes_per_ns("scan", "bytes", 8064), bytes_per_ns("scan", "word", 8064),
+         bytes_per_ns("escape", "bytes", 192), bytes_per_ns("escape", "builder", 192),
+         bytes_per_ns("subrecv", "frame", 1024));
+
+  if ((output != NULL) && (write_json(output) != 0))
+  {
+    fprintf(stderr, "cannot write %s\n", output);
+    return 1;
+  }
+
+  for (uint32_t i = 0; i < result_count; i++)
+  {
+    if (results[i].failed)
+    {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/**
+  * @brief  Host replacement of the error trap of main.c.
+  */
+void Error_Handler(void)
+{
+  fprintf(stderr, "Error_Handler() reached\n");
+  exit(1);
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  A command went out: its scripted response starts arriving.
+  */
+static void tx_hook(const uint8_t* data, uint32_t length)
+{
+  (void)data;
+  (void)length;
+  stream_pos = 0;
+  stream_armed = 1;
+}
+
+/**
+  * @brief  Deliver the next burst of the armed stream while the ring has room.
+  */
+static void rx_pump(void)
+{
+  uint32_t burst;
+
+  if ((stream_armed == 0) || (esp8266_io_rx_pending() >= RX_PENDING_LIMIT))
+  {
+    return;
+  }
+
+  burst = stream_length - stream_pos;
+  if (burst > RX_BURST_SIZE)
+  {
+    burst = RX_BURST_SIZE;
+  }
+
+  /* Disarm first, hal_stub_dma_rx() does not call HAL_GetTick() but keep the
+     pump reentrancy safe anyway */
+  stream_armed = 0;
+  hal_stub_dma_rx(&stream[stream_pos], burst);
+  stream_pos += burst;
+  stream_armed = (stream_pos < stream_length) ? 1 : 0;
+}
+
+/**
+  * @brief  Drop whatever an operation left unread.
+  */
+static void rx_flush(void)
+{
+  uint8_t c;
+
+  stream_armed = 0;
+  while (esp8266_io_rx_pending() != 0)
+  {
+    esp8266_io_recv(&c, 1);
+  }
+}
+
+static void append(const char* text)
+{
+  uint32_t length = (uint32_t)strlen(text);
+
+  memcpy(&stream[stream_length], text, length);
+  stream_length += length;
+}
+
+/**
+  * @brief  Fill the stream with response lines up to length bytes.
+  * @param  urc_every: one line out of urc_every is a URC, 0 for none.
+  */
+static void fill_lines(uint32_t length, uint32_t urc_every)
+{
+  uint32_t line = 0;
+
+  while (1)
+  {
+    const char* text = ((urc_every != 0) && ((line % urc_every) == 0)) ? URC_LINE : NOISE_LINE;
+    uint32_t text_length = (uint32_t)strlen(text);
+
+    if ((stream_length + text_length) > length)
+    {
+      break;
+    }
+    append(text);
+    line++;
+  }
+
+  /* Pad to the exact size with bytes no token can match */
+  while (stream_length < length)
+  {
+    stream[stream_length++] = '.';
+  }
+}
+
+static void prepare_rx_ring(bench_case_t* bc)
+{
+  stream_length = 0;
+  fill_lines(bc->size, bc->urc_every);
+  bc->bytes = bc->size;
+}
+
+/**
+  * @brief  DMA bursts followed by IDLE events, drained by esp8266_io_recv().
+  */
+static int run_rx_ring(bench_case_t* bc)
+{
+  uint32_t offset = 0;
+
+  while (offset < bc->size)
+  {
+    uint32_t burst = bc->size - offset;
+
+    if (burst > 2048)
+    {
+      burst = 2048;
+    }
+    hal_stub_dma_rx(&stream[offset], burst);
+    if (esp8266_io_recv(&sink[offset], burst) != (int32_t)burst)
+    {
+      return -1;
+    }
+    offset += burst;
+  }
+
+  return memcmp(sink, stream, bc->size);
+}
+
+static void prepare_send_at_cmd(bench_case_t* bc)
+{
+  stream_length = 0;
+  fill_lines(bc->size - (sizeof(OK_TAIL) - 1), bc->urc_every);
+  append(OK_TAIL);
+  bc->bytes = stream_length;
+}
+
+static int run_send_at_cmd(bench_case_t* bc)
+{
+  (void)bc;
+  return (esp8266_mqtt_subscribe("led/cmd", 1) == ESP8266_OK) ? 0 : -1;
+}
+
+/**
+  * @brief  "+IPD,<n>:" framed chunks of at most 1460 bytes, size payload bytes.
+  */
+static void prepare_recv_data(bench_case_t* bc)
+{
+  uint32_t remaining = bc->size;
+  uint32_t line = 0;
+
+  stream_length = 0;
+  while (remaining != 0)
+  {
+    uint32_t chunk = (remaining > IPD_CHUNK_SIZE) ? IPD_CHUNK_SIZE : remaining;
+    char header[32];
+
+    if ((bc->urc_every != 0) && ((line++ % bc->urc_every) == 0))
+    {
+      append(URC_LINE);
+    }
+    snprintf(header, sizeof(header), "\r\n+IPD,%u:", chunk);
+    append(header);
+    for (uint32_t i = 0; i < chunk; i++)
+    {
+      stream[stream_length++] = (uint8_t)('a' + (i % 26));
+    }
+    remaining -= chunk;
+  }
+  bc->bytes = stream_length;
+}
+
+static int run_recv_data(bench_case_t* bc)
+{
+  uint32_t length = 0;
+
+  stream_pos = 0;
+  stream_armed = 1;
+  if (esp8266_recv_data(sink, sizeof(sink), &length) != ESP8266_OK)
+  {
+    return -1;
+  }
+  return (length == bc->size) ? 0 : -1;
+}
+
+static void prepare_catch_incoming(bench_case_t* bc)
+{
+  uint32_t tail = sizeof(LED_URC) - 1;
+
+  /* The smallest sizes are just the URC */
+  stream_length = 0;
+  fill_lines((bc->size > tail) ? (bc->size - tail) : 0, bc->urc_every);
+  append(LED_URC);
+  bc->bytes = stream_length;
+}
+
+static int run_catch_incoming(bench_case_t* bc)
+{
+  (void)bc;
+  stream_pos = 0;
+  stream_armed = 1;
+  return (catch_incoming_message(sink, MAX_BUFFER_SIZE, (const uint8_t *)"LED ON") == ESP8266_OK) ? 0 : -1;
+}
+
+static void prepare_publish(bench_case_t* bc)
+{
+  memset(payload, 'p', bc->size);
+  payload[bc->size] = '\0';
+  stream_length = 0;
+  append(OK_TAIL);
+  bc->bytes = bc->size;
+}
+
+static int run_publish(bench_case_t* bc)
+{
+  (void)bc;
+  return (esp8266_mqtt_publish("topic/esp32at", payload, 1, 0) == ESP8266_OK) ? 0 : -1;
+}
+
+/**
+  * @brief  A payload with a comma: AT+MQTTPUBRAW, then the payload after
+  *         the prompt. Both responses are in the stream, the second one is
+  *         read after the payload went out.
+  */
+static void prepare_publish_raw(bench_case_t* bc)
+{
+  prepare_publish(bc);
+  payload[bc->size / 2] = ',';
+  stream_length = 0;
+  append(RAW_TAIL);
+}
+
+static int run_publish_raw(bench_case_t* bc)
+{
+  (void)bc;
+  rx_flush();
+  return (esp8266_mqtt_publish("topic/esp32at", payload, 1, 0) == ESP8266_OK) ? 0 : -1;
+}
+
+/**
+  * @brief  AT+CIPSEND over UDP, then the payload after the prompt; no MQTT
+  *         framing nor acknowledgement from a peer.
+  */
+static void prepare_datagram(bench_case_t* bc)
+{
+  prepare_publish(bc);
+  stream_length = 0;
+  append(SEND_TAIL);
+}
+
+static int run_datagram(bench_case_t* bc)
+{
+  rx_flush();
+  return (esp8266_send_datagram((const uint8_t *)payload, bc->size, NULL, 0) == ESP8266_OK) ? 0 : -1;
+}
+
+/**
+  * @brief  Same publish as a coroutine, polled to completion.
+  */
+static int run_publish_async(bench_case_t* bc)
+{
+  (void)bc;
+  esp8266_mqtt_publish_async(&ops[0], "topic/esp32at", payload, 1, 0);
+  while (esp8266_op_poll(&ops[0]) == ESP8266_FALSE)
+  {
+  }
+  return (ops[0].status == ESP8266_OK) ? 0 : -1;
+}
+
+/**
+  * @brief  The AT+MQTTPUB construction of esp8266_mqtt_publish() before
+  *         at_builder.c, without sending.
+  */
+static int run_cmd_sprintf(bench_case_t* bc)
+{
+  static char cmd[MAX_AT_CMD_SIZE];
+  volatile size_t length;
+
+  (void)bc;
+  memset(cmd, '\0', MAX_AT_CMD_SIZE);
+  sprintf(cmd, "AT+MQTTPUB=0,\"%s\",\"%s\",%u,%u%c%c", "topic/esp32at", payload, 1, 0, '\r', '\n');
+  length = strlen(cmd);
+  return (length != 0) ? 0 : -1;
+}
+
+/**
+  * @brief  The same command with at_builder.c.
+  */
+static int run_cmd_builder(bench_case_t* bc)
+{
+  static char cmd[MAX_AT_CMD_SIZE];
+  at_builder_t b;
+
+  (void)bc;
+  at_builder_init(&b, cmd, sizeof(cmd));
+  at_builder_lit(&b, "AT+MQTTPUB=0,");
+  at_builder_quoted(&b, "topic/esp32at");
+  at_builder_char(&b, ',');
+  at_builder_quoted(&b, payload);
+  at_builder_char(&b, ',');
+  at_builder_uint(&b, 1);
+  at_builder_char(&b, ',');
+  at_builder_uint(&b, 0);
+  at_builder_crlf(&b);
+  return (at_builder_finish(&b) > 0) ? 0 : -1;
+}
+
+static void prepare_handle(bench_case_t* bc)
+{
+  prepare_publish(bc);
+  esp8266_mqtt_publish_register(&pub_handle, "topic/esp32at", 1, 0);
+}
+
+/**
+  * @brief  The same command from a registered handle.
+  */
+static int run_cmd_handle(bench_case_t* bc)
+{
+  static char cmd[MAX_AT_CMD_SIZE];
+  at_builder_t b;
+
+  (void)bc;
+  at_builder_init(&b, cmd, sizeof(cmd));
+  at_builder_mem(&b, pub_handle.prefix, pub_handle.prefix_length);
+  at_builder_escaped(&b, payload);
+  at_builder_mem(&b, pub_handle.suffix, pub_handle.suffix_length);
+  return (at_builder_finish(&b) > 0) ? 0 : -1;
+}
+
+static int run_publish_handle(bench_case_t* bc)
+{
+  (void)bc;
+  return (esp8266_mqtt_publish_handle(&pub_handle, payload) == ESP8266_OK) ? 0 : -1;
+}
+
+/**
+  * @brief  Response lines, counting the delimiters each variant must find.
+  */
+static void prepare_scan(bench_case_t* bc)
+{
+  stream_length = 0;
+  fill_lines(bc->size, 0);
+  bc->bytes = bc->size;
+
+  scan_expected = 0;
+  for (uint32_t i = 0; i < stream_length; i++)
+  {
+    scan_expected += ((stream[i] == '\n') || (stream[i] == '>')) ? 1U : 0U;
+  }
+}
+
+static int run_scan_bytes(bench_case_t* bc)
+{
+  uint32_t found = 0;
+
+  for (uint32_t i = 0; i < bc->size; i++)
+  {
+    if ((stream[i] == '\n') || (stream[i] == '>'))
+    {
+      found++;
+    }
+  }
+  return (found == scan_expected) ? 0 : -1;
+}
+
+static int run_scan_word(bench_case_t* bc)
+{
+  uint32_t found = 0;
+  uint32_t i = 0;
+
+  while (1)
+  {
+    i += at_scan(&stream[i], bc->size - i, &at_scan_line);
+    if (i == bc->size)
+    {
+      break;
+    }
+    found++;
+    i++;
+  }
+  return (found == scan_expected) ? 0 : -1;
+}
+
+/**
+  * @brief  A payload with one ',' per 32 bytes.
+  */
+static void prepare_escape(bench_case_t* bc)
+{
+  memset(payload, 'p', bc->size);
+  for (uint32_t i = 31; i < bc->size; i += 32)
+  {
+    payload[i] = ',';
+  }
+  payload[bc->size] = '\0';
+  bc->bytes = bc->size;
+}
+
+/**
+  * @brief  The byte loop at_builder_escaped() used before at_scan.c.
+  */
+static int run_escape_bytes(bench_case_t* bc)
+{
+  static char cmd[MAX_AT_CMD_SIZE];
+  const char* s = payload;
+  char* out = cmd;
+  char* end = &cmd[sizeof(cmd) - 1];
+  char c;
+
+  (void)bc;
+  while ((c = *s++) != '\0')
+  {
+    if ((c == '"') || (c == ',') || (c == '\\'))
+    {
+      if (out == end)
+      {
+        return -1;
+      }
+      *out++ = '\\';
+    }
+    if (out == end)
+    {
+      return -1;
+    }
+    *out++ = c;
+  }
+  *out = '\0';
+  return (out != cmd) ? 0 : -1;
+}
+
+static int run_escape_builder(bench_case_t* bc)
+{
+  static char cmd[MAX_AT_CMD_SIZE];
+  at_builder_t b;
+
+  (void)bc;
+  at_builder_init(&b, cmd, sizeof(cmd));
+  at_builder_escaped(&b, payload);
+  return (at_builder_finish(&b) > 0) ? 0 : -1;
+}
+
+/**
+  * @brief  +CWLAP: lines up to size bytes, then OK.
+  */
+static void prepare_query_cwlap(bench_case_t* bc)
+{
+  char line[96];
+
+  stream_length = 0;
+  ap_expected = 0;
+  while (1)
+  {
+    int n = snprintf(line, sizeof(line), "+CWLAP:(3,\"ap\\,%u\",-%u,\"aa:bb:cc:dd:ee:%02x\",%u,-1,-1,4,4,7,0)\r\n",
+                     ap_expected, 40U + (ap_expected % 50U), ap_expected & 0xFFU, 1U + (ap_expected % 13U));
+
+    if ((stream_length + (uint32_t)n + (sizeof(OK_TAIL) - 1)) > bc->size)
+    {
+      break;
+    }
+    append(line);
+    ap_expected++;
+  }
+  append(OK_TAIL);
+  bc->bytes = stream_length;
+}
+
+static int run_query_cwlap(bench_case_t* bc)
+{
+  uint32_t count = 0;
+
+  (void)bc;
+  if (esp8266_list_ap(count_ap, &count) != ESP8266_OK)
+  {
+    return -1;
+  }
+  return (count == ap_expected) ? 0 : -1;
+}
+
+static void count_ap(const esp8266_ap_info_t* ap, void* context)
+{
+  (void)ap;
+  (*(uint32_t *)context)++;
+}
+
+static void prepare_subrecv(bench_case_t* bc)
+{
+  char header[64];
+
+  at_sim_message_pattern(message, bc->size);
+  snprintf(header, sizeof(header), "+MQTTSUBRECV:0,\"led/cmd\",%u,", bc->size);
+
+  stream_length = 0;
+  for (uint32_t i = 0; i < SUBRECV_FRAMES; i++)
+  {
+    append(header);
+    memcpy(&stream[stream_length], message, bc->size);
+    stream_length += bc->size;
+    append("\r\n");
+  }
+  esp8266_urc_init(&frame_reader, frame_buf, sizeof(frame_buf));
+  bc->bytes = SUBRECV_FRAMES * bc->size;
+}
+
+/**
+  * @brief  RX events of RX_EVENT_SIZE bytes, each drained by the reader as
+  *         the RX task does; every payload is checked byte for byte.
+  */
+static int run_subrecv(bench_case_t* bc)
+{
+  esp8266_urc_t urc;
+  uint32_t count = 0;
+
+  for (uint32_t offset = 0; offset < stream_length; offset += RX_EVENT_SIZE)
+  {
+    uint32_t burst = stream_length - offset;
+
+    hal_stub_dma_rx(&stream[offset], (burst < RX_EVENT_SIZE) ? burst : RX_EVENT_SIZE);
+    while (esp8266_urc_read(&frame_reader, &urc) != 0)
+    {
+      if ((urc.type != ESP8266_URC_SUBRECV) || (urc.truncated != 0) || (urc.data_length != bc->size) ||
+          (memcmp(urc.data, message, bc->size) != 0))
+      {
+        return -1;
+      }
+      count++;
+    }
+  }
+
+  return (count == SUBRECV_FRAMES) ? 0 : -1;
+}
+
+/**
+  * @brief  ops[0] takes the channel and waits for a response that does not
+  *         come; ops[1..size] queue behind it.
+  */
+static void prepare_op_switch(bench_case_t* bc)
+{
+  /* Real time: the owner must not time out while the others are polled */
+  hal_stub_set_virtual_clock(0);
+  stream_length = 0;
+
+  for (uint32_t i = 0; i <= bc->size; i++)
+  {
+    esp8266_mqtt_publish_async(&ops[i], "topic/esp32at", "switch", 1, 0);
+    esp8266_op_poll(&ops[i]);
+  }
+  bc->bytes = bc->size;
+}
+
+/**
+  * @brief  Resume every waiting operation once; each yields straight back.
+  */
+static int run_op_switch(bench_case_t* bc)
+{
+  for (uint32_t i = 1; i <= bc->size; i++)
+  {
+    if (esp8266_op_poll(&ops[i]) != ESP8266_FALSE)
+    {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+/**
+  * @brief  Answer OK to every command and complete all the operations.
+  */
+static void cleanup_op_switch(bench_case_t* bc)
+{
+  hal_stub_set_virtual_clock(DEFAULT_TIME_OUT);
+  stream_length = 0;
+  append(OK_TAIL);
+  stream_pos = 0;
+  stream_armed = 1;
+
+  for (uint32_t i = 0; i <= bc->size; i++)
+  {
+    while (esp8266_op_poll(&ops[i]) == ESP8266_FALSE)
+    {
+    }
+  }
+  rx_flush();
+}
+
+static void prepare_ucontext(bench_case_t* bc)
+{
+  getcontext(&switch_coroutine);
+  switch_coroutine.uc_stack.ss_sp = switch_stack;
+  switch_coroutine.uc_stack.ss_size = sizeof(switch_stack);
+  switch_coroutine.uc_link = NULL;
+  makecontext(&switch_coroutine, switch_entry, 0);
+  bc->bytes = bc->size;
+}
+
+/**
+  * @brief  size round trips to a second stack and back.
+  */
+static int run_ucontext(bench_case_t* bc)
+{
+  for (uint32_t i = 0; i < bc->size; i++)
+  {
+    if (swapcontext(&switch_main, &switch_coroutine) != 0)
+    {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+static void switch_entry(void)
+{
+  while (1)
+  {
+    swapcontext(&switch_coroutine, &switch_main);
+  }
+}
+
+/**
+  * @brief  CPU time of the calling thread: time the thread is preempted on a
+  *         loaded machine does not count.
+  */
+static uint64_t cpu_now_ns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/**
+  * @brief  Time one case: calibrate the iteration count, keep the best round.
+  */
+static void* bench_thread(void* arg)
+{
+  bench_result_t* result = (bench_result_t *)arg;
+  bench_case_t* bc = (bench_case_t *)result->bc;
+  uint64_t start;
+  double once;
+  double best = 0;
+
+  bc->prepare(bc);
+
+  start = cpu_now_ns();
+  if (bc->run(bc) != 0)
+  {
+    result->failed = 1;
+    return NULL;
+  }
+  rx_flush();
+  once = (double)(cpu_now_ns() - start);
+
+  result->iterations = (once > 0) ? (uint32_t)(target_ns / once) : BENCH_MAX_ITERATIONS;
+  if (result->iterations < 3)
+  {
+    result->iterations = 3;
+  }
+  if (result->iterations > BENCH_MAX_ITERATIONS)
+  {
+    result->iterations = BENCH_MAX_ITERATIONS;
+  }
+
+  for (uint32_t round = 0; round < BENCH_ROUNDS; round++)
+  {
+    double elapsed;
+
+    start = cpu_now_ns();
+    for (uint32_t i = 0; i < result->iterations; i++)
+    {
+      if (bc->run(bc) != 0)
+      {
+        result->failed = 1;
+        return NULL;
+      }
+      rx_flush();
+    }
+    elapsed = (double)(cpu_now_ns() - start) / result->iterations;
+    if ((round == 0) || (elapsed < best))
+    {
+      best = elapsed;
+    }
+  }
+
+  result->ns_per_op = best;
+  if (bc->cleanup != NULL)
+  {
+    bc->cleanup(bc);
+  }
+  return NULL;
+}
+
+/**
+  * @brief  Run a case on a painted stack and record the result.
+  */
+static void bench_run_case(bench_case_t* bc)
+{
+  bench_result_t* result;
+  pthread_attr_t attr;
+  pthread_t thread;
+  uint32_t unused = 0;
+
+  if (result_count == BENCH_MAX_RESULTS)
+  {
+    return;
+  }
+  result = &results[result_count++];
+  memset(result, 0, sizeof(*result));
+  result->bc = bc;
+
+  memset(bench_stack, BENCH_STACK_PAINT, sizeof(bench_stack));
+  METRIC_SET(METRIC_RING_HWM, 0);
+
+  pthread_attr_init(&attr);
+  pthread_attr_setstack(&attr, bench_stack, sizeof(bench_stack));
+  if (pthread_create(&thread, &attr, bench_thread, result) != 0)
+  {
+    result->failed = 1;
+  }
+  else
+  {
+    pthread_join(thread, NULL);
+  }
+  pthread_attr_destroy(&attr);
+
+  /* The stack grows down: count the untouched bytes from the bottom */
+  while ((unused < sizeof(bench_stack)) && (bench_stack[unused] == BENCH_STACK_PAINT))
+  {
+    unused++;
+  }
+  result->stack_bytes = (uint32_t)sizeof(bench_stack) - unused;
+  result->ring_hwm = metric_values[METRIC_RING_HWM];
+
+  if (result->failed)
+  {
+    printf("%-16s %-7s %6u FAILED\n", bc->name, bc->variant, bc->size);
+    return;
+  }
+
+  printf("%-16s %-7s %6u %10u %12.1f %10.3f %8u %8u\n",
+         bc->name, bc->variant, bc->size, result->iterations, result->ns_per_op,
+         result->ns_per_op / bc->bytes, result->stack_bytes, result->ring_hwm);
+  fflush(stdout);
+}
+
+/**
+  * @brief  Peak stack of a case already run, 0 if it was filtered out.
+  */
+static uint32_t stack_of(const char* name, const char* variant, uint32_t size)
+{
+  for (uint32_t i = 0; i < result_count; i++)
+  {
+    const bench_case_t* bc = results[i].bc;
+
+    if ((strcmp(bc->name, name) == 0) && (strcmp(bc->variant, variant) == 0) && (bc->size == size))
+    {
+      return results[i].stack_bytes;
+    }
+  }
+  return 0;
+}
+
+/**
+  * @brief  Throughput of a case already run, 0 if it was filtered out.
+  */
+static double bytes_per_ns(const char* name, const char* variant, uint32_t size)
+{
+  for (uint32_t i = 0; i < result_count; i++)
+  {
+    const bench_result_t* r = &results[i];
+
+    if ((strcmp(r->bc->name, name) == 0) && (strcmp(r->bc->variant, variant) == 0) &&
+        (r->bc->size == size) && (r->ns_per_op > 0))
+    {
+      return r->bc->bytes / r->ns_per_op;
+    }
+  }
+  return 0;
+}
+
+/**
+  * @brief  Machine readable results, see Tools/bench_compare.py.
+  */
+static int write_json(const char* path)
+{
+  FILE* f = fopen(path, "w");
+
+  if (f == NULL)
+  {
+    return -1;
+  }
+
+  fprintf(f, "{\n  \"schema\": 1,\n  \"cases\": [\n");
+  for (uint32_t i = 0; i < result_count; i++)
+  {
+    const bench_result_t* r = &results[i];
+
+    fprintf(f, "    {\"name\": \"%s\", \"variant\": \"%s\", \"size\": %u, \"bytes\": %u, "
+               "\"iterations\": %u, \"ns_per_op\": %.1f, \"ns_per_byte\": %.3f, "
+               "\"stack_bytes\": %u, \"ring_hwm\": %u, \"failed\": %s}%s\n",
+            r->bc->name, r->bc->variant, r->bc->size, r->bc->bytes,
+            r->iterations, r->ns_per_op, (r->bc->bytes != 0) ? (r->ns_per_op / r->bc->bytes) : 0.0,
+            r->stack_bytes, r->ring_hwm, r->failed ? "true" : "false",
+            (i + 1 < result_count) ? "," : "");
+  }
+  fprintf(f, "  ]\n}\n");
+
+  return fclose(f);
+}
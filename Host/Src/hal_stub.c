@@ -0,0 +1,442 @@
+/*
+ * hal_stub.c
+ *
+ *  Host implementation of the HAL subset used by the firmware. The UART is a
+ *  file descriptor (one end of a socketpair to the AT simulator); reception is
+ *  emulated like the circular DMA + IDLE line detection used on target: bytes
+ *  land in the buffer given to HAL_UARTEx_ReceiveToIdle_DMA() and
+ *  HAL_UARTEx_RxEventCallback() is called from a separate thread (the "ISR")
+ *  with the DMA write position after each burst. In polling mode there is no
+ *  such thread: the caller delivers the bytes with hal_stub_poll_rx(), e.g.
+ *  from a FreeRTOS task standing in for the ISR (the FreeRTOS POSIX port does
+ *  not allow kernel calls from foreign threads).
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "hal_stub.h"
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Private define ------------------------------------------------------------*/
+#define RX_READ_CHUNK           512
+
+/* Private variables ---------------------------------------------------------*/
+GPIO_TypeDef host_gpio[8];
+DWT_Type host_dwt;
+CoreDebug_Type host_core_debug;
+ITM_Type host_itm;
+uint32_t SystemCoreClock = 180000000U;
+
+static uint64_t clock_origin_ns;
+static uint32_t virtual_step_ms;
+static volatile uint32_t virtual_ms;
+
+static UART_HandleTypeDef* rx_uart;
+static uint8_t* rx_dma_buffer;
+static uint16_t rx_dma_size;
+static uint16_t rx_dma_pos;
+static pthread_t rx_thread;
+static volatile int rx_thread_running;
+static int rx_polling;
+
+static hal_stub_tx_hook_t tx_hook;
+static hal_stub_rx_pump_t rx_pump;
+
+static pthread_mutex_t wfi_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wfi_cond = PTHREAD_COND_INITIALIZER;
+
+/* Private function prototypes -----------------------------------------------*/
+static void* rx_thread_main(void* arg);
+
+/* Exported functions -------------------------------------------------------*/
+
+/**
+  * @brief  Monotonic host time.
+  * @retval Nanoseconds since the first call.
+  */
+uint64_t hal_stub_now_ns(void)
+{
+  struct timespec ts;
+  uint64_t now;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  now = (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+  if (clock_origin_ns == 0)
+  {
+    clock_origin_ns = now;
+  }
+  return now - clock_origin_ns;
+}
+
+/**
+  * @brief  DWT cycle counter emulation, in target cycles (SystemCoreClock).
+  */
+DWT_Type* host_dwt_sample(void)
+{
+  host_dwt.CYCCNT = (uint32_t)((hal_stub_now_ns() * (SystemCoreClock / 1000000U)) / 1000U);
+  return &host_dwt;
+}
+
+/**
+  * @brief  Wait for an "interrupt": the next RX burst or 1 ms, like SysTick.
+  */
+void host_wfi(void)
+{
+  struct timespec ts;
+
+  if (virtual_step_ms != 0)
+  {
+    hal_stub_advance_ms(1);
+    return;
+  }
+
+  if (rx_polling != 0)
+  {
+    if (hal_stub_poll_rx() == 0)
+    {
+      usleep(1000);
+    }
+    return;
+  }
+
+  clock_gettime(CLOCK_REALTIME, &ts);
+  ts.tv_nsec += 1000000L;
+  if (ts.tv_nsec >= 1000000000L)
+  {
+    ts.tv_sec++;
+    ts.tv_nsec -= 1000000000L;
+  }
+
+  pthread_mutex_lock(&wfi_lock);
+  pthread_cond_timedwait(&wfi_cond, &wfi_lock, &ts);
+  pthread_mutex_unlock(&wfi_lock);
+}
+
+/**
+  * @brief  Use a virtual clock that moves by step_ms on every HAL_GetTick().
+  * @details Lets timeouts expire without sleeping; 0 goes back to real time.
+  */
+void hal_stub_set_virtual_clock(uint32_t step_ms)
+{
+  virtual_step_ms = step_ms;
+}
+
+/**
+  * @brief  Move the virtual clock forward.
+  */
+void hal_stub_advance_ms(uint32_t ms)
+{
+  virtual_ms += ms;
+}
+
+uint32_t HAL_GetTick(void)
+{
+  if (rx_pump != NULL)
+  {
+    rx_pump();
+  }
+
+  if (virtual_step_ms != 0)
+  {
+    virtual_ms += virtual_step_ms;
+    return virtual_ms;
+  }
+  return (uint32_t)(hal_stub_now_ns() / 1000000ULL);
+}
+
+void HAL_Delay(uint32_t Delay)
+{
+  if (virtual_step_ms != 0)
+  {
+    hal_stub_advance_ms(Delay);
+    return;
+  }
+  usleep(Delay * 1000U);
+}
+
+void HAL_GPIO_WritePin(GPIO_TypeDef* GPIOx, uint16_t GPIO_Pin, GPIO_PinState PinState)
+{
+  if (PinState == GPIO_PIN_SET)
+  {
+    GPIOx->ODR |= GPIO_Pin;
+  }
+  else
+  {
+    GPIOx->ODR &= ~(uint32_t)GPIO_Pin;
+  }
+}
+
+void HAL_GPIO_TogglePin(GPIO_TypeDef* GPIOx, uint16_t GPIO_Pin)
+{
+  GPIOx->ODR ^= GPIO_Pin;
+}
+
+/**
+  * @brief  Connect a UART handle to a file descriptor, at the baud rate of
+  *         MX_UART4_Init().
+  */
+void hal_stub_attach_uart(UART_HandleTypeDef* huart, int fd)
+{
+  huart->Init.BaudRate = 115200;
+  huart->host_fd = fd;
+  huart->gState = HAL_UART_STATE_READY;
+  huart->RxState = HAL_UART_STATE_READY;
+}
+
+/**
+  * @brief  Stop the reception thread of a UART handle.
+  */
+void hal_stub_detach_uart(UART_HandleTypeDef* huart)
+{
+  HAL_UART_DMAStop(huart);
+  huart->host_fd = -1;
+}
+
+/**
+  * @brief  Route transmitted bytes to a hook instead of the file descriptor.
+  */
+void hal_stub_set_tx_hook(hal_stub_tx_hook_t hook)
+{
+  tx_hook = hook;
+}
+
+/**
+  * @brief  Call a function on every HAL_GetTick(), i.e. while the driver waits.
+  * @details Lets a single threaded benchmark deliver a stream larger than the
+  *          reception ring as the driver consumes it.
+  */
+void hal_stub_set_rx_pump(hal_stub_rx_pump_t pump)
+{
+  rx_pump = pump;
+}
+
+/**
+  * @brief  Deliver the received bytes from the caller instead of a thread.
+  * @details Must be set before HAL_UARTEx_ReceiveToIdle_DMA().
+  */
+void hal_stub_set_rx_polling(int enable)
+{
+  rx_polling = enable;
+}
+
+/**
+  * @brief  Polling mode: feed whatever the wire holds to the DMA emulation.
+  * @retval Number of bytes delivered, 0 if none was waiting.
+  */
+uint32_t hal_stub_poll_rx(void)
+{
+  uint8_t chunk[RX_READ_CHUNK];
+  struct pollfd pfd;
+  uint32_t total = 0;
+
+  if ((rx_uart == NULL) || (rx_uart->host_fd <= 0))
+  {
+    return 0;
+  }
+
+  pfd.fd = rx_uart->host_fd;
+  pfd.events = POLLIN;
+  while ((poll(&pfd, 1, 0) > 0) && ((pfd.revents & POLLIN) != 0))
+  {
+    ssize_t n = read(rx_uart->host_fd, chunk, sizeof(chunk));
+
+    if (n <= 0)
+    {
+      break;
+    }
+    hal_stub_dma_rx(chunk, (uint32_t)n);
+    total += (uint32_t)n;
+  }
+
+  return total;
+}
+
+/**
+  * @brief  Emulate the circular DMA receiving a burst followed by an IDLE line.
+  * @details Can be called from the reception thread or directly by a benchmark.
+  */
+void hal_stub_dma_rx(const uint8_t* data, uint32_t length)
+{
+  if ((rx_uart == NULL) || (rx_dma_buffer == NULL))
+  {
+    return;
+  }
+
+  while (length != 0)
+  {
+    uint32_t chunk = rx_dma_size - rx_dma_pos;
+
+    if (chunk > length)
+    {
+      chunk = length;
+    }
+
+    memcpy(&rx_dma_buffer[rx_dma_pos], data, chunk);
+    rx_dma_pos += chunk;
+    data += chunk;
+    length -= chunk;
+
+    /* Transfer complete event, the circular DMA wraps */
+    if (rx_dma_pos == rx_dma_size)
+    {
+      HAL_UARTEx_RxEventCallback(rx_uart, rx_dma_size);
+      rx_dma_pos = 0;
+    }
+  }
+
+  /* IDLE line event */
+  if (rx_dma_pos != 0)
+  {
+    HAL_UARTEx_RxEventCallback(rx_uart, rx_dma_pos);
+  }
+
+  pthread_mutex_lock(&wfi_lock);
+  pthread_cond_broadcast(&wfi_cond);
+  pthread_mutex_unlock(&wfi_lock);
+}
+
+HAL_StatusTypeDef HAL_UART_Transmit(UART_HandleTypeDef *huart, const uint8_t *pData, uint16_t Size, uint32_t Timeout)
+{
+  (void)Timeout;
+
+  if (tx_hook != NULL)
+  {
+    tx_hook(pData, Size);
+    return HAL_OK;
+  }
+
+  while (Size != 0)
+  {
+    ssize_t n = write(huart->host_fd, pData, Size);
+
+    if (n < 0)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+      return HAL_ERROR;
+    }
+    pData += n;
+    Size -= (uint16_t)n;
+  }
+
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_UART_Transmit_DMA(UART_HandleTypeDef *huart, const uint8_t *pData, uint16_t Size)
+{
+  HAL_StatusTypeDef ret = HAL_OK;
+
+  if (huart->gState != HAL_UART_STATE_READY)
+  {
+    return HAL_BUSY;
+  }
+
+  /* No wire attached (e.g. the log USART): complete immediately. A UART
+     attached without a wire (fd -1) still goes to the TX hook. */
+  if ((huart->host_fd > 0) || ((huart->host_fd < 0) && (tx_hook != NULL)))
+  {
+    huart->gState = HAL_UART_STATE_BUSY_TX;
+    ret = HAL_UART_Transmit(huart, pData, Size, 0);
+    huart->gState = HAL_UART_STATE_READY;
+  }
+
+  if (ret == HAL_OK)
+  {
+    HAL_UART_TxCpltCallback(huart);
+  }
+  return ret;
+}
+
+HAL_StatusTypeDef HAL_UARTEx_ReceiveToIdle_DMA(UART_HandleTypeDef *huart, uint8_t *pData, uint16_t Size)
+{
+  if (huart->RxState == HAL_UART_STATE_BUSY_RX)
+  {
+    return HAL_BUSY;
+  }
+
+  rx_uart = huart;
+  rx_dma_buffer = pData;
+  rx_dma_size = Size;
+  rx_dma_pos = 0;
+  huart->RxState = HAL_UART_STATE_BUSY_RX;
+
+  if ((huart->host_fd > 0) && (rx_polling == 0) && (rx_thread_running == 0))
+  {
+    rx_thread_running = 1;
+    if (pthread_create(&rx_thread, NULL, rx_thread_main, huart) != 0)
+    {
+      rx_thread_running = 0;
+      return HAL_ERROR;
+    }
+  }
+
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_UART_DMAStop(UART_HandleTypeDef *huart)
+{
+  if (rx_thread_running != 0)
+  {
+    rx_thread_running = 0;
+    pthread_cancel(rx_thread);
+    pthread_join(rx_thread, NULL);
+  }
+
+  huart->RxState = HAL_UART_STATE_READY;
+  rx_uart = NULL;
+  rx_dma_buffer = NULL;
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_UART_AbortTransmit(UART_HandleTypeDef *huart)
+{
+  huart->gState = HAL_UART_STATE_READY;
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_UART_DeInit(UART_HandleTypeDef *huart)
+{
+  huart->gState = HAL_UART_STATE_RESET;
+  return HAL_OK;
+}
+
+__attribute__((weak)) void HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart)
+{
+  (void)huart;
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  The "UART IRQ": read bursts from the wire and feed the DMA emulation.
+  */
+static void* rx_thread_main(void* arg)
+{
+  UART_HandleTypeDef* huart = (UART_HandleTypeDef *)arg;
+  uint8_t chunk[RX_READ_CHUNK];
+
+  while (rx_thread_running != 0)
+  {
+    ssize_t n = read(huart->host_fd, chunk, sizeof(chunk));
+
+    if (n > 0)
+    {
+      hal_stub_dma_rx(chunk, (uint32_t)n);
+    }
+    else if ((n == 0) || (errno != EINTR))
+    {
+      break;
+    }
+  }
+
+  return NULL;
+}
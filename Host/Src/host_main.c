@@ -0,0 +1,1127 @@
+/*
+ * host_main.c
+ *
+ *  Host entry point: runs the same bring-up sequence as main.c and then the
+ *  application loop against the ESP-AT simulator, and prints timings.
+ *
+ *  usage: esp_host [-n publishes] [-l latency_ms] [-j join_ms] [-k connect_ms]
+ *                  [-c chunk_bytes] [-g chunk_gap_us] [-u urc_period_ms]
+ *                  [-s publish_period_ms] [-w wake_ms] [-x hang_every]
+ *                  [-m message_bytes] [-b busy_every]
+ *                  [-d datagrams] [-D datagram_bytes] [-S server_bytes]
+ *                  [-H scrape_period_ms] [-R reconnects] [-I] [-W joins]
+ *                  [-L link_profile] [-A]
+ *
+ *  With -s the publishes are driven by the scheduler tasks of app.c instead
+ *  of a loop calling publish_and_process_incoming_message(). The periodic
+ *  URCs of -u start after the bring-up; with -m they are +MQTTSUBRECV
+ *  messages of that many binary bytes. With -s a message sent but not
+ *  handed to app.c, between two commands or during one, fails the run.
+ *  With -d the publishes are followed by that many datagrams sent with
+ *  esp8266_send_datagram() over AT+CIPSTART="UDP" to a receiver on
+ *  127.0.0.1, and the datagram rate is printed. With -S the module runs a
+ *  TCP server (AT+CIPSERVER) and a client on 127.0.0.1 pulls that many
+ *  bytes of a data log, streamed with esp8266_server_send(); with -d as well,
+ *  the datagrams go out on ESP8266_CLIENT_LINK between the segments, the
+ *  server running, and a loss on either side fails the run. With -H (and -s)
+ *  a client on 127.0.0.1 scrapes GET /metrics from the tasks of app.c at that
+ *  period while they publish. With -R the broker is reconnected that many times
+ *  by host name, then as many times through the cached address (the broker
+ *  moving halfway), and both reconnect times are printed; -I simulates a
+ *  firmware without AT+MQTTSNI. With -W the module is on a site of four
+ *  APs of two networks, and joins that many times with a plain AT+CWJAP,
+ *  then as many times through the join manager (the AP it uses switched off
+ *  halfway), and both join times are printed. With -L (1 walk-away, 2
+ *  flapping, 3 congested) the tasks of app.c sample every -s period (100 ms
+ *  by default) through a scripted link, RSSI and PUBACK round trip changing
+ *  over time, and the publish latency, samples delivered and link levels
+ *  are printed; -A keeps the link controller from adapting, for comparison.
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "main.h"
+#include "esp8266.h"
+#include "esp8266_io.h"
+#include "esp8266_power.h"
+#include "esp8266_urc.h"
+#include "app.h"
+#include "metrics.h"
+#include "metrics_http.h"
+#include "log_ring.h"
+#include "sched.h"
+#include "power.h"
+#include "hal_stub.h"
+#include "at_sim.h"
+#include "wifi_join.h"
+#include "link_ctrl.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+/* Private typedef -----------------------------------------------------------*/
+/* The local UDP collector of the -d run */
+typedef struct {
+    int                 fd;
+    volatile int        running;
+    uint32_t            datagrams;
+    uint32_t            bytes;
+    uint32_t            wrong_size;
+} udp_receiver_t;
+
+/* The LAN client of the -S run, pulling the data log */
+typedef struct {
+    uint16_t            port;
+    uint32_t            received;
+    uint32_t            mismatches;       /* bytes not matching the log */
+} tcp_client_t;
+
+/* The monitoring of the -H run, scraping GET /metrics */
+typedef struct {
+    uint16_t            port;
+    uint32_t            period_ms;
+    volatile int        running;
+    volatile int        done;
+    uint32_t            ok;
+    uint32_t            failed;             /* refused, cut short or not a complete chunked body */
+    uint32_t            bytes;
+    double              max_ms;
+} scraper_t;
+
+/* A scripted link of the -L run */
+typedef struct {
+    const char*                 name;
+    const at_sim_link_step_t*   steps;
+    uint32_t                    count;
+    uint32_t                    duration_ms;
+} link_profile_t;
+
+/* Private define ------------------------------------------------------------*/
+/* Longest wait for the messages on the way at the end of a -s run */
+#define MESSAGE_DRAIN_MS  2000U
+
+/* Private macro -------------------------------------------------------------*/
+/* Bring-up command, as in main.c: again after APP_BUSY_RETRY_MS while busy */
+#define BRING_UP(call)  while ((status = (call)) == ESP8266_BUSY) { HAL_Delay(APP_BUSY_RETRY_MS); }
+
+/* Private variables ---------------------------------------------------------*/
+/* Away from the AP and back: RSSI and round trip degrade together */
+static const at_sim_link_step_t walk_away[] = {
+    {     0, -55,  40,  0 },
+    {  2000, -72,  90,  0 },
+    {  3500, -78, 160,  0 },
+    {  5000, -84, 260,  0 },
+    {  6500, -88, 380, 40 },
+    {  8500, -80, 200,  0 },
+    { 10000, -68,  80,  0 },
+    { 11000, -55,  40,  0 },
+};
+
+/* On the edge of the cell: bad and good every 1.5 s, then steady */
+static const at_sim_link_step_t flapping[] = {
+    {     0, -60,  50,  0 },
+    {  1500, -86, 350, 40 },
+    {  3000, -60,  50,  0 },
+    {  4500, -86, 350, 40 },
+    {  6000, -60,  50,  0 },
+    {  7500, -86, 350, 40 },
+    {  9000, -60,  50,  0 },
+};
+
+/* Strong signal, slow broker path: only the round trip tells */
+static const at_sim_link_step_t congested[] = {
+    {     0, -55,  40,  0 },
+    {  2000, -58, 420,  0 },
+    {  9000, -55,  40,  0 },
+};
+
+static const link_profile_t link_profiles[] = {
+    { "walk-away", walk_away, sizeof(walk_away) / sizeof(walk_away[0]), 17000 },
+    { "flapping",  flapping,  sizeof(flapping) / sizeof(flapping[0]),   15000 },
+    { "congested", congested, sizeof(congested) / sizeof(congested[0]), 14000 },
+};
+
+static const wifi_network_t wifi_networks[] = {
+    { WIFI_SSID,     WIFI_PASSWORD     },
+    { WIFI_SSID_ALT, WIFI_PASSWORD_ALT },
+};
+
+UART_HandleTypeDef huart4;
+UART_HandleTypeDef huart2;
+
+/* Private function prototypes -----------------------------------------------*/
+static double elapsed_ms(uint64_t start_ns);
+static void bring_up(void);
+static void report_queries(void);
+static void count_ap(const esp8266_ap_info_t* ap, void* context);
+static void run_scheduler(uint32_t publishes, uint32_t period_ms, uint32_t scrape_period_ms);
+static void* scraper_main(void* arg);
+static uint16_t free_tcp_port(void);
+static uint32_t run_link(uint32_t profile, uint32_t period_ms, uint8_t adaptive);
+static void run_reconnects(uint32_t count);
+static void add_site(uint8_t several);
+static void run_joins(uint32_t count);
+static void run_datagrams(uint32_t datagrams, uint32_t size);
+static uint16_t udp_collector_start(udp_receiver_t* receiver, pthread_t* thread);
+static void udp_collector_stop(udp_receiver_t* receiver, pthread_t thread);
+static void* udp_receiver_main(void* arg);
+static void run_server(uint32_t bytes, uint32_t datagrams, uint32_t datagram_size);
+static void* tcp_client_main(void* arg);
+static uint8_t log_byte(uint32_t offset);
+
+/* Exported functions -------------------------------------------------------*/
+
+int main(int argc, char** argv)
+{
+  at_sim_config_t sim;
+  at_sim_stats_t sim_stats;
+  metrics_snapshot_t snapshot;
+  char encoded[METRICS_MAX_ENCODED_SIZE];
+  const esp8266_deadline_t* deadlines;
+  uint32_t deadline_count;
+  uint32_t publishes = 100;
+  uint32_t sched_period_ms = 0;
+  uint32_t datagrams = 0;
+  uint32_t datagram_size = 64;
+  uint32_t server_bytes = 0;
+  uint32_t scrape_period_ms = 0;
+  uint32_t reconnects = 0;
+  uint32_t joins = 0;
+  uint32_t link_profile = 0;
+  uint32_t urc_period_ms = 0;
+  uint8_t adaptive = 1;
+  int wire[2];
+  int opt;
+  uint64_t start;
+
+  at_sim_default_config(&sim);
+
+  while ((opt = getopt(argc, argv, "n:l:j:k:c:g:u:s:w:x:m:b:d:D:S:H:R:IW:L:A")) != -1)
+  {
+    switch (opt)
+    {
+      case 'n': publishes = (uint32_t)strtoul(optarg, NULL, 0); break;
+      case 'l': sim.latency_ms = (uint32_t)strtoul(optarg, NULL, 0); break;
+      case 'j': sim.join_latency_ms = (uint32_t)strtoul(optarg, NULL, 0); break;
+      case 'k': sim.connect_latency_ms = (uint32_t)strtoul(optarg, NULL, 0); break;
+      case 'c': sim.chunk_size = (uint32_t)strtoul(optarg, NULL, 0); break;
+      case 'g': sim.chunk_gap_us = (uint32_t)strtoul(optarg, NULL, 0); break;
+      case 'u': urc_period_ms = (uint32_t)strtoul(optarg, NULL, 0); break;
+      case 's': sched_period_ms = (uint32_t)strtoul(optarg, NULL, 0); break;
+      case 'w': sim.wake_latency_ms = (uint32_t)strtoul(optarg, NULL, 0); break;
+      case 'x': sim.hang_every = (uint32_t)strtoul(optarg, NULL, 0); break;
+      case 'm': sim.urc_message_size = (uint32_t)strtoul(optarg, NULL, 0); break;
+      case 'b': sim.busy_every = (uint32_t)strtoul(optarg, NULL, 0); break;
+      case 'd': datagrams = (uint32_t)strtoul(optarg, NULL, 0); break;
+      case 'D': datagram_size = (uint32_t)strtoul(optarg, NULL, 0); break;
+      case 'S': server_bytes = (uint32_t)strtoul(optarg, NULL, 0); break;
+      case 'H': scrape_period_ms = (uint32_t)strtoul(optarg, NULL, 0); break;
+      case 'R': reconnects = (uint32_t)strtoul(optarg, NULL, 0); break;
+      case 'I': sim.no_sni = 1; break;
+      case 'W': joins = (uint32_t)strtoul(optarg, NULL, 0); break;
+      case 'L': link_profile = (uint32_t)strtoul(optarg, NULL, 0); break;
+      case 'A': adaptive = 0; break;
+      default:
+        fprintf(stderr, "usage: %s [-n publishes] [-l latency_ms] [-j join_ms] [-k connect_ms]"
+                        " [-c chunk_bytes] [-g chunk_gap_us] [-u urc_period_ms] [-s publish_period_ms]"
+                        " [-w wake_ms] [-x hang_every] [-m message_bytes] [-b busy_every]"
+                        " [-d datagrams] [-D datagram_bytes] [-S server_bytes]"
+                        " [-H scrape_period_ms] [-R reconnects] [-I] [-W joins]"
+                        " [-L link_profile] [-A]\n", argv[0]);
+        return 2;
+    }
+  }
+  if (link_profile > (sizeof(link_profiles) / sizeof(link_profiles[0])))
+  {
+    fprintf(stderr, "link profiles: 1 walk-away, 2 flapping, 3 congested\n");
+    return 2;
+  }
+
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, wire) != 0)
+  {
+    perror("socketpair");
+    return 1;
+  }
+
+  hal_stub_attach_uart(&huart4, wire[0]);
+  hal_stub_attach_uart(&huart2, -1);
+  add_site((joins != 0) ? 1U : 0U);
+  if (at_sim_start(&sim, wire[1]) != 0)
+  {
+    fprintf(stderr, "cannot start the AT simulator\n");
+    return 1;
+  }
+
+  wifi_uart_handle = &huart4;
+  metrics_init();
+  power_init();
+  log_ring_init(&log_sink_itm);
+
+  start = hal_stub_now_ns();
+  bring_up();
+  printf("bring-up           %10.3f ms\n", elapsed_ms(start));
+  report_queries();
+
+  // Messages from here on: each of them is accounted for by app.c
+  at_sim_set_urc_period(urc_period_ms);
+  start = hal_stub_now_ns();
+  if (link_profile != 0)
+  {
+    publishes = run_link(link_profile - 1U, (sched_period_ms != 0) ? sched_period_ms : 100U, adaptive);
+  }
+  else if (sched_period_ms != 0)
+  {
+    run_scheduler(publishes, sched_period_ms, scrape_period_ms);
+  }
+  else
+  {
+    for (uint32_t i = 0; i < publishes; i++)
+    {
+      publish_and_process_incoming_message();
+    }
+  }
+  printf("publishes          %10u\n", publishes);
+  printf("publish loop       %10.3f ms\n", elapsed_ms(start));
+  printf("per publish        %10.3f ms\n", (publishes != 0) ? (elapsed_ms(start) / publishes) : 0.0);
+
+  if (reconnects != 0)
+  {
+    run_reconnects(reconnects);
+  }
+  if (joins != 0)
+  {
+    run_joins(joins);
+  }
+  if ((datagrams != 0) && (server_bytes == 0))
+  {
+    run_datagrams(datagrams, datagram_size);
+  }
+  if (server_bytes != 0)
+  {
+    run_server(server_bytes, datagrams, datagram_size);
+  }
+
+  metrics_snapshot(&snapshot);
+  if (metrics_encode(&snapshot, encoded, sizeof(encoded)) > 0)
+  {
+    printf("metrics            %s\n", encoded);
+  }
+
+  at_sim_get_stats(&sim_stats);
+  printf("sim commands       %10u (errors %u, hangs %u, busy %u, urcs %u, raw publishes %u, rx %u B, tx %u B)\n",
+         sim_stats.commands, sim_stats.errors, sim_stats.hangs, sim_stats.busy, sim_stats.urcs,
+         sim_stats.raw_publishes, sim_stats.rx_bytes, sim_stats.tx_bytes);
+  printf("busy answers       %10u (%u ms waited before resending)\n",
+         metric_values[METRIC_AT_BUSY], metric_values[METRIC_BUSY_WAIT_MS]);
+
+  deadlines = esp8266_deadline_table(&deadline_count);
+  for (uint32_t i = 0; i < deadline_count; i++)
+  {
+    if ((deadlines[i].samples != 0) || (deadlines[i].failures != 0))
+    {
+      printf("verb %-13s %10u ok, %u failed (srtt %u ms, rttvar %u ms, deadline %u ms; failures detected in %u ms, max %u ms)\n",
+             esp8266_deadline_label(&deadlines[i]), deadlines[i].samples, deadlines[i].failures,
+             deadlines[i].srtt_x8 / 8U, deadlines[i].rttvar_x4 / 4U, deadlines[i].rto_ms,
+             deadlines[i].fail_latency_last_ms, deadlines[i].fail_latency_max_ms);
+    }
+  }
+
+  hal_stub_detach_uart(&huart4);
+  at_sim_stop();
+  close(wire[0]);
+  close(wire[1]);
+  return 0;
+}
+
+/**
+  * @brief  Host replacement of the error trap of main.c.
+  */
+void Error_Handler(void)
+{
+  fprintf(stderr, "Error_Handler() reached\n");
+  exit(1);
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Same sequence as the USER CODE 2 section of main.c.
+  */
+static void bring_up(void)
+{
+  esp8266_status_t status;
+  esp8266_time_t sntp_time;
+
+  BRING_UP(esp8266_init());
+  if (status != ESP8266_OK)
+  {
+    Error_Handler();
+  }
+
+  wifi_join_init(wifi_networks, sizeof(wifi_networks) / sizeof(wifi_networks[0]));
+  while (wifi_join() != ESP8266_OK);
+
+  BRING_UP(esp8266_config_sntp("pool.ntp.org"));
+  if (status != ESP8266_OK)
+  {
+    Error_Handler();
+  }
+
+  BRING_UP(esp8266_get_sntp_time(&sntp_time));
+  if (status != ESP8266_OK)
+  {
+    Error_Handler();
+  }
+
+  BRING_UP(esp8266_mqtt_usercfg(MQTT_CLIENT_ID, "espressif", "1234567890"));
+  if (status != ESP8266_OK)
+  {
+    Error_Handler();
+  }
+
+  BRING_UP(esp8266_mqtt_connect_cached(MQTT_BROKER, MQTT_PORT, 1));
+  if (status != ESP8266_OK)
+  {
+    Error_Handler();
+  }
+
+  BRING_UP(esp8266_mqtt_subscribe("led/cmd", 1));
+  if (status != ESP8266_OK)
+  {
+    Error_Handler();
+  }
+}
+
+/**
+  * @brief  Read back the state of the module through the query commands.
+  */
+static void report_queries(void)
+{
+  esp8266_status_t status;
+  uint8_t ip[ESP8266_IP_SIZE];
+  char version[64];
+  esp8266_ap_info_t ap;
+  esp8266_mqtt_conn_info_t conn;
+  esp8266_time_t now;
+  uint32_t ap_count = 0;
+
+  BRING_UP(esp8266_get_ip(ESP8266_STATION_MODE, ip));
+  if (status == ESP8266_OK)
+  {
+    BRING_UP(esp8266_get_ap_info(&ap));
+  }
+  if (status == ESP8266_OK)
+  {
+    BRING_UP(esp8266_list_ap(count_ap, &ap_count));
+  }
+  if (status == ESP8266_OK)
+  {
+    BRING_UP(esp8266_mqtt_get_conn(&conn));
+  }
+  if (status == ESP8266_OK)
+  {
+    BRING_UP(esp8266_get_sntp_time(&now));
+  }
+  if (status == ESP8266_OK)
+  {
+    BRING_UP(esp8266_get_version(version, sizeof(version)));
+  }
+  if (status != ESP8266_OK)
+  {
+    Error_Handler();
+  }
+
+  printf("station            %10s (ap \"%s\" %s channel %u rssi %d, %u in range)\n",
+         (char *)ip, ap.ssid, ap.bssid, ap.channel, ap.rssi, ap_count);
+  printf("mqtt               %10u (scheme %u, %s:%u)\n", conn.state, conn.scheme, conn.host, conn.port);
+  printf("sntp time          %04u-%02u-%02u %02u:%02u:%02u\n",
+         now.year, now.month, now.day, now.hour, now.minute, now.second);
+  printf("at version         %s\n", version);
+}
+
+static void count_ap(const esp8266_ap_info_t* ap, void* context)
+{
+  (void)ap;
+  (*(uint32_t *)context)++;
+}
+
+/**
+  * @brief  Let the tasks of app.c publish until the count is reached.
+  */
+static void run_scheduler(uint32_t publishes, uint32_t period_ms, uint32_t scrape_period_ms)
+{
+  uint32_t target = metric_values[METRIC_PUBLISHES] + publishes;
+  sched_stats_t stats;
+  app_rx_stats_t rx;
+  at_sim_stats_t sim_stats;
+  power_stats_t power;
+  power_stats_t power_start;
+  esp8266_power_stats_t radio;
+  uint64_t run_us;
+  uint64_t total_us;
+  uint64_t energy_uj;
+  scraper_t scraper = { .period_ms = scrape_period_ms, .running = 1 };
+  metrics_http_stats_t http;
+  pthread_t thread;
+  uint32_t until;
+
+  // The metrics endpoint only when scraped, on a free port
+  scraper.port = (scrape_period_ms != 0) ? free_tcp_port() : 0;
+  app_set_metrics_port(scraper.port);
+  app_set_publish_period(period_ms);
+  app_init();
+  power_get_stats(&power_start);
+  if ((scrape_period_ms != 0) && (pthread_create(&thread, NULL, scraper_main, &scraper) != 0))
+  {
+    Error_Handler();
+  }
+
+  while (metric_values[METRIC_PUBLISHES] < target)
+  {
+    sched_run_once();
+  }
+
+  if (scrape_period_ms != 0)
+  {
+    // The tasks serve the last scrape until it ends
+    scraper.running = 0;
+    while (scraper.done == 0)
+    {
+      sched_run_once();
+    }
+    pthread_join(thread, NULL);
+    metrics_http_get_stats(&http);
+    printf("scrapes            %10u ok (%u failed, %u B, slowest %.1f ms; served %u, %u steps, %u aborted)\n",
+           scraper.ok, scraper.failed, scraper.bytes, scraper.max_ms, http.scrapes, http.steps, http.aborted);
+    printf("scrape step max    %10u us (publishing stalled at most that long per step)\n", http.step_max_us);
+  }
+
+  // Every message sent reaches the application, read between two commands
+  // or during one: no more of them, and those on the way are read
+  at_sim_set_urc_period(0);
+  at_sim_get_stats(&sim_stats);
+  app_get_rx_stats(&rx);
+  until = HAL_GetTick() + MESSAGE_DRAIN_MS;
+  while ((rx.messages < sim_stats.messages) && ((int32_t)(HAL_GetTick() - until) < 0))
+  {
+    sched_run_once();
+    app_get_rx_stats(&rx);
+  }
+
+  sched_get_stats(&stats);
+  printf("dispatches         %10u (timers %u, work %u, max latency %u us)\n",
+         stats.dispatches, stats.timers_fired, stats.work_done, stats.max_latency_us);
+  printf("led                %10s\n", (GPIOA->ODR & GPIO_PIN_5) ? "on" : "off");
+
+  printf("messages           %10u (of %u sent, %u B, %u too long", rx.messages, sim_stats.messages,
+         rx.message_bytes, rx.truncated);
+  if (sim_stats.message_bytes != 0)
+  {
+    printf(", %u B of binary payloads sent", sim_stats.message_bytes);
+  }
+  printf(")\n");
+  if (rx.messages != sim_stats.messages)
+  {
+    fprintf(stderr, "messages lost\n");
+    exit(1);
+  }
+
+  // Same energy model as power_update_metrics(), over the whole run
+  power_get_stats(&power);
+  run_us = power.run_us - power_start.run_us;
+  total_us = run_us + (power.sleep_us - power_start.sleep_us) + (power.stop_us - power_start.stop_us);
+  energy_uj = (run_us * POWER_RUN_UA + (power.sleep_us - power_start.sleep_us) * POWER_SLEEP_UA +
+               (power.stop_us - power_start.stop_us) * POWER_STOP_UA) * POWER_SUPPLY_MV / 1000000000ULL;
+  printf("duty cycle         %10.2f %%\n", (total_us != 0) ? (100.0 * run_us / total_us) : 0.0);
+  printf("energy per publish %10.1f uJ (model, %u stop entries)\n",
+         (publishes != 0) ? ((double)energy_uj / publishes) : 0.0, power.stop_entries);
+
+  esp8266_power_get_stats(&radio);
+  printf("module sleeps      %10u (mode %u, fallbacks %u, lead %u ms)\n",
+         radio.sleeps, radio.mode, radio.fallbacks, radio.wake_lead_ms);
+  printf("wake latency max   %10u ms\n", radio.wake_latency_max_ms);
+  printf("radio on / publish %10.1f ms\n", (publishes != 0) ? ((double)radio.radio_on_ms / publishes) : 0.0);
+  printf("publish jitter max %10u ms (%u late)\n", radio.jitter_max_ms, radio.late_publishes);
+}
+
+/**
+  * @brief  Let the tasks of app.c sample through a scripted link for the
+  *         length of the profile, and report how the publishing held up.
+  * @retval The publishes done.
+  */
+static uint32_t run_link(uint32_t profile, uint32_t period_ms, uint8_t adaptive)
+{
+  const link_profile_t* p = &link_profiles[profile];
+  uint32_t publishes_start = metric_values[METRIC_PUBLISHES];
+  link_ctrl_config_t config;
+  link_ctrl_stats_t stats;
+  esp8266_power_stats_t radio;
+  at_sim_stats_t sim_stats;
+  uint64_t start;
+  double ms;
+
+  // The RSSI every 10 samples, metrics every second: both show within the profile
+  link_ctrl_get_config(&config);
+  config.adaptive = adaptive;
+  config.rssi_period_ms = 10U * period_ms;
+  link_ctrl_configure(&config);
+  metrics_set_period(1000);
+
+  app_set_metrics_port(0);
+  app_set_publish_period(period_ms);
+  at_sim_set_profile(p->steps, p->count);
+  app_init();
+
+  start = hal_stub_now_ns();
+  while (elapsed_ms(start) < p->duration_ms)
+  {
+    sched_run_once();
+  }
+  ms = elapsed_ms(start);
+  at_sim_set_profile(NULL, 0);
+
+  link_ctrl_get_stats(&stats);
+  esp8266_power_get_stats(&radio);
+  at_sim_get_stats(&sim_stats);
+  printf("link profile       %10s (%u ms, sample every %u ms, %s)\n",
+         p->name, p->duration_ms, period_ms, (adaptive != 0) ? "adaptive" : "fixed QoS 1");
+  printf("link samples       %10u delivered in %u periods (%u at QoS 1), %u publishes (%u failed or busy)\n",
+         stats.samples, (uint32_t)(ms / period_ms), stats.samples_qos1, stats.publishes, stats.failed);
+  printf("link latency       %10.1f ms avg, %u ms max, %u over the %u ms target\n",
+         (stats.publishes != 0) ? ((double)stats.latency_sum_ms / stats.publishes) : 0.0,
+         stats.latency_max_ms, stats.over_target, config.target_latency_ms);
+  printf("link levels        %10u changes (good %u ms, fair %u ms, poor %u ms; recover hold %u)\n",
+         stats.level_changes, stats.level_ms[LINK_GOOD], stats.level_ms[LINK_FAIR], stats.level_ms[LINK_POOR],
+         stats.recover_hold);
+  printf("link rssi          %10d dBm last (%u samples)\n", stats.rssi, stats.rssi_samples);
+  printf("link metrics       %10u published\n",
+         metric_values[METRIC_PUBLISHES] - publishes_start - (stats.publishes - stats.failed));
+  printf("radio on           %10llu ms (%u sleeps; %u sim publishes, %u at QoS 1)\n",
+         (unsigned long long)radio.radio_on_ms, radio.sleeps, sim_stats.publishes, sim_stats.publishes_qos1);
+  return stats.publishes;
+}
+
+/**
+  * @brief  Reconnect to the broker by host name, then through the cached
+  *         address, and compare: every connection by name pays a DNS lookup.
+  *         The broker moves halfway, so that the cache is refreshed once.
+  */
+static void run_reconnects(uint32_t count)
+{
+  const esp8266_dns_cache_t* cache = esp8266_dns_cache();
+  at_sim_stats_t before;
+  at_sim_stats_t after;
+  double ms;
+  double name_total = 0.0;
+  double name_max = 0.0;
+  double cached_total = 0.0;
+  double cached_max = 0.0;
+  uint32_t name_failed = 0;
+  uint32_t cached_failed = 0;
+  uint64_t start;
+
+  at_sim_get_stats(&before);
+  for (uint32_t i = 0; i < count; i++)
+  {
+    start = hal_stub_now_ns();
+    name_failed += (esp8266_mqtt_connect(MQTT_BROKER, MQTT_PORT, 1) != ESP8266_OK) ? 1U : 0U;
+    ms = elapsed_ms(start);
+    name_total += ms;
+    name_max = (ms > name_max) ? ms : name_max;
+  }
+  for (uint32_t i = 0; i < count; i++)
+  {
+    if (i == (count / 2U))
+    {
+      at_sim_move_broker("10.0.0.8");
+    }
+    start = hal_stub_now_ns();
+    cached_failed += (esp8266_mqtt_connect_cached(MQTT_BROKER, MQTT_PORT, 1) != ESP8266_OK) ? 1U : 0U;
+    ms = elapsed_ms(start);
+    cached_total += ms;
+    cached_max = (ms > cached_max) ? ms : cached_max;
+  }
+  at_sim_get_stats(&after);
+
+  printf("reconnect by name  %10.3f ms avg, %.3f ms max (%u, %u failed)\n", name_total / count, name_max, count, name_failed);
+  printf("reconnect cached   %10.3f ms avg, %.3f ms max (%u, %u failed)\n", cached_total / count, cached_max, count, cached_failed);
+  printf("dns cache          %10s (%u lookups, %u refreshes, %u by address, %u by name, sni %u; sim %u lookups)\n",
+         cache->ip, cache->lookups, cache->refreshes, cache->by_address, cache->by_name, cache->sni,
+         after.dns_lookups - before.dns_lookups);
+}
+
+/**
+  * @brief  Put the APs of WIFI_SSID in range of the simulator: one, or
+  *         several of both configured networks, the strongest on channel 6.
+  */
+static void add_site(uint8_t several)
+{
+  if (several == 0)
+  {
+    at_sim_add_ap(WIFI_SSID, "aa:bb:cc:00:00:01", -58, 6);
+    return;
+  }
+  at_sim_add_ap(WIFI_SSID, "aa:bb:cc:00:00:01", -77, 1);
+  at_sim_add_ap(WIFI_SSID, "aa:bb:cc:00:00:02", -66, 11);
+  at_sim_add_ap(WIFI_SSID, "aa:bb:cc:00:00:03", -70, 4);
+  at_sim_add_ap(WIFI_SSID_ALT, "aa:bb:cc:00:00:04", -55, 6);
+}
+
+/**
+  * @brief  Rejoin with a plain AT+CWJAP, which scans every channel each
+  *         time, then through the join manager. The AP it joined is
+  *         switched off halfway, so that it falls back to a scan once.
+  */
+static void run_joins(uint32_t count)
+{
+  const wifi_join_ap_t* last = wifi_join_last_ap();
+  wifi_join_stats_t stats;
+  double ms;
+  double plain_total = 0.0;
+  double plain_max = 0.0;
+  double managed_total = 0.0;
+  double managed_max = 0.0;
+  uint32_t plain_failed = 0;
+  uint32_t managed_failed = 0;
+  uint64_t start;
+
+  for (uint32_t i = 0; i < count; i++)
+  {
+    esp8266_quit_ap();
+    start = hal_stub_now_ns();
+    plain_failed += (esp8266_joint_ap((uint8_t *)WIFI_SSID, (uint8_t *)WIFI_PASSWORD) != ESP8266_OK) ? 1U : 0U;
+    ms = elapsed_ms(start);
+    plain_total += ms;
+    plain_max = (ms > plain_max) ? ms : plain_max;
+  }
+  for (uint32_t i = 0; i < count; i++)
+  {
+    esp8266_quit_ap();
+    if ((i == (count / 2U)) && (last->valid != 0))
+    {
+      at_sim_remove_ap(last->bssid);
+    }
+    start = hal_stub_now_ns();
+    managed_failed += (wifi_join() != ESP8266_OK) ? 1U : 0U;
+    ms = elapsed_ms(start);
+    managed_total += ms;
+    managed_max = (ms > managed_max) ? ms : managed_max;
+  }
+
+  wifi_join_get_stats(&stats);
+  printf("join plain CWJAP   %10.3f ms avg, %.3f ms max (%u, %u failed)\n", plain_total / count, plain_max, count, plain_failed);
+  printf("join manager       %10.3f ms avg, %.3f ms max (%u, %u failed)\n", managed_total / count, managed_max, count, managed_failed);
+  printf("join stats         %10u (fast %u, max %u ms; fell back %u; scans %u, max %u ms; failed %u)\n",
+         stats.joins, stats.fast_joins, stats.fast_max_ms, stats.fast_failures, stats.scans, stats.scan_max_ms,
+         stats.failures);
+  printf("joined             %10s (\"%s\" rssi %d)\n",
+         last->bssid, wifi_networks[last->network].ssid, last->rssi);
+}
+
+/**
+  * @brief  Send datagrams to a UDP receiver on 127.0.0.1 through the
+  *         simulated module, as fast as the AT round trips allow.
+  */
+static void run_datagrams(uint32_t datagrams, uint32_t size)
+{
+  static uint8_t payload[ESP8266_MAX_DATAGRAM_SIZE];
+  udp_receiver_t receiver = { .fd = -1, .running = 1 };
+  esp8266_connection_info_t link = {
+      .connection_type = ESP8266_UDP_CONNECTION,
+      .connection_mode = UDP_PEER_NO_CHANGE,
+      .ip_address = (uint8_t *)"127.0.0.1",
+  };
+  pthread_t thread;
+  uint32_t sent = 0;
+  uint32_t failed = 0;
+  uint64_t start;
+  double ms;
+
+  link.port = udp_collector_start(&receiver, &thread);
+
+  if (size > sizeof(payload))
+  {
+    size = sizeof(payload);
+  }
+  for (uint32_t i = 0; i < size; i++)
+  {
+    payload[i] = (uint8_t)i;
+  }
+
+  if (esp8266_establish_connection(&link) != ESP8266_OK)
+  {
+    Error_Handler();
+  }
+
+  start = hal_stub_now_ns();
+  for (uint32_t i = 0; i < datagrams; i++)
+  {
+    // Sequence number first, the collector sees losses and reordering
+    payload[0] = (uint8_t)i;
+    if (esp8266_send_datagram(payload, size, NULL, 0) == ESP8266_OK)
+    {
+      sent++;
+    }
+    else
+    {
+      failed++;
+    }
+  }
+  ms = elapsed_ms(start);
+
+  esp8266_close_connection(0);
+  udp_collector_stop(&receiver, thread);
+
+  printf("datagrams          %10u (%u B, %u failed, %u received by the collector, %u of another size)\n",
+         sent, size, failed, receiver.datagrams, receiver.wrong_size);
+  printf("datagram rate      %10.0f /s (%.3f ms each, %.1f kB/s)\n",
+         (ms > 0.0) ? (sent * 1000.0 / ms) : 0.0, (sent != 0) ? (ms / sent) : 0.0,
+         (ms > 0.0) ? ((double)receiver.bytes / ms) : 0.0);
+}
+
+/**
+  * @brief  Start the UDP collector on a free port of 127.0.0.1.
+  * @retval The port.
+  */
+static uint16_t udp_collector_start(udp_receiver_t* receiver, pthread_t* thread)
+{
+  struct sockaddr_in addr = { .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+  socklen_t addr_len = sizeof(addr);
+  struct timeval timeout = { .tv_sec = 0, .tv_usec = 100000 };
+  int rcvbuf = 1 << 20;
+
+  receiver->fd = socket(AF_INET, SOCK_DGRAM, 0);
+  setsockopt(receiver->fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+  setsockopt(receiver->fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  if ((receiver->fd < 0) || (bind(receiver->fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) ||
+      (getsockname(receiver->fd, (struct sockaddr *)&addr, &addr_len) != 0) ||
+      (pthread_create(thread, NULL, udp_receiver_main, receiver) != 0))
+  {
+    perror("udp receiver");
+    exit(1);
+  }
+  return ntohs(addr.sin_port);
+}
+
+/**
+  * @brief  Stop the UDP collector once the last datagrams are in.
+  */
+static void udp_collector_stop(udp_receiver_t* receiver, pthread_t thread)
+{
+  usleep(200000);
+  receiver->running = 0;
+  pthread_join(thread, NULL);
+  close(receiver->fd);
+}
+
+static void* udp_receiver_main(void* arg)
+{
+  udp_receiver_t* receiver = (udp_receiver_t *)arg;
+  uint8_t datagram[ESP8266_MAX_DATAGRAM_SIZE + 1];
+
+  while (receiver->running != 0)
+  {
+    ssize_t n = recv(receiver->fd, datagram, sizeof(datagram), 0);
+
+    if (n > 0)
+    {
+      receiver->datagrams++;
+      receiver->bytes += (uint32_t)n;
+    }
+  }
+  return NULL;
+}
+
+/**
+  * @brief  Let a TCP client on 127.0.0.1 pull bytes of a data log from the
+  *         server of the simulated module, streamed from a 64 KB buffer.
+  *         With datagrams, one of them follows each segment over UDP on
+  *         ESP8266_CLIENT_LINK, both links open at once.
+  */
+static void run_server(uint32_t bytes, uint32_t datagrams, uint32_t datagram_size)
+{
+  static uint8_t log_data[64 * 1024];
+  static uint8_t payload[ESP8266_MAX_DATAGRAM_SIZE];
+  static char urc_buf[256];
+  udp_receiver_t receiver = { .fd = -1, .running = 1 };
+  esp8266_connection_info_t udp = {
+      .connection_type = ESP8266_UDP_CONNECTION,
+      .connection_mode = UDP_PEER_NO_CHANGE,
+      .ip_address = (uint8_t *)"127.0.0.1",
+  };
+  pthread_t udp_thread;
+  uint32_t datagrams_sent = 0;
+  uint32_t datagrams_failed = 0;
+  struct sockaddr_in addr = { .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+  socklen_t addr_len = sizeof(addr);
+  tcp_client_t client = { .port = 0 };
+  esp8266_urc_reader_t reader;
+  esp8266_urc_t urc;
+  const esp8266_link_t* links;
+  uint32_t link_count;
+  int32_t link = -1;
+  uint32_t sent = 0;
+  pthread_t thread;
+  uint64_t start;
+  double ms;
+  int fd;
+
+  for (uint32_t i = 0; i < sizeof(log_data); i++)
+  {
+    log_data[i] = log_byte(i);
+  }
+
+  // A free port, then the server on it
+  fd = socket(AF_INET, SOCK_STREAM, 0);
+  if ((fd < 0) || (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) ||
+      (getsockname(fd, (struct sockaddr *)&addr, &addr_len) != 0))
+  {
+    perror("tcp port");
+    exit(1);
+  }
+  close(fd);
+  client.port = ntohs(addr.sin_port);
+
+  if ((esp8266_server_start(client.port) != ESP8266_OK) ||
+      (pthread_create(&thread, NULL, tcp_client_main, &client) != 0))
+  {
+    Error_Handler();
+  }
+
+  // Wait for its <link>,CONNECT
+  esp8266_urc_init(&reader, urc_buf, sizeof(urc_buf));
+  start = hal_stub_now_ns();
+  while ((link < 0) && (elapsed_ms(start) < 2000.0))
+  {
+    while (esp8266_urc_read(&reader, &urc) != 0)
+    {
+      if (urc.type == ESP8266_URC_LINE)
+      {
+        esp8266_server_handle_line(urc.line, urc.length);
+      }
+    }
+    links = esp8266_server_links(&link_count);
+    for (uint32_t i = 0; i < link_count; i++)
+    {
+      if (links[i].connected != 0)
+      {
+        link = (int32_t)i;
+      }
+    }
+    HAL_Delay(1);
+  }
+  if (link < 0)
+  {
+    Error_Handler();
+  }
+
+  // The outgoing connection next to the server, on its own link
+  if (datagrams != 0)
+  {
+    udp.port = udp_collector_start(&receiver, &udp_thread);
+    if (esp8266_establish_connection(&udp) != ESP8266_OK)
+    {
+      Error_Handler();
+    }
+    datagram_size = (datagram_size < sizeof(payload)) ? datagram_size : sizeof(payload);
+    memset(payload, 0x5A, datagram_size);
+  }
+
+  start = hal_stub_now_ns();
+  while (sent < bytes)
+  {
+    uint32_t offset = sent % sizeof(log_data);
+    uint32_t n = sizeof(log_data) - offset;
+
+    if (n > (bytes - sent))
+    {
+      n = bytes - sent;
+    }
+    if ((datagrams != 0) && (n > ESP8266_MAX_SEGMENT_SIZE))
+    {
+      n = ESP8266_MAX_SEGMENT_SIZE;
+    }
+    if ((n != 0) && (esp8266_server_send((uint8_t)link, &log_data[offset], n) != ESP8266_OK))
+    {
+      break;
+    }
+    sent += n;
+
+    // Spread over the log: the client times out after 2 s without data
+    while ((datagrams_sent + datagrams_failed) < (uint32_t)(((uint64_t)datagrams * sent + bytes - 1U) / bytes))
+    {
+      if (esp8266_send_datagram(payload, datagram_size, NULL, 0) == ESP8266_OK)
+      {
+        datagrams_sent++;
+      }
+      else
+      {
+        datagrams_failed++;
+      }
+    }
+  }
+  ms = elapsed_ms(start);
+
+  if (datagrams != 0)
+  {
+    if (esp8266_close_connection(ESP8266_CLIENT_LINK) != ESP8266_OK)
+    {
+      Error_Handler();
+    }
+    udp_collector_stop(&receiver, udp_thread);
+  }
+
+  // The node closes the link when done, the client reads up to there
+  if ((esp8266_close_connection((uint8_t)link) != ESP8266_OK) || (esp8266_server_stop() != ESP8266_OK))
+  {
+    Error_Handler();
+  }
+  pthread_join(thread, NULL);
+
+  if (datagrams != 0)
+  {
+    printf("datagrams          %10u (%u B, %u failed, %u received by the collector, server running)\n",
+           datagrams_sent, datagram_size, datagrams_failed, receiver.datagrams);
+    if ((datagrams_failed != 0) || (receiver.datagrams != datagrams_sent) ||
+        (sent != bytes) || (client.received != sent) || (client.mismatches != 0))
+    {
+      fprintf(stderr, "server and UDP: bytes or datagrams lost\n");
+      exit(1);
+    }
+  }
+
+  printf("server             %10u B sent on link %d (%u received by the client, %u wrong)\n",
+         sent, (int)link, client.received, client.mismatches);
+  printf("server throughput  %10.1f kB/s (%u segments of up to %u B, %.3f ms each)\n",
+         (ms > 0.0) ? ((double)sent / ms) : 0.0,
+         (sent + ESP8266_MAX_SEGMENT_SIZE - 1U) / ESP8266_MAX_SEGMENT_SIZE, ESP8266_MAX_SEGMENT_SIZE,
+         (sent != 0) ? (ms * ESP8266_MAX_SEGMENT_SIZE / sent) : 0.0);
+}
+
+static void* tcp_client_main(void* arg)
+{
+  tcp_client_t* client = (tcp_client_t *)arg;
+  struct sockaddr_in addr = { .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+  struct timeval timeout = { .tv_sec = 2, .tv_usec = 0 };
+  uint8_t chunk[4096];
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+
+  addr.sin_port = htons(client->port);
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  if ((fd < 0) || (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0))
+  {
+    perror("tcp client");
+    return NULL;
+  }
+
+  while (1)
+  {
+    ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+
+    if (n <= 0)
+    {
+      break;
+    }
+    for (ssize_t i = 0; i < n; i++)
+    {
+      // The log restarts every 64 KB
+      if (chunk[i] != log_byte((client->received + (uint32_t)i) % (64U * 1024U)))
+      {
+        client->mismatches++;
+      }
+    }
+    client->received += (uint32_t)n;
+  }
+  close(fd);
+  return NULL;
+}
+
+static uint8_t log_byte(uint32_t offset)
+{
+  return (uint8_t)((offset * 7U) ^ (offset >> 8));
+}
+
+/**
+  * @brief  GET /metrics every period_ms, each on a new connection, until
+  *         stopped; a response counts when its chunked body is complete.
+  */
+static void* scraper_main(void* arg)
+{
+  static const char request[] = "GET /metrics HTTP/1.1\r\nHost: esp\r\nAccept: text/plain\r\n\r\n";
+  static char response[16 * 1024];
+  scraper_t* scraper = (scraper_t *)arg;
+
+  while (scraper->running != 0)
+  {
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+    struct timeval timeout = { .tv_sec = 2, .tv_usec = 0 };
+    uint64_t start = hal_stub_now_ns();
+    uint32_t length = 0;
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+
+    addr.sin_port = htons(scraper->port);
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    if ((fd >= 0) && (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0) &&
+        (write(fd, request, sizeof(request) - 1U) == (ssize_t)(sizeof(request) - 1U)))
+    {
+      ssize_t n;
+
+      while ((n = recv(fd, &response[length], sizeof(response) - 1U - length, 0)) > 0)
+      {
+        length += (uint32_t)n;
+      }
+    }
+    if (fd >= 0)
+    {
+      close(fd);
+    }
+    response[length] = '\0';
+
+    if ((strncmp(response, "HTTP/1.1 200 OK\r\n", 17) == 0) && (strstr(response, "\nesp_publishes_total ") != NULL) &&
+        (length >= 5U) && (memcmp(&response[length - 5U], "0\r\n\r\n", 5) == 0))
+    {
+      scraper->ok++;
+      scraper->bytes += length;
+      if (elapsed_ms(start) > scraper->max_ms)
+      {
+        scraper->max_ms = elapsed_ms(start);
+      }
+    }
+    else
+    {
+      scraper->failed++;
+    }
+    usleep(scraper->period_ms * 1000U);
+  }
+  scraper->done = 1;
+  return NULL;
+}
+
+static uint16_t free_tcp_port(void)
+{
+  struct sockaddr_in addr = { .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+  socklen_t addr_len = sizeof(addr);
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+
+  if ((fd < 0) || (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) ||
+      (getsockname(fd, (struct sockaddr *)&addr, &addr_len) != 0))
+  {
+    perror("tcp port");
+    exit(1);
+  }
+  close(fd);
+  return ntohs(addr.sin_port);
+}
+
+static double elapsed_ms(uint64_t start_ns)
+{
+  return (double)(hal_stub_now_ns() - start_ns) / 1e6;
+}
@@ -0,0 +1,209 @@
+/*
+ * rtos_host_main.c
+ *
+ *  Host entry point of the FreeRTOS application (app_rtos.c) on the FreeRTOS
+ *  POSIX port: same bring-up as main.c against the ESP-AT simulator, then the
+ *  RX, TX and application tasks until a number of publishes, and a report of
+ *  the task stacks and latencies.
+ *
+ *  usage: esp_rtos [-n publishes] [-l latency_ms] [-u urc_period_ms]
+ *                  [-m message_bytes] [-b busy_every] [-x hang_every]
+ *
+ *  The UART "interrupt" is a highest priority task polling the wire every
+ *  tick (the POSIX port does not allow kernel calls from other threads), so
+ *  the RX wake-up latencies include up to 1 ms of polling delay.
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "main.h"
+#include "esp8266.h"
+#include "esp8266_io.h"
+#include "app_rtos.h"
+#include "metrics.h"
+#include "log_ring.h"
+#include "hal_stub.h"
+#include "at_sim.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+/* Private define ------------------------------------------------------------*/
+#define HOST_TASK_STACK         4096    /* words */
+
+/* Private variables ---------------------------------------------------------*/
+UART_HandleTypeDef huart4;
+UART_HandleTypeDef huart2;
+
+static StackType_t uart_isr_stack[HOST_TASK_STACK];
+static StackType_t supervisor_stack[HOST_TASK_STACK];
+static StaticTask_t uart_isr_tcb;
+static StaticTask_t supervisor_tcb;
+
+static uint32_t target_publishes;
+static uint64_t start_ns;
+
+/* Private function prototypes -----------------------------------------------*/
+static void bring_up(void);
+static void uart_isr_task(void* arg);
+static void supervisor_task(void* arg);
+
+/* Exported functions -------------------------------------------------------*/
+
+int main(int argc, char** argv)
+{
+  static at_sim_config_t sim;
+  uint32_t publishes = 20;
+  int wire[2];
+  int opt;
+
+  at_sim_default_config(&sim);
+
+  while ((opt = getopt(argc, argv, "n:l:u:m:b:x:")) != -1)
+  {
+    switch (opt)
+    {
+      case 'n': publishes = (uint32_t)strtoul(optarg, NULL, 0); break;
+      case 'l': sim.latency_ms = (uint32_t)strtoul(optarg, NULL, 0); break;
+      case 'u': sim.urc_period_ms = (uint32_t)strtoul(optarg, NULL, 0); break;
+      case 'm': sim.urc_message_size = (uint32_t)strtoul(optarg, NULL, 0); break;
+      case 'b': sim.busy_every = (uint32_t)strtoul(optarg, NULL, 0); break;
+      case 'x': sim.hang_every = (uint32_t)strtoul(optarg, NULL, 0); break;
+      default:
+        fprintf(stderr, "usage: %s [-n publishes] [-l latency_ms] [-u urc_period_ms] [-m message_bytes] [-b busy_every] [-x hang_every]\n", argv[0]);
+        return 2;
+    }
+  }
+
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, wire) != 0)
+  {
+    perror("socketpair");
+    return 1;
+  }
+
+  hal_stub_set_rx_polling(1);
+  hal_stub_attach_uart(&huart4, wire[0]);
+  hal_stub_attach_uart(&huart2, -1);
+  if (at_sim_start(&sim, wire[1]) != 0)
+  {
+    fprintf(stderr, "cannot start the AT simulator\n");
+    return 1;
+  }
+
+  wifi_uart_handle = &huart4;
+  metrics_init();
+  log_ring_init(&log_sink_itm);
+
+  bring_up();
+
+  target_publishes = metric_values[METRIC_PUBLISHES] + publishes;
+  start_ns = hal_stub_now_ns();
+
+  xTaskCreateStatic(uart_isr_task, "uart_isr", HOST_TASK_STACK, NULL, configMAX_PRIORITIES - 1,
+                    uart_isr_stack, &uart_isr_tcb);
+  xTaskCreateStatic(supervisor_task, "supervisor", HOST_TASK_STACK, NULL, tskIDLE_PRIORITY + 1,
+                    supervisor_stack, &supervisor_tcb);
+
+  /* Does not return */
+  app_rtos_start();
+  return 1;
+}
+
+/**
+  * @brief  Host replacement of the error trap of main.c.
+  */
+void Error_Handler(void)
+{
+  fprintf(stderr, "Error_Handler() reached\n");
+  exit(1);
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Same sequence as the USER CODE 2 section of main.c.
+  */
+static void bring_up(void)
+{
+  esp8266_time_t sntp_time;
+
+  if (esp8266_init() != ESP8266_OK)
+  {
+    Error_Handler();
+  }
+
+  while (esp8266_joint_ap((uint8_t *)WIFI_SSID, (uint8_t *)WIFI_PASSWORD) != ESP8266_OK);
+
+  if ((esp8266_config_sntp("pool.ntp.org") != ESP8266_OK) ||
+      (esp8266_get_sntp_time(&sntp_time) != ESP8266_OK) ||
+      (esp8266_mqtt_usercfg(MQTT_CLIENT_ID, "espressif", "1234567890") != ESP8266_OK) ||
+      (esp8266_mqtt_connect(MQTT_BROKER, MQTT_PORT, 1) != ESP8266_OK) ||
+      (esp8266_mqtt_subscribe("led/cmd", 1) != ESP8266_OK))
+  {
+    Error_Handler();
+  }
+}
+
+/**
+  * @brief  Stands in for the UART4 / DMA interrupts.
+  */
+static void uart_isr_task(void* arg)
+{
+  (void)arg;
+
+  for (;;)
+  {
+    hal_stub_poll_rx();
+    vTaskDelay(1);
+  }
+}
+
+/**
+  * @brief  Stops the run once the publishes are done and prints the report.
+  */
+static void supervisor_task(void* arg)
+{
+  app_rtos_stats_t stats;
+  app_rtos_task_info_t info[APP_RTOS_TASK_COUNT];
+  at_sim_stats_t sim_stats;
+  uint32_t n;
+
+  (void)arg;
+
+  while (metric_values[METRIC_PUBLISHES] < target_publishes)
+  {
+    vTaskDelay(pdMS_TO_TICKS(100));
+  }
+
+  vTaskSuspendAll();
+
+  app_rtos_get_stats(&stats);
+  n = app_rtos_get_task_info(info, APP_RTOS_TASK_COUNT);
+
+  printf("publish run        %10.3f ms\n", (double)(hal_stub_now_ns() - start_ns) / 1e6);
+  printf("commands           %10u (errors %u, timeouts %u, late answers %u, queue full %u)\n",
+         stats.commands, stats.command_errors, stats.command_timeouts, stats.late_answers, stats.queue_full);
+  printf("urcs               %10u (dropped %u, messages too long %u)\n", stats.urcs, stats.urc_drops, stats.message_drops);
+  printf("busy answers       %10u (%u ms waited before resending)\n", stats.busy, stats.busy_wait_ms);
+  printf("rx wake-ups        %10u (max latency %u us)\n", stats.rx_wakeups, stats.rx_wake_max_us);
+  printf("queue wait max     %10u ms\n", stats.queue_wait_max_ms);
+  printf("command max        %10u ms\n", stats.command_max_ms);
+  for (uint32_t i = 0; i < n; i++)
+  {
+    printf("stack %-12s %6u B, %6u B never used\n", info[i].name, info[i].stack_bytes, info[i].unused_bytes);
+  }
+  printf("led                %10s\n", (GPIOA->ODR & GPIO_PIN_5) ? "on" : "off");
+
+  at_sim_get_stats(&sim_stats);
+  printf("sim commands       %10u (errors %u, urcs %u, raw publishes %u, rx %u B, tx %u B)\n",
+         sim_stats.commands, sim_stats.errors, sim_stats.urcs, sim_stats.raw_publishes,
+         sim_stats.rx_bytes, sim_stats.tx_bytes);
+  fflush(stdout);
+
+  exit(0);
+}
@@ -0,0 +1,627 @@
+/*
+ * rtos_shim.c
+ *
+ *  Host stand-in for the FreeRTOS kernel, see rtos_shim/FreeRTOS.h. Every
+ *  task is a pthread waiting on its condition until it is the running one;
+ *  the kernel state is under one mutex, and a tick thread wakes the tasks
+ *  whose timeout expired, or dispatches when every task was blocked.
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: agent
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "FreeRTOS.h"
+#include "task.h"
+#include "queue.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Private define ------------------------------------------------------------*/
+#define SHIM_MAX_TASKS           16
+#define SHIM_STACK_FILL          ((StackType_t)0xA5A5A5A5A5A5A5A5ULL)
+
+#define NOTIFY_NONE              0
+#define NOTIFY_WAITING           1
+#define NOTIFY_PENDING           2
+
+/* Private variables ---------------------------------------------------------*/
+static pthread_mutex_t kernel = PTHREAD_MUTEX_INITIALIZER;
+static StaticTask_t* tasks[SHIM_MAX_TASKS];
+static uint32_t task_count;
+static StaticTask_t* current;           /* the running task, NULL when all are blocked */
+static uint8_t started;
+static uint8_t suspended;
+static uint8_t yield_pending;           /* a task of higher priority than current is ready */
+static struct timespec start_time;
+
+/* Private function prototypes -----------------------------------------------*/
+static TickType_t now_tick(void);
+static StaticTask_t* pick(void);
+static void switch_out(StaticTask_t* self);
+static uint8_t block_until(StaticTask_t* self, uint8_t forever, TickType_t wake_tick);
+static void unblock(StaticTask_t* task);
+static void yield_if_pending(StaticTask_t* self);
+static void wake_queue_waiter(const StaticQueue_t* queue, uint8_t send);
+static void* task_main(void* arg);
+static void* tick_main(void* arg);
+
+/* Exported functions -------------------------------------------------------*/
+
+TaskHandle_t xTaskCreateStatic(TaskFunction_t fn, const char* name, uint32_t stack_words, void* arg,
+                               UBaseType_t priority, StackType_t* stack, StaticTask_t* tcb)
+{
+  pthread_attr_t attr;
+
+  if (task_count == SHIM_MAX_TASKS)
+  {
+    return NULL;
+  }
+
+  memset(tcb, 0, sizeof(*tcb));
+  tcb->name = name;
+  tcb->fn = fn;
+  tcb->arg = arg;
+  tcb->priority = (priority < configMAX_PRIORITIES) ? priority : (configMAX_PRIORITIES - 1);
+  tcb->stack = stack;
+  tcb->stack_words = stack_words;
+  pthread_cond_init(&tcb->run, NULL);
+
+  /* Filled for uxTaskGetStackHighWaterMark(); the thread runs on it */
+  for (uint32_t i = 0; i < stack_words; i++)
+  {
+    stack[i] = SHIM_STACK_FILL;
+  }
+  pthread_attr_init(&attr);
+  if (pthread_attr_setstack(&attr, stack, stack_words * sizeof(StackType_t)) != 0)
+  {
+    pthread_attr_destroy(&attr);
+    return NULL;
+  }
+
+  pthread_mutex_lock(&kernel);
+  tasks[task_count++] = tcb;
+  if (pthread_create(&tcb->thread, &attr, task_main, tcb) != 0)
+  {
+    task_count--;
+    tcb = NULL;
+  }
+  else if ((started != 0) && (current != NULL) && (tcb->priority > current->priority))
+  {
+    yield_pending = 1;
+  }
+  pthread_mutex_unlock(&kernel);
+  pthread_attr_destroy(&attr);
+
+  if ((tcb != NULL) && (started != 0))
+  {
+    rtos_shim_yield();
+  }
+  return tcb;
+}
+
+/**
+  * @brief  Run the highest priority task; the calling thread only waits.
+  * @retval None, does not return.
+  */
+void vTaskStartScheduler(void)
+{
+  StaticTask_t* idle_tcb;
+  StackType_t* idle_stack;
+  uint32_t idle_words;
+  pthread_t tick;
+
+  /* The shim has no idle task: whenever all tasks block, nothing runs */
+  vApplicationGetIdleTaskMemory(&idle_tcb, &idle_stack, &idle_words);
+
+  clock_gettime(CLOCK_MONOTONIC, &start_time);
+  pthread_mutex_lock(&kernel);
+  started = 1;
+  current = pick();
+  if (current != NULL)
+  {
+    pthread_cond_signal(&current->run);
+  }
+  pthread_mutex_unlock(&kernel);
+
+  if (pthread_create(&tick, NULL, tick_main, NULL) != 0)
+  {
+    return;
+  }
+
+  for (;;)
+  {
+    pause();
+  }
+}
+
+/**
+  * @brief  No task switch until the end of the program (the shim has no
+  *         xTaskResumeAll()).
+  */
+void vTaskSuspendAll(void)
+{
+  pthread_mutex_lock(&kernel);
+  suspended = 1;
+  pthread_mutex_unlock(&kernel);
+}
+
+void vTaskEnterCritical(void)
+{
+  pthread_mutex_lock(&kernel);
+  if (current != NULL)
+  {
+    current->critical_nesting++;
+  }
+  pthread_mutex_unlock(&kernel);
+}
+
+void vTaskExitCritical(void)
+{
+  pthread_mutex_lock(&kernel);
+  if ((current != NULL) && (current->critical_nesting != 0))
+  {
+    current->critical_nesting--;
+  }
+  yield_if_pending(current);
+  pthread_mutex_unlock(&kernel);
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+  pthread_mutex_lock(&kernel);
+  if (ticks == 0)
+  {
+    yield_pending = 1;
+    yield_if_pending(current);
+  }
+  else
+  {
+    block_until(current, 0, now_tick() + ticks);
+  }
+  pthread_mutex_unlock(&kernel);
+}
+
+void vTaskDelayUntil(TickType_t* previous_wake, TickType_t increment)
+{
+  TickType_t wake = *previous_wake + increment;
+
+  pthread_mutex_lock(&kernel);
+  *previous_wake = wake;
+  if ((int32_t)(wake - now_tick()) > 0)
+  {
+    block_until(current, 0, wake);
+  }
+  pthread_mutex_unlock(&kernel);
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+  return now_tick();
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+  TaskHandle_t task;
+
+  pthread_mutex_lock(&kernel);
+  task = current;
+  pthread_mutex_unlock(&kernel);
+  return task;
+}
+
+/**
+  * @brief  Stack words never written since the task was created.
+  */
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task)
+{
+  UBaseType_t unused = 0;
+
+  while ((unused < task->stack_words) && (task->stack[unused] == SHIM_STACK_FILL))
+  {
+    unused++;
+  }
+  return unused;
+}
+
+BaseType_t xTaskNotify(TaskHandle_t task, uint32_t value, eNotifyAction action)
+{
+  BaseType_t ret = pdPASS;
+  uint8_t previous;
+
+  pthread_mutex_lock(&kernel);
+  previous = task->notify_state;
+  switch (action)
+  {
+    case eSetBits:               task->notify_value |= value; break;
+    case eIncrement:             task->notify_value++; break;
+    case eSetValueWithOverwrite: task->notify_value = value; break;
+    case eSetValueWithoutOverwrite:
+      if (previous == NOTIFY_PENDING)
+      {
+        ret = pdFAIL;
+      }
+      else
+      {
+        task->notify_value = value;
+      }
+      break;
+    default: break;
+  }
+  task->notify_state = NOTIFY_PENDING;
+  if (previous == NOTIFY_WAITING)
+  {
+    unblock(task);
+  }
+  yield_if_pending(current);
+  pthread_mutex_unlock(&kernel);
+
+  return ret;
+}
+
+BaseType_t xTaskNotifyWait(uint32_t clear_on_entry, uint32_t clear_on_exit, uint32_t* value, TickType_t ticks)
+{
+  StaticTask_t* self;
+  BaseType_t ret = pdFALSE;
+
+  pthread_mutex_lock(&kernel);
+  self = current;
+  if (self->notify_state != NOTIFY_PENDING)
+  {
+    self->notify_value &= ~clear_on_entry;
+    if (ticks != 0)
+    {
+      self->notify_state = NOTIFY_WAITING;
+      block_until(self, (ticks == portMAX_DELAY) ? 1U : 0U, now_tick() + ticks);
+    }
+  }
+  if (value != NULL)
+  {
+    *value = self->notify_value;
+  }
+  if (self->notify_state == NOTIFY_PENDING)
+  {
+    self->notify_value &= ~clear_on_exit;
+    ret = pdTRUE;
+  }
+  self->notify_state = NOTIFY_NONE;
+  yield_if_pending(self);
+  pthread_mutex_unlock(&kernel);
+
+  return ret;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks)
+{
+  StaticTask_t* self;
+  uint32_t value;
+
+  pthread_mutex_lock(&kernel);
+  self = current;
+  if ((self->notify_value == 0) && (ticks != 0))
+  {
+    self->notify_state = NOTIFY_WAITING;
+    block_until(self, (ticks == portMAX_DELAY) ? 1U : 0U, now_tick() + ticks);
+  }
+  value = self->notify_value;
+  if (value != 0)
+  {
+    self->notify_value = (clear_on_exit != pdFALSE) ? 0 : (value - 1U);
+  }
+  self->notify_state = NOTIFY_NONE;
+  yield_if_pending(self);
+  pthread_mutex_unlock(&kernel);
+
+  return value;
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t* higher_priority_woken)
+{
+  uint8_t previous;
+
+  pthread_mutex_lock(&kernel);
+  previous = task->notify_state;
+  task->notify_value++;
+  task->notify_state = NOTIFY_PENDING;
+  if (previous == NOTIFY_WAITING)
+  {
+    unblock(task);
+  }
+  if ((higher_priority_woken != NULL) && (current != NULL) && (task->priority > current->priority))
+  {
+    *higher_priority_woken = pdTRUE;
+  }
+  pthread_mutex_unlock(&kernel);
+}
+
+QueueHandle_t xQueueCreateStatic(UBaseType_t length, UBaseType_t item_size, uint8_t* storage, StaticQueue_t* queue)
+{
+  queue->storage = storage;
+  queue->length = length;
+  queue->item_size = item_size;
+  queue->count = 0;
+  queue->head = 0;
+  return queue;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void* item, TickType_t ticks)
+{
+  StaticTask_t* self;
+  TickType_t wake;
+  BaseType_t ret = pdFAIL;
+
+  pthread_mutex_lock(&kernel);
+  self = current;
+  wake = now_tick() + ticks;
+  while (queue->count == queue->length)
+  {
+    if ((ticks == 0) || ((ticks != portMAX_DELAY) && ((int32_t)(wake - now_tick()) <= 0)))
+    {
+      break;
+    }
+    self->wait_queue = queue;
+    self->wait_send = 1;
+    block_until(self, (ticks == portMAX_DELAY) ? 1U : 0U, wake);
+    self->wait_queue = NULL;
+  }
+  if (queue->count < queue->length)
+  {
+    memcpy(&queue->storage[((queue->head + queue->count) % queue->length) * queue->item_size], item, queue->item_size);
+    queue->count++;
+    wake_queue_waiter(queue, 0);
+    ret = pdPASS;
+  }
+  yield_if_pending(self);
+  pthread_mutex_unlock(&kernel);
+
+  return ret;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t ticks)
+{
+  StaticTask_t* self;
+  TickType_t wake;
+  BaseType_t ret = pdFAIL;
+
+  pthread_mutex_lock(&kernel);
+  self = current;
+  wake = now_tick() + ticks;
+  while (queue->count == 0)
+  {
+    if ((ticks == 0) || ((ticks != portMAX_DELAY) && ((int32_t)(wake - now_tick()) <= 0)))
+    {
+      break;
+    }
+    self->wait_queue = queue;
+    self->wait_send = 0;
+    block_until(self, (ticks == portMAX_DELAY) ? 1U : 0U, wake);
+    self->wait_queue = NULL;
+  }
+  if (queue->count != 0)
+  {
+    memcpy(item, &queue->storage[queue->head * queue->item_size], queue->item_size);
+    queue->head = (queue->head + 1U) % queue->length;
+    queue->count--;
+    wake_queue_waiter(queue, 1);
+    ret = pdPASS;
+  }
+  yield_if_pending(self);
+  pthread_mutex_unlock(&kernel);
+
+  return ret;
+}
+
+/**
+  * @brief  Let a higher priority task that became ready run first.
+  */
+void rtos_shim_yield(void)
+{
+  pthread_mutex_lock(&kernel);
+  yield_if_pending(current);
+  pthread_mutex_unlock(&kernel);
+}
+
+/* Private functions ---------------------------------------------------------*/
+
+static TickType_t now_tick(void)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (TickType_t)(((int64_t)(now.tv_sec - start_time.tv_sec) * 1000) +
+                      ((now.tv_nsec - start_time.tv_nsec) / 1000000L));
+}
+
+/**
+  * @brief  The highest priority ready task; after current among equals, for
+  *         the time slicing of configUSE_TIME_SLICING.
+  */
+static StaticTask_t* pick(void)
+{
+  StaticTask_t* best = NULL;
+  uint32_t first = 0;
+
+  for (uint32_t i = 0; i < task_count; i++)
+  {
+    if (tasks[i] == current)
+    {
+      first = i + 1U;
+    }
+  }
+
+  for (uint32_t n = 0; n < task_count; n++)
+  {
+    StaticTask_t* task = tasks[(first + n) % task_count];
+
+    if ((task->blocked == 0) && ((best == NULL) || (task->priority > best->priority)))
+    {
+      best = task;
+    }
+  }
+
+  return best;
+}
+
+/**
+  * @brief  Hand the processor to the next task and wait to get it back.
+  *         Kernel mutex held.
+  */
+static void switch_out(StaticTask_t* self)
+{
+  if (self->stack[0] != SHIM_STACK_FILL)
+  {
+    vApplicationStackOverflowHook(self, (char*)self->name);
+  }
+
+  yield_pending = 0;
+  current = pick();
+  if (current == self)
+  {
+    return;
+  }
+  if (current != NULL)
+  {
+    pthread_cond_signal(&current->run);
+  }
+  while (current != self)
+  {
+    pthread_cond_wait(&self->run, &kernel);
+  }
+}
+
+/**
+  * @brief  Block the running task until unblock() or wake_tick.
+  * @retval 1 if woken by unblock(), 0 on the timeout.
+  */
+static uint8_t block_until(StaticTask_t* self, uint8_t forever, TickType_t wake_tick)
+{
+  self->blocked = 1;
+  self->woken = 0;
+  self->forever = forever;
+  self->wake_tick = wake_tick;
+  switch_out(self);
+  return self->woken;
+}
+
+static void unblock(StaticTask_t* task)
+{
+  if (task->blocked == 0)
+  {
+    return;
+  }
+
+  task->blocked = 0;
+  task->woken = 1;
+  if (current == NULL)
+  {
+    if ((started != 0) && (suspended == 0))
+    {
+      current = task;
+      pthread_cond_signal(&task->run);
+    }
+  }
+  else if (task->priority > current->priority)
+  {
+    yield_pending = 1;
+  }
+}
+
+static void yield_if_pending(StaticTask_t* self)
+{
+  if ((self != NULL) && (self == current) && (yield_pending != 0) &&
+      (self->critical_nesting == 0) && (suspended == 0))
+  {
+    switch_out(self);
+  }
+}
+
+/**
+  * @brief  Unblock the highest priority task waiting to send to (send = 1)
+  *         or to receive from the queue.
+  */
+static void wake_queue_waiter(const StaticQueue_t* queue, uint8_t send)
+{
+  StaticTask_t* best = NULL;
+
+  for (uint32_t i = 0; i < task_count; i++)
+  {
+    StaticTask_t* task = tasks[i];
+
+    if ((task->blocked != 0) && (task->wait_queue == queue) && (task->wait_send == send) &&
+        ((best == NULL) || (task->priority > best->priority)))
+    {
+      best = task;
+    }
+  }
+
+  if (best != NULL)
+  {
+    unblock(best);
+  }
+}
+
+static void* task_main(void* arg)
+{
+  StaticTask_t* self = (StaticTask_t*)arg;
+
+  pthread_mutex_lock(&kernel);
+  while (current != self)
+  {
+    pthread_cond_wait(&self->run, &kernel);
+  }
+  pthread_mutex_unlock(&kernel);
+
+  self->fn(self->arg);
+
+  fprintf(stderr, "task %s returned\n", self->name);
+  exit(1);
+  return NULL;
+}
+
+/**
+  * @brief  Every tick: the expired timeouts, then a switch if a higher
+  *         priority task is ready and the running one is blocked.
+  */
+static void* tick_main(void* arg)
+{
+  const struct timespec period = { 0, 1000000L };
+
+  (void)arg;
+
+  for (;;)
+  {
+    TickType_t now;
+
+    nanosleep(&period, NULL);
+
+    pthread_mutex_lock(&kernel);
+    now = now_tick();
+    for (uint32_t i = 0; i < task_count; i++)
+    {
+      StaticTask_t* task = tasks[i];
+
+      if ((task->blocked != 0) && (task->forever == 0) && ((int32_t)(now - task->wake_tick) >= 0))
+      {
+        task->blocked = 0;
+        if ((current != NULL) && (task->priority > current->priority))
+        {
+          yield_pending = 1;
+        }
+      }
+    }
+    if ((current == NULL) && (suspended == 0))
+    {
+      current = pick();
+      if (current != NULL)
+      {
+        pthread_cond_signal(&current->run);
+      }
+    }
+    pthread_mutex_unlock(&kernel);
+  }
+
+  return NULL;
+}
@@ -0,0 +1,85 @@
+/**
+ * @file logging_binary.h
+ * @brief Binary deferred backend for the logging stack.
+ *
+ * When LOGGING_BACKEND_BINARY is defined, every LogError/LogWarn/LogInfo/
+ * LogDebug call site is turned at compile time into:
+ *  - a format string (with level, library name, file and line already
+ *    concatenated) placed in the non-loaded ".logstr" ELF section, whose
+ *    address is used as the message ID;
+ *  - an array of 32-bit argument words.
+ * No formatting happens on the MCU. The frame written to the log stream is
+ *
+ *     0xA5 | nargs | id (u32 LE) | arg[0..nargs-1] (u32 LE)
+ *
+ * and Tools/logbin_decode.py rebuilds the text from the captured stream and
+ * the ELF. Bytes outside frames (plain printf output) are passed through.
+ *
+ * Limitations: at most LOGBIN_MAX_ARGS arguments per message, every argument
+ * is sent as one 32-bit word (no %f, no 64-bit integers), and %s is only
+ * resolved for strings located in flash.
+ */
+
+#ifndef LOGGING_BINARY_H_
+#define LOGGING_BINARY_H_
+
+#include <stdint.h>
+
+#define LOGBIN_SYNC        0xA5U
+#define LOGBIN_MAX_ARGS    8
+
+#define LOGBIN_STR_( x )    # x
+#define LOGBIN_STR( x )     LOGBIN_STR_( x )
+#define LOGBIN_CAT_( a, b ) a ## b
+#define LOGBIN_CAT( a, b )  LOGBIN_CAT_( a, b )
+
+/* Number of variadic arguments, 0 to 8 (relies on the GNU ", ##" extension). */
+#define LOGBIN_NARGS( ... ) \
+    LOGBIN_NARGS_( 0, ## __VA_ARGS__, 8, 7, 6, 5, 4, 3, 2, 1, 0 )
+#define LOGBIN_NARGS_( _0, _1, _2, _3, _4, _5, _6, _7, _8, N, ... )    N
+
+#define LOGBIN_W( x )    ( ( uint32_t ) ( uintptr_t ) ( x ) )
+
+#define LOGBIN_WORDS_0()
+#define LOGBIN_WORDS_1( a )                         , LOGBIN_W( a )
+#define LOGBIN_WORDS_2( a, b )                      LOGBIN_WORDS_1( a ) LOGBIN_WORDS_1( b )
+#define LOGBIN_WORDS_3( a, b, c )                   LOGBIN_WORDS_2( a, b ) LOGBIN_WORDS_1( c )
+#define LOGBIN_WORDS_4( a, b, c, d )                LOGBIN_WORDS_3( a, b, c ) LOGBIN_WORDS_1( d )
+#define LOGBIN_WORDS_5( a, b, c, d, e )             LOGBIN_WORDS_4( a, b, c, d ) LOGBIN_WORDS_1( e )
+#define LOGBIN_WORDS_6( a, b, c, d, e, f )          LOGBIN_WORDS_5( a, b, c, d, e ) LOGBIN_WORDS_1( f )
+#define LOGBIN_WORDS_7( a, b, c, d, e, f, g )       LOGBIN_WORDS_6( a, b, c, d, e, f ) LOGBIN_WORDS_1( g )
+#define LOGBIN_WORDS_8( a, b, c, d, e, f, g, h )    LOGBIN_WORDS_7( a, b, c, d, e, f, g ) LOGBIN_WORDS_1( h )
+
+#define LOGBIN_UNWRAP( ... )    __VA_ARGS__
+
+/**
+ * @brief Emit one binary log record.
+ *
+ * @p message is the parenthesized printf-style argument list given to the
+ * LogXxx() macros, e.g. ( "rc=%d", rc ).
+ */
+#define LOGBIN_RECORD( level, message ) \
+    do { LOGBIN_RECORD_EXPAND( level, LOGBIN_UNWRAP message ) } while( 0 )
+
+#define LOGBIN_RECORD_EXPAND( level, ... )    LOGBIN_RECORD_( level, __VA_ARGS__ )
+
+#define LOGBIN_RECORD_( level, fmt, ... )                                          \
+    static const char logbin_fmt_[] __attribute__( ( section( ".logstr" ), used ) ) = \
+        "[" level "] [" LIBRARY_LOG_NAME "] [" __FILE__ ":" LOGBIN_STR( __LINE__ ) "] " fmt; \
+    const uint32_t logbin_args_[] =                                                 \
+    {                                                                               \
+        LOGBIN_NARGS( __VA_ARGS__ )                                                 \
+        LOGBIN_CAT( LOGBIN_WORDS_, LOGBIN_NARGS( __VA_ARGS__ ) )( __VA_ARGS__ )     \
+    };                                                                              \
+    logbin_write( ( uint32_t ) ( uintptr_t ) logbin_fmt_, logbin_args_ );
+
+/**
+ * @brief Write one frame to the log stream.
+ *
+ * @param[in] id Message ID (address of the format string in ".logstr").
+ * @param[in] args args[0] is the argument count, followed by the arguments.
+ */
+void logbin_write( uint32_t id,
+                   const uint32_t * args );
+
+#endif /* ifndef LOGGING_BINARY_H_ */
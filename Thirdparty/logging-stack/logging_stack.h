@@ -84,6 +84,20 @@
     #define SdkLog( string )
 #endif
 
+/**
+ * @brief Emit one log message at the given level.
+ *
+ * With LOGGING_BACKEND_BINARY defined the message is not formatted on the
+ * target: see logging_binary.h. Otherwise it is printed through #SdkLog with
+ * the metadata prefix.
+ */
+#if defined( LOGGING_BACKEND_BINARY ) && !defined( DISABLE_LOGGING )
+    #include "logging_binary.h"
+    #define LogEntry( level, message )    LOGBIN_RECORD( level, message )
+#else
+    #define LogEntry( level, message )    SdkLog( ( "[" level "] " LOG_METADATA_FORMAT, LOG_METADATA_ARGS ) ); SdkLog( message ); SdkLog( ( "\r\n" ) )
+#endif
+
 /**
  * Disable definition of logging interface macros when generating doxygen output,
  * to avoid conflict with documentation of macros at the end of the file.
@@ -101,28 +115,28 @@
 #else
     #if LIBRARY_LOG_LEVEL == LOG_DEBUG
         /* All log level messages will logged. */
-        #define LogError( message )    SdkLog( ( "[ERROR] " LOG_METADATA_FORMAT, LOG_METADATA_ARGS ) ); SdkLog( message ); SdkLog( ( "\r\n" ) )
-        #define LogWarn( message )     SdkLog( ( "[WARN] " LOG_METADATA_FORMAT, LOG_METADATA_ARGS ) ); SdkLog( message ); SdkLog( ( "\r\n" ) )
-        #define LogInfo( message )     SdkLog( ( "[INFO] " LOG_METADATA_FORMAT, LOG_METADATA_ARGS ) ); SdkLog( message ); SdkLog( ( "\r\n" ) )
-        #define LogDebug( message )    SdkLog( ( "[DEBUG] " LOG_METADATA_FORMAT, LOG_METADATA_ARGS ) ); SdkLog( message ); SdkLog( ( "\r\n" ) )
+        #define LogError( message )    LogEntry( "ERROR", message )
+        #define LogWarn( message )     LogEntry( "WARN", message )
+        #define LogInfo( message )     LogEntry( "INFO", message )
+        #define LogDebug( message )    LogEntry( "DEBUG", message )
 
     #elif LIBRARY_LOG_LEVEL == LOG_INFO
         /* Only INFO, WARNING and ERROR messages will be logged. */
-        #define LogError( message )    SdkLog( ( "[ERROR] " LOG_METADATA_FORMAT, LOG_METADATA_ARGS ) ); SdkLog( message ); SdkLog( ( "\r\n" ) )
-        #define LogWarn( message )     SdkLog( ( "[WARN] " LOG_METADATA_FORMAT, LOG_METADATA_ARGS ) ); SdkLog( message ); SdkLog( ( "\r\n" ) )
-        #define LogInfo( message )     SdkLog( ( "[INFO] " LOG_METADATA_FORMAT, LOG_METADATA_ARGS ) ); SdkLog( message ); SdkLog( ( "\r\n" ) )
+        #define LogError( message )    LogEntry( "ERROR", message )
+        #define LogWarn( message )     LogEntry( "WARN", message )
+        #define LogInfo( message )     LogEntry( "INFO", message )
         #define LogDebug( message )
 
     #elif LIBRARY_LOG_LEVEL == LOG_WARN
         /* Only WARNING and ERROR messages will be logged.*/
-        #define LogError( message )    SdkLog( ( "[ERROR] " LOG_METADATA_FORMAT, LOG_METADATA_ARGS ) ); SdkLog( message ); SdkLog( ( "\r\n" ) )
-        #define LogWarn( message )     SdkLog( ( "[WARN] " LOG_METADATA_FORMAT, LOG_METADATA_ARGS ) ); SdkLog( message ); SdkLog( ( "\r\n" ) )
+        #define LogError( message )    LogEntry( "ERROR", message )
+        #define LogWarn( message )     LogEntry( "WARN", message )
         #define LogInfo( message )
         #define LogDebug( message )
 
     #elif LIBRARY_LOG_LEVEL == LOG_ERROR
         /* Only ERROR messages will be logged. */
-        #define LogError( message )    SdkLog( ( "[ERROR] " LOG_METADATA_FORMAT, LOG_METADATA_ARGS ) ); SdkLog( message ); SdkLog( ( "\r\n" ) )
+        #define LogError( message )    LogEntry( "ERROR", message )
         #define LogWarn( message )
         #define LogInfo( message )
         #define LogDebug( message )
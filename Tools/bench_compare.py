@@ -0,0 +1,125 @@
+#!/usr/bin/env python3
+"""
+Compare esp_bench result files (Host/build/bench.json) with a baseline and
+fail when a case got slower, or uses more stack or ring buffer, than the
+baseline by more than the threshold.
+
+The timings of a shared host vary by up to 60% from one run to the next, the
+stack and ring figures not at all. Several runs are compared at once: a case
+is slower when the median of its runs exceeds the slowest run recorded in the
+baseline by more than the threshold, so the tolerance of each case is its own
+spread plus the threshold.
+
+usage: bench_compare.py [--threshold PCT] baseline.json results.json [...]
+       bench_compare.py --merge out.json results.json [...]
+
+--merge writes the median of the runs (ns_per_op_max: the slowest of them),
+the format of bench/baseline.json.
+
+Exit status: 0 no regression, 1 regression or failed case, 2 bad input.
+"""
+
+import argparse
+import json
+import statistics
+import sys
+
+
+def load(path):
+    with open(path) as f:
+        data = json.load(f)
+    if data.get("schema") != 1:
+        raise ValueError("%s: unsupported schema %r" % (path, data.get("schema")))
+    return {(c["name"], c["variant"], c["size"]): c for c in data["cases"]}
+
+
+def merge(runs):
+    """One result per case: the median timing of the runs, their slowest
+    timing and their largest stack and ring figures."""
+    merged = {}
+    for key in runs[0]:
+        cases = [run[key] for run in runs if key in run]
+        case = dict(cases[0])
+        times = [c["ns_per_op"] for c in cases]
+        case["ns_per_op"] = round(statistics.median(times), 1)
+        case["ns_per_op_max"] = round(max(times), 1)
+        case["ns_per_byte"] = round(case["ns_per_op"] / case["bytes"], 3) if case["bytes"] else 0.0
+        case["runs"] = len(cases)
+        for field in ("stack_bytes", "ring_hwm"):
+            case[field] = max(c[field] for c in cases)
+        case["failed"] = any(c["failed"] for c in cases)
+        merged[key] = case
+    return merged
+
+
+def write(path, cases):
+    with open(path, "w") as f:
+        f.write('{\n  "schema": 1,\n  "cases": [\n')
+        f.write(",\n".join("    " + json.dumps(c) for c in cases.values()))
+        f.write("\n  ]\n}\n")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    parser.add_argument("--threshold", type=float, default=25.0,
+                        help="allowed increase in percent (default 25)")
+    parser.add_argument("--merge", metavar="OUT",
+                        help="write the merged runs to OUT instead of comparing")
+    parser.add_argument("files", nargs="+", metavar="baseline.json results.json")
+    args = parser.parse_args()
+
+    if (args.merge is None) and (len(args.files) < 2):
+        parser.error("a baseline and at least one result file are needed")
+
+    try:
+        if args.merge is not None:
+            write(args.merge, merge([load(path) for path in args.files]))
+            return 0
+        baseline = load(args.files[0])
+        results = merge([load(path) for path in args.files[1:]])
+    except (OSError, ValueError, KeyError) as e:
+        print("error: %s" % e, file=sys.stderr)
+        return 2
+
+    limit = 1.0 + args.threshold / 100.0
+    regressions = 0
+
+    print("%-16s %-7s %6s %12s %12s %8s  %s" % ("case", "variant", "size", "base ns/op", "ns/op", "delta", ""))
+    for key in sorted(results):
+        new = results[key]
+        old = baseline.get(key)
+        notes = []
+
+        if new.get("failed"):
+            notes.append("FAILED")
+        if old is None:
+            notes.append("new case")
+            delta = ""
+        else:
+            ratio = new["ns_per_op"] / old["ns_per_op"] if old["ns_per_op"] else 1.0
+            delta = "%+.1f%%" % ((ratio - 1.0) * 100.0)
+            if new["ns_per_op"] > old.get("ns_per_op_max", old["ns_per_op"]) * limit:
+                notes.append("SLOWER")
+            for field in ("stack_bytes", "ring_hwm"):
+                if old.get(field) and new[field] > old[field] * limit:
+                    notes.append("%s %d -> %d" % (field, old[field], new[field]))
+
+        if any(n != "new case" for n in notes):
+            regressions += 1
+        print("%-16s %-7s %6d %12s %12.1f %8s  %s" % (
+            key[0], key[1], key[2],
+            "%.1f" % old["ns_per_op"] if old else "-",
+            new["ns_per_op"], delta, ", ".join(notes)))
+
+    for key in sorted(set(baseline) - set(results)):
+        print("%-16s %-7s %6d missing from the results" % key)
+
+    if regressions:
+        print("%d regression(s) above %.0f%%" % (regressions, args.threshold))
+        return 1
+    print("no regression above %.0f%%" % args.threshold)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,162 @@
+#!/usr/bin/env python3
+"""
+logbin_decode.py
+
+Rebuild the text of the binary logging backend (logging_binary.h) from a
+captured log stream (SWO/ITM or USART2) and the firmware ELF.
+
+    logbin_decode.py Debug/001_MQTT_Subscribe_Publish_AT.elf capture.bin
+    cat /dev/ttyACM0 | logbin_decode.py Debug/001_MQTT_Subscribe_Publish_AT.elf -
+
+Frame layout: 0xA5 | nargs | id (u32 LE) | nargs x u32 LE.
+The id is the address of the format string in the ".logstr" section. Bytes
+outside frames are plain printf output and are copied through unchanged.
+"""
+
+import argparse
+import os
+import re
+import struct
+import sys
+
+LOGBIN_SYNC = 0xA5
+LOGBIN_MAX_ARGS = 8
+SHT_NOBITS = 8
+SHF_ALLOC = 0x2
+
+FORMAT_RE = re.compile(r"%([-+ #0]*)(\*|\d+)?(?:\.(\*|\d+))?(hh|h|ll|l|j|z|t|L)?([diouxXcspfFeEgG%])")
+
+
+class Elf:
+    """Minimal ELF reader: section contents by name and by address."""
+
+    def __init__(self, path):
+        with open(path, "rb") as f:
+            self.data = f.read()
+        if self.data[:4] != b"\x7fELF":
+            raise ValueError("%s is not an ELF file" % path)
+        is64 = self.data[4] == 2
+        endian = "<" if self.data[5] == 1 else ">"
+        if is64:
+            shoff, = struct.unpack_from(endian + "Q", self.data, 0x28)
+            shentsize, shnum, shstrndx = struct.unpack_from(endian + "HHH", self.data, 0x3A)
+            fmt = endian + "IIQQQQIIQQ"
+        else:
+            shoff, = struct.unpack_from(endian + "I", self.data, 0x20)
+            shentsize, shnum, shstrndx = struct.unpack_from(endian + "HHH", self.data, 0x2E)
+            fmt = endian + "IIIIIIIIII"
+        raw = [struct.unpack_from(fmt, self.data, shoff + i * shentsize) for i in range(shnum)]
+        strtab = raw[shstrndx]
+        self.sections = []
+        for name, stype, flags, addr, offset, size, *_ in raw:
+            start = strtab[4] + name
+            sname = self.data[start:self.data.index(b"\0", start)].decode()
+            self.sections.append((sname, stype, flags, addr, offset, size))
+
+    def section(self, name):
+        for sname, stype, _, addr, offset, size in self.sections:
+            if sname == name and stype != SHT_NOBITS:
+                return addr, self.data[offset:offset + size]
+        return None
+
+    def string_at(self, addr):
+        """C string at a target address in a loaded (flash) section, or None."""
+        for _, stype, flags, saddr, offset, size in self.sections:
+            if (flags & SHF_ALLOC) and stype != SHT_NOBITS and saddr <= addr < saddr + size:
+                start = offset + (addr - saddr)
+                end = self.data.index(b"\0", start)
+                return self.data[start:end].decode(errors="replace")
+        return None
+
+
+def c_string(blob, offset):
+    end = blob.index(b"\0", offset)
+    return blob[offset:end].decode(errors="replace")
+
+
+def render(elf, fmt, args):
+    """Apply a printf format to 32-bit argument words."""
+    args = list(args)
+
+    def convert(match):
+        flags, width, prec, _, conv = match.groups()
+        if conv == "%":
+            return "%"
+        if width == "*":
+            width = str(args.pop(0)) if args else ""
+        if prec == "*":
+            prec = str(args.pop(0)) if args else ""
+        spec = "%" + flags + (width or "") + ("." + prec if prec else "")
+        if not args:
+            return "<missing>"
+        word = args.pop(0)
+        if conv in "di":
+            value = word - (1 << 32) if word & 0x80000000 else word
+            return (spec + "d") % value
+        if conv in "ouxX":
+            return (spec + conv) % word
+        if conv == "c":
+            return (spec + "c") % chr(word & 0xFF)
+        if conv == "p":
+            return "0x%08x" % word
+        if conv == "s":
+            text = elf.string_at(word)
+            return (spec + "s") % (text if text is not None else "<ram 0x%08x>" % word)
+        return "<float 0x%08x>" % word
+
+    return FORMAT_RE.sub(convert, fmt)
+
+
+def decode(elf, logstr, stream, out):
+    base, blob = logstr
+    i = 0
+    text = bytearray()
+    while i < len(stream):
+        if stream[i] != LOGBIN_SYNC or i + 6 > len(stream) or stream[i + 1] > LOGBIN_MAX_ARGS:
+            text.append(stream[i])
+            i += 1
+            continue
+        nargs = stream[i + 1]
+        end = i + 6 + 4 * nargs
+        if end > len(stream):
+            break
+        msg_id, = struct.unpack_from("<I", stream, i + 2)
+        if not base <= msg_id < base + len(blob):
+            text.append(stream[i])
+            i += 1
+            continue
+        if text:
+            out.write(text.decode(errors="replace"))
+            text.clear()
+        args = struct.unpack_from("<%dI" % nargs, stream, i + 6)
+        fmt = c_string(blob, msg_id - base)
+        # Keep the file name only, like the FILENAME macro of logging_stack.h
+        fmt = re.sub(r"\[[^\]]*/([^/\]]+:\d+)\]", r"[\1]", fmt, count=1)
+        out.write(render(elf, fmt, args) + "\n")
+        i = end
+    if text:
+        out.write(text.decode(errors="replace"))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("elf", help="firmware ELF, e.g. Debug/001_MQTT_Subscribe_Publish_AT.elf")
+    parser.add_argument("capture", help="captured log stream, '-' for stdin")
+    opts = parser.parse_args()
+
+    elf = Elf(opts.elf)
+    logstr = elf.section(".logstr")
+    if logstr is None:
+        sys.exit("%s has no .logstr section: was it built with LOGGING_BACKEND_BINARY?" % opts.elf)
+
+    if opts.capture == "-":
+        stream = sys.stdin.buffer.read()
+    else:
+        with open(opts.capture, "rb") as f:
+            stream = f.read()
+
+    decode(elf, logstr, stream, sys.stdout)
+
+
+if __name__ == "__main__":
+    main()